@@ -101,6 +101,22 @@ struct Editor : public kobra::BaseApp {
 
         std::shared_ptr <EditorViewport> m_editor_renderer;
 
+        // Assets being imported in the background, each filled into one
+        // entity as its submeshes arrive (see handle_imports)
+        struct Import {
+                std::filesystem::path path;
+                std::shared_ptr <kobra::MeshImport> handle;
+
+                // The entity (-1 until the first batch), the import index of
+                // each of its submeshes, in order, and the submeshes that
+                // arrived since
+                int32_t entity = -1;
+                std::vector <size_t> shown;
+                std::vector <std::pair <size_t, kobra::Submesh>> pending;
+        };
+
+        std::vector <Import> m_imports;
+
 	Editor(const vk::raii::PhysicalDevice &, const std::vector <const char *> &);
 	~Editor();
 
@@ -276,27 +292,9 @@ void import_asset(Editor *editor)
 	nfdresult_t result = NFD_OpenDialog(&path, nullptr, 0, nullptr);
 
 	if (result == NFD_OKAY) {
-                KOBRA_LOG_FUNC(Log::WARN) << "Needs to be implemented" << std::endl;
-                // // Extract name of the entity from the file name
-                // TODO: check for duplicates
+                // Imported in the background; see handle_imports
                 std::filesystem::path asset_path = path;
-                auto [mesh, materials] = *kobra::Mesh::load(asset_path.string());
-
-                auto system = editor->m_scene.system;
-                auto entity = system->make_entity(asset_path.stem());
-                entity.add <kobra::Mesh> (mesh);
-                entity.add <kobra::Renderable> (editor->get_context(), &entity.get <kobra::Mesh> ());
-
-                kobra::Mesh &mesh_ref = entity.get <kobra::Mesh> ();
-                for (int i = 0; i < materials.size(); i++) {
-                        auto &mat = materials[i];
-                        if (mat.name.empty())
-                                mat.name = entity.name + "_material_" + std::to_string(i);
-
-                        std::cout << "Adding material: " << mat.name << std::endl;
-                        int32_t index = load(system->material_daemon, mat);
-                        mesh_ref.submeshes[i].material_index = index;
-                }
+                editor->m_imports.push_back({ asset_path, kobra::MeshImport::start(asset_path.string()) });
 	} else if (result == NFD_CANCEL) {
 		std::cout << "User cancelled" << std::endl;
 	} else {
@@ -881,7 +879,13 @@ Editor::Editor(const vk::raii::PhysicalDevice &phdev,
 	// Load scene
  	m_project.load_project(g_application.project);
 
+        // Imported meshes are cached with the project, unless it is packed
+        if (!m_project.archive)
+                kobra::Mesh::cache_directory = std::filesystem::path(m_project.directory) / ".cache" / "meshes";
+
 	// m_scene.load(get_context(), project.scene);
+        m_project.residency_budget = g_application.residency_budget;
+        m_project.scene_bvh = g_application.scene_bvh;
 	m_scene = m_project.load_scene(get_context());
 	assert(m_scene.system);
 
@@ -1050,6 +1054,9 @@ void Editor::record(const vk::raii::CommandBuffer &cmd,
 
 	params.environment_map = environment_map_path;
 
+	// Coarser submesh LODs, up to a pixel of error
+	params.lod_threshold = 1.0f;
+
 	cmd.begin({});
                 // Editor renderer
                 RenderInfo render_info { cmd };
@@ -1211,6 +1218,11 @@ void handle_viewport_input(Editor *editor, const InputRequest &request)
                                 editor->m_highlighted_entities.clear();
                         } else {
                                 auto selection = indices[0];
+
+                                // Selected entities need their geometry
+                                if (editor->m_scene.residency)
+                                        kobra::request(editor->m_scene.residency.get(), editor->get_context(), selection.first);
+
                                 kobra::Renderable &renderable = editor->m_scene.system->get <kobra::Renderable> (selection.first);
                                 editor->m_ui_attachments.viewport->set_transform(editor->m_scene.system->get_entity(selection.first));
                                 uint32_t material_index = renderable.material_indices[selection.second];
@@ -1294,6 +1306,108 @@ void handle_material_preview_input(Editor *editor, const InputRequest &request)
 	}
 }
 
+// Add imported submeshes to the scene as they arrive, so that large assets
+// show up piece by piece instead of after the whole file is converted.
+// Submeshes are kept in import order, whatever order they finish in, and
+// shown in batches: the first right away, then each at least as large as
+// what is shown already, and the rest once the import is done. Every batch
+// rebuilds the renderable of the entity, so this uploads each submesh about
+// twice in all, and frames in flight wait on only a few of them
+void handle_imports(Editor *editor)
+{
+        auto system = editor->m_scene.system;
+        auto context = editor->get_context();
+
+        auto &imports = editor->m_imports;
+        for (auto it = imports.begin(); it != imports.end(); ) {
+                Editor::Import &import = *it;
+
+                // Checked first, so that nothing published before the
+                // import finished is left behind
+                bool done = import.handle->done();
+
+                for (auto &[index, submesh, mat] : import.handle->take()) {
+                        // Extract name of the entity from the file name
+                        // TODO: check for duplicates
+                        if (mat.name.empty())
+                                mat.name = import.path.stem().string() + "_material_" + std::to_string(index);
+
+                        std::cout << "Adding material: " << mat.name << std::endl;
+                        submesh.material_index = load(system->material_daemon, mat);
+                        import.pending.push_back({ index, std::move(submesh) });
+                }
+
+                bool batch = !import.pending.empty()
+                        && (done || import.pending.size() >= import.shown.size());
+
+                if (batch) {
+                        std::sort(import.pending.begin(), import.pending.end(),
+                                [](const auto &a, const auto &b) {
+                                        return a.first < b.first;
+                                }
+                        );
+
+                        // Merge with the submeshes shown already
+                        kobra::Mesh *mesh = nullptr;
+                        if (import.entity >= 0)
+                                mesh = &system->get <kobra::Mesh> (import.entity);
+
+                        std::vector <kobra::Submesh> submeshes;
+                        std::vector <size_t> shown;
+
+                        size_t i = 0;
+                        size_t j = 0;
+                        while (i < import.shown.size() || j < import.pending.size()) {
+                                if (j == import.pending.size()
+                                                || (i < import.shown.size() && import.shown[i] < import.pending[j].first)) {
+                                        shown.push_back(import.shown[i]);
+                                        submeshes.push_back(std::move(mesh->submeshes[i++]));
+                                } else {
+                                        shown.push_back(import.pending[j].first);
+                                        submeshes.push_back(std::move(import.pending[j++].second));
+                                }
+                        }
+
+                        import.shown = std::move(shown);
+                        import.pending.clear();
+
+                        if (!mesh) {
+                                auto &e = system->make_entity(import.path.stem());
+                                e.add <kobra::Mesh> (kobra::Mesh { submeshes });
+                                e.add <kobra::Renderable> (context, &e.get <kobra::Mesh> ());
+                                import.entity = e.id;
+                        } else {
+                                // The mesh is replaced in place; the
+                                // renderable is recreated, and frames in
+                                // flight may still use the old one
+                                mesh->submeshes = std::move(submeshes);
+
+                                kobra::RenderablePtr old = system->rasterizers[import.entity];
+                                system->add <kobra::Renderable> (import.entity, context, mesh);
+
+                                if (context.sync_queue)
+                                        context.sync_queue->push({ "Release imported buffers", [old]() {} });
+
+                                if (editor->m_scene.bvh)
+                                        invalidate(editor->m_scene.bvh.get(), import.entity);
+                        }
+                }
+
+                if (!done) {
+                        it++;
+                        continue;
+                }
+
+                // Everything has been taken already; this only joins the
+                // import and drops its copy of the mesh. Entities cannot be
+                // removed, so a failed import keeps what arrived before
+                if (!import.handle->get())
+                        KOBRA_LOG_FUNC(Log::WARN) << "Could not import " << import.path << std::endl;
+
+                it = imports.erase(it);
+        }
+}
+
 void handle_application_communications(Editor *editor)
 {
         while (!g_application.packets.empty()) {
@@ -1329,6 +1443,7 @@ void Editor::after_present()
 
         // Handle application communications
         handle_application_communications(this);
+        handle_imports(this);
 
 	// Ping all systems using materials
         // TODO: formalize material daemon
@@ -1338,6 +1453,21 @@ void Editor::after_present()
         transform_daemon->update();
         update(m_scene.system->material_daemon);
 
+        if (m_scene.residency) {
+                update(m_scene.residency.get(), get_context(), m_viewport.camera_transform.position);
+
+                // Paged geometry is new to the BVH
+                for (int32_t entity : m_scene.residency->swapped) {
+                        if (m_scene.bvh)
+                                invalidate(m_scene.bvh.get(), entity);
+                }
+
+                m_scene.residency->swapped.clear();
+        }
+
+        if (m_scene.bvh)
+                update(m_scene.bvh.get(), transform_daemon.get());
+
 	// TODO: push profiler frame to UI
 	// KOBRA_PROFILE_PRINT();
 }
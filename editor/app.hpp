@@ -21,6 +21,13 @@ struct Application {
         kobra::Context context;
         std::queue <Packet> packets;
         std::string project;
+
+        // Bytes of submesh data kept in memory (see Project::residency_budget)
+        size_t residency_budget = size_t(1) << 30;
+
+        // Keep a CPU BVH of the scene (see Project::scene_bvh); nothing in
+        // the editor queries it yet, so it is off by default
+        bool scene_bvh = false;
 };
 
 extern Application g_application;
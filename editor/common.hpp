@@ -12,6 +12,7 @@
 #include "include/layers/framer.hpp"
 #include "include/layers/image_renderer.hpp"
 #include "include/layers/ui.hpp"
+#include "include/mesh_import.hpp"
 #include "include/project.hpp"
 #include "include/scene.hpp"
 #include "include/shader_program.hpp"
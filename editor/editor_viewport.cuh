@@ -51,6 +51,10 @@ struct CommonRaytracing {
         
         bool clk_rise = true;
         bool material_reset = false;
+
+        // Set when the geometry of an entity was replaced (e.g. paged in
+        // or out); the lights refer to its buffers
+        bool geometry_reset = false;
         bool transform_reset = false;
 
         void reset() {
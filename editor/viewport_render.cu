@@ -83,7 +83,7 @@ void update_materials(CommonRaytracing *crtx,
         bool valid_materials = (crtx->dev_materials != 0);
         bool no_updates = crtx->material_update_queue.empty();
         bool size_match = (crtx->materials.size() == md->materials.size());
-        if (valid_materials && no_updates && size_match)
+        if (valid_materials && no_updates && size_match && !crtx->geometry_reset)
                 return;
 
         // TODO: logf for formatted
@@ -148,6 +148,7 @@ void update_materials(CommonRaytracing *crtx,
         crtx->dev_materials = cuda::make_buffer_ptr(crtx->materials);
         crtx->material_reset = true;
         crtx->material_update_queue = {};
+        crtx->geometry_reset = false;
 
         // Synthesize lighting information
         crtx->triangle_count = 0;
@@ -187,8 +188,17 @@ void EditorViewport::prerender_raytrace(const std::vector <Entity> &entities,
                         rebuild_sbt |= true;
                 }
 
-                // Generate cache data
-                mesh_memory->cache_cuda(entity);
+                // Generate cache data; if the renderable was replaced
+                // (e.g. paged in or out), the records and lights of the
+                // entity still point to the old buffers
+                bool replaced = mesh_memory->cache_cuda(entity)
+                        && common_rtx.record_refs.count({ id, 0 }) > 0;
+
+                if (replaced) {
+                        common_rtx.geometry_reset = true;
+                        rebuild_tlas = true;
+                        rebuild_sbt = true;
+                }
 
                 // Create SBT record for each submesh
                 const auto &meshes = renderable.mesh->submeshes;
@@ -246,10 +256,14 @@ void EditorViewport::prerender_raytrace(const std::vector <Entity> &entities,
 
                                 rebuild_tlas = true;
                                 rebuild_sbt = true;
-                        } else if (td->changed(id)) {
+                        } else if (replaced || td->changed(id)) {
                                 int record_index = common_rtx.record_refs[index];
                                 auto &record = common_rtx.records[record_index];
                                 record.data.model = transform.matrix();
+
+                                auto cachelet = mesh_memory->get(entity.id, i);
+                                record.data.vertices = cachelet.m_cuda_vertices;
+                                record.data.triangles = (uint3 *) cachelet.m_cuda_triangles;
                         }
                 }
         }
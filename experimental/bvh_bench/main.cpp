@@ -0,0 +1,710 @@
+// Standard headers
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <random>
+
+// Unix headers
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Engine headers
+#include "include/bvh.hpp"
+#include "include/bvh/compressed.hpp"
+#include "include/bvh/packet.hpp"
+#include "include/bvh/wide.hpp"
+#include "include/daemons/bvh.hpp"
+#include "include/mesh.hpp"
+#include "include/timer.hpp"
+
+// Peak resident memory (in KB) of a forked child running the given task, so
+// that every measurement starts from the same baseline
+static long peak_memory(const std::function <void ()> &task)
+{
+	pid_t pid = fork();
+	if (pid == 0) {
+		task();
+		_exit(0);
+	}
+
+	int status;
+	struct rusage usage;
+	wait4(pid, &status, 0, &usage);
+
+	return usage.ru_maxrss;
+}
+
+// Random triangle soup, standing in for a scene
+static std::vector <glm::vec3> random_triangles(size_t count)
+{
+	std::mt19937 rng(0);
+	std::uniform_real_distribution <float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution <float> extent(-1.0f, 1.0f);
+
+	std::vector <glm::vec3> triangles;
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 p {position(rng), position(rng), position(rng)};
+		for (int j = 0; j < 3; j++)
+			triangles.push_back(p + glm::vec3 {extent(rng), extent(rng), extent(rng)});
+	}
+
+	return triangles;
+}
+
+// All triangles in a mesh file
+static std::vector <glm::vec3> mesh_triangles(const std::string &path)
+{
+	auto opt = kobra::Mesh::load(path);
+	if (!opt.has_value())
+		return {};
+
+	const kobra::Mesh &mesh = std::get <0> (*opt);
+
+	std::vector <glm::vec3> triangles;
+	for (const auto &submesh : mesh.submeshes)
+		submesh.triangle_positions(triangles, kobra::Transform {});
+
+	return triangles;
+}
+
+static std::vector <kobra::BoundingBox> triangle_boxes(const std::vector <glm::vec3> &triangles)
+{
+	std::vector <kobra::BoundingBox> boxes;
+	for (size_t i = 0; i < triangles.size(); i += 3) {
+		glm::vec3 min = glm::min(triangles[i], glm::min(triangles[i + 1], triangles[i + 2]));
+		glm::vec3 max = glm::max(triangles[i], glm::max(triangles[i + 1], triangles[i + 2]));
+		boxes.push_back(kobra::BoundingBox {min, max});
+	}
+
+	return boxes;
+}
+
+// Legacy pointer based construction
+static void legacy_build(const std::vector <kobra::BoundingBox> &boxes,
+		std::vector <aligned_vec4> &buffer)
+{
+	std::vector <kobra::BVHPtr> nodes;
+	for (size_t i = 0; i < boxes.size(); i++) {
+		kobra::BVHPtr node = std::make_shared <kobra::BVHNode> ();
+		node->bbox = boxes[i];
+		node->object = i;
+		nodes.push_back(node);
+	}
+
+	kobra::BVHPtr bvh = kobra::partition(nodes);
+	kobra::serialize(buffer, bvh);
+}
+
+// Flat construction
+static void flat_build(const std::vector <kobra::BoundingBox> &boxes,
+		std::vector <aligned_vec4> &buffer)
+{
+	kobra::BVH bvh = kobra::partition(boxes);
+	kobra::serialize(buffer, bvh);
+}
+
+static void lbvh_build(const std::vector <kobra::BoundingBox> &boxes,
+		std::vector <aligned_vec4> &buffer)
+{
+	kobra::BVH bvh = kobra::partition(boxes, {kobra::BVHBuild::eLBVH});
+	kobra::serialize(buffer, bvh);
+}
+
+static void treelet_build(const std::vector <kobra::BoundingBox> &boxes,
+		std::vector <aligned_vec4> &buffer)
+{
+	kobra::BVH bvh = kobra::partition(boxes, {kobra::BVHBuild::eLBVH, true});
+	kobra::serialize(buffer, bvh);
+}
+
+static void report(const char *name,
+		const std::vector <kobra::BoundingBox> &boxes,
+		void (*build)(const std::vector <kobra::BoundingBox> &, std::vector <aligned_vec4> &),
+		long baseline)
+{
+	// Time (best of a few runs)
+	double best = std::numeric_limits <double> ::max();
+	size_t records = 0;
+
+	for (int i = 0; i < 3; i++) {
+		std::vector <aligned_vec4> buffer;
+
+		kobra::Timer timer;
+		build(boxes, buffer);
+		best = std::min(best, timer.elapsed_start());
+
+		records = buffer.size();
+	}
+
+	// Memory
+	long peak = peak_memory([&]() {
+		std::vector <aligned_vec4> buffer;
+		build(boxes, buffer);
+	});
+
+	printf("%-8s build + serialize: %10.3f ms, peak memory: %8ld KB (+%ld KB), %zu vec4s\n",
+		name, best/1000.0, peak, peak - baseline, records);
+}
+
+// Rays between random points in the scene bounds
+static std::vector <kobra::Ray> random_rays(const kobra::BVH &bvh, size_t count)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution <float> uniform(0.0f, 1.0f);
+
+	glm::vec3 min = bvh.nodes[0].min;
+	glm::vec3 max = bvh.nodes[0].max;
+
+	auto point = [&]() {
+		glm::vec3 t {uniform(rng), uniform(rng), uniform(rng)};
+		return min + t * (max - min);
+	};
+
+	std::vector <kobra::Ray> rays(count);
+	for (auto &ray : rays) {
+		ray.origin = point();
+		ray.direction = glm::normalize(point() - ray.origin);
+	}
+
+	return rays;
+}
+
+// Throughput of a traversal kernel, in millions of rays per second
+template <class F>
+static void report_traversal(const char *name, size_t rays, const F &trace)
+{
+	double best = std::numeric_limits <double> ::max();
+
+	size_t hits = 0;
+	for (int i = 0; i < 3; i++) {
+		kobra::Timer timer;
+		hits = trace();
+		best = std::min(best, timer.elapsed_start());
+	}
+
+	printf("%-16s %8.3f Mrays/s, %zu hits\n", name, rays/best, hits);
+}
+
+static void traversal(const std::vector <glm::vec3> &triangles,
+		const std::vector <kobra::BoundingBox> &boxes)
+{
+	kobra::BVH bvh = kobra::partition(boxes);
+	kobra::BVH4 bvh4 = kobra::collapse <4> (bvh);
+	kobra::BVH8 bvh8 = kobra::collapse <8> (bvh);
+	kobra::CompressedBVH compressed = kobra::compress(bvh4);
+
+	// Memory per triangle of each format
+	std::vector <aligned_vec4> serialized;
+	kobra::serialize(serialized, bvh);
+
+	double triangles_count = boxes.size();
+
+	printf("Bytes per triangle: serialized %.2f, binary %.2f, BVH4 %.2f, BVH8 %.2f, compressed %.2f\n",
+		serialized.size() * sizeof(aligned_vec4)/triangles_count,
+		bvh.bytes()/triangles_count,
+		bvh4.bytes()/triangles_count,
+		bvh8.bytes()/triangles_count,
+		compressed.bytes()/triangles_count);
+
+	std::vector <kobra::Ray> rays = random_rays(bvh, 1 << 20);
+
+	printf("Traversal of %zu rays\n", rays.size());
+
+	auto closest = [&](const auto &tree) {
+		return [&]() {
+			size_t hits = 0;
+			for (const auto &ray : rays) {
+				kobra::Hit hit;
+				hits += kobra::closest_hit(tree, triangles, ray, hit);
+			}
+
+			return hits;
+		};
+	};
+
+	auto any = [&](const auto &tree) {
+		return [&]() {
+			size_t hits = 0;
+			for (const auto &ray : rays)
+				hits += kobra::any_hit(tree, triangles, ray);
+
+			return hits;
+		};
+	};
+
+	report_traversal("binary closest", rays.size(), closest(bvh));
+	report_traversal("BVH4 closest", rays.size(), closest(bvh4));
+	report_traversal("BVH8 closest", rays.size(), closest(bvh8));
+	report_traversal("BVH4Q closest", rays.size(), closest(compressed));
+	report_traversal("binary any", rays.size(), any(bvh));
+	report_traversal("BVH4 any", rays.size(), any(bvh4));
+	report_traversal("BVH8 any", rays.size(), any(bvh8));
+	report_traversal("BVH4Q any", rays.size(), any(compressed));
+}
+
+// Camera rays through a square image, looking at the scene from outside its
+// bounds; emitted in 4x4 tiles, as a tiled renderer would
+static std::vector <kobra::Ray> primary_rays(const kobra::BVH &bvh, int resolution)
+{
+	glm::vec3 min = bvh.nodes[0].min;
+	glm::vec3 max = bvh.nodes[0].max;
+
+	glm::vec3 center = (min + max) / 2.0f;
+	float radius = glm::length(max - min) / 2.0f;
+
+	glm::vec3 eye = center + glm::vec3 {0.0f, 0.0f, -2.0f * radius};
+
+	std::vector <kobra::Ray> rays;
+	rays.reserve(resolution * resolution);
+
+	for (int ty = 0; ty < resolution; ty += 4) {
+		for (int tx = 0; tx < resolution; tx += 4) {
+			for (int y = ty; y < ty + 4; y++) {
+				for (int x = tx; x < tx + 4; x++) {
+					float u = 2.0f * (x + 0.5f)/resolution - 1.0f;
+					float v = 2.0f * (y + 0.5f)/resolution - 1.0f;
+
+					glm::vec3 target = center + radius * glm::vec3 {u, v, 0.0f};
+					rays.push_back({ eye, glm::normalize(target - eye) });
+				}
+			}
+		}
+	}
+
+	return rays;
+}
+
+// Secondary rays from the primary hits: shadow rays towards a point light
+// (unnormalized, so that the light sits at t = 1) and diffuse rays in the
+// hemisphere of the surface normal
+static void secondary_rays(const kobra::BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const std::vector <kobra::Ray> &primary, const std::vector <kobra::Hit> &hits,
+		std::vector <kobra::Ray> &shadow, std::vector <kobra::Ray> &diffuse)
+{
+	std::mt19937 rng(2);
+	std::uniform_real_distribution <float> uniform(-1.0f, 1.0f);
+
+	glm::vec3 light = bvh.nodes[0].max + (bvh.nodes[0].max - bvh.nodes[0].min);
+
+	for (size_t i = 0; i < primary.size(); i++) {
+		const kobra::Hit &hit = hits[i];
+		if (hit.primitive == ~0u)
+			continue;
+
+		const glm::vec3 *v = &triangles[3 * hit.primitive];
+		glm::vec3 n = glm::normalize(glm::cross(v[1] - v[0], v[2] - v[0]));
+		if (glm::dot(n, primary[i].direction) > 0.0f)
+			n = -n;
+
+		glm::vec3 p = primary[i].origin + hit.t * primary[i].direction + 1e-3f * n;
+
+		shadow.push_back({ p, light - p });
+
+		glm::vec3 d;
+		do {
+			d = glm::vec3 {uniform(rng), uniform(rng), uniform(rng)};
+		} while (glm::dot(d, d) > 1.0f || glm::dot(d, d) < 1e-6f);
+
+		if (glm::dot(d, n) < 0.0f)
+			d = -d;
+
+		diffuse.push_back({ p, glm::normalize(d) });
+	}
+}
+
+// Packet and stream throughput against the single ray kernels, on primary,
+// shadow and diffuse workloads; every result is checked against the single
+// ray query
+static void workloads(const std::vector <glm::vec3> &triangles,
+		const std::vector <kobra::BoundingBox> &boxes)
+{
+	kobra::BVH bvh = kobra::partition(boxes);
+
+	std::vector <kobra::Ray> primary = primary_rays(bvh, 1024);
+
+	std::vector <kobra::Hit> hits(primary.size());
+	for (size_t i = 0; i < primary.size(); i++)
+		kobra::closest_hit(bvh, triangles, primary[i], hits[i]);
+
+	std::vector <kobra::Ray> shadow;
+	std::vector <kobra::Ray> diffuse;
+	secondary_rays(bvh, triangles, primary, hits, shadow, diffuse);
+
+	size_t mismatches = 0;
+
+	auto closest = [&](const char *workload, const std::vector <kobra::Ray> &rays) {
+		std::vector <kobra::Hit> reference(rays.size());
+		std::vector <kobra::Hit> results(rays.size());
+
+		auto count = [&](const std::vector <kobra::Hit> &hits) {
+			size_t count = 0;
+			for (size_t i = 0; i < hits.size(); i++) {
+				count += hits[i].primitive != ~0u;
+				mismatches += std::memcmp(&hits[i], &reference[i], sizeof(kobra::Hit)) != 0;
+			}
+
+			return count;
+		};
+
+		auto packet = [&](auto width) {
+			constexpr int N = decltype(width)::value;
+			return [&]() {
+				for (size_t i = 0; i < rays.size(); i += N) {
+					int n = std::min <size_t> (N, rays.size() - i);
+					kobra::closest_hit_packet <N> (bvh, triangles, &rays[i], n, &results[i]);
+				}
+
+				return count(results);
+			};
+		};
+
+		std::string name = std::string(workload) + " single";
+		report_traversal(name.c_str(), rays.size(), [&]() {
+			for (size_t i = 0; i < rays.size(); i++)
+				kobra::closest_hit(bvh, triangles, rays[i], reference[i]);
+
+			return count(reference);
+		});
+
+		name = std::string(workload) + " packet8";
+		report_traversal(name.c_str(), rays.size(), packet(std::integral_constant <int, 8> {}));
+
+		name = std::string(workload) + " packet16";
+		report_traversal(name.c_str(), rays.size(), packet(std::integral_constant <int, 16> {}));
+
+		name = std::string(workload) + " stream";
+		report_traversal(name.c_str(), rays.size(), [&]() {
+			kobra::closest_hit_stream(bvh, triangles, rays, results);
+			return count(results);
+		});
+	};
+
+	auto any = [&](const char *workload, const std::vector <kobra::Ray> &rays, float tmax) {
+		std::vector <uint8_t> reference(rays.size());
+		std::vector <uint8_t> results(rays.size());
+
+		auto count = [&](const std::vector <uint8_t> &occluded) {
+			size_t count = 0;
+			for (size_t i = 0; i < occluded.size(); i++) {
+				count += occluded[i];
+				mismatches += occluded[i] != reference[i];
+			}
+
+			return count;
+		};
+
+		auto packet = [&](auto width) {
+			constexpr int N = decltype(width)::value;
+			return [&]() {
+				for (size_t i = 0; i < rays.size(); i += N) {
+					int n = std::min <size_t> (N, rays.size() - i);
+					kobra::any_hit_packet <N> (bvh, triangles, &rays[i], n, &results[i], tmax);
+				}
+
+				return count(results);
+			};
+		};
+
+		std::string name = std::string(workload) + " single";
+		report_traversal(name.c_str(), rays.size(), [&]() {
+			for (size_t i = 0; i < rays.size(); i++)
+				reference[i] = kobra::any_hit(bvh, triangles, rays[i], tmax);
+
+			return count(reference);
+		});
+
+		name = std::string(workload) + " packet8";
+		report_traversal(name.c_str(), rays.size(), packet(std::integral_constant <int, 8> {}));
+
+		name = std::string(workload) + " packet16";
+		report_traversal(name.c_str(), rays.size(), packet(std::integral_constant <int, 16> {}));
+
+		name = std::string(workload) + " stream";
+		report_traversal(name.c_str(), rays.size(), [&]() {
+			kobra::any_hit_stream(bvh, triangles, rays, results, tmax);
+			return count(results);
+		});
+	};
+
+	printf("Packet traversal: %zu primary, %zu shadow, %zu diffuse rays\n",
+		primary.size(), shadow.size(), diffuse.size());
+
+	closest("primary", primary);
+	any("shadow", shadow, 1.0f);
+	closest("diffuse", diffuse);
+
+	printf("Mismatches against single ray queries: %zu\n", mismatches);
+}
+
+// Tree quality of each builder; SAH cost, reference duplication and closest
+// hit throughput on the binary tree
+static void quality(const std::vector <glm::vec3> &triangles)
+{
+	struct {
+		const char *name;
+		kobra::BVHOptions options;
+	} builders[] = {
+		{ "binned", { kobra::BVHBuild::eBinnedSAH } },
+		{ "lbvh", { kobra::BVHBuild::eLBVH } },
+		{ "treelet", { kobra::BVHBuild::eLBVH, true } },
+		{ "sbvh", { kobra::BVHBuild::eSBVH } },
+	};
+
+	std::vector <kobra::Ray> rays;
+	for (const auto &builder : builders) {
+		kobra::Timer timer;
+		kobra::BVH bvh = kobra::partition(triangles, builder.options);
+		double elapsed = timer.elapsed_start();
+
+		if (rays.empty())
+			rays = random_rays(bvh, 1 << 18);
+
+		kobra::BVHStats stats = kobra::statistics(bvh);
+
+		timer.start();
+
+		size_t hits = 0;
+		for (const auto &ray : rays) {
+			kobra::Hit hit;
+			hits += kobra::closest_hit(bvh, triangles, ray, hit);
+		}
+
+		double trace = timer.elapsed_start();
+
+		printf("%-8s build: %10.3f ms, SAH cost: %8.2f, duplication: %5.1f%%, %8.3f Mrays/s, %zu hits\n",
+			builder.name, elapsed/1000.0, stats.sah_cost,
+			100.0f * stats.duplication(), rays.size()/trace, hits);
+	}
+}
+
+// Two-level BVH of the BVHDaemon over a scene of instances, driven by the
+// TransformDaemon
+static size_t two_level(const std::vector <glm::vec3> &triangles)
+{
+	constexpr int kinds = 16;
+	constexpr int entities = 1024;
+
+	size_t per_kind = std::min(triangles.size()/(3 * kinds), size_t(1024));
+	if (per_kind == 0)
+		return 0;
+
+	// Pieces of the input, fit into a unit box
+	std::vector <kobra::MeshPtr> meshes;
+	for (int k = 0; k < kinds; k++) {
+		auto first = triangles.begin() + 3 * k * per_kind;
+		std::vector <glm::vec3> piece(first, first + 3 * per_kind);
+
+		glm::vec3 min = piece[0];
+		glm::vec3 max = piece[0];
+		for (const auto &p : piece) {
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+
+		glm::vec3 center = 0.5f * (min + max);
+		float extent = std::max(glm::length(max - min), 1e-6f);
+
+		kobra::VertexList vertices;
+		std::vector <uint32_t> indices;
+		for (const auto &p : piece) {
+			indices.push_back(vertices.size());
+			vertices.push_back(kobra::Vertex {2.0f * (p - center)/extent});
+		}
+
+		meshes.push_back(std::make_shared <kobra::Mesh> (
+			std::vector <kobra::Submesh> { kobra::Submesh { vertices, indices, -1, false } }
+		));
+	}
+
+	std::mt19937 rng(2);
+	std::uniform_real_distribution <float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution <float> angle(0.0f, 360.0f);
+	std::uniform_int_distribution <int> pick(0, entities - 1);
+
+	// Entities share the meshes, as instances do in the editor
+	kobra::System system(nullptr);
+	for (int i = 0; i < entities; i++) {
+		kobra::Entity &entity = system.make_entity("Instance " + std::to_string(i));
+		system.meshes[entity.id] = meshes[i % kinds];
+		system.transforms[entity.id] = kobra::Transform {
+			{ position(rng), position(rng), position(rng) },
+			{ angle(rng), angle(rng), angle(rng) },
+			glm::vec3 { 1.0f + i % 3 }
+		};
+	}
+
+	kobra::TransformDaemon transform_daemon(&system);
+	transform_daemon.update();
+
+	kobra::BVHDaemon *daemon = kobra::make_bvh_daemon(&system);
+
+	kobra::Timer timer;
+	kobra::update(daemon, &transform_daemon);
+
+	printf("Two-level: %d entities over %d meshes of %zu triangles, built in %.3f ms (%d BLASes)\n",
+		entities, kinds, per_kind, timer.elapsed_start()/1000.0, daemon->stats.blas_built);
+
+	size_t mismatches = 0;
+
+	// Against tracing every instance in turn, with transforms and meshes
+	// taken from the System; hits are compared by distance only, since
+	// instances of one mesh may tie
+	auto check = [&]() {
+		std::vector <kobra::BVH> bvhs;
+		std::vector <std::vector <glm::vec3>> positions(kinds);
+		for (int k = 0; k < kinds; k++) {
+			const kobra::Submesh &submesh = meshes[k]->submeshes[0];
+			submesh.triangle_positions(positions[k], kobra::Transform {});
+			bvhs.push_back(submesh.bvh(kobra::Transform {}));
+		}
+
+		std::vector <kobra::Ray> rays = random_rays(daemon->tlas, 1 << 12);
+		for (const auto &ray : rays) {
+			kobra::Hit expected;
+			bool hit = false;
+
+			for (int i = 0; i < entities; i++) {
+				glm::mat4 inverse = glm::inverse(system.transforms[i].matrix());
+				kobra::Ray local {
+					glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)),
+					glm::vec3(inverse * glm::vec4(ray.direction, 0.0f))
+				};
+
+				kobra::Hit local_hit;
+				if (kobra::closest_hit(bvhs[i % kinds], positions[i % kinds], local, local_hit, expected.t)) {
+					expected = local_hit;
+					hit = true;
+				}
+			}
+
+			kobra::Hit result;
+			int32_t instance = -1;
+			bool found = kobra::closest_hit(daemon, ray, result, instance);
+
+			mismatches += hit != found || expected.t != result.t;
+		}
+	};
+
+	check();
+
+	// Moving a fraction of the entities each frame; past the threshold of
+	// the daemon, the TLAS is rebuilt rather than refit
+	for (float fraction : { 0.001f, 0.01f, 0.1f, 0.5f }) {
+		int moved = std::max(1, int(fraction * entities));
+		for (int i = 0; i < moved; i++)
+			system.transforms[pick(rng)].position += glm::vec3 { 1.0f, -0.5f, 0.25f };
+
+		transform_daemon.update();
+
+		timer.start();
+		kobra::update(daemon, &transform_daemon);
+		double elapsed = timer.elapsed_start();
+
+		printf("%5.1f%% moved     update: %10.3f ms, %d instances refit%s\n",
+			100.0f * fraction, elapsed/1000.0, daemon->stats.instances_refit,
+			daemon->stats.tlas_rebuilt ? ", TLAS rebuilt" : "");
+
+		check();
+	}
+
+	timer.start();
+	kobra::rebuild(daemon);
+	printf("Full rebuild:     %10.3f ms\n", timer.elapsed_start()/1000.0);
+
+	// Editing one mesh in place; only its BLAS is built again, and the
+	// old one released
+	for (auto &vertex : meshes[0]->submeshes[0].vertices)
+		vertex.position *= 1.5f;
+
+	for (int i = 0; i < entities; i += kinds)
+		kobra::invalidate(daemon, i);
+
+	transform_daemon.update();
+
+	timer.start();
+	kobra::update(daemon, &transform_daemon);
+	double elapsed = timer.elapsed_start();
+
+	printf("Edited one mesh   update: %10.3f ms, %d BLAS built, %d released\n",
+		elapsed/1000.0, daemon->stats.blas_built, daemon->stats.blas_released);
+
+	mismatches += daemon->stats.blas_built != 1 || daemon->stats.blas_released != 1;
+	check();
+
+	// Loading the scene twice with an on-disk cache, as Project::load_scene
+	// does; the second load reads every BLAS instead of building it
+	std::filesystem::path cache = std::filesystem::temp_directory_path() / "bvh_bench_cache";
+	std::filesystem::remove_all(cache);
+	std::filesystem::create_directories(cache);
+
+	std::vector <kobra::Ray> rays = random_rays(daemon->tlas, 1 << 12);
+	for (int load = 0; load < 2; load++) {
+		kobra::BVHDaemon *loaded = kobra::make_bvh_daemon(&system, {}, cache);
+
+		timer.start();
+		kobra::rebuild(loaded);
+		double elapsed = timer.elapsed_start();
+
+		printf("%s load:        %10.3f ms, %d BLASes built, %d loaded\n",
+			load ? "Warm" : "Cold", elapsed/1000.0,
+			loaded->stats.blas_built, loaded->stats.blas_loaded);
+
+		int blases = loaded->blases.size();
+		mismatches += loaded->stats.blas_built != (load ? 0 : blases);
+		mismatches += loaded->stats.blas_loaded != (load ? blases : 0);
+
+		for (const auto &ray : rays) {
+			kobra::Hit expected, result;
+			int32_t instance;
+
+			bool hit = kobra::closest_hit(daemon, ray, expected, instance);
+			bool found = kobra::closest_hit(loaded, ray, result, instance);
+			mismatches += hit != found || expected.t != result.t;
+		}
+
+		delete loaded;
+	}
+
+	std::filesystem::remove_all(cache);
+
+	printf("Two-level mismatches: %zu\n", mismatches);
+
+	delete daemon;
+	return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+	// Usage: bvh_bench [mesh file | triangle count]
+	std::vector <glm::vec3> triangles;
+	if (argc > 1 && !std::isdigit(argv[1][0]))
+		triangles = mesh_triangles(argv[1]);
+	else
+		triangles = random_triangles(argc > 1 ? std::stoul(argv[1]) : 1000000);
+
+	std::vector <kobra::BoundingBox> boxes = triangle_boxes(triangles);
+
+	if (boxes.empty()) {
+		fprintf(stderr, "No primitives to build a BVH over\n");
+		return 1;
+	}
+
+	printf("BVH benchmark over %zu primitives\n", boxes.size());
+
+	long baseline = peak_memory([]() {});
+
+	report("legacy", boxes, legacy_build, baseline);
+	report("flat", boxes, flat_build, baseline);
+	report("lbvh", boxes, lbvh_build, baseline);
+	report("treelet", boxes, treelet_build, baseline);
+
+	quality(triangles);
+	traversal(triangles, boxes);
+	workloads(triangles, boxes);
+
+	return two_level(triangles) ? 1 : 0;
+}
@@ -0,0 +1,346 @@
+// Standard headers
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <unordered_map>
+
+// Unix headers
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Engine headers
+#include "include/core/flat_map.hpp"
+#include "include/mesh.hpp"
+#include "include/packed_vertex.hpp"
+#include "include/timer.hpp"
+#include "source/io/obj.hpp"
+
+// Scan-like OBJ: a noisy heightfield with shared positions, normals and
+// texture coordinates, split into a few shapes and materials
+static std::string generate_scan(size_t resolution)
+{
+	std::string path = "mesh_bench_scan.obj";
+
+	std::ofstream file(path);
+
+	std::mt19937 rng(0);
+	std::uniform_real_distribution <float> noise(-0.01f, 0.01f);
+
+	for (size_t y = 0; y < resolution; y++) {
+		for (size_t x = 0; x < resolution; x++) {
+			float u = float(x)/(resolution - 1);
+			float v = float(y)/(resolution - 1);
+			float h = 0.1f * std::sin(10.0f * u) * std::cos(7.0f * v) + noise(rng);
+
+			file << "v " << u << " " << h << " " << v << "\n";
+			file << "vt " << u << " " << v << "\n";
+			file << "vn 0 1 0\n";
+		}
+	}
+
+	size_t bands = 4;
+	for (size_t y = 0; y + 1 < resolution; y++) {
+		if (y % ((resolution + bands - 1)/bands) == 0)
+			file << "o band" << y << "\nusemtl default\n";
+
+		for (size_t x = 0; x + 1 < resolution; x++) {
+			size_t a = y * resolution + x + 1;
+			size_t b = a + 1;
+			size_t c = a + resolution;
+			size_t d = c + 1;
+
+			file << "f " << a << "/" << a << "/" << a
+				<< " " << b << "/" << b << "/" << b
+				<< " " << d << "/" << d << "/" << d << "\n";
+
+			file << "f " << a << "/" << a << "/" << a
+				<< " " << d << "/" << d << "/" << d
+				<< " " << c << "/" << c << "/" << c << "\n";
+		}
+	}
+
+	return path;
+}
+
+// Previous deduplication tables, for comparison
+struct IndexHash {
+	size_t operator()(const tinyobj::index_t &k) const {
+		return ((std::hash <int> ()(k.vertex_index)
+			^ (std::hash <int> ()(k.normal_index) << 1)) >> 1)
+			^ (std::hash <int> ()(k.texcoord_index) << 1);
+	}
+};
+
+struct IndexEqual {
+	bool operator()(const tinyobj::index_t &a, const tinyobj::index_t &b) const {
+		return a.vertex_index == b.vertex_index
+			&& a.normal_index == b.normal_index
+			&& a.texcoord_index == b.texcoord_index;
+	}
+};
+
+struct VertexHash {
+	size_t operator()(const kobra::Vertex &v) const {
+		auto h3 = [](const glm::vec3 &v) {
+			return ((std::hash <float> ()(v.x)
+				^ (std::hash <float> ()(v.y) << 1)) >> 1)
+				^ (std::hash <float> ()(v.z) << 1);
+		};
+
+		auto h2 = [](const glm::vec2 &v) {
+			return ((std::hash <float> ()(v.x)
+				^ (std::hash <float> ()(v.y) << 1)) >> 1);
+		};
+
+		return ((h3(v.position) ^ (h3(v.normal) << 1)) >> 1)
+			^ (h2(v.tex_coords) << 1);
+	}
+};
+
+struct VertexEqual {
+	bool operator()(const kobra::Vertex &a, const kobra::Vertex &b) const {
+		return a.position == b.position
+			&& a.normal == b.normal
+			&& a.tex_coords == b.tex_coords;
+	}
+};
+
+static kobra::Vertex make_vertex(const tinyobj::attrib_t &attrib, const tinyobj::index_t &index)
+{
+	kobra::Vertex vertex;
+	vertex.position = {
+		attrib.vertices[3 * index.vertex_index + 0],
+		attrib.vertices[3 * index.vertex_index + 1],
+		attrib.vertices[3 * index.vertex_index + 2]
+	};
+
+	vertex.normal = glm::vec3(0.0f);
+	if (index.normal_index >= 0) {
+		vertex.normal = {
+			attrib.normals[3 * index.normal_index + 0],
+			attrib.normals[3 * index.normal_index + 1],
+			attrib.normals[3 * index.normal_index + 2]
+		};
+	}
+
+	vertex.tex_coords = glm::vec2(0.0f);
+	if (index.texcoord_index >= 0) {
+		vertex.tex_coords = {
+			attrib.texcoords[2 * index.texcoord_index + 0],
+			attrib.texcoords[2 * index.texcoord_index + 1]
+		};
+	}
+
+	return vertex;
+}
+
+// Deduplicate all shapes with the node based maps, as the loader used to
+// (count() followed by operator[], so two hashes per lookup)
+static size_t dedup_unordered(const kobra::io::OBJData &data)
+{
+	size_t unique = 0;
+	for (const auto &shape : data.shapes) {
+		std::unordered_map <kobra::Vertex, uint32_t, VertexHash, VertexEqual> vertices;
+		std::unordered_map <tinyobj::index_t, uint32_t, IndexHash, IndexEqual> indices;
+
+		for (const auto &index : shape.mesh.indices) {
+			if (indices.count(index) > 0)
+				continue;
+
+			kobra::Vertex vertex = make_vertex(data.attrib, index);
+
+			uint32_t id;
+			if (vertices.count(vertex) > 0) {
+				id = vertices[vertex];
+			} else {
+				id = vertices.size();
+				vertices[vertex] = id;
+			}
+
+			indices[index] = id;
+		}
+
+		unique += vertices.size();
+	}
+
+	return unique;
+}
+
+// Deduplicate all shapes with the flat tables, reused across shapes
+static size_t dedup_flat(const kobra::io::OBJData &data)
+{
+	struct VertexKey {
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 tex_coords;
+	};
+
+	using VertexTable = kobra::core::FlatMap <VertexKey, uint32_t,
+		kobra::core::BytesHash <VertexKey>,
+		kobra::core::BytesEqual <VertexKey>>;
+
+	using IndexTable = kobra::core::FlatMap <tinyobj::index_t, uint32_t,
+		kobra::core::BytesHash <tinyobj::index_t>,
+		kobra::core::BytesEqual <tinyobj::index_t>>;
+
+	VertexTable vertices;
+	IndexTable indices;
+
+	size_t unique = 0;
+	for (const auto &shape : data.shapes) {
+		vertices.clear();
+		indices.clear();
+
+		vertices.reserve(shape.mesh.num_face_vertices.size()/2 + 1);
+		indices.reserve(shape.mesh.num_face_vertices.size()/2 + 1);
+
+		for (const auto &index : shape.mesh.indices) {
+			if (indices.find(index))
+				continue;
+
+			kobra::Vertex vertex = make_vertex(data.attrib, index);
+
+			VertexKey key { vertex.position, vertex.normal, vertex.tex_coords };
+
+			uint32_t id = vertices.insert(key, vertices.size()).first;
+			indices.insert(index, id);
+		}
+
+		unique += vertices.size();
+	}
+
+	return unique;
+}
+
+// Run a task in a forked child, so that every measurement starts from the
+// same heap; reports the best of three runs and the peak resident memory
+// (in KB) over the child's starting footprint
+template <class F>
+static void report(const char *name, const F &task)
+{
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid != 0) {
+		int status;
+		waitpid(pid, &status, 0);
+		return;
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	long baseline = usage.ru_maxrss;
+
+	double best = std::numeric_limits <double> ::max();
+	size_t result = 0;
+
+	for (int i = 0; i < 3; i++) {
+		kobra::Timer timer;
+		result = task();
+		best = std::min(best, timer.elapsed_start());
+	}
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("%-16s %10.3f ms, peak memory: %8ld KB (+%ld KB), %zu\n",
+		name, best/1000.0, usage.ru_maxrss, usage.ru_maxrss - baseline, result);
+
+	fflush(stdout);
+	_exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	// Usage: mesh_bench [OBJ file | grid resolution]
+	std::string path;
+	if (argc > 1 && !std::isdigit(argv[1][0]))
+		path = argv[1];
+	else
+		path = generate_scan(argc > 1 ? std::stoul(argv[1]) : 1024);
+
+	kobra::io::OBJData data;
+	if (!kobra::io::parse_obj(path, kobra::common::get_directory(path), data)) {
+		fprintf(stderr, "Could not parse %s: %s\n", path.c_str(), data.error.c_str());
+		return 1;
+	}
+
+	size_t face_vertices = 0;
+	for (const auto &shape : data.shapes)
+		face_vertices += shape.mesh.indices.size();
+
+	printf("Mesh benchmark over %s: %zu shapes, %zu face vertices\n",
+		path.c_str(), data.shapes.size(), face_vertices);
+
+	// Deduplication alone, over the parsed data
+	report("unordered dedup", [&]() { return dedup_unordered(data); });
+	report("flat dedup", [&]() { return dedup_flat(data); });
+
+	// Whole import, through Mesh::load
+	report("parse", [&]() {
+		kobra::io::OBJData data;
+		kobra::io::parse_obj(path, kobra::common::get_directory(path), data);
+		return data.shapes.size();
+	});
+
+	report("Mesh::load", [&]() {
+		auto mesh = kobra::Mesh::load(path);
+		return mesh ? std::get <0> (*mesh).submeshes.size() : 0;
+	});
+
+	// Accuracy of the packed vertex layout, quality of the meshlets, and
+	// the LOD chain
+	if (auto mesh = kobra::Mesh::load(path)) {
+		for (const auto &submesh : std::get <0> (*mesh).submeshes) {
+			std::cout << "packed: " << kobra::packing_error(submesh, kobra::pack(submesh)) << "\n";
+			std::cout << "meshlets: " << kobra::statistics(submesh.meshlets) << "\n";
+
+			std::cout << "lods: " << submesh.indices.size()/3;
+			for (const auto &lod : submesh.lods)
+				std::cout << " -> " << lod.indices.size()/3 << " (" << lod.error << ")";
+			std::cout << "\n";
+		}
+	}
+
+	// Tangent frames, with the SSE and the scalar kernels, which must agree;
+	// they are identical unless the compiler contracts the scalar kernel
+	// into FMAs, whose rounding shows most where normals are missing
+	int failed = 0;
+	if (auto mesh = kobra::Mesh::load(path)) {
+		const auto &submeshes = std::get <0> (*mesh).submeshes;
+
+		auto generate = [&](bool simd) {
+			std::vector <kobra::VertexList> frames;
+			for (const auto &submesh : submeshes) {
+				frames.push_back(submesh.vertices);
+				kobra::generate_tangents(frames.back(), submesh.indices, simd);
+			}
+
+			return frames;
+		};
+
+		report("tangents", [&]() { return generate(true).size(); });
+		report("tangents scalar", [&]() { return generate(false).size(); });
+
+		auto simd = generate(true);
+		auto scalar = generate(false);
+
+		float difference = 0.0f;
+		for (size_t i = 0; i < simd.size(); i++) {
+			for (size_t j = 0; j < simd[i].size(); j++) {
+				glm::vec3 dt = simd[i][j].tangent - scalar[i][j].tangent;
+				glm::vec3 db = simd[i][j].bitangent - scalar[i][j].bitangent;
+				difference = std::max({ difference, glm::length(dt), glm::length(db) });
+			}
+		}
+
+		printf("tangents: SSE and scalar differ by %g\n", difference);
+		failed = !(difference < 1e-2f);
+	}
+
+	return failed;
+}
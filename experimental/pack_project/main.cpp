@@ -0,0 +1,85 @@
+// Standard headers
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+// Engine headers
+#include "include/project_archive.hpp"
+#include "include/timer.hpp"
+
+// Read every file of a project, as Project::load_scene would
+static size_t read_directory(const std::filesystem::path &directory, const kobra::ProjectArchive &archive)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < archive.size(); i++) {
+		std::ifstream file(directory / std::string(archive.name(i)), std::ios::binary | std::ios::ate);
+
+		std::string data(file.tellg(), '\0');
+		file.seekg(0);
+		file.read(data.data(), data.size());
+
+		bytes += data.size();
+	}
+
+	return bytes;
+}
+
+static size_t read_archive(const std::filesystem::path &path)
+{
+	auto archive = kobra::ProjectArchive::open(path);
+	if (!archive)
+		return 0;
+
+	// Touch every page, as decoding would
+	static volatile char sink;
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < archive->size(); i++) {
+		std::string_view contents = *archive->find(archive->name(i));
+		for (size_t j = 0; j < contents.size(); j += 4096)
+			sink = sink ^ contents[j];
+
+		bytes += contents.size();
+	}
+
+	return bytes;
+}
+
+int main(int argc, char *argv[])
+{
+	// Usage: pack_project <project directory> [archive]
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <project directory> [archive]\n", argv[0]);
+		return 1;
+	}
+
+	std::filesystem::path directory = argv[1];
+	std::filesystem::path path = (argc > 2) ? argv[2] : kobra::project_archive_path(directory);
+
+	kobra::Timer timer;
+	if (!kobra::pack_project(directory, path)) {
+		fprintf(stderr, "Could not pack %s\n", directory.c_str());
+		return 1;
+	}
+
+	printf("Packed %s into %s in %.3f ms\n", directory.c_str(), path.c_str(), timer.elapsed_start()/1000.0);
+
+	auto archive = kobra::ProjectArchive::open(path);
+	if (!archive) {
+		fprintf(stderr, "Could not open %s\n", path.c_str());
+		return 1;
+	}
+
+	printf("%zu files, %zu bytes\n", archive->size(), size_t(std::filesystem::file_size(path)));
+
+	// Reading everything back both ways (warm page cache)
+	timer.start();
+	size_t bytes = read_directory(directory, *archive);
+	printf("%-16s %10.3f ms, %zu bytes\n", "directory", timer.elapsed_start()/1000.0, bytes);
+
+	timer.start();
+	bytes = read_archive(path);
+	printf("%-16s %10.3f ms, %zu bytes\n", "archive", timer.elapsed_start()/1000.0, bytes);
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+// Standard headers
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+
+// Engine headers
+#include "include/scene_description.hpp"
+#include "include/timer.hpp"
+
+// Scene like the ones Project::save writes: entities with a few submeshes,
+// from a shared pool of files and materials, some of them transformed copies
+static kobra::SceneDescription generate_scene(size_t entities)
+{
+	kobra::SceneDescription description;
+
+	std::mt19937 rng(0);
+	std::uniform_real_distribution <float> position(-1000.0f, 1000.0f);
+	std::uniform_real_distribution <float> angle(0.0f, 360.0f);
+	std::uniform_int_distribution <int> count(1, 3);
+	std::uniform_int_distribution <int> file(0, 4095);
+	std::uniform_int_distribution <int> material(0, 255);
+
+	for (size_t i = 0; i < entities; i++) {
+		// Some names need quoting in the text encoding
+		std::string label = "Entity " + std::to_string(i);
+		if (i % 64 == 1)
+			label = " \"Lamp\", \\ copy " + std::to_string(i) + "\n";
+
+		description.add_entity(label,
+			{ position(rng), position(rng), position(rng) },
+			{ 0.0f, angle(rng), 0.0f },
+			glm::vec3 { 1.0f });
+
+		description.flags.back() |= kobra::SceneDescription::eMesh
+			| kobra::SceneDescription::eRenderable;
+
+		int submeshes = count(rng);
+		for (int j = 0; j < submeshes; j++) {
+			char name[48];
+			std::snprintf(name, sizeof(name), "submesh-%016x.submesh", file(rng));
+
+			kobra::SceneDescription::SubmeshEntry entry;
+			entry.file = description.add_string(name);
+			entry.material = description.add_string("material " + std::to_string(material(rng)) + ", glossy.mat");
+
+			// A quarter are moved copies
+			glm::mat4 transform { 1.0f };
+			if (rng() % 4 == 0)
+				transform[3] = glm::vec4 { position(rng), position(rng), position(rng), 1.0f };
+
+			entry.set_matrix(transform);
+			entry.set_bounds({ glm::vec3 { -1.0f }, glm::vec3 { 1.0f } }, 1 << 12, 3 << 12);
+			description.add_submesh(entry);
+		}
+	}
+
+	description.add_entity("Camera", glm::vec3 { 0.0f }, glm::vec3 { 0.0f }, glm::vec3 { 1.0f });
+	description.add_camera(45.0f, 16.0f/9.0f);
+
+	return description;
+}
+
+// Best of five runs, in milliseconds
+template <class F>
+static void report(const char *name, size_t bytes, const F &task)
+{
+	double best = std::numeric_limits <double> ::max();
+	for (int i = 0; i < 5; i++) {
+		kobra::Timer timer;
+		task();
+		best = std::min(best, timer.elapsed_start()/1000.0);
+	}
+
+	printf("%-16s %10.3f ms, %10zu bytes\n", name, best, bytes);
+}
+
+int main(int argc, char *argv[])
+{
+	// Usage: scene_bench [entities | scene file]
+	kobra::SceneDescription description;
+	if (argc > 1 && !std::isdigit(argv[1][0])) {
+		std::ifstream file(argv[1], std::ios::binary | std::ios::ate);
+
+		std::string data(file.tellg(), '\0');
+		file.seekg(0);
+		file.read(data.data(), data.size());
+
+		auto scene = kobra::read_scene(data);
+		if (!scene) {
+			fprintf(stderr, "Could not read %s\n", argv[1]);
+			return 1;
+		}
+
+		description = std::move(*scene);
+	} else {
+		description = generate_scene(argc > 1 ? std::stoul(argv[1]) : 100000);
+	}
+
+	std::string text = kobra::write_scene_text(description);
+	std::string binary = kobra::encode_scene(description);
+
+	printf("Scene benchmark: %zu entities, %zu submeshes, %zu strings\n",
+		description.size(), description.submeshes.size(),
+		description.string_offsets.size() - 1);
+
+	// Both encodings must hold the same scene
+	auto from_text = kobra::read_scene_text(text);
+	auto from_binary = kobra::decode_scene(binary);
+
+	bool lossless = from_text && from_binary
+		&& kobra::encode_scene(*from_text) == binary
+		&& kobra::write_scene_text(*from_binary) == text;
+
+	printf("Round trip: %s\n", lossless ? "lossless" : "MISMATCH");
+
+	static volatile size_t sink;
+
+	report("write text", text.size(), [&]() {
+		sink = sink + kobra::write_scene_text(description).size();
+	});
+
+	report("encode binary", binary.size(), [&]() {
+		sink = sink + kobra::encode_scene(description).size();
+	});
+
+	report("read text", text.size(), [&]() {
+		sink = sink + kobra::read_scene_text(text)->size();
+	});
+
+	report("decode binary", binary.size(), [&]() {
+		sink = sink + kobra::decode_scene(binary)->size();
+	});
+
+	return lossless ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+// Standard headers
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Engine headers
+#include "include/scene_description.hpp"
+
+// Converts scene descriptions (.kobra) between the binary and the text
+// encoding; without an output, the result goes to the standard output, so
+// that git can show diffs of binary scenes:
+//
+//	git config diff.kobra.textconv "scene_convert --text"
+//	echo "*.kobra diff=kobra" >> .gitattributes
+int main(int argc, char *argv[])
+{
+	// Usage: scene_convert [--text | --binary] <input> [output]
+	enum { eOther, eText, eBinary } target = eOther;
+
+	int arg = 1;
+	if (arg < argc && std::strcmp(argv[arg], "--text") == 0) {
+		target = eText;
+		arg++;
+	} else if (arg < argc && std::strcmp(argv[arg], "--binary") == 0) {
+		target = eBinary;
+		arg++;
+	}
+
+	if (arg >= argc) {
+		fprintf(stderr, "Usage: %s [--text | --binary] <input> [output]\n", argv[0]);
+		return 1;
+	}
+
+	std::ifstream file(argv[arg], std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		fprintf(stderr, "Could not open %s\n", argv[arg]);
+		return 1;
+	}
+
+	std::string data(file.tellg(), '\0');
+	file.seekg(0);
+	file.read(data.data(), data.size());
+
+	// By default, to the other encoding
+	if (target == eOther)
+		target = kobra::is_binary_scene(data) ? eText : eBinary;
+
+	auto description = kobra::read_scene(data);
+	if (!description) {
+		fprintf(stderr, "Invalid scene description %s\n", argv[arg]);
+		return 1;
+	}
+
+	std::string result = (target == eText)
+		? kobra::write_scene_text(*description)
+		: kobra::encode_scene(*description);
+
+	if (arg + 1 >= argc) {
+		std::cout.write(result.data(), result.size());
+		return std::cout ? 0 : 1;
+	}
+
+	std::ofstream output(argv[arg + 1], std::ios::binary);
+	output.write(result.data(), result.size());
+	output.close();
+
+	if (!output) {
+		fprintf(stderr, "Could not write %s\n", argv[arg + 1]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -34,6 +34,10 @@ class Accelerator {
                 int index = 0;
                 glm::mat4 transform;
                 OptixTraversableHandle m_gas = 0;
+                CUdeviceptr m_gas_buffer = 0;
+
+                // Of the renderable the GAS was built from
+                uint64_t generation = 0;
         };
 
         // Object cache
@@ -125,6 +129,9 @@ class Accelerator {
 			)
 		);
 
+		instance.m_gas_buffer = d_gas_output;
+		instance.generation = renderable.generation;
+
 		// Free data at the end
 		cuda::free(d_vertices);
 		cuda::free(d_triangles);
@@ -150,16 +157,27 @@ public:
                         auto &renderable = entity.get <Renderable> ();
                         auto &transform = entity.get <Transform> ();
 
-                        // If already cached, just update transform
-                        if (m_cache.instances.count(id) > 0) {
-                                for (Instance &instance : m_cache.instances[id]) {
+                        // If already cached, just update transform; if the
+                        // renderable was replaced (e.g. paged in or out), the
+                        // GASes are rebuilt
+                        auto cached = m_cache.instances.find(id);
+                        if (cached != m_cache.instances.end()) {
+                                bool stale = false;
+                                for (Instance &instance : cached->second) {
+                                        stale |= (instance.generation != renderable.generation);
                                         if (transform_daemon->changed(id)) {
                                                 instance.transform = transform.matrix();
                                                 updated |= true;
                                         }
                                 }
 
-                                continue;
+                                if (!stale)
+                                        continue;
+
+                                for (Instance &instance : cached->second)
+                                        cuda::free(instance.m_gas_buffer);
+
+                                m_cache.instances.erase(cached);
                         }
 
                         std::cout << "New renderable: " << &renderable << std::endl;
@@ -2,25 +2,162 @@
 #define KOBRA_RT_BVH_H_
 
 // Standard headers
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
 
 // Engine headers
 #include "bbox.hpp"
+#include "common.hpp"
 #include "core.hpp"
 #include "logger.hpp"
 
 namespace kobra {
 
-// Forward declarations
+// Flat BVH; all nodes live in a single contiguous arena and reference their
+// children (or their primitives) through 32-bit indices. The root is node 0.
+struct BVH {
+	// 32 byte node
+	struct Node {
+		glm::vec3	min;
+		uint32_t	left;	// Left child (first primitive for leaves)
+		glm::vec3	max;
+		uint32_t	right;	// Right child (primitive count for leaves)
+
+		// Leaves are tagged in the high bit of the right field
+		static constexpr uint32_t eLeaf = 0x80000000u;
+
+		bool is_leaf() const {
+			return right & eLeaf;
+		}
+
+		uint32_t first() const {
+			return left;
+		}
+
+		uint32_t count() const {
+			return right & ~eLeaf;
+		}
+
+		BoundingBox bbox() const {
+			return BoundingBox {min, max};
+		}
+	};
+
+	std::vector <Node> nodes;
+
+	// Primitive indices (into the input boxes), in leaf order; each leaf
+	// references the range [first, first + count). Spatial splits may
+	// reference a primitive from several leaves.
+	std::vector <uint32_t> primitives;
+
+	// Properties
+	bool empty() const {
+		return nodes.empty();
+	}
+
+	size_t node_count() const {
+		return nodes.size();
+	}
+
+	size_t primitive_count() const {
+		return primitives.size();
+	}
+
+	// Memory used by the arena and the primitive indices
+	size_t bytes() const {
+		return nodes.size() * sizeof(Node)
+			+ primitives.size() * sizeof(uint32_t);
+	}
+
+	// Number of aligned_vec4s written by serialize()
+	size_t serialized_size() const;
+};
+
+static_assert(sizeof(BVH::Node) == 32, "BVH::Node must be 32 bytes");
+
+// Construction modes
+enum class BVHBuild {
+	// Binned SAH; subtrees over a few thousand primitives are built as
+	// parallel tasks
+	eBinnedSAH,
+
+	// Linear BVH over Morton codes of the centroids; builds in linear time,
+	// much faster than SAH for per-frame rebuilds, at some cost in quality
+	eLBVH,
+
+	// SAH with spatial splits (SBVH); triangles straddling a split plane
+	// are clipped and referenced from both sides, which cuts node overlap
+	// for long, thin triangles. Requires triangles, not boxes.
+	eSBVH
+};
+
+struct BVHOptions {
+	BVHBuild mode = BVHBuild::eBinnedSAH;
+
+	// Restructure treelets after an LBVH build to recover SAH quality
+	bool optimize_treelets = false;
+
+	// Spatial splits may add at most this many references, as a fraction of
+	// the number of triangles
+	float duplication_budget = 0.3f;
+};
+
+// Construction over boxes, or over triangles given as three consecutive
+// positions each; spatial splits are only available for the latter
+BVH partition(const std::vector <BoundingBox> &, const BVHOptions & = {});
+BVH partition(const std::vector <glm::vec3> &, const BVHOptions & = {});
+
+namespace detail {
+
+BVH lbvh(const std::vector <BoundingBox> &, bool);
+BVH sbvh(const std::vector <glm::vec3> &, float);
+
+}
+
+// Quality metrics
+struct BVHStats {
+	float	sah_cost = 0.0f;	// Expected traversal cost, relative to the root
+	size_t	primitives = 0;		// Unique primitives
+	size_t	references = 0;		// Primitive references in the leaves
+
+	// Fraction of duplicated references
+	float duplication() const {
+		return primitives ? float(references)/primitives - 1.0f : 0.0f;
+	}
+};
+
+BVHStats statistics(const BVH &);
+
+// Serialization into the threaded layout of shaders/rt/modules/bvh.glsl;
+// linear in the number of nodes
+void serialize(std::vector <aligned_vec4> &, const BVH &, int = -1);
+
+// Closest intersection of a ray with a triangle soup
+struct Hit {
+	float		t = std::numeric_limits <float> ::max();
+	float		u = 0.0f;
+	float		v = 0.0f;
+	uint32_t	primitive = ~0u;	// Index of the triangle
+};
+
+// Triangle queries, on the CPU; triangles are given as three consecutive
+// positions each, in the order of the boxes the BVH was built over (see
+// Submesh::triangle_positions)
+bool closest_hit(const BVH &, const std::vector <glm::vec3> &, const Ray &, Hit &,
+		float = std::numeric_limits <float> ::max());
+
+bool any_hit(const BVH &, const std::vector <glm::vec3> &, const Ray &,
+		float = std::numeric_limits <float> ::max());
+
+// Legacy pointer based BVH, kept around for comparison (see
+// experimental/bvh_bench); prefer the flat BVH above
 struct BVHNode;
 
-// Shared ptr alias
 using BVHPtr = std::shared_ptr <BVHNode>;
 
-// BVH Node
-// TODO: into source file!
 struct BVHNode {
 	// Bounding box
 	BoundingBox	bbox;
@@ -37,11 +174,8 @@ struct BVHNode {
 	size_t primitive_count() const;
 };
 
-// Construction
 BVHPtr partition(const std::vector <BVHPtr> &);
-BVHPtr partition(const std::vector <BoundingBox> &);
 
-// Serialization
 void serialize(std::vector <aligned_vec4> &, const BVHPtr &, int = -1);
 
 }
@@ -0,0 +1,63 @@
+#ifndef KOBRA_BVH_CACHE_H_
+#define KOBRA_BVH_CACHE_H_
+
+// Standard headers
+#include <filesystem>
+#include <optional>
+
+// Engine headers
+#include "../mesh.hpp"
+
+namespace kobra {
+
+// On-disk BVH cache; files live in the project cache directory (next to the
+// submesh files written by Project::save) and are named after a key derived
+// from the submesh content hash, its vertex and index counts and the build
+// settings, so that stale entries are never picked up. The header repeats
+// the hash and the counts, which are checked against the submesh on load,
+// and the tree is validated before use.
+//
+// Layout: a 64 byte header, then the nodes, then the primitive indices.
+struct BVHCacheHeader {
+	static constexpr uint32_t eMagic = 0x4856424B;	// "KBVH"
+	static constexpr uint32_t eVersion = 2;
+
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	key;
+	uint64_t	content;	// Submesh::hash of the source
+	uint64_t	nodes;
+	uint64_t	primitives;
+	uint64_t	vertices;	// Of the source submesh
+	uint64_t	indices;
+	uint64_t	reserved;
+};
+
+static_assert(sizeof(BVHCacheHeader) == 64, "BVHCacheHeader must be 64 bytes");
+
+// Key of the BVH of a submesh, from its content hash (Submesh::hash), its
+// vertex and index counts and the build settings
+uint64_t bvh_cache_key(uint64_t, const Submesh &, const BVHOptions &);
+
+// Path of a cache entry in a cache directory
+std::filesystem::path bvh_cache_path(const std::filesystem::path &, uint64_t);
+
+// Write the BVH of a submesh, given its key and content hash; the file is
+// written to a temporary first and renamed, so readers never see partial
+// entries
+bool bvh_cache_save(const std::filesystem::path &, const BVH &, uint64_t, uint64_t, const Submesh &);
+
+// Read the BVH of a submesh back, if the file exists, matches the key, the
+// content hash and the counts of the submesh, and passes validation
+std::optional <BVH> bvh_cache_load(const std::filesystem::path &, uint64_t, uint64_t, const Submesh &);
+
+// Content hash of the submesh a cache entry was built from, if the file is
+// a cache entry of the current version; used to sweep stale entries
+std::optional <uint64_t> bvh_cache_content(const std::filesystem::path &);
+
+// Load the BVH of a submesh from a cache directory, or build and store it
+BVH cached_bvh(const std::filesystem::path &, const Submesh &, const BVHOptions & = {});
+
+}
+
+#endif
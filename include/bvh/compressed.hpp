@@ -0,0 +1,67 @@
+#ifndef KOBRA_BVH_COMPRESSED_H_
+#define KOBRA_BVH_COMPRESSED_H_
+
+// Engine headers
+#include "wide.hpp"
+
+namespace kobra {
+
+// Compressed 4-wide BVH; child bounds are quantized to 8 bits on a grid
+// anchored at the node origin, with a power of two cell size per axis, and
+// rounded outwards so that decoded boxes always contain the originals
+struct CompressedBVH {
+	struct alignas(64) Node {
+		float		origin[3];
+		int8_t		exponent[3];
+		uint8_t		valid;		// Mask of used slots
+
+		uint8_t		qmin_x[4];
+		uint8_t		qmin_y[4];
+		uint8_t		qmin_z[4];
+		uint8_t		qmax_x[4];
+		uint8_t		qmax_y[4];
+		uint8_t		qmax_z[4];
+
+		// As for WideBVH
+		uint32_t	child[4];
+		uint8_t		count[4];
+
+		uint32_t	padding;
+	};
+
+	std::vector <Node> nodes;
+	std::vector <uint32_t> primitives;
+
+	// Properties
+	bool empty() const {
+		return nodes.empty();
+	}
+
+	size_t bytes() const {
+		return nodes.size() * sizeof(Node)
+			+ primitives.size() * sizeof(uint32_t);
+	}
+};
+
+static_assert(sizeof(CompressedBVH::Node) == 64, "CompressedBVH::Node must be 64 bytes");
+
+// Encoding, from a binary BVH (through collapse <4>) or from a BVH4; leaves
+// may hold at most 255 primitives, which all builders in bvh.hpp respect
+CompressedBVH compress(const BVH &);
+CompressedBVH compress(const BVH4 &);
+
+// Decoding
+void decode(const CompressedBVH::Node &, BVH4::Node &);
+BVH4 decompress(const CompressedBVH &);
+
+// Triangle queries, as for the binary BVH; nodes are decoded as they are
+// visited
+bool closest_hit(const CompressedBVH &, const std::vector <glm::vec3> &, const Ray &, Hit &,
+		float = std::numeric_limits <float> ::max());
+
+bool any_hit(const CompressedBVH &, const std::vector <glm::vec3> &, const Ray &,
+		float = std::numeric_limits <float> ::max());
+
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef KOBRA_BVH_PACKET_H_
+#define KOBRA_BVH_PACKET_H_
+
+// Engine headers
+#include "../bvh.hpp"
+
+namespace kobra {
+
+// Packet traversal of the binary BVH; up to N rays (8 or 16) walk the tree
+// together, with a mask of the lanes that are still active at each node.
+// Packets whose rays share a direction octant are culled against each node
+// with interval arithmetic before the per lane tests. Hits are bit identical
+// to those of the single ray queries.
+template <int N>
+void closest_hit_packet(const BVH &, const std::vector <glm::vec3> &,
+		const Ray *, int, Hit *,
+		float = std::numeric_limits <float> ::max());
+
+// Occlusion results are written as 0 or 1 per ray
+template <int N>
+void any_hit_packet(const BVH &, const std::vector <glm::vec3> &,
+		const Ray *, int, uint8_t *,
+		float = std::numeric_limits <float> ::max());
+
+// Stream traversal; rays are grouped by direction octant (keeping their
+// relative order, so that coherent input such as camera rays stays coherent)
+// and traced in packets of 16, in parallel. Results are in input order.
+void closest_hit_stream(const BVH &, const std::vector <glm::vec3> &,
+		const std::vector <Ray> &, std::vector <Hit> &,
+		float = std::numeric_limits <float> ::max());
+
+void any_hit_stream(const BVH &, const std::vector <glm::vec3> &,
+		const std::vector <Ray> &, std::vector <uint8_t> &,
+		float = std::numeric_limits <float> ::max());
+
+}
+
+#endif
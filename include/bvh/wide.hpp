@@ -0,0 +1,64 @@
+#ifndef KOBRA_BVH_WIDE_H_
+#define KOBRA_BVH_WIDE_H_
+
+// Engine headers
+#include "../bvh.hpp"
+
+namespace kobra {
+
+// Wide BVH, collapsed from a binary BVH; each node stores the bounds of up to
+// N children in SoA layout, so that a ray can be tested against all of them
+// at once. Empty slots have inverted bounds, which never intersect.
+template <int N>
+struct WideBVH {
+	static_assert(N == 4 || N == 8, "WideBVH supports 4 or 8 children");
+
+	struct alignas(32) Node {
+		float		min_x[N];
+		float		min_y[N];
+		float		min_z[N];
+		float		max_x[N];
+		float		max_y[N];
+		float		max_z[N];
+
+		// Child node index, or first primitive for leaves (count > 0)
+		uint32_t	child[N];
+		uint32_t	count[N];
+	};
+
+	std::vector <Node> nodes;
+
+	// Same primitive indices as the source BVH
+	std::vector <uint32_t> primitives;
+
+	// Properties
+	bool empty() const {
+		return nodes.empty();
+	}
+
+	size_t bytes() const {
+		return nodes.size() * sizeof(Node)
+			+ primitives.size() * sizeof(uint32_t);
+	}
+};
+
+using BVH4 = WideBVH <4>;
+using BVH8 = WideBVH <8>;
+
+// Collapse a binary BVH; children with the largest surface area are opened
+// first
+template <int N>
+WideBVH <N> collapse(const BVH &);
+
+// Triangle queries, as for the binary BVH
+template <int N>
+bool closest_hit(const WideBVH <N> &, const std::vector <glm::vec3> &, const Ray &, Hit &,
+		float = std::numeric_limits <float> ::max());
+
+template <int N>
+bool any_hit(const WideBVH <N> &, const std::vector <glm::vec3> &, const Ray &,
+		float = std::numeric_limits <float> ::max());
+
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef KOBRA_CORE_FLAT_MAP_H_
+#define KOBRA_CORE_FLAT_MAP_H_
+
+// Standard headers
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace kobra {
+
+namespace core {
+
+// Open addressing hash map with linear probing, for hot lookup tables such
+// as vertex deduplication; keys are hashed once per lookup, slots live in a
+// single array, and clear() is O(1) (slots are tagged with an epoch), so
+// that one table can be reused across many small batches
+template <class K, class V, class Hash = std::hash <K>, class Equal = std::equal_to <K>>
+class FlatMap {
+	struct Slot {
+		K		key;
+		V		value;
+		uint32_t	epoch = 0;
+	};
+
+	std::vector <Slot> _slots;
+	size_t _mask = 0;
+	size_t _size = 0;
+	uint32_t _epoch = 1;
+
+	Hash _hash;
+	Equal _equal;
+
+	// Kept at most three quarters full
+	static bool _overloaded(size_t size, size_t capacity) {
+		return 4 * size > 3 * capacity;
+	}
+
+	void _rehash(size_t capacity) {
+		std::vector <Slot> old = std::move(_slots);
+		uint32_t epoch = _epoch;
+
+		_slots.assign(capacity, Slot {});
+		_mask = capacity - 1;
+		_epoch = 1;
+
+		for (Slot &slot : old) {
+			if (slot.epoch != epoch)
+				continue;
+
+			size_t i = _hash(slot.key) & _mask;
+			while (_slots[i].epoch == _epoch)
+				i = (i + 1) & _mask;
+
+			_slots[i].key = std::move(slot.key);
+			_slots[i].value = std::move(slot.value);
+			_slots[i].epoch = _epoch;
+		}
+	}
+public:
+	// Properties
+	size_t size() const {
+		return _size;
+	}
+
+	size_t capacity() const {
+		return _slots.size();
+	}
+
+	// Make room for a number of entries without rehashing
+	void reserve(size_t count) {
+		size_t capacity = 16;
+		while (_overloaded(count, capacity))
+			capacity <<= 1;
+
+		if (capacity > _slots.size())
+			_rehash(capacity);
+	}
+
+	// Remove all entries, keeping the storage
+	void clear() {
+		_size = 0;
+
+		// Epoch wrapped around; stale tags could alias the new one
+		if (++_epoch == 0) {
+			for (Slot &slot : _slots)
+				slot.epoch = 0;
+
+			_epoch = 1;
+		}
+	}
+
+	// Value of a key, or nullptr
+	V *find(const K &key) {
+		if (_slots.empty())
+			return nullptr;
+
+		size_t i = _hash(key) & _mask;
+		while (_slots[i].epoch == _epoch) {
+			if (_equal(_slots[i].key, key))
+				return &_slots[i].value;
+
+			i = (i + 1) & _mask;
+		}
+
+		return nullptr;
+	}
+
+	// Value of a key, inserting the given one if the key is missing; the
+	// flag is true if it was inserted
+	std::pair <V &, bool> insert(const K &key, const V &value) {
+		if (_overloaded(_size + 1, _slots.size()))
+			_rehash(std::max <size_t> (16, 2 * _slots.size()));
+
+		size_t i = _hash(key) & _mask;
+		while (_slots[i].epoch == _epoch) {
+			if (_equal(_slots[i].key, key))
+				return { _slots[i].value, false };
+
+			i = (i + 1) & _mask;
+		}
+
+		_slots[i].key = key;
+		_slots[i].value = value;
+		_slots[i].epoch = _epoch;
+		_size++;
+
+		return { _slots[i].value, true };
+	}
+};
+
+// Hash and equality over the raw bytes of a trivially copyable value (or of
+// its first Size bytes); words are mixed independently of each other, so
+// that the multiplies overlap, and then folded together. This is the one
+// byte hash of the engine (table keys, cache keys and content hashes); a
+// previous hash passed as the seed chains several blocks
+inline uint64_t hash_words(const void *data, size_t size, uint64_t seed = 0)
+{
+	const uint8_t *bytes = (const uint8_t *) data;
+
+	uint64_t hash = seed ^ (0x9E3779B97F4A7C15ull * (size + 1));
+	for (size_t i = 0; i < size; i += 8) {
+		uint64_t word = 0;
+		std::memcpy(&word, bytes + i, std::min <size_t> (8, size - i));
+
+		word ^= 0x9E3779B97F4A7C15ull * (i + 1);
+		word *= 0xBF58476D1CE4E5B9ull;
+		word ^= word >> 29;
+
+		hash += word;
+	}
+
+	// Final mix, so that the low bits used for the slot index depend on
+	// every input bit
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+template <class T, size_t Size = sizeof(T)>
+struct BytesHash {
+	size_t operator()(const T &value) const {
+		return hash_words(&value, Size);
+	}
+};
+
+template <class T, size_t Size = sizeof(T)>
+struct BytesEqual {
+	bool operator()(const T &a, const T &b) const {
+		return std::memcmp(&a, &b, Size) == 0;
+	}
+};
+
+}
+
+}
+
+#endif
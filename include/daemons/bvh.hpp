@@ -0,0 +1,112 @@
+#pragma once
+
+// Standard headers
+#include <filesystem>
+#include <map>
+#include <set>
+#include <vector>
+
+// Engine headers
+#include "include/bvh.hpp"
+#include "include/system.hpp"
+#include "include/daemons/transform.hpp"
+
+namespace kobra {
+
+// Two-level BVH over the scene: one object space BLAS per unique submesh,
+// built once, and a TLAS over the world space boxes of all instances
+// (entity, submesh pairs), refit as the TransformDaemon reports changes.
+//
+// Updates cost O(changed instances): moved entities come from the
+// TransformDaemon, and geometry edited (or replaced) in place must be
+// reported with invalidate(daemon, entity), after which its BLASes are
+// found again by content hash. New entities trigger a full rebuild.
+//
+// This is for CPU queries (bvh.hpp), tools and benchmarks (bvh_bench); the
+// editor and the path tracers use the GPU acceleration structures of
+// amadeus instead
+struct BVHDaemon {
+        // Bottom level structure; shared by all instances of submeshes with
+        // identical geometry. The triangles it was built from (three
+        // positions each) are kept for queries, and to confirm matches,
+        // since hashes can collide
+        struct BLAS {
+                BVH bvh;
+                BoundingBox bbox;
+                uint64_t hash;
+
+                std::vector <glm::vec3> triangles;
+        };
+
+        // Instance of a BLAS
+        struct Instance {
+                int32_t entity;
+                int32_t submesh;
+                int32_t blas;
+                glm::mat4 model;
+                glm::mat4 inverse;
+                BoundingBox bbox;
+        };
+
+        System *system = nullptr;
+        BVHOptions options;
+
+        // Directory of the on-disk BLAS cache (see bvh/cache.hpp), usually
+        // the .cache directory of the project; disabled if empty
+        std::filesystem::path cache;
+
+        // Bottom level structures, looked up by content hash; those no
+        // instance refers to are released on rebuild
+        std::vector <BLAS> blases;
+        std::map <uint64_t, std::vector <int32_t>> blas_lookup;
+
+        // Top level structure; primitives are instance indices, and the
+        // instances of entity i are [first_instance[i], first_instance[i + 1])
+        std::vector <Instance> instances;
+        std::vector <int32_t> first_instance;
+        BVH tlas;
+
+        // Pending changes; entities added since the last rebuild are noticed
+        // from the size of the System
+        bool dirty = true;
+        std::set <int32_t> dirty_entities;
+
+        // Refit bookkeeping for the TLAS
+        std::vector <uint32_t> parents;
+        std::vector <uint32_t> depths;
+        std::vector <uint32_t> leaves;  // Leaf node of each instance
+        std::vector <uint8_t> marked;   // Nodes collected for refitting
+
+        // Fraction of changed instances above which the TLAS is rebuilt
+        // instead of refit
+        float rebuild_threshold = 0.25f;
+
+        // Statistics of the last update
+        struct {
+                int blas_built = 0;
+                int blas_loaded = 0;
+                int blas_released = 0;
+                int instances_refit = 0;
+                bool tlas_rebuilt = false;
+        } stats;
+};
+
+// Methods
+BVHDaemon *make_bvh_daemon(System *, const BVHOptions & = {},
+                const std::filesystem::path & = {});
+
+void update(BVHDaemon *, const TransformDaemon *);
+
+// Full TLAS rebuild, e.g. after entities are added or removed
+void rebuild(BVHDaemon *);
+
+// Report changes the daemon cannot see: the geometry of an entity (edited in
+// place, or swapped, e.g. by the ResidencyDaemon), or anything at all
+void invalidate(BVHDaemon *, int32_t);
+void invalidate(BVHDaemon *);
+
+// Closest intersection with the scene as of the last update, and the
+// instance that was hit
+bool closest_hit(const BVHDaemon *, const Ray &, Hit &, int32_t &);
+
+}
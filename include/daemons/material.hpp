@@ -2,6 +2,7 @@
 
 // Standard headers
 #include <filesystem>
+#include <istream>
 #include <map>
 #include <queue>
 #include <vector>
@@ -17,6 +18,7 @@ struct MaterialDaemon {
         std::map <std::string, int32_t> lookup;
         std::vector <Material> materials;
         std::vector <int32_t> status;
+        std::vector <int32_t> dirty;    // Changed since last saved
         std::vector <Forward> forward;
 };
 
@@ -28,6 +30,7 @@ void signal_update(MaterialDaemon *, int32_t);
 void update(MaterialDaemon *);
 
 int32_t load(MaterialDaemon *, const std::filesystem::path &);
+int32_t load(MaterialDaemon *, std::istream &);
 int32_t load(MaterialDaemon *, const Material &);
 
 }
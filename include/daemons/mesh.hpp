@@ -26,6 +26,9 @@ struct MeshDaemon {
 	// Full information for a renderable and its mesh
 	struct Cache {
 		std::vector <Cachelet> m_cachelets;
+
+		// Of the renderable the cachelets were made from
+		uint64_t m_generation = 0;
 	};
 
         // Vulkan structures
@@ -45,9 +48,11 @@ struct MeshDaemon {
 	MeshDaemon(const Context &context)
 			: m_phdev(context.phdev), m_device(context.device) {}
 
-	// Cache a renderable
+	// Cache a renderable; entries are remade (and the old buffers freed)
+	// once the renderable of the entity is replaced. Returns whether the
+	// entry was (re)made, so that users of the old buffers can update
 	// void cache(const Renderable &);
-	void cache_cuda(const Entity &);
+	bool cache_cuda(const Entity &);
 
 	// Get a cache item
 	const Cache &get(int entity) const {
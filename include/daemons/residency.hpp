@@ -0,0 +1,121 @@
+#pragma once
+
+// Standard headers
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Taskflow headers
+#include <taskflow/taskflow.hpp>
+
+// Engine headers
+#include "../backend.hpp"
+#include "../system.hpp"
+
+namespace kobra {
+
+// On-demand residency of submesh geometry, for projects too large to hold in
+// memory; tracked entities start with proxy boxes, made from the bounds that
+// the scene description records, and their vertices and indices are read
+// when first needed (see request and update). Files are read on worker
+// threads, and the geometry is swapped in by a later update, so that paging
+// does not stall frames. Resident entities are returned to their proxies,
+// least recently used first, to stay within the budget.
+//
+// Anything that reads the geometry of a tracked entity (selection, BVH
+// builds) should request it first; a BVHDaemon must then be told with
+// invalidate (see daemons/bvh.hpp), for the entities in swapped.
+struct ResidencyDaemon {
+        // Where a submesh of a tracked entity comes from
+        struct Source {
+                std::string file;       // Name in the .cache directory
+                glm::mat4 transform;    // From the file (see instancing.hpp)
+                int32_t material;
+                BoundingBox bounds;     // Object space, after the transform
+                size_t vertices;
+                size_t indices;
+        };
+
+        // Reads and decodes a submesh file, by name
+        using Loader = std::function <std::optional <Submesh> (const std::string &)>;
+
+        System *system = nullptr;
+        Loader loader;
+
+        // Bytes of vertex and index data of tracked entities kept in memory
+        size_t budget = 0;
+
+        // Tracked entities, and the resident ones in order of use (least
+        // recent first)
+        std::map <int32_t, std::vector <Source>> sources;
+        std::list <int32_t> lru;
+        std::map <int32_t, std::list <int32_t>::iterator> resident;
+        size_t resident_bytes = 0;
+
+        // Entities being read in the background; their sources are copies,
+        // corrected from the files (see decode)
+        struct Pending {
+                std::vector <Source> sources;
+                std::optional <std::vector <Submesh>> submeshes;
+                tf::Taskflow taskflow;
+                std::future <void> ready;
+        };
+
+        std::map <int32_t, std::shared_ptr <Pending>> pending;
+        size_t pending_bytes = 0;
+
+        // Entities whose files could not be read; not retried by update
+        std::set <int32_t> failed;
+
+        // Entities paged in or out since the owner last cleared this
+        std::vector <int32_t> swapped;
+
+        // Statistics
+        struct {
+                size_t paged_in = 0;
+                size_t evicted = 0;
+                size_t peak_bytes = 0;
+        } stats;
+
+        // Reads files in the background; declared last so that it waits for
+        // them before anything else goes away
+        tf::Executor executor {
+                std::max(1u, std::thread::hardware_concurrency()/2)
+        };
+};
+
+// Methods
+ResidencyDaemon *make_residency_daemon(System *, const ResidencyDaemon::Loader &, size_t);
+
+// Proxy geometry; one box per source, with its material
+Mesh proxy_mesh(const std::vector <ResidencyDaemon::Source> &);
+
+// Start tracking an entity, whose mesh is its proxy
+void track(ResidencyDaemon *, int32_t, const std::vector <ResidencyDaemon::Source> &);
+
+// Untracked entities are always resident
+bool is_resident(const ResidencyDaemon *, int32_t);
+
+// Sources of an entity that currently has proxy geometry, otherwise null
+const std::vector <ResidencyDaemon::Source> *proxied(const ResidencyDaemon *, int32_t);
+
+// Page in an entity now (waiting for it if it is being read), evicting
+// others if needed; false if its files could not be read
+bool request(ResidencyDaemon *, const Context &, int32_t);
+
+// Swap in the entities read since the last call, and start reading the
+// nearest non-resident entities to the camera (at most the given number in
+// flight), evicting farther ones if needed
+void update(ResidencyDaemon *, const Context &, const glm::vec3 &, int = 4);
+
+void set_budget(ResidencyDaemon *, const Context &, size_t);
+
+}
@@ -19,6 +19,10 @@ struct TransformDaemon {
         std::vector <uint8_t> status;
         std::vector <kobra::Transform> transforms;
 
+        // Entities whose status became eChanged in the last update, so that
+        // consumers only visit those
+        std::vector <int32_t> changed_entities;
+
         TransformDaemon(System *ref) : system(ref) {}
 
         size_t size() const {
@@ -31,6 +35,8 @@ struct TransformDaemon {
                 // TODO: store by address, to avoid
                 // issues when entities are removed...
 
+                changed_entities.clear();
+
                 // If there are new entities, then initialize
                 for (int i = 0; i < entities; i++) {
                         if (i < transforms.size()) {
@@ -42,9 +48,10 @@ struct TransformDaemon {
                                 glm::vec3 drot = t.rotation - old.rotation;
                                 glm::vec3 dsc = t.scale - old.scale;
 
-                                if (glm::length(dtr) > 1e-3f || glm::length(drot) > 1e-3f || glm::length(dsc) > 1e-3f)
+                                if (glm::length(dtr) > 1e-3f || glm::length(drot) > 1e-3f || glm::length(dsc) > 1e-3f) {
                                         status[i] = eChanged;
-                                else
+                                        changed_entities.push_back(i);
+                                } else
                                         status[i] = eSame;
 
                                 old = t;
@@ -0,0 +1,52 @@
+#ifndef KOBRA_INSTANCING_H_
+#define KOBRA_INSTANCING_H_
+
+// Standard headers
+#include <vector>
+
+// Engine headers
+#include "mesh.hpp"
+
+namespace kobra {
+
+// Submesh whose geometry another one repeats, and the transform that maps
+// the first onto the second (identity for exact copies), along with the
+// content hash of the submesh itself (Submesh::hash)
+struct SubmeshInstance {
+	size_t		source;
+	glm::mat4	transform { 1.0f };
+	bool		exact = true;
+	uint64_t	hash = 0;
+};
+
+struct InstancingOptions {
+	// Also match copies that were moved, rotated or uniformly scaled; off
+	// by default, since such copies are lossy (see below)
+	bool		similarity = false;
+
+	// Largest vertex position error of a match, relative to the diagonal of
+	// the bounds; normals and tangents must match to about 0.1 degrees
+	float		tolerance = 1e-5f;
+};
+
+// Deduplicates geometry, returning one entry per submesh; sources are always
+// submeshes that map onto themselves. Exact copies are found by content hash
+// (and confirmed bytewise). Other copies must have the same indices and
+// texture coordinates, which holds for geometry duplicated in an editor or
+// by a kitbashing tool; the similarity is fitted from corresponding vertices
+// (centroid, RMS radius and a frame from two extreme vertices) and then
+// checked against every vertex, so mirrored or deformed copies never match.
+//
+// Transformed copies are lossy: instantiate rebuilds them from the source,
+// so positions may move by up to the tolerance, and normals and tangents
+// come back renormalized rather than as stored. They only save space on
+// disk; every entity still holds a full copy of its geometry in memory.
+std::vector <SubmeshInstance> find_instances(const std::vector <const Submesh *> &,
+		const InstancingOptions & = {});
+
+// Copy of a submesh under a similarity transform
+Submesh instantiate(const Submesh &, const glm::mat4 &);
+
+}
+
+#endif
@@ -34,7 +34,10 @@ public:
 		// TODO: alias to simplify...
 		std::function <void (const vk::raii::DescriptorSet &)> configure_dset = nullptr;
 
-		std::map <const Renderable *, RenderableDset> dsets;
+		// Descriptor sets of the renderables drawn, and the generation
+		// of the renderable each was made for (addresses are reused once
+		// a renderable is replaced, e.g. when paged in or out)
+		std::map <const Renderable *, std::pair <uint64_t, RenderableDset>> dsets;
 	};
 
 	// Critical Vulkan structures
@@ -43,6 +46,9 @@ public:
 	vk::raii::DescriptorPool *descriptor_pool = nullptr;
 	vk::raii::RenderPass render_pass = nullptr;
 
+	// Releases descriptor sets that frames in flight may still use
+	SyncQueue *sync_queue = nullptr;
+
 	// Texture loader
 	TextureLoader *loader = nullptr;
 
@@ -68,6 +74,10 @@ public:
 		std::vector <std::tuple <const Light *, const Transform *>> lights;
 		std::string pipeline_package = BUILTIN_PIPELINE_PACKAGE;
 		std::string environment_map = "";
+
+		// Largest screen space error of a submesh LOD, in pixels; zero
+		// always draws full detail
+		float lod_threshold = 0.0f;
 	};
 
 	void render(const Parameters &,
@@ -0,0 +1,75 @@
+#ifndef KOBRA_LOD_H_
+#define KOBRA_LOD_H_
+
+// Standard headers
+#include <algorithm>
+#include <vector>
+
+// Engine headers
+#include "vertex.hpp"
+
+namespace kobra {
+
+// Simplified index list of a submesh; levels share the submesh's vertices,
+// and the error is the RMS distance to the original surface, in object
+// units
+struct SubmeshLOD {
+	std::vector <uint32_t>	indices;
+	float			error = 0.0f;
+};
+
+struct LODOptions {
+	uint32_t	levels = 4;		// At most, after full detail
+	float		ratio = 0.5f;		// Triangles kept per level
+	uint32_t	min_triangles = 64;
+
+	// Largest error, relative to the diagonal of the submesh bounds;
+	// the chain stops at the first level that would exceed it
+	float		target_error = 0.02f;
+};
+
+// Quadric error edge collapse (Garland and Heckbert), restricted to
+// collapses onto existing vertices so that every level can share the
+// vertex buffer. Open borders, and seams (edges across which the vertices
+// differ, e.g. in UVs or normals), only collapse along themselves, keeping
+// the attributes on either side, and their junctions stay. Simplifies
+// until the index count drops to the target, or no collapse stays within
+// the error (relative, as above); the achieved error (absolute) is returned
+// through the last argument.
+std::vector <uint32_t> simplify(const VertexList &, const std::vector <uint32_t> &,
+		size_t, float, float * = nullptr);
+
+// Chain of successively coarser levels, each simplified from the previous
+// one and in vertex cache order
+std::vector <SubmeshLOD> build_lods(const VertexList &, const std::vector <uint32_t> &,
+		const LODOptions & = {});
+
+// Screen space size, in pixels, of an object space error; scale is the
+// largest scale factor of the object transform, distance is from the
+// camera to the object, and projection is the viewport height over
+// 2 tan(fov/2)
+inline float lod_screen_error(float error, float scale, float distance, float projection)
+{
+	return error * scale * projection/std::max(distance, 1e-6f);
+}
+
+// Coarsest level whose screen error stays below the threshold (in pixels),
+// given the errors of the levels (see SubmeshLOD); zero is full detail, and
+// level k > 0 is the one of errors[k - 1]
+inline size_t select_lod(const std::vector <float> &errors,
+		float scale, float distance, float projection, float threshold)
+{
+	size_t level = 0;
+	for (size_t i = 0; i < errors.size(); i++) {
+		if (lod_screen_error(errors[i], scale, distance, projection) > threshold)
+			break;
+
+		level = i + 1;
+	}
+
+	return level;
+}
+
+}
+
+#endif
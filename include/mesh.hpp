@@ -1,6 +1,8 @@
 #pragma once
 
 // Standard headers
+#include <filesystem>
+#include <functional>
 #include <optional>
 #include <vector>
 
@@ -9,7 +11,10 @@
 #include "bvh.hpp"
 #include "transform.hpp"
 #include "vertex.hpp"
+#include "lod.hpp"
 #include "material.hpp"
+#include "meshlet.hpp"
+#include "tangents.hpp"
 
 namespace kobra {
 
@@ -17,23 +22,28 @@ namespace kobra {
 
 // Submesh, holds vertices and indices
 class Submesh {
-	// Process tangent and bitangent
-	void _process_vertex_data();
 public:
 	// Data
 	VertexList vertices;
         std::vector <uint32_t> indices;
 	int32_t material_index = 0;
 
+	// Clusters for culling, built on import (may be empty)
+	Meshlets meshlets;
+
+	// Coarser index lists over the same vertices, built on import (may be
+	// empty); see select_lod
+	std::vector <SubmeshLOD> lods;
+
 	// Constructors
 	// TODO: remove this constructor...
 	Submesh(const VertexList &vs, const std::vector <uint32_t> &is,
 			int32_t mat_index = -1,
 			bool calculate_tangents = true)
 			: vertices(vs), indices(is), material_index(mat_index) {
-		/* Process the vertex data
-		if (calculate_tangents)
-			_process_vertex_data(); */
+		// Only when the source has none
+		if (calculate_tangents && !has_tangents(vertices))
+			generate_tangents(vertices, indices);
 	}
 
 	// Number of triangles
@@ -44,37 +54,47 @@ public:
 	// Generate a bounding box
 	BoundingBox bbox() const;
 
-	// Generate a BVH for this submesh
-	BVHPtr bvh(const Transform &transform) const {
-		// Generate list of bounding boxes
-		std::vector <BoundingBox> boxes;
+	// Content hash of the vertices and indices
+	uint64_t hash() const;
 
+	// Append the bounding boxes of all triangles, after transformation
+	void triangle_boxes(std::vector <BoundingBox> &boxes, const Transform &transform) const {
+		glm::mat4 model = transform.matrix();
 		for (int i = 0; i < indices.size(); i += 3) {
-			// Get the triangle
-			int a = indices[i];
-			int b = indices[i + 1];
-			int c = indices[i + 2];
-
-			// Get the vertices
-			const auto &v1 = vertices[a];
-			const auto &v2 = vertices[b];
-			const auto &v3 = vertices[c];
-
 			// Get the transformed vertices
-			glm::vec3 p1 = transform * v1.position;
-			glm::vec3 p2 = transform * v2.position;
-			glm::vec3 p3 = transform * v3.position;
+			glm::vec3 p1 = model * glm::vec4(vertices[indices[i]].position, 1.0f);
+			glm::vec3 p2 = model * glm::vec4(vertices[indices[i + 1]].position, 1.0f);
+			glm::vec3 p3 = model * glm::vec4(vertices[indices[i + 2]].position, 1.0f);
 
 			// Create the bounding box
 			glm::vec3 min = glm::min(p1, glm::min(p2, p3));
 			glm::vec3 max = glm::max(p1, glm::max(p2, p3));
 
-			// Add the bounding box
 			boxes.push_back(BoundingBox {min, max});
 		}
+	}
+
+	// Append the vertex positions of all triangles, after transformation;
+	// three per triangle, for the CPU queries in bvh.hpp
+	void triangle_positions(std::vector <glm::vec3> &positions, const Transform &transform) const {
+		glm::mat4 model = transform.matrix();
+		for (int i = 0; i < indices.size(); i++)
+			positions.push_back(model * glm::vec4(vertices[indices[i]].position, 1.0f));
+	}
+
+	// Generate a BVH for this submesh; primitives are triangle indices
+	BVH bvh(const Transform &transform, const BVHOptions &options = {}) const {
+		if (options.mode == BVHBuild::eSBVH) {
+			std::vector <glm::vec3> positions;
+			positions.reserve(indices.size());
+			triangle_positions(positions, transform);
+			return partition(positions, options);
+		}
 
-		// Generate the BVH
-		return partition(boxes);
+		std::vector <BoundingBox> boxes;
+		boxes.reserve(triangles());
+		triangle_boxes(boxes, transform);
+		return partition(boxes, options);
 	}
 
 	// Submesh modifiers
@@ -125,18 +145,26 @@ struct Mesh {
 		return submeshes[i];
 	}
 
-	// Generate a BVH for this mesh
-	BVHPtr bvh(const Transform &transform) const {
-		if (submeshes.size() == 1)
-			return submeshes[0].bvh(transform);
+	// Generate a BVH for this mesh; primitives are triangle indices
+	// across all submeshes, in submesh order
+	BVH bvh(const Transform &transform, const BVHOptions &options = {}) const {
+		if (options.mode == BVHBuild::eSBVH) {
+			std::vector <glm::vec3> positions;
+			positions.reserve(indices());
+
+			for (const auto &submesh : submeshes)
+				submesh.triangle_positions(positions, transform);
+
+			return partition(positions, options);
+		}
+
+		std::vector <BoundingBox> boxes;
+		boxes.reserve(triangles());
 
-		// Generate list of partial BVHs
-		std::vector <BVHPtr> bvhs;
 		for (const auto &submesh : submeshes)
-			bvhs.push_back(submesh.bvh(transform));
+			submesh.triangle_boxes(boxes, transform);
 
-		// Generate the BVH
-		return partition(bvhs);
+		return partition(boxes, options);
 	}
 
 	// Populate mesh cache
@@ -162,9 +190,25 @@ struct Mesh {
 
 	static std::optional <std::tuple <Mesh, std::vector <Material>>> load(const std::string &);
 
-	// Caching
-	static void cache_save(const Mesh &, const std::string &);
-	static std::optional <Mesh> cache_load(const std::string &);
+	// Binary cache (see mesh_cache.cpp); entries are stamped with their
+	// source file and the files it depends on (e.g. material libraries),
+	// and cache_load fails if any has changed since. Entries are kept in
+	// cache_directory, or, while it is empty, in the user's cache directory
+	// ($XDG_CACHE_HOME/kobra/meshes, or ~/.cache/kobra/meshes)
+	static std::filesystem::path cache_directory;
+
+	static std::string cache_path(const std::string &);
+
+	static bool cache_save(const std::string &, const std::string &,
+		const std::vector <std::string> &,
+		const Mesh &, const std::vector <Material> &);
+
+	// Called with the number of submeshes, and each submesh (with its
+	// index and material) as soon as it is decoded
+	using CacheCallback = std::function <void (size_t, size_t, const Submesh &, const Material &)>;
+
+	static std::optional <std::tuple <Mesh, std::vector <Material>>>
+		cache_load(const std::string &, const std::string &, const CacheCallback & = nullptr);
 };
 
 using MeshPtr = std::shared_ptr <Mesh>;
@@ -0,0 +1,114 @@
+#ifndef KOBRA_MESH_IMPORT_H_
+#define KOBRA_MESH_IMPORT_H_
+
+// Standard headers
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Engine headers
+#include "mesh.hpp"
+
+namespace kobra {
+
+namespace detail {
+
+// State shared between an import and its handle; see Mesh::load
+struct ImportHooks {
+	std::atomic <size_t>	bytes_parsed { 0 };
+	std::atomic <size_t>	bytes_total { 0 };
+	std::atomic <size_t>	submeshes_done { 0 };
+	std::atomic <size_t>	submeshes_total { 0 };
+
+	std::atomic <bool>	cancel { false };
+
+	// Called on worker threads, once per finished submesh (with its index
+	// in the final mesh)
+	std::function <void (size_t, const Submesh &, const Material &)> finished;
+};
+
+std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::string &, ImportHooks *);
+
+}
+
+// Mesh import running in the background, so that large assets do not block
+// the calling thread; the file is parsed and converted on worker threads,
+// and each submesh is published as soon as it is finished (optimized, with
+// its meshlets and LODs), in completion order
+class MeshImport {
+public:
+	enum class Status {
+		eRunning,
+		eFinished,
+		eCancelled,
+		eFailed
+	};
+
+	// Totals are zero until known
+	struct Progress {
+		size_t	bytes_parsed = 0;
+		size_t	bytes_total = 0;
+		size_t	submeshes_done = 0;
+		size_t	submeshes_total = 0;
+	};
+
+	// Index of the submesh in the final mesh, the submesh and its
+	// material; called on worker threads
+	using Callback = std::function <void (size_t, const Submesh &, const Material &)>;
+
+	using Result = std::optional <std::tuple <Mesh, std::vector <Material>>>;
+private:
+	detail::ImportHooks _hooks;
+
+	std::atomic <Status> _status { Status::eRunning };
+	std::thread _thread;
+
+	// Finished submeshes not yet taken, and the final result
+	mutable std::mutex _mutex;
+	std::vector <std::tuple <size_t, Submesh, Material>> _ready;
+	Result _result;
+
+	MeshImport() = default;
+public:
+	// No copy or move; handles are shared
+	MeshImport(const MeshImport &) = delete;
+	MeshImport &operator=(const MeshImport &) = delete;
+
+	// Cancels the import if it is still running, and waits for it
+	~MeshImport();
+
+	// Begin importing a file; with a callback, every submesh is handed to
+	// it (and take() stays empty), otherwise submeshes are queued for take()
+	static std::shared_ptr <MeshImport> start(const std::string &, const Callback & = nullptr);
+
+	// Properties
+	Status status() const {
+		return _status;
+	}
+
+	bool done() const {
+		return _status != Status::eRunning;
+	}
+
+	Progress progress() const;
+
+	// Stop at the next chunk of the file or submesh; nothing is cached
+	void cancel();
+
+	// Submeshes finished since the last call, for polling from the main
+	// thread (imports without a callback only)
+	std::vector <std::tuple <size_t, Submesh, Material>> take();
+
+	// Block until the import is done, and move out the whole mesh (only
+	// once); empty if the import was cancelled or failed
+	Result get();
+};
+
+}
+
+#endif
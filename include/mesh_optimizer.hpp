@@ -0,0 +1,54 @@
+#ifndef KOBRA_MESH_OPTIMIZER_H_
+#define KOBRA_MESH_OPTIMIZER_H_
+
+// Standard headers
+#include <ostream>
+#include <vector>
+
+// Engine headers
+#include "mesh.hpp"
+
+namespace kobra {
+
+// Index and vertex reordering for the GPU; none of these change the
+// rendered result, only the order of triangles and vertices:
+//
+//	optimize_vertex_cache	Forsyth's linear-speed ordering for a post
+//				transform vertex cache
+//	optimize_overdraw	splits a cache optimized order into clusters and
+//				sorts them front to back from the outside (Sander
+//				et al.), unless that costs more than a factor of
+//				the cache efficiency
+//	optimize_vertex_fetch	reorders vertices in order of first use
+//
+// optimize runs all three, in that order
+std::vector <uint32_t> optimize_vertex_cache(const std::vector <uint32_t> &, size_t);
+std::vector <uint32_t> optimize_overdraw(const std::vector <uint32_t> &, const VertexList &, float = 1.05f);
+void optimize_vertex_fetch(Submesh &);
+void optimize(Submesh &);
+
+// FIFO post transform cache simulation
+struct VertexCacheStats {
+	size_t	triangles = 0;
+	size_t	vertices = 0;		// Distinct vertices referenced
+	size_t	transformed = 0;	// Cache misses
+
+	// Average cache miss ratio, transformed vertices per triangle (at
+	// best about 0.5 for large regular meshes)
+	float acmr() const {
+		return triangles ? float(transformed)/triangles : 0.0f;
+	}
+
+	// Average transform to vertex ratio (at best 1)
+	float atvr() const {
+		return vertices ? float(transformed)/vertices : 0.0f;
+	}
+};
+
+VertexCacheStats vertex_cache_stats(const std::vector <uint32_t> &, size_t, size_t = 16);
+
+std::ostream &operator<<(std::ostream &, const VertexCacheStats &);
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef KOBRA_MESHLET_H_
+#define KOBRA_MESHLET_H_
+
+// Standard headers
+#include <ostream>
+#include <vector>
+
+// Engine headers
+#include "vertex.hpp"
+
+namespace kobra {
+
+// Cluster of at most MeshletOptions::max_vertices vertices and
+// max_triangles triangles of a submesh, with bounds for cluster culling
+struct Meshlet {
+	uint32_t	vertex_offset;		// Into Meshlets::vertices
+	uint32_t	triangle_offset;	// Into Meshlets::triangles, in bytes
+	uint32_t	vertex_count;
+	uint32_t	triangle_count;
+
+	// Bounding sphere
+	glm::vec3	center;
+	float		radius;
+
+	// Normal cone; every triangle normal is within acos(cone_cutoff) of
+	// the axis, and a cutoff of zero or less cannot be culled
+	glm::vec3	cone_axis;
+	float		cone_cutoff;
+};
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet must be 48 bytes");
+
+// Meshlets of one submesh; meshlet vertices index the submesh vertices, and
+// triangles are three local (8-bit) vertex indices each
+struct Meshlets {
+	std::vector <Meshlet>	meshlets;
+	std::vector <uint32_t>	vertices;
+	std::vector <uint8_t>	triangles;
+
+	// Properties
+	bool empty() const {
+		return meshlets.empty();
+	}
+
+	size_t bytes() const {
+		return meshlets.size() * sizeof(Meshlet)
+			+ vertices.size() * sizeof(uint32_t)
+			+ triangles.size();
+	}
+};
+
+struct MeshletOptions {
+	uint32_t	max_vertices = 64;	// At most 256
+	uint32_t	max_triangles = 124;	// At most 512
+
+	// Between 0 and 1; how much triangles that widen the normal cone are
+	// penalized, against triangles far from the cluster center
+	float		cone_weight = 0.5f;
+};
+
+// Greedy clustering; each meshlet is grown from a seed triangle by the
+// adjacent triangle that adds the fewest vertices, then the one that best
+// matches the cluster's normal and position. Works best on indices that
+// are already in vertex cache order (see mesh_optimizer.hpp).
+Meshlets build_meshlets(const VertexList &, const std::vector <uint32_t> &,
+		const MeshletOptions & = {});
+
+// Recompute the bounds of all meshlets, e.g. after the vertices moved
+void meshlet_bounds(Meshlets &, const VertexList &);
+
+// Conservative cone test against a camera position, for the bounds above
+inline bool backfacing(const Meshlet &meshlet, const glm::vec3 &camera)
+{
+	if (meshlet.cone_cutoff <= 0.0f)
+		return false;
+
+	glm::vec3 view = meshlet.center - camera;
+
+	float distance = glm::length(view);
+	if (distance <= meshlet.radius)
+		return false;
+
+	float sine = std::sqrt(1.0f - meshlet.cone_cutoff * meshlet.cone_cutoff);
+	return glm::dot(view, meshlet.cone_axis) >= sine * distance + meshlet.radius;
+}
+
+// Quality metrics
+struct MeshletStats {
+	size_t	meshlets = 0;
+	float	vertex_fill = 0.0f;	// Average fraction of max_vertices used
+	float	triangle_fill = 0.0f;	// Average fraction of max_triangles used
+	float	cone_angle = 0.0f;	// Average cone half angle, in degrees
+	float	cullable = 0.0f;	// Fraction of cones narrower than 90 degrees
+	float	vertex_ratio = 0.0f;	// Meshlet vertices per submesh vertex
+};
+
+MeshletStats statistics(const Meshlets &, const MeshletOptions & = {});
+
+std::ostream &operator<<(std::ostream &, const MeshletStats &);
+
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef KOBRA_PACKED_VERTEX_H_
+#define KOBRA_PACKED_VERTEX_H_
+
+// Standard headers
+#include <ostream>
+#include <vector>
+
+// Engine headers
+#include "mesh.hpp"
+
+namespace kobra {
+
+// Compact vertex layout (20 bytes, against 56 for Vertex):
+//
+//	position	unorm16 x 3, over the bounds of the submesh
+//	sign		unorm16, 0 or 1 after normalization; the bitangent is
+//			(2 sign - 1) cross(normal, tangent)
+//	normal		snorm16 x 2, octahedral
+//	tangent		snorm16 x 2, octahedral
+//	tex_coords	half x 2
+struct PackedVertex {
+	uint16_t	position[3];
+	uint16_t	sign;
+	int16_t		normal[2];
+	int16_t		tangent[2];
+	uint16_t	tex_coords[2];
+
+	// Vertex binding
+	static vk::VertexInputBindingDescription
+		vertex_binding();
+
+	// Get vertex attribute descriptions; locations match those of Vertex,
+	// except that the bitangent (location 4) is reconstructed in the shader
+	static std::vector <vk::VertexInputAttributeDescription>
+		vertex_attributes();
+};
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must be 20 bytes");
+
+// Packed submesh; positions decode as origin + extent * position, and the
+// indices are 16-bit whenever the submesh has fewer than 65536 vertices
+// (only one of the index lists is filled)
+struct PackedSubmesh {
+	glm::vec3			origin;
+	glm::vec3			extent;
+
+	std::vector <PackedVertex>	vertices;
+	std::vector <uint16_t>		indices16;
+	std::vector <uint32_t>		indices32;
+
+	int32_t				material_index = -1;
+
+	// False if the source had no tangents (they decode to zero)
+	bool				tangents = false;
+
+	// Properties
+	size_t indices() const {
+		return indices16.empty() ? indices32.size() : indices16.size();
+	}
+
+	vk::IndexType index_type() const {
+		return indices16.empty() ? vk::IndexType::eUint32 : vk::IndexType::eUint16;
+	}
+
+	size_t bytes() const {
+		return vertices.size() * sizeof(PackedVertex)
+			+ indices16.size() * sizeof(uint16_t)
+			+ indices32.size() * sizeof(uint32_t);
+	}
+};
+
+// Encoding and decoding
+PackedSubmesh pack(const Submesh &);
+Submesh unpack(const PackedSubmesh &);
+
+// Octahedral encoding of unit vectors, exposed for the shaders' reference
+glm::vec2 octahedral_encode(const glm::vec3 &);
+glm::vec3 octahedral_decode(const glm::vec2 &);
+
+// Largest errors after a round trip through the packed layout
+struct PackingError {
+	float	position = 0.0f;	// Distance, in object units
+	float	normal = 0.0f;		// Angle, in degrees
+	float	tangent = 0.0f;		// Angle, in degrees
+	float	bitangent = 0.0f;	// Angle, in degrees (includes handedness)
+	float	tex_coords = 0.0f;	// Absolute difference
+
+	size_t	bytes = 0;		// Size of the source vertices and indices
+	size_t	packed_bytes = 0;
+};
+
+PackingError packing_error(const Submesh &, const PackedSubmesh &);
+
+std::ostream &operator<<(std::ostream &, const PackingError &);
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <queue>
 #include <stack>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace kobra {
@@ -38,6 +39,10 @@ struct Profiler {
 	std::queue <Frame> frames;
 	std::stack <Frame> stack;
 
+	// Whether finished root frames are queued; only the main thread
+	// drains its queue, so worker threads drop theirs (see one)
+	bool retain = true;
+
 	// Default constructor
 	Profiler() = default;
 
@@ -57,8 +62,10 @@ struct Profiler {
 		stack.pop();
 
 		// If frame has no parent, add to queue
-		if (stack.empty())
-			frames.push(frame);
+		if (stack.empty()) {
+			if (retain)
+				frames.push(frame);
+		}
 		else
 			stack.top().children.push_back(frame);
 	}
@@ -122,9 +129,19 @@ struct Profiler {
 		return str;
 	}
 
-	// Singleton
+	// Thread that runs static initialization, i.e. the main thread
+	inline static const std::thread::id main_thread = std::this_thread::get_id();
+
+	// Singleton, per thread; the stack is not synchronized, so events
+	// recorded on worker threads (e.g. background imports, page ins) stay
+	// with them, and are discarded once their root frame ends
 	static Profiler &one() {
-		static Profiler profiler;
+		static thread_local Profiler profiler = [] {
+			Profiler p;
+			p.retain = (std::this_thread::get_id() == main_thread);
+			return p;
+		} ();
+
 		return profiler;
 	}
 };
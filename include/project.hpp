@@ -3,6 +3,7 @@
 // Standard headers
 #include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,7 @@
 // Engine headers
 #include "scene.hpp"
 #include "include/daemons/material.hpp"
+#include "include/project_archive.hpp"
 
 namespace kobra {
 
@@ -26,6 +28,34 @@ struct Project {
 
         MaterialDaemon *material_daemon = nullptr;
 
+        // Set for packed projects (directory is then the archive)
+        std::shared_ptr <ProjectArchive> archive = nullptr;
+
+        // Bytes of submesh data kept in memory for scenes loaded from now on;
+        // above zero, entities whose bounds are recorded start as proxies and
+        // are paged in on demand (see daemons/residency.hpp), otherwise all
+        // geometry is loaded up front
+        size_t residency_budget = 0;
+
+        // Submeshes that are moved, rotated or uniformly scaled copies of
+        // others are saved as references to them; lossy within the
+        // instancing tolerance, so opt-in (see instancing.hpp). Exact
+        // copies are always shared
+        bool instance_similar = false;
+
+        // Scene descriptions are saved in the binary encoding, which loads
+        // without parsing (see scene_description.hpp); for diffs, register
+        // scene_convert as the git textconv driver of .kobra files (see
+        // experimental/scene_convert). Projects that merge scenes by hand
+        // can opt into text instead. Either loads regardless
+        bool binary_scenes = true;
+
+        // Scenes loaded from now on get a CPU BVH (see daemons/bvh.hpp),
+        // whose BLASes are cached next to the submesh files, so that only
+        // geometry not seen by an earlier load is built. Not cached for
+        // packed projects, which are read-only
+        bool scene_bvh = false;
+
 	// Default constructor
 	Project() = default;
 
@@ -56,15 +86,33 @@ struct Project {
 		printf("Loading project from path: %s\n", dir.c_str());
 		std::filesystem::path path = dir;
 
+		// Packed projects are mapped once, and read from memory
+		archive = nullptr;
+		if (is_project_archive(path)) {
+			archive = ProjectArchive::open(path);
+			if (!archive)
+				throw std::runtime_error("Invalid project archive");
+		}
+
+		auto exists = [&](const std::string &name) {
+			if (archive)
+				return archive->find(name).has_value();
+
+			return std::filesystem::exists(path / name);
+		};
+
 		// Project file
-		std::filesystem::path project_file = path / "project.den";
-		if (!std::filesystem::exists(project_file))
+		if (!exists("project.den"))
 			throw std::runtime_error("Project file does not exist");
 
 		// Load the project file
 		std::string token;
 
-		std::ifstream file(project_file);
+		std::stringstream file;
+		if (archive)
+			file << *archive->find("project.den");
+		else
+			file << std::ifstream(path / "project.den").rdbuf();
 
 		int number_of_scenes;
 		file >> token >> number_of_scenes;
@@ -81,7 +129,7 @@ struct Project {
 			printf("Scene %d: %s\n", i, scene_file.c_str());
 
 			// Ensure the scene file exists
-			if (!std::filesystem::exists(path / scene_file))
+			if (!exists(scene_file))
 				throw std::runtime_error("Scene file does not exist");
 		}
 
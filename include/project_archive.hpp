@@ -0,0 +1,92 @@
+#ifndef KOBRA_PROJECT_ARCHIVE_H_
+#define KOBRA_PROJECT_ARCHIVE_H_
+
+// Standard headers
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace kobra {
+
+// Packed project; the files of a project directory (project.den, the scene
+// descriptions, .cache/*.submesh and assets/*.mat) in a single archive, so
+// that loading costs one open and one mapping instead of one open per
+// submesh and material. Files are named by their path relative to the
+// project directory, with forward slashes.
+//
+// Layout: a 64 byte header, the file contents (each aligned to eAlignment),
+// then the table of contents, sorted by name, and the pool of names.
+struct ProjectArchiveHeader {
+	static constexpr uint32_t eMagic = 0x4B41504B;	// "KPAK"
+	static constexpr uint32_t eVersion = 1;
+	static constexpr uint64_t eAlignment = 64;
+
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	entries;
+	uint64_t	toc;		// Offset of the table of contents
+	uint64_t	names;		// Offset of the name pool
+	uint64_t	names_size;
+	uint64_t	reserved[3];
+};
+
+static_assert(sizeof(ProjectArchiveHeader) == 64, "ProjectArchiveHeader must be 64 bytes");
+
+struct ProjectArchiveEntry {
+	uint64_t	offset;
+	uint64_t	size;
+	uint32_t	name;		// Offset into the name pool
+	uint32_t	name_size;
+	uint64_t	reserved;
+};
+
+static_assert(sizeof(ProjectArchiveEntry) == 32, "ProjectArchiveEntry must be 32 bytes");
+
+// Memory mapped archive; views stay valid while the archive is alive
+class ProjectArchive {
+	const uint8_t *_data = nullptr;
+	size_t _size = 0;
+
+	const ProjectArchiveEntry *_entries = nullptr;
+	size_t _count = 0;
+
+	const char *_names = nullptr;
+
+	ProjectArchive() = default;
+public:
+	// No copy or move; archives are shared
+	ProjectArchive(const ProjectArchive &) = delete;
+	ProjectArchive &operator=(const ProjectArchive &) = delete;
+
+	~ProjectArchive();
+
+	// Map an archive, if it exists and passes validation
+	static std::shared_ptr <ProjectArchive> open(const std::filesystem::path &);
+
+	// Properties
+	size_t size() const {
+		return _count;
+	}
+
+	std::string_view name(size_t) const;
+	std::string_view contents(size_t) const;
+
+	// Contents of a file, by name (binary search)
+	std::optional <std::string_view> find(std::string_view) const;
+};
+
+// Archive next to a project directory (<directory>.kpak)
+std::filesystem::path project_archive_path(const std::filesystem::path &);
+
+// Whether a path names a packed project
+bool is_project_archive(const std::filesystem::path &);
+
+// Pack a project directory; the archive is written to a temporary first and
+// renamed, so readers never see partial archives
+bool pack_project(const std::filesystem::path &, const std::filesystem::path &);
+
+}
+
+#endif
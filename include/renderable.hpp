@@ -19,12 +19,27 @@ struct Renderable {
 	std::vector <uint32_t>		index_count;
 	std::vector <uint32_t>		material_indices;
 
+	// LOD levels of each submesh, as (first, count) ranges of its index
+	// buffer after the full detail indices, with their errors, and object
+	// space bounding spheres (center, radius) to select them with; captured
+	// on construction, like the buffers, since the mesh may change later
+	std::vector <std::vector <std::pair <uint32_t, uint32_t>>>
+					lod_ranges;
+	std::vector <std::vector <float>>
+					lod_errors;
+	std::vector <glm::vec4>		bounding_spheres;
+
 	// Mesh itself
         // TODO: distinguish between model and mesh:
         // renderables should contain a set of MESHES
         // that are directly indirected
 	const Mesh *mesh = nullptr;
 
+	// Distinct for every renderable made; caches keyed by entity (or by
+	// address) compare it to notice that the renderable of an entity was
+	// replaced, e.g. when the residency daemon pages its geometry in or out
+	uint64_t generation = 0;
+
 	// No default or copy constructor
 	Renderable() = delete;
 	Renderable(const Renderable &) = delete;
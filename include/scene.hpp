@@ -7,6 +7,8 @@
 #include "backend.hpp"
 #include "system.hpp"
 #include "mesh.hpp"
+#include "daemons/bvh.hpp"
+#include "daemons/residency.hpp"
 
 namespace kobra {
 
@@ -15,6 +17,13 @@ struct Scene {
 	std::string name;
 	std::shared_ptr <System> system;
 
+	// Set if the geometry of (some) entities is paged in on demand
+	std::shared_ptr <ResidencyDaemon> residency;
+
+	// CPU BVH of the scene, for projects that ask for one (see
+	// Project::scene_bvh)
+	std::shared_ptr <BVHDaemon> bvh;
+
 	// Other scene-local data
 	std::string p_environment_map;
 
@@ -0,0 +1,142 @@
+#ifndef KOBRA_SCENE_DESCRIPTION_H_
+#define KOBRA_SCENE_DESCRIPTION_H_
+
+// Standard headers
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Engine headers
+#include "bbox.hpp"
+
+namespace kobra {
+
+// Scene description, as stored in .kobra files: a table of entities, their
+// transforms as a structure of arrays, tables of components, and a pool of
+// the strings (names and files) they refer to by index.
+//
+// Descriptions are encoded either in binary, where every table is one bulk
+// copy, or as text, for diffs; both hold the same information, and convert
+// into each other without loss.
+struct SceneDescription {
+	// Components of an entity, besides its transform
+	enum Flags : uint32_t {
+		eMesh		= 1 << 0,
+		eRenderable	= 1 << 1,
+		eCamera		= 1 << 2,
+	};
+
+	// Submesh of a mesh component: its file (in .cache) and the file of
+	// its material (in assets), the transform from the file for copies
+	// (see instancing.hpp), and the extent that proxies are made from
+	// (see daemons/residency.hpp)
+	struct SubmeshEntry {
+		enum Flags : uint32_t {
+			eInstance	= 1 << 0,
+			eExtent		= 1 << 1,
+		};
+
+		uint64_t	vertices = 0;
+		uint64_t	indices = 0;
+		uint32_t	file = 0;
+		uint32_t	material = 0;
+		uint32_t	flags = 0;
+		uint32_t	reserved = 0;
+		float		rows[12] {};	// Of the 3x4 affine transform
+		float		extent[6] {};	// Minimum, then maximum
+
+		glm::mat4 matrix() const;
+		void set_matrix(const glm::mat4 &);
+
+		BoundingBox bounds() const;
+		void set_bounds(const BoundingBox &, size_t, size_t);
+	};
+
+	static_assert(sizeof(SubmeshEntry) == 104, "SubmeshEntry must be 104 bytes");
+
+	struct CameraEntry {
+		uint32_t	entity;
+		float		fov;
+		float		aspect;
+	};
+
+	static_assert(sizeof(CameraEntry) == 12, "CameraEntry must be 12 bytes");
+	static_assert(sizeof(glm::vec3) == 12, "glm::vec3 must be tightly packed");
+
+	// Entities
+	std::vector <uint32_t> names;
+	std::vector <uint32_t> flags;
+
+	std::vector <glm::vec3> positions;
+	std::vector <glm::vec3> rotations;
+	std::vector <glm::vec3> scales;
+
+	// Submeshes of entity i are [submesh_offsets[i], submesh_offsets[i + 1])
+	std::vector <uint32_t> submesh_offsets { 0 };
+	std::vector <SubmeshEntry> submeshes;
+
+	// Sorted by entity
+	std::vector <CameraEntry> cameras;
+
+	// String i is [string_offsets[i], string_offsets[i + 1]) of the data
+	std::vector <uint32_t> string_offsets { 0 };
+	std::string string_data;
+
+	// Properties
+	size_t size() const {
+		return names.size();
+	}
+
+	std::string_view string(uint32_t index) const {
+		return std::string_view(string_data).substr(string_offsets[index],
+			string_offsets[index + 1] - string_offsets[index]);
+	}
+
+	// Building descriptions; submeshes and cameras are added to the last
+	// entity, and strings are pooled
+	uint32_t add_string(std::string_view);
+	uint32_t add_entity(std::string_view, const glm::vec3 &, const glm::vec3 &, const glm::vec3 &);
+	void add_submesh(const SubmeshEntry &);
+	void add_camera(float, float);
+private:
+	std::unordered_map <std::string, uint32_t> _lookup;
+};
+
+// Binary encoding; a header, then each table in the order above (aligned
+// to 16 bytes), so that decoding is one copy per table and a validation
+// pass over the indices
+struct SceneDescriptionHeader {
+	static constexpr uint32_t eMagic = 0x4E43534B;	// "KSCN"
+	static constexpr uint32_t eVersion = 1;
+	static constexpr uint64_t eAlignment = 16;
+
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	entities;
+	uint32_t	submeshes;
+	uint32_t	cameras;
+	uint32_t	strings;
+	uint64_t	string_bytes;
+	uint64_t	reserved[4];
+};
+
+static_assert(sizeof(SceneDescriptionHeader) == 64, "SceneDescriptionHeader must be 64 bytes");
+
+// Whether the contents of a .kobra file are binary
+bool is_binary_scene(std::string_view);
+
+std::string encode_scene(const SceneDescription &);
+std::optional <SceneDescription> decode_scene(std::string_view);
+
+std::string write_scene_text(const SceneDescription &);
+std::optional <SceneDescription> read_scene_text(std::string_view);
+
+// Either encoding, detected from the contents
+std::optional <SceneDescription> read_scene(std::string_view);
+
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef KOBRA_TANGENTS_H_
+#define KOBRA_TANGENTS_H_
+
+// Standard headers
+#include <vector>
+
+// Engine headers
+#include "vertex.hpp"
+
+namespace kobra {
+
+// Whether any vertex has a tangent, i.e. the source provided them
+bool has_tangents(const VertexList &);
+
+// Per vertex tangent frames from the texture coordinates, in O(V + F);
+// triangle frames are computed four at a time (with SSE where the target
+// has it; simd = false forces the scalar kernel) and accumulated with
+// area weights, then made orthonormal against the vertex normals. Triangles
+// with mirrored UVs are accumulated apart from the rest, and a vertex shared
+// by both (on the mirror seam) takes the frame of the side with the most
+// area, with the bitangent flipped to match; vertices without usable UVs get
+// an arbitrary frame around the normal.
+void generate_tangents(VertexList &, const std::vector <uint32_t> &, bool simd = true);
+
+}
+
+#endif
@@ -1,7 +1,431 @@
+// Standard headers
+#include <algorithm>
+#include <atomic>
+
+// Engine headers
 #include "../include/bvh.hpp"
+#include "bvh/common.hpp"
 
 namespace kobra {
 
+using detail::Bounds;
+using detail::make_leaf;
+
+//////////////
+// Flat BVH //
+//////////////
+
+// Binned SAH construction parameters
+static constexpr int eBins = 16;
+static constexpr uint32_t eMaxLeafSize = 4;
+static constexpr uint32_t eParallelThreshold = 1 << 12;
+static constexpr float eTraversalCost = 1.0f;
+
+// A bin holds the primitive count, the primitive bounds and the centroid
+// bounds of everything that falls into it
+struct Bin {
+	uint32_t count = 0;
+	Bounds bounds;
+	Bounds centroids;
+};
+
+// State shared by all the tasks of one build
+struct BinnedBuilder {
+	const std::vector <BoundingBox> &boxes;
+	std::vector <glm::vec3> centroids;
+	BVH &bvh;
+
+	// Sibling pairs are carved out of the preallocated arena
+	std::atomic <uint32_t> next { 1 };
+
+	BinnedBuilder(const std::vector <BoundingBox> &boxes_, BVH &bvh_)
+			: boxes(boxes_), bvh(bvh_) {}
+};
+
+// Range of primitives to be turned into a subtree
+struct BuildTask {
+	uint32_t index;
+	uint32_t begin;
+	uint32_t end;
+	Bounds bounds;
+	Bounds centroids;
+};
+
+// Bin index of a centroid along an axis
+static inline int bin_index(float c, float min, float scale, int bins)
+{
+	int b = (c - min) * scale;
+	return std::min(std::max(b, 0), bins - 1);
+}
+
+// Build the subtree for a range of primitives; subtrees larger than the
+// parallel threshold are spawned as tasks of the subflow, if given
+static void build(BinnedBuilder &builder, BuildTask task, tf::Subflow *subflow)
+{
+	BVH::Node &node = builder.bvh.nodes[task.index];
+	uint32_t count = task.end - task.begin;
+
+	glm::vec3 extent = task.centroids.max - task.centroids.min;
+
+	int axis = 0;
+	if (extent.y > extent[axis])
+		axis = 1;
+	if (extent.z > extent[axis])
+		axis = 2;
+
+	// Small ranges, or coincident centroids that can not be told apart
+	if (count <= 1 || (extent[axis] <= 0.0f && count <= eMaxLeafSize)) {
+		make_leaf(node, task.bounds, task.begin, count);
+		return;
+	}
+
+	uint32_t *prims = builder.bvh.primitives.data();
+
+	// One pass to fill the bins along the axis of largest centroid extent;
+	// small ranges use fewer bins
+	Bin bins[eBins];
+
+	int nbins = std::min <uint32_t> (eBins, std::max <uint32_t> (count, 4));
+	float min = task.centroids.min[axis];
+	float scale = extent[axis] > 0.0f ? nbins / extent[axis] : 0.0f;
+
+	for (uint32_t i = task.begin; i < task.end; i++) {
+		uint32_t p = prims[i];
+
+		const BoundingBox &box = builder.boxes[p];
+		const glm::vec3 &c = builder.centroids[p];
+
+		Bin &bin = bins[bin_index(c[axis], min, scale, nbins)];
+		bin.count++;
+		bin.bounds.extend(box.min, box.max);
+		bin.centroids.extend(c);
+	}
+
+	// Sweep suffix then prefix areas to find the cheapest split plane
+	float best_cost = std::numeric_limits <float> ::max();
+	int best_split = -1;
+
+	float right_cost[eBins];
+
+	Bounds right_bounds;
+	uint32_t right_count = 0;
+	for (int b = nbins - 1; b > 0; b--) {
+		right_bounds.extend(bins[b].bounds);
+		right_count += bins[b].count;
+		right_cost[b] = right_count * right_bounds.area();
+	}
+
+	Bounds left_bounds;
+	uint32_t left_count = 0;
+	for (int b = 0; b < nbins - 1 && extent[axis] > 0.0f; b++) {
+		left_bounds.extend(bins[b].bounds);
+		left_count += bins[b].count;
+
+		// Empty sides are not splits
+		if (left_count == 0 || left_count == count)
+			continue;
+
+		float cost = left_count * left_bounds.area() + right_cost[b + 1];
+		if (cost < best_cost) {
+			best_cost = cost;
+			best_split = b + 1;
+		}
+	}
+
+	float area = task.bounds.area();
+	float split_cost = eTraversalCost + (area > 0.0f ? best_cost / area : 0.0f);
+
+	// Leaf if splitting does not pay off
+	if (count <= eMaxLeafSize && (best_split < 0 || split_cost >= count)) {
+		make_leaf(node, task.bounds, task.begin, count);
+		return;
+	}
+
+	// Partition in place, with bounds for the children gathered from the
+	// bins; falls back to a median split if no plane separates the range
+	BuildTask left { 0, task.begin, 0 };
+	BuildTask right { 0, 0, task.end };
+
+	if (best_split >= 0) {
+		uint32_t *pivot = std::partition(prims + task.begin, prims + task.end,
+			[&](uint32_t p) {
+				return bin_index(builder.centroids[p][axis], min, scale, nbins) < best_split;
+			}
+		);
+
+		left.end = right.begin = pivot - prims;
+		for (int b = 0; b < nbins; b++) {
+			BuildTask &side = (b < best_split) ? left : right;
+			side.bounds.extend(bins[b].bounds);
+			side.centroids.extend(bins[b].centroids);
+		}
+	} else {
+		left.end = right.begin = task.begin + count / 2;
+		for (uint32_t i = task.begin; i < task.end; i++) {
+			BuildTask &side = (i < left.end) ? left : right;
+			const BoundingBox &box = builder.boxes[prims[i]];
+			side.bounds.extend(box.min, box.max);
+			side.centroids.extend(builder.centroids[prims[i]]);
+		}
+	}
+
+	// Children are allocated as a sibling pair
+	uint32_t children = builder.next.fetch_add(2);
+	left.index = children;
+	right.index = children + 1;
+
+	node.min = task.bounds.min;
+	node.max = task.bounds.max;
+	node.left = left.index;
+	node.right = right.index;
+
+	for (const BuildTask &child : { left, right }) {
+		if (subflow && child.end - child.begin >= eParallelThreshold) {
+			subflow->emplace([&builder, child](tf::Subflow &sf) {
+				build(builder, child, &sf);
+			});
+		} else {
+			build(builder, child, nullptr);
+		}
+	}
+}
+
+// Binned SAH construction; large builds fan out across the worker threads
+static BVH binned_sah(const std::vector <BoundingBox> &bboxes)
+{
+	BVH bvh;
+	if (bboxes.empty())
+		return bvh;
+
+	uint32_t n = bboxes.size();
+
+	BinnedBuilder builder(bboxes, bvh);
+	builder.centroids.resize(n);
+
+	BuildTask root { 0, 0, n };
+
+	bvh.primitives.resize(n);
+	for (uint32_t i = 0; i < n; i++) {
+		const BoundingBox &box = bboxes[i];
+
+		bvh.primitives[i] = i;
+		builder.centroids[i] = (box.min + box.max) / 2.0f;
+
+		root.bounds.extend(box.min, box.max);
+		root.centroids.extend(builder.centroids[i]);
+	}
+
+	// A binary tree has at most 2n - 1 nodes; the arena is trimmed after
+	bvh.nodes.resize(2 * n - 1);
+
+	if (n < eParallelThreshold) {
+		build(builder, root, nullptr);
+	} else {
+		tf::Taskflow taskflow;
+		taskflow.emplace([&](tf::Subflow &sf) {
+			build(builder, root, &sf);
+		});
+
+		detail::bvh_executor().run(taskflow).wait();
+	}
+
+	bvh.nodes.resize(builder.next);
+	bvh.nodes.shrink_to_fit();
+
+	return bvh;
+}
+
+// Construct a flat BVH over a list of bounding boxes
+BVH partition(const std::vector <BoundingBox> &bboxes, const BVHOptions &options)
+{
+	if (options.mode == BVHBuild::eLBVH)
+		return detail::lbvh(bboxes, options.optimize_treelets);
+
+	if (options.mode == BVHBuild::eSBVH) {
+		KOBRA_LOG_FUNC(Log::WARN) << "Spatial splits need triangles,"
+			" falling back to binned SAH\n";
+	}
+
+	return binned_sah(bboxes);
+}
+
+// Construct a flat BVH over a list of triangles
+BVH partition(const std::vector <glm::vec3> &triangles, const BVHOptions &options)
+{
+	if (options.mode == BVHBuild::eSBVH)
+		return detail::sbvh(triangles, options.duplication_budget);
+
+	std::vector <BoundingBox> bboxes(triangles.size()/3);
+	for (size_t i = 0; i < bboxes.size(); i++) {
+		const glm::vec3 *v = &triangles[3 * i];
+		bboxes[i].min = glm::min(v[0], glm::min(v[1], v[2]));
+		bboxes[i].max = glm::max(v[0], glm::max(v[1], v[2]));
+	}
+
+	return partition(bboxes, options);
+}
+
+// Expected cost of a ray traversing the BVH, with unit node and primitive
+// costs, along with reference counts
+BVHStats statistics(const BVH &bvh)
+{
+	BVHStats stats;
+	if (bvh.empty())
+		return stats;
+
+	float root = detail::area(bvh.nodes[0]);
+
+	double cost = 0.0;
+	for (const BVH::Node &node : bvh.nodes) {
+		float a = detail::area(node);
+		if (node.is_leaf())
+			cost += a * node.count();
+		else
+			cost += a * eTraversalCost;
+	}
+
+	stats.sah_cost = root > 0.0f ? cost/root : 0.0f;
+
+	// Unique primitives
+	std::vector <bool> seen;
+	for (uint32_t primitive : bvh.primitives) {
+		if (primitive >= seen.size())
+			seen.resize(primitive + 1);
+
+		if (!seen[primitive]) {
+			seen[primitive] = true;
+			stats.primitives++;
+		}
+	}
+
+	stats.references = bvh.primitives.size();
+	return stats;
+}
+
+// Serialized records of a node: leaves with several primitives are written
+// as a box record followed by a chain of single primitive records
+static inline uint32_t serialized_records(const BVH::Node &node)
+{
+	if (node.is_leaf() && node.count() > 1)
+		return 1 + node.count();
+
+	return 1;
+}
+
+// Pre-order of the nodes, without recursion
+static std::vector <uint32_t> preorder(const BVH &bvh)
+{
+	std::vector <uint32_t> order;
+	order.reserve(bvh.nodes.size());
+
+	std::vector <uint32_t> stack { 0 };
+	while (!stack.empty()) {
+		uint32_t index = stack.back();
+		stack.pop_back();
+
+		order.push_back(index);
+
+		const BVH::Node &node = bvh.nodes[index];
+		if (!node.is_leaf()) {
+			stack.push_back(node.right);
+			stack.push_back(node.left);
+		}
+	}
+
+	return order;
+}
+
+size_t BVH::serialized_size() const
+{
+	size_t records = 0;
+	for (const Node &node : nodes)
+		records += serialized_records(node);
+
+	return 3 * records;
+}
+
+// Write a single threaded record
+static inline void write_record(aligned_vec4 *dst, bool leaf, int32_t object,
+		int32_t hit, int32_t miss, const glm::vec3 &min, const glm::vec3 &max)
+{
+	dst[0] = glm::vec4 {
+		leaf ? 1.0f : 0.0f,
+		*reinterpret_cast <float *> (&object),
+		*reinterpret_cast <float *> (&hit),
+		*reinterpret_cast <float *> (&miss)
+	};
+
+	dst[1] = min;
+	dst[2] = max;
+}
+
+// Serialize a flat BVH to a vector of vec4s
+void serialize(std::vector <aligned_vec4> &buffer, const BVH &bvh, int miss)
+{
+	if (bvh.empty())
+		return;
+
+	// Subtree sizes (in records), accumulated in reverse pre-order
+	std::vector <uint32_t> order = preorder(bvh);
+	std::vector <uint32_t> size(bvh.nodes.size());
+
+	for (auto it = order.rbegin(); it != order.rend(); it++) {
+		const BVH::Node &node = bvh.nodes[*it];
+
+		size[*it] = serialized_records(node);
+		if (!node.is_leaf())
+			size[*it] += size[node.left] + size[node.right];
+	}
+
+	// Absolute positions and miss links, assigned in pre-order
+	int32_t base = buffer.size();
+	buffer.resize(base + 3 * size[0]);
+
+	std::vector <int32_t> position(bvh.nodes.size());
+	std::vector <int32_t> misses(bvh.nodes.size());
+
+	position[0] = base;
+	misses[0] = miss;
+
+	for (uint32_t index : order) {
+		const BVH::Node &node = bvh.nodes[index];
+
+		int32_t at = position[index];
+		int32_t next = misses[index];
+
+		if (!node.is_leaf()) {
+			position[node.left] = at + 3;
+			position[node.right] = at + 3 + 3 * size[node.left];
+			misses[node.left] = position[node.right];
+			misses[node.right] = next;
+
+			write_record(&buffer[at], false, -1,
+				position[node.left], next, node.min, node.max);
+		} else if (node.count() == 1) {
+			int32_t object = bvh.primitives[node.first()];
+			write_record(&buffer[at], true, object,
+				next, next, node.min, node.max);
+		} else {
+			// Box record, then one record per primitive
+			write_record(&buffer[at], false, -1,
+				at + 3, next, node.min, node.max);
+
+			for (uint32_t i = 0; i < node.count(); i++) {
+				int32_t object = bvh.primitives[node.first() + i];
+				int32_t record = at + 3 * (i + 1);
+				int32_t after = (i + 1 < node.count()) ? record + 3 : next;
+
+				write_record(&buffer[record], true, object,
+					after, after, node.min, node.max);
+			}
+		}
+	}
+}
+
+////////////////
+// Legacy BVH //
+////////////////
+
 // Node
 bool BVHNode::is_leaf() const
 {
@@ -194,21 +618,6 @@ BVHPtr partition(const std::vector <BVHPtr> &nodes)
 	return node;
 }
 
-// Overload with a vector of bounding boxes (convert them to BVH nodes)
-BVHPtr partition(const std::vector <BoundingBox> &bboxes)
-{
-	std::vector <BVHPtr> nodes;
-
-	for (size_t i = 0; i < bboxes.size(); i++) {
-		BVHPtr node = std::make_shared <BVHNode> ();
-		node->bbox = bboxes[i];
-		node->object = i;
-		nodes.push_back(node);
-	}
-
-	return partition(nodes);
-}
-
 // Serialize a BVH to a vector of vec4s
 void serialize(std::vector <aligned_vec4> &buffer, const BVHPtr &bvh, int miss)
 {
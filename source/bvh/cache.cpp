@@ -0,0 +1,247 @@
+// Standard headers
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// Engine headers
+#include "common.hpp"
+#include "include/bvh/cache.hpp"
+#include "include/core/flat_map.hpp"
+
+namespace kobra {
+
+uint64_t bvh_cache_key(uint64_t content, const Submesh &submesh, const BVHOptions &options)
+{
+	uint32_t budget;
+	std::memcpy(&budget, &options.duplication_budget, sizeof(float));
+
+	// Only SBVH builds depend on the budget
+	uint64_t fields[6] = {
+		BVHCacheHeader::eVersion,
+		submesh.vertices.size() * sizeof(Vertex),
+		submesh.indices.size() * sizeof(uint32_t),
+		uint64_t(options.mode),
+		uint64_t(options.optimize_treelets),
+		(options.mode == BVHBuild::eSBVH) ? budget : 0u
+	};
+
+	return core::hash_words(fields, sizeof(fields), content);
+}
+
+std::filesystem::path bvh_cache_path(const std::filesystem::path &directory, uint64_t key)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "bvh-%016llx.bvh", (unsigned long long) key);
+	return directory / name;
+}
+
+// Whether every child comes after its parent
+static bool parents_first(const BVH &bvh)
+{
+	for (size_t i = 0; i < bvh.nodes.size(); i++) {
+		const BVH::Node &node = bvh.nodes[i];
+		if (!node.is_leaf() && (node.left <= i || node.right <= i))
+			return false;
+	}
+
+	return true;
+}
+
+// Same tree, with the children of every node allocated as a sibling pair
+// after it (as the binned SAH builder does); LBVH trees keep their internal
+// nodes ahead of the leaves, in any order
+static BVH relayout(const BVH &bvh)
+{
+	BVH result;
+	result.primitives = bvh.primitives;
+	result.nodes.reserve(bvh.nodes.size());
+	result.nodes.push_back(bvh.nodes[0]);
+
+	std::vector <uint32_t> stack { 0 };
+	while (!stack.empty()) {
+		uint32_t index = stack.back();
+		stack.pop_back();
+
+		BVH::Node node = result.nodes[index];
+		if (node.is_leaf())
+			continue;
+
+		uint32_t children = result.nodes.size();
+		result.nodes.push_back(bvh.nodes[node.left]);
+		result.nodes.push_back(bvh.nodes[node.right]);
+
+		result.nodes[index].left = children;
+		result.nodes[index].right = children + 1;
+
+		stack.push_back(children + 1);
+		stack.push_back(children);
+	}
+
+	return result;
+}
+
+bool bvh_cache_save(const std::filesystem::path &path, const BVH &bvh_,
+		uint64_t key, uint64_t content, const Submesh &submesh)
+{
+	// Entries are stored parents first, as validate() expects
+	std::optional <BVH> relaid;
+	if (!parents_first(bvh_))
+		relaid = relayout(bvh_);
+
+	const BVH &bvh = relaid ? *relaid : bvh_;
+
+	BVHCacheHeader header {};
+	header.magic = BVHCacheHeader::eMagic;
+	header.version = BVHCacheHeader::eVersion;
+	header.key = key;
+	header.content = content;
+	header.nodes = bvh.nodes.size();
+	header.primitives = bvh.primitives.size();
+	header.vertices = submesh.vertices.size();
+	header.indices = submesh.indices.size();
+
+	std::filesystem::path tmp = path;
+	tmp += ".tmp";
+
+	std::ofstream file(tmp, std::ios::binary);
+	if (!file.is_open()) {
+		KOBRA_LOG_FUNC(Log::WARN) << "Could not write BVH cache file " << tmp << "\n";
+		return false;
+	}
+
+	file.write((const char *) &header, sizeof(header));
+	file.write((const char *) bvh.nodes.data(), bvh.nodes.size() * sizeof(BVH::Node));
+	file.write((const char *) bvh.primitives.data(), bvh.primitives.size() * sizeof(uint32_t));
+	file.close();
+
+	if (!file) {
+		std::filesystem::remove(tmp);
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tmp, path, error);
+	return !error;
+}
+
+// Structural checks, so that a corrupt file can never send traversal out of
+// bounds or into a cycle: children come after their parent (as all builders
+// lay them out) and every node but the root is referenced exactly once, so
+// the nodes form a tree
+static bool validate(const BVH &bvh, size_t triangles)
+{
+	size_t nodes = bvh.nodes.size();
+	size_t primitives = bvh.primitives.size();
+
+	std::vector <uint8_t> referenced(nodes, 0);
+
+	for (size_t i = 0; i < nodes; i++) {
+		const BVH::Node &node = bvh.nodes[i];
+		if (node.is_leaf()) {
+			if (size_t(node.first()) + node.count() > primitives)
+				return false;
+
+			continue;
+		}
+
+		for (uint32_t child : { node.left, node.right }) {
+			if (child <= i || child >= nodes || referenced[child])
+				return false;
+
+			referenced[child] = 1;
+		}
+	}
+
+	for (size_t i = 1; i < nodes; i++) {
+		if (!referenced[i])
+			return false;
+	}
+
+	for (uint32_t primitive : bvh.primitives) {
+		if (primitive >= triangles)
+			return false;
+	}
+
+	return true;
+}
+
+// Entries are read straight into the node and primitive arrays
+std::optional <BVH> bvh_cache_load(const std::filesystem::path &path,
+		uint64_t key, uint64_t content, const Submesh &submesh)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return std::nullopt;
+
+	size_t size = file.tellg();
+	file.seekg(0);
+
+	BVHCacheHeader header;
+	if (size < sizeof(header) || !file.read((char *) &header, sizeof(header)))
+		return std::nullopt;
+
+	std::optional <BVH> result;
+
+	bool valid = header.magic == BVHCacheHeader::eMagic
+		&& header.version == BVHCacheHeader::eVersion
+		&& header.key == key
+		&& header.content == content
+		&& header.vertices == submesh.vertices.size()
+		&& header.indices == submesh.indices.size()
+		&& header.nodes <= size && header.primitives <= size
+		&& sizeof(BVHCacheHeader)
+			+ header.nodes * sizeof(BVH::Node)
+			+ header.primitives * sizeof(uint32_t) == size;
+
+	if (valid) {
+		BVH bvh;
+		bvh.nodes.resize(header.nodes);
+		bvh.primitives.resize(header.primitives);
+
+		file.read((char *) bvh.nodes.data(), header.nodes * sizeof(BVH::Node));
+		file.read((char *) bvh.primitives.data(), header.primitives * sizeof(uint32_t));
+
+		if (file && validate(bvh, submesh.triangles()))
+			result = std::move(bvh);
+	}
+
+	if (!result) {
+		KOBRA_LOG_FUNC(Log::WARN) << "Discarding invalid BVH cache file "
+			<< path << "\n";
+	}
+
+	return result;
+}
+
+std::optional <uint64_t> bvh_cache_content(const std::filesystem::path &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return std::nullopt;
+
+	BVHCacheHeader header;
+	if (!file.read((char *) &header, sizeof(header))
+			|| header.magic != BVHCacheHeader::eMagic
+			|| header.version != BVHCacheHeader::eVersion)
+		return std::nullopt;
+
+	return header.content;
+}
+
+BVH cached_bvh(const std::filesystem::path &directory, const Submesh &submesh, const BVHOptions &options)
+{
+	uint64_t content = submesh.hash();
+	uint64_t key = bvh_cache_key(content, submesh, options);
+	std::filesystem::path path = bvh_cache_path(directory, key);
+
+	auto cached = bvh_cache_load(path, key, content, submesh);
+	if (cached)
+		return std::move(*cached);
+
+	BVH bvh = submesh.bvh(Transform {}, options);
+	bvh_cache_save(path, bvh, key, content, submesh);
+
+	return bvh;
+}
+
+}
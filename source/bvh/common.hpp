@@ -0,0 +1,297 @@
+#pragma once
+
+// Standard headers
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Taskflow headers
+#include <taskflow/taskflow.hpp>
+
+// Engine headers
+#include "include/bvh.hpp"
+
+// Helpers shared by the BVH builders
+namespace kobra {
+
+namespace detail {
+
+// Box accumulator for the builders
+struct Bounds {
+	glm::vec3 min = glm::vec3(std::numeric_limits <float> ::max());
+	glm::vec3 max = glm::vec3(-std::numeric_limits <float> ::max());
+
+	void extend(const glm::vec3 &p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void extend(const glm::vec3 &lo, const glm::vec3 &hi) {
+		min = glm::min(min, lo);
+		max = glm::max(max, hi);
+	}
+
+	void extend(const Bounds &b) {
+		extend(b.min, b.max);
+	}
+
+	float area() const {
+		glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+		return 2.0f * (d.x * d.y + d.y * d.z + d.x * d.z);
+	}
+};
+
+// Surface area of a node
+inline float area(const BVH::Node &node)
+{
+	glm::vec3 d = glm::max(node.max - node.min, glm::vec3(0.0f));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.x * d.z);
+}
+
+// Make a leaf node for a range of primitives
+inline void make_leaf(BVH::Node &node, const Bounds &bounds,
+		uint32_t first, uint32_t count)
+{
+	node.min = bounds.min;
+	node.max = bounds.max;
+	node.left = first;
+	node.right = count | BVH::Node::eLeaf;
+}
+
+// Executor shared by all builds, so that worker threads are only spawned once
+inline tf::Executor &bvh_executor()
+{
+	static tf::Executor executor;
+	return executor;
+}
+
+// Number of chunks a range is split into for parallel loops
+inline uint32_t chunk_count(uint32_t count)
+{
+	uint32_t chunks = std::max <uint32_t> (1, bvh_executor().num_workers());
+	return std::min(chunks, std::max <uint32_t> (1, count / 1024));
+}
+
+// Run a function over [0, count) in contiguous chunks, as given by
+// chunk_count(); the function receives the chunk index and its range
+template <class F>
+void parallel_chunks(uint32_t count, const F &f)
+{
+	uint32_t chunks = chunk_count(count);
+	uint32_t size = (count + chunks - 1) / chunks;
+
+	if (chunks == 1) {
+		f(0, 0, count);
+		return;
+	}
+
+	tf::Taskflow taskflow;
+	for (uint32_t c = 0; c < chunks; c++) {
+		uint32_t begin = std::min(count, c * size);
+		uint32_t end = std::min(count, begin + size);
+		taskflow.emplace([&f, c, begin, end]() {
+			f(c, begin, end);
+		});
+	}
+
+	bvh_executor().run(taskflow).wait();
+}
+
+// Spread the lower 10 bits of an integer so that there are two zero bits
+// between each of them
+inline uint32_t expand_bits(uint32_t v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// 30-bit Morton code of a point in the unit cube
+inline uint32_t morton(const glm::vec3 &p)
+{
+	glm::vec3 q = glm::clamp(p * 1024.0f, 0.0f, 1023.0f);
+	return (expand_bits(q.x) << 2) | (expand_bits(q.y) << 1) | expand_bits(q.z);
+}
+
+// Min and max with the semantics of the SSE instructions (the second operand
+// is returned if either is NaN), so that scalar and SIMD slab tests agree
+// bit for bit
+inline float min_ps(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+inline float max_ps(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+// Ray with precomputed reciprocal direction and octant
+struct RayData {
+	glm::vec3	origin;
+	glm::vec3	direction;
+	glm::vec3	inv;
+	bool		negative[3];
+
+	RayData() = default;
+
+	RayData(const Ray &ray)
+			: origin(ray.origin), direction(ray.direction) {
+		inv = glm::vec3(1.0f)/direction;
+		for (int i = 0; i < 3; i++)
+			negative[i] = std::signbit(direction[i]);
+	}
+};
+
+// Traversal stack; the first N entries live on the stack frame, and deeper
+// trees than the builders produce (e.g. from caches or other tools) spill to
+// the heap instead of overflowing
+template <class T, int N>
+struct TraversalStack {
+	T local[N];
+	std::vector <T> heap;
+
+	T *data = local;
+	int capacity = N;
+	int size = 0;
+
+	TraversalStack() = default;
+	TraversalStack(const TraversalStack &) = delete;
+	TraversalStack &operator=(const TraversalStack &) = delete;
+
+	bool empty() const {
+		return size == 0;
+	}
+
+	void push(const T &value) {
+		if (size == capacity)
+			grow();
+
+		data[size++] = value;
+	}
+
+	T pop() {
+		return data[--size];
+	}
+
+	T &operator[](int i) {
+		return data[i];
+	}
+
+	void grow() {
+		if (heap.empty())
+			heap.assign(local, local + size);
+
+		capacity *= 2;
+		heap.resize(capacity);
+		data = heap.data();
+	}
+};
+
+// Slab test; the near planes are chosen by the ray octant, so inverted boxes
+// never intersect
+inline bool slab(const RayData &ray, const glm::vec3 &min, const glm::vec3 &max,
+		float tmax, float &tnear)
+{
+	float t0x = ((ray.negative[0] ? max.x : min.x) - ray.origin.x) * ray.inv.x;
+	float t0y = ((ray.negative[1] ? max.y : min.y) - ray.origin.y) * ray.inv.y;
+	float t0z = ((ray.negative[2] ? max.z : min.z) - ray.origin.z) * ray.inv.z;
+
+	float t1x = ((ray.negative[0] ? min.x : max.x) - ray.origin.x) * ray.inv.x;
+	float t1y = ((ray.negative[1] ? min.y : max.y) - ray.origin.y) * ray.inv.y;
+	float t1z = ((ray.negative[2] ? min.z : max.z) - ray.origin.z) * ray.inv.z;
+
+	tnear = max_ps(max_ps(t0x, t0y), max_ps(t0z, 0.0f));
+	float tfar = min_ps(min_ps(t1x, t1y), min_ps(t1z, tmax));
+
+	return tnear <= tfar;
+}
+
+// Moller-Trumbore ray-triangle intersection; only hits in (0, tmax) count
+inline bool intersect_triangle(const RayData &ray,
+		const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+		float tmax, float &t, float &u, float &v)
+{
+	glm::vec3 e1 = b - a;
+	glm::vec3 e2 = c - a;
+
+	glm::vec3 p = glm::cross(ray.direction, e2);
+	float det = glm::dot(e1, p);
+	if (det == 0.0f)
+		return false;
+
+	float inv_det = 1.0f/det;
+
+	glm::vec3 s = ray.origin - a;
+	u = glm::dot(s, p) * inv_det;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	glm::vec3 q = glm::cross(s, e1);
+	v = glm::dot(ray.direction, q) * inv_det;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	t = glm::dot(e2, q) * inv_det;
+	return t > 0.0f && t < tmax;
+}
+
+// Test a ray against a range of primitives, keeping the closest hit; ties
+// go to the lowest primitive index, so that the result does not depend on
+// the order in which a traversal visits the leaves
+inline bool intersect_leaf(const RayData &ray, const std::vector <glm::vec3> &triangles,
+		const uint32_t *primitives, uint32_t count, Hit &hit)
+{
+	constexpr float inf = std::numeric_limits <float> ::infinity();
+
+	bool found = false;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t primitive = primitives[i];
+
+		float t, u, v;
+		if (!intersect_triangle(ray,
+				triangles[3 * primitive + 0],
+				triangles[3 * primitive + 1],
+				triangles[3 * primitive + 2],
+				inf, t, u, v))
+			continue;
+
+		// Equal distances only tie with an actual hit, never with tmax
+		bool tie = t == hit.t && hit.primitive != ~0u && primitive < hit.primitive;
+		if (t < hit.t || tie) {
+			hit.t = t;
+			hit.u = u;
+			hit.v = v;
+			hit.primitive = primitive;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+// Occlusion variant of the above
+inline bool occluded_leaf(const RayData &ray, const std::vector <glm::vec3> &triangles,
+		const uint32_t *primitives, uint32_t count, float tmax)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t primitive = primitives[i];
+
+		float t, u, v;
+		if (intersect_triangle(ray,
+				triangles[3 * primitive + 0],
+				triangles[3 * primitive + 1],
+				triangles[3 * primitive + 2],
+				tmax, t, u, v))
+			return true;
+	}
+
+	return false;
+}
+
+}
+
+}
@@ -0,0 +1,216 @@
+// Standard headers
+#include <cmath>
+#include <cstring>
+
+// Engine headers
+#include "common.hpp"
+#include "simd.hpp"
+#include "include/bvh/compressed.hpp"
+
+// Quantized BVH4 encoding and traversal
+namespace kobra {
+
+// Grid cell size of an axis; built from the exponent bits directly, since
+// this is on the traversal path
+static inline float cell_size(int8_t exponent)
+{
+	uint32_t bits = uint32_t(exponent + 127) << 23;
+
+	float scale;
+	std::memcpy(&scale, &bits, sizeof(float));
+	return scale;
+}
+
+static inline float dequantize(float origin, float scale, uint8_t q)
+{
+	return origin + float(q) * scale;
+}
+
+// Smallest power of two cell size that lets 255 cells cover [lo, hi]
+static int8_t choose_exponent(float lo, float hi)
+{
+	float extent = hi - lo;
+
+	int e = -126;
+	if (extent > 0.0f) {
+		int exp;
+		std::frexp(extent/255.0f, &exp);
+		e = std::max(exp - 1, -126);
+	}
+
+	// Account for rounding of the origin
+	while (e < 127 && dequantize(lo, cell_size(e), 255) < hi)
+		e++;
+
+	return e;
+}
+
+static void encode(const BVH4::Node &wide, CompressedBVH::Node &node)
+{
+	constexpr float inf = std::numeric_limits <float> ::infinity();
+
+	// Bounds of the valid children
+	const float *mins[3] = { wide.min_x, wide.min_y, wide.min_z };
+	const float *maxs[3] = { wide.max_x, wide.max_y, wide.max_z };
+
+	uint8_t *qmins[3] = { node.qmin_x, node.qmin_y, node.qmin_z };
+	uint8_t *qmaxs[3] = { node.qmax_x, node.qmax_y, node.qmax_z };
+
+	for (int axis = 0; axis < 3; axis++) {
+		float lo = inf;
+		float hi = -inf;
+
+		for (int i = 0; i < 4; i++) {
+			if (mins[axis][i] > maxs[axis][i])
+				continue;
+
+			lo = std::min(lo, mins[axis][i]);
+			hi = std::max(hi, maxs[axis][i]);
+		}
+
+		if (lo > hi)
+			lo = hi = 0.0f;
+
+		node.origin[axis] = lo;
+		node.exponent[axis] = choose_exponent(lo, hi);
+
+		float scale = cell_size(node.exponent[axis]);
+
+		for (int i = 0; i < 4; i++) {
+			float cmin = mins[axis][i];
+			float cmax = maxs[axis][i];
+
+			// Empty slot
+			if (cmin > cmax) {
+				qmins[axis][i] = 255;
+				qmaxs[axis][i] = 0;
+				continue;
+			}
+
+			// Round outwards, then fix up for float rounding
+			int qmin = std::floor((cmin - lo)/scale);
+			int qmax = std::ceil((cmax - lo)/scale);
+
+			qmin = std::clamp(qmin, 0, 255);
+			qmax = std::clamp(qmax, 0, 255);
+
+			while (qmin > 0 && dequantize(lo, scale, qmin) > cmin)
+				qmin--;
+
+			while (qmax < 255 && dequantize(lo, scale, qmax) < cmax)
+				qmax++;
+
+			qmins[axis][i] = qmin;
+			qmaxs[axis][i] = qmax;
+		}
+	}
+
+	node.valid = 0;
+	node.padding = 0;
+
+	for (int i = 0; i < 4; i++) {
+		if (wide.min_x[i] <= wide.max_x[i])
+			node.valid |= 1 << i;
+
+		KOBRA_ASSERT(wide.count[i] <= 255,
+			"Leaf with " + std::to_string(wide.count[i])
+			+ " primitives cannot be compressed");
+
+		node.child[i] = wide.child[i];
+		node.count[i] = wide.count[i];
+	}
+}
+
+void decode(const CompressedBVH::Node &node, BVH4::Node &wide)
+{
+	constexpr float inf = std::numeric_limits <float> ::infinity();
+
+	float sx = cell_size(node.exponent[0]);
+	float sy = cell_size(node.exponent[1]);
+	float sz = cell_size(node.exponent[2]);
+
+	for (int i = 0; i < 4; i++) {
+		wide.child[i] = node.child[i];
+		wide.count[i] = node.count[i];
+
+		wide.min_x[i] = dequantize(node.origin[0], sx, node.qmin_x[i]);
+		wide.min_y[i] = dequantize(node.origin[1], sy, node.qmin_y[i]);
+		wide.min_z[i] = dequantize(node.origin[2], sz, node.qmin_z[i]);
+
+		wide.max_x[i] = dequantize(node.origin[0], sx, node.qmax_x[i]);
+		wide.max_y[i] = dequantize(node.origin[1], sy, node.qmax_y[i]);
+		wide.max_z[i] = dequantize(node.origin[2], sz, node.qmax_z[i]);
+	}
+
+	// Empty slots must never intersect
+	for (int i = 0; i < 4; i++) {
+		if (node.valid & (1 << i))
+			continue;
+
+		wide.min_x[i] = wide.min_y[i] = wide.min_z[i] = inf;
+		wide.max_x[i] = wide.max_y[i] = wide.max_z[i] = -inf;
+	}
+}
+
+CompressedBVH compress(const BVH4 &wide)
+{
+	CompressedBVH compressed;
+	compressed.primitives = wide.primitives;
+	compressed.nodes.resize(wide.nodes.size());
+
+	for (size_t i = 0; i < wide.nodes.size(); i++)
+		encode(wide.nodes[i], compressed.nodes[i]);
+
+	return compressed;
+}
+
+CompressedBVH compress(const BVH &bvh)
+{
+	return compress(collapse <4> (bvh));
+}
+
+BVH4 decompress(const CompressedBVH &compressed)
+{
+	BVH4 wide;
+	wide.primitives = compressed.primitives;
+	wide.nodes.resize(compressed.nodes.size());
+
+	for (size_t i = 0; i < compressed.nodes.size(); i++)
+		decode(compressed.nodes[i], wide.nodes[i]);
+
+	return wide;
+}
+
+bool closest_hit(const CompressedBVH &compressed, const std::vector <glm::vec3> &triangles,
+		const Ray &ray, Hit &hit, float tmax)
+{
+	if (compressed.empty())
+		return false;
+
+	BVH4::Node buffer;
+	return detail::closest_hit_wide <4> (
+		[&](uint32_t index) -> const BVH4::Node & {
+			decode(compressed.nodes[index], buffer);
+			return buffer;
+		},
+		compressed.primitives, triangles, ray, hit, tmax
+	);
+}
+
+bool any_hit(const CompressedBVH &compressed, const std::vector <glm::vec3> &triangles,
+		const Ray &ray, float tmax)
+{
+	if (compressed.empty())
+		return false;
+
+	BVH4::Node buffer;
+	return detail::any_hit_wide <4> (
+		[&](uint32_t index) -> const BVH4::Node & {
+			decode(compressed.nodes[index], buffer);
+			return buffer;
+		},
+		compressed.primitives, triangles, ray, tmax
+	);
+}
+
+}
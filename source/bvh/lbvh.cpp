@@ -0,0 +1,392 @@
+// Standard headers
+#include <array>
+#include <atomic>
+
+// Engine headers
+#include "common.hpp"
+
+// Linear BVH construction (Karras 2012), with optional treelet restructuring
+// (Karras and Aila 2013)
+namespace kobra {
+
+namespace detail {
+
+// Parallel LSD radix sort of 32-bit keys, carrying primitive indices along;
+// one pass per byte, each pass histograms chunks in parallel and scatters
+// them stably into the scratch buffers
+static void radix_sort(std::vector <uint32_t> &keys, std::vector <uint32_t> &values)
+{
+	uint32_t n = keys.size();
+	uint32_t chunks = chunk_count(n);
+
+	std::vector <uint32_t> keys_tmp(n);
+	std::vector <uint32_t> values_tmp(n);
+	std::vector <std::array <uint32_t, 256>> histograms(chunks);
+
+	uint32_t *src_keys = keys.data();
+	uint32_t *src_values = values.data();
+	uint32_t *dst_keys = keys_tmp.data();
+	uint32_t *dst_values = values_tmp.data();
+
+	for (uint32_t shift = 0; shift < 32; shift += 8) {
+		// Per chunk histograms
+		parallel_chunks(n, [&](uint32_t c, uint32_t begin, uint32_t end) {
+			std::array <uint32_t, 256> &histogram = histograms[c];
+			histogram.fill(0);
+
+			for (uint32_t i = begin; i < end; i++)
+				histogram[(src_keys[i] >> shift) & 0xFF]++;
+		});
+
+		// Exclusive prefix over (digit, chunk), so that every chunk
+		// scatters into its own stable range
+		uint32_t offset = 0;
+		for (uint32_t d = 0; d < 256; d++) {
+			for (uint32_t c = 0; c < chunks; c++) {
+				uint32_t count = histograms[c][d];
+				histograms[c][d] = offset;
+				offset += count;
+			}
+		}
+
+		parallel_chunks(n, [&](uint32_t c, uint32_t begin, uint32_t end) {
+			std::array <uint32_t, 256> &histogram = histograms[c];
+
+			for (uint32_t i = begin; i < end; i++) {
+				uint32_t index = histogram[(src_keys[i] >> shift) & 0xFF]++;
+				dst_keys[index] = src_keys[i];
+				dst_values[index] = src_values[i];
+			}
+		});
+
+		std::swap(src_keys, dst_keys);
+		std::swap(src_values, dst_values);
+	}
+
+	// Four passes leave the result in the original buffers
+}
+
+// Length of the common prefix of two sorted keys; duplicates are told apart
+// by their indices
+static inline int delta(const std::vector <uint32_t> &codes, int i, int j)
+{
+	if (j < 0 || j >= (int) codes.size())
+		return -1;
+
+	uint32_t a = codes[i];
+	uint32_t b = codes[j];
+	if (a == b)
+		return 32 + __builtin_clz((uint32_t) (i ^ j));
+
+	return __builtin_clz(a ^ b);
+}
+
+// Emit the children of internal node i; internal nodes occupy [0, n - 1)
+// of the arena and leaves occupy [n - 1, 2n - 1)
+static inline void emit_internal(BVH &bvh, const std::vector <uint32_t> &codes,
+		std::vector <uint32_t> &parents, int i)
+{
+	int n = codes.size();
+
+	// Direction of the range
+	int d = (delta(codes, i, i + 1) - delta(codes, i, i - 1)) >= 0 ? 1 : -1;
+
+	// Upper bound for the length of the range, then its other end
+	int delta_min = delta(codes, i, i - d);
+
+	int lmax = 2;
+	while (delta(codes, i, i + lmax * d) > delta_min)
+		lmax *= 2;
+
+	int l = 0;
+	for (int t = lmax / 2; t >= 1; t /= 2) {
+		if (delta(codes, i, i + (l + t) * d) > delta_min)
+			l += t;
+	}
+
+	int j = i + l * d;
+
+	// Split position, by binary search
+	int delta_node = delta(codes, i, j);
+
+	int s = 0;
+	for (int div = 2; ; div *= 2) {
+		int t = (l + div - 1) / div;
+		if (delta(codes, i, i + (s + t) * d) > delta_node)
+			s += t;
+
+		if (t <= 1)
+			break;
+	}
+
+	int gamma = i + s * d + std::min(d, 0);
+
+	uint32_t left = (std::min(i, j) == gamma) ? (n - 1) + gamma : gamma;
+	uint32_t right = (std::max(i, j) == gamma + 1) ? (n - 1) + gamma + 1 : gamma + 1;
+
+	BVH::Node &node = bvh.nodes[i];
+	node.left = left;
+	node.right = right;
+
+	parents[left] = i;
+	parents[right] = i;
+}
+
+// Treelet restructuring state
+static constexpr int eTreeletSize = 7;
+static constexpr float eTraversalCost = 1.0f;
+
+struct TreeletState {
+	BVH &bvh;
+	std::vector <float> cost;
+	std::vector <uint32_t> counts;
+};
+
+// Recompute the bounds, primitive count and SAH cost of an internal node
+static inline void refit_node(TreeletState &state, uint32_t index)
+{
+	BVH::Node &node = state.bvh.nodes[index];
+	const BVH::Node &left = state.bvh.nodes[node.left];
+	const BVH::Node &right = state.bvh.nodes[node.right];
+
+	node.min = glm::min(left.min, right.min);
+	node.max = glm::max(left.max, right.max);
+
+	state.counts[index] = state.counts[node.left] + state.counts[node.right];
+	state.cost[index] = eTraversalCost * area(node)
+		+ state.cost[node.left] + state.cost[node.right];
+}
+
+// Find the optimal topology of the treelet rooted at the given node by
+// dynamic programming over subsets of its leaves, and rewire it in place
+static void restructure(TreeletState &state, uint32_t root)
+{
+	BVH &bvh = state.bvh;
+
+	// Grow the treelet by repeatedly expanding its largest leaf
+	uint32_t leaves[eTreeletSize];
+	uint32_t internals[eTreeletSize - 1];
+
+	int nleaves = 2;
+	int ninternals = 1;
+
+	internals[0] = root;
+	leaves[0] = bvh.nodes[root].left;
+	leaves[1] = bvh.nodes[root].right;
+
+	while (nleaves < eTreeletSize) {
+		int largest = -1;
+		float largest_area = -1.0f;
+
+		for (int i = 0; i < nleaves; i++) {
+			const BVH::Node &node = bvh.nodes[leaves[i]];
+			if (!node.is_leaf() && area(node) > largest_area) {
+				largest = i;
+				largest_area = area(node);
+			}
+		}
+
+		if (largest < 0)
+			break;
+
+		uint32_t expanded = leaves[largest];
+		internals[ninternals++] = expanded;
+		leaves[largest] = bvh.nodes[expanded].left;
+		leaves[nleaves++] = bvh.nodes[expanded].right;
+	}
+
+	if (nleaves < 3)
+		return;
+
+	// Surface area of every subset of leaves, and the optimal cost of
+	// building a subtree over it
+	constexpr int subsets = 1 << eTreeletSize;
+
+	float areas[subsets];
+	float optimal[subsets];
+	uint8_t partition[subsets];
+
+	int full = (1 << nleaves) - 1;
+	for (int set = 1; set <= full; set++) {
+		Bounds bounds;
+		for (int i = 0; i < nleaves; i++) {
+			if (set & (1 << i))
+				bounds.extend(bvh.nodes[leaves[i]].min, bvh.nodes[leaves[i]].max);
+		}
+
+		areas[set] = bounds.area();
+	}
+
+	for (int i = 0; i < nleaves; i++)
+		optimal[1 << i] = state.cost[leaves[i]];
+
+	// Subsets in increasing order always have their own subsets solved
+	for (int set = 1; set <= full; set++) {
+		if ((set & (set - 1)) == 0)
+			continue;
+
+		float best = std::numeric_limits <float> ::max();
+		int best_part = 0;
+
+		// Enumerate partitions once, by keeping the lowest leaf on the left
+		int lowest = set & -set;
+		for (int part = (set - 1) & set; part > 0; part = (part - 1) & set) {
+			if (!(part & lowest))
+				continue;
+
+			float c = optimal[part] + optimal[set ^ part];
+			if (c < best) {
+				best = c;
+				best_part = part;
+			}
+		}
+
+		optimal[set] = eTraversalCost * areas[set] + best;
+		partition[set] = best_part;
+	}
+
+	// Only rewire if the treelet gets cheaper
+	if (optimal[full] >= state.cost[root] * (1.0f - 1e-5f))
+		return;
+
+	// Rewire the internal nodes of the treelet top down, then refit them
+	// bottom up (in reverse order of assignment)
+	uint32_t order[eTreeletSize - 1];
+	int assigned = 0;
+
+	struct Pending {
+		int set;
+		uint32_t index;
+	};
+
+	Pending stack[eTreeletSize];
+	int top = 0;
+
+	stack[top++] = { full, internals[assigned++] };
+	order[0] = root;
+
+	auto child = [&](int set) -> uint32_t {
+		if ((set & (set - 1)) == 0)
+			return leaves[__builtin_ctz(set)];
+
+		uint32_t index = internals[assigned];
+		order[assigned++] = index;
+		stack[top++] = { set, index };
+		return index;
+	};
+
+	while (top > 0) {
+		Pending pending = stack[--top];
+
+		int left = partition[pending.set];
+		int right = pending.set ^ left;
+
+		uint32_t l = child(left);
+		uint32_t r = child(right);
+
+		bvh.nodes[pending.index].left = l;
+		bvh.nodes[pending.index].right = r;
+	}
+
+	for (int i = assigned - 1; i >= 0; i--)
+		refit_node(state, order[i]);
+}
+
+// Construct a linear BVH over a list of bounding boxes
+BVH lbvh(const std::vector <BoundingBox> &boxes, bool optimize_treelets)
+{
+	BVH bvh;
+	if (boxes.empty())
+		return bvh;
+
+	uint32_t n = boxes.size();
+
+	// Centroid bounds, reduced over chunks
+	std::vector <Bounds> chunk_bounds(chunk_count(n));
+	parallel_chunks(n, [&](uint32_t c, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			chunk_bounds[c].extend((boxes[i].min + boxes[i].max) / 2.0f);
+	});
+
+	Bounds centroids;
+	for (const Bounds &b : chunk_bounds)
+		centroids.extend(b);
+
+	glm::vec3 extent = centroids.max - centroids.min;
+	glm::vec3 scale {
+		extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+		extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+		extent.z > 0.0f ? 1.0f / extent.z : 0.0f
+	};
+
+	// Morton codes, sorted along with the primitive indices
+	std::vector <uint32_t> codes(n);
+	bvh.primitives.resize(n);
+
+	parallel_chunks(n, [&](uint32_t c, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			glm::vec3 centroid = (boxes[i].min + boxes[i].max) / 2.0f;
+			codes[i] = morton((centroid - centroids.min) * scale);
+			bvh.primitives[i] = i;
+		}
+	});
+
+	radix_sort(codes, bvh.primitives);
+
+	// Leaves hold a single primitive each
+	bvh.nodes.resize(2 * n - 1);
+
+	parallel_chunks(n, [&](uint32_t c, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			const BoundingBox &box = boxes[bvh.primitives[i]];
+
+			Bounds bounds;
+			bounds.extend(box.min, box.max);
+			make_leaf(bvh.nodes[(n - 1) + i], bounds, i, 1);
+		}
+	});
+
+	if (n == 1)
+		return bvh;
+
+	// Emit the hierarchy, each internal node independently
+	std::vector <uint32_t> parents(2 * n - 1);
+	parallel_chunks(n - 1, [&](uint32_t c, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			emit_internal(bvh, codes, parents, i);
+	});
+
+	// Bounds bottom up: every leaf walks towards the root, and only the
+	// second visitor of an internal node (whose children are both done)
+	// processes it and keeps going
+	TreeletState state { bvh };
+	state.cost.resize(2 * n - 1);
+	state.counts.resize(2 * n - 1);
+
+	for (uint32_t i = n - 1; i < 2 * n - 1; i++) {
+		state.cost[i] = area(bvh.nodes[i]);
+		state.counts[i] = 1;
+	}
+
+	std::vector <std::atomic <uint32_t>> visits(n - 1);
+	parallel_chunks(n, [&](uint32_t c, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			uint32_t index = (n - 1) + i;
+			while (index != 0) {
+				index = parents[index];
+				if (visits[index].fetch_add(1, std::memory_order_acq_rel) == 0)
+					break;
+
+				refit_node(state, index);
+				if (optimize_treelets && state.counts[index] >= eTreeletSize)
+					restructure(state, index);
+			}
+		}
+	});
+
+	return bvh;
+}
+
+}
+
+}
@@ -0,0 +1,478 @@
+// Standard headers
+#include <array>
+#include <cstring>
+
+// SIMD headers
+#include <immintrin.h>
+
+// Engine headers
+#include "common.hpp"
+#include "include/bvh/packet.hpp"
+
+// Packet and stream traversal of the binary BVH
+namespace kobra {
+
+namespace detail {
+
+// Deep enough for any BVH produced by the builders; deeper ones spill
+static constexpr int ePacketStackSize = 128;
+
+// Stack entry: a node and the lanes that reached it
+struct PacketEntry {
+	uint32_t index;
+	uint32_t mask;
+};
+
+using PacketStack = TraversalStack <PacketEntry, ePacketStackSize>;
+
+// Rays of a packet, in SoA layout for the per lane box tests; the RayData
+// copies are used for the triangle tests, which are shared with the scalar
+// traversal
+template <int N>
+struct Packet {
+	static_assert(N == 8 || N == 16, "Packets hold 8 or 16 rays");
+
+	RayData rays[N];
+	uint32_t lanes;
+
+	alignas(16) float ox[N], oy[N], oz[N];
+	alignas(16) float ix[N], iy[N], iz[N];
+
+	// Octant of each lane, as all ones or all zeros
+	alignas(16) float nx[N], ny[N], nz[N];
+
+	// Interval bounds of the origins and reciprocal directions, usable for
+	// culling if all lanes share an octant and no direction component is
+	// zero
+	bool coherent;
+	bool negative[3];
+	glm::vec3 origin_lo, origin_hi;
+	glm::vec3 inv_lo, inv_hi;
+
+	Packet(const Ray *source, int count) {
+		lanes = (1u << count) - 1;
+
+		// Missing lanes replicate the first ray, and stay masked out
+		for (int l = 0; l < N; l++) {
+			rays[l] = RayData(source[l < count ? l : 0]);
+
+			ox[l] = rays[l].origin.x;
+			oy[l] = rays[l].origin.y;
+			oz[l] = rays[l].origin.z;
+
+			ix[l] = rays[l].inv.x;
+			iy[l] = rays[l].inv.y;
+			iz[l] = rays[l].inv.z;
+
+			nx[l] = lane_mask(rays[l].negative[0]);
+			ny[l] = lane_mask(rays[l].negative[1]);
+			nz[l] = lane_mask(rays[l].negative[2]);
+		}
+
+		coherent = true;
+		for (int i = 0; i < 3; i++)
+			negative[i] = rays[0].negative[i];
+
+		origin_lo = origin_hi = rays[0].origin;
+		inv_lo = inv_hi = rays[0].inv;
+
+		for (int l = 0; l < count; l++) {
+			for (int i = 0; i < 3; i++) {
+				coherent &= rays[l].negative[i] == negative[i];
+				coherent &= std::isfinite(rays[l].inv[i]);
+			}
+
+			origin_lo = glm::min(origin_lo, rays[l].origin);
+			origin_hi = glm::max(origin_hi, rays[l].origin);
+			inv_lo = glm::min(inv_lo, rays[l].inv);
+			inv_hi = glm::max(inv_hi, rays[l].inv);
+		}
+	}
+
+	static float lane_mask(bool negative) {
+		uint32_t bits = negative ? ~0u : 0u;
+
+		float mask;
+		std::memcpy(&mask, &bits, sizeof(float));
+		return mask;
+	}
+};
+
+// Bounds of (plane - o) * inv over the intervals of o and inv; the rounded
+// products are monotonic in each operand, so the corners bound every lane
+static inline void slab_interval(float plane, float olo, float ohi,
+		float ilo, float ihi, float &lo, float &hi)
+{
+	float a = plane - ohi;
+	float b = plane - olo;
+
+	float p0 = a * ilo, p1 = a * ihi;
+	float p2 = b * ilo, p3 = b * ihi;
+
+	lo = std::min(std::min(p0, p1), std::min(p2, p3));
+	hi = std::max(std::max(p0, p1), std::max(p2, p3));
+}
+
+// Interval arithmetic cull; true if no lane of a coherent packet can hit
+// the box before tmax (the largest distance over the lanes)
+template <int N>
+static inline bool packet_misses(const Packet <N> &packet, const BVH::Node &node, float tmax)
+{
+	float tnear = 0.0f;
+	float tfar = tmax;
+
+	for (int i = 0; i < 3; i++) {
+		float near = packet.negative[i] ? node.max[i] : node.min[i];
+		float far = packet.negative[i] ? node.min[i] : node.max[i];
+
+		float lo, hi;
+		slab_interval(near, packet.origin_lo[i], packet.origin_hi[i],
+			packet.inv_lo[i], packet.inv_hi[i], lo, hi);
+		tnear = std::max(tnear, lo);
+
+		slab_interval(far, packet.origin_lo[i], packet.origin_hi[i],
+			packet.inv_lo[i], packet.inv_hi[i], lo, hi);
+		tfar = std::min(tfar, hi);
+	}
+
+	return tnear > tfar;
+}
+
+// Per lane slab tests, four lanes at a time, with the same arithmetic as
+// slab(); returns the mask of lanes (out of the given ones) that hit the box
+template <int N>
+static inline uint32_t packet_slab(const Packet <N> &packet, const BVH::Node &node,
+		const float *tmax, uint32_t mask)
+{
+	__m128 min_x = _mm_set1_ps(node.min.x);
+	__m128 min_y = _mm_set1_ps(node.min.y);
+	__m128 min_z = _mm_set1_ps(node.min.z);
+
+	__m128 max_x = _mm_set1_ps(node.max.x);
+	__m128 max_y = _mm_set1_ps(node.max.y);
+	__m128 max_z = _mm_set1_ps(node.max.z);
+
+	// Near plane if negative ? max : min, far plane the other one
+	auto select = [](__m128 negative, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(negative, a), _mm_andnot_ps(negative, b));
+	};
+
+	uint32_t result = 0;
+	for (int k = 0; k < N; k += 4) {
+		if (!((mask >> k) & 0xF))
+			continue;
+
+		__m128 nx = _mm_load_ps(packet.nx + k);
+		__m128 ny = _mm_load_ps(packet.ny + k);
+		__m128 nz = _mm_load_ps(packet.nz + k);
+
+		__m128 ox = _mm_load_ps(packet.ox + k);
+		__m128 oy = _mm_load_ps(packet.oy + k);
+		__m128 oz = _mm_load_ps(packet.oz + k);
+
+		__m128 ix = _mm_load_ps(packet.ix + k);
+		__m128 iy = _mm_load_ps(packet.iy + k);
+		__m128 iz = _mm_load_ps(packet.iz + k);
+
+		__m128 t0x = _mm_mul_ps(_mm_sub_ps(select(nx, max_x, min_x), ox), ix);
+		__m128 t0y = _mm_mul_ps(_mm_sub_ps(select(ny, max_y, min_y), oy), iy);
+		__m128 t0z = _mm_mul_ps(_mm_sub_ps(select(nz, max_z, min_z), oz), iz);
+
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(select(nx, min_x, max_x), ox), ix);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(select(ny, min_y, max_y), oy), iy);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(select(nz, min_z, max_z), oz), iz);
+
+		__m128 tn = _mm_max_ps(_mm_max_ps(t0x, t0y), _mm_max_ps(t0z, _mm_setzero_ps()));
+		__m128 tf = _mm_min_ps(_mm_min_ps(t1x, t1y), _mm_min_ps(t1z, _mm_loadu_ps(tmax + k)));
+
+		result |= _mm_movemask_ps(_mm_cmple_ps(tn, tf)) << k;
+	}
+
+	return result & mask;
+}
+
+// Push the children of a node, the nearest for the leading lane on top
+static inline void push_children(const BVH &bvh, const BVH::Node &node,
+		const RayData &leader, float tmax, uint32_t mask, PacketStack &stack)
+{
+	const BVH::Node &left = bvh.nodes[node.left];
+	const BVH::Node &right = bvh.nodes[node.right];
+
+	float tl = std::numeric_limits <float> ::infinity();
+	float tr = tl;
+
+	slab(leader, left.min, left.max, tmax, tl);
+	slab(leader, right.min, right.max, tmax, tr);
+
+	if (tl <= tr) {
+		stack.push({ node.right, mask });
+		stack.push({ node.left, mask });
+	} else {
+		stack.push({ node.left, mask });
+		stack.push({ node.right, mask });
+	}
+}
+
+template <int N>
+static void closest_hit(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const Packet <N> &packet, Hit *hits, float tmax)
+{
+	float t[N];
+	for (int l = 0; l < N; l++) {
+		hits[l] = Hit {};
+		hits[l].t = t[l] = tmax;
+	}
+
+	PacketStack stack;
+	stack.push({ 0, packet.lanes });
+
+	while (!stack.empty()) {
+		PacketEntry entry = stack.pop();
+
+		const BVH::Node &node = bvh.nodes[entry.index];
+
+		if (packet.coherent) {
+			float far = 0.0f;
+			for (uint32_t m = entry.mask; m; m &= m - 1)
+				far = std::max(far, t[__builtin_ctz(m)]);
+
+			if (packet_misses(packet, node, far))
+				continue;
+		}
+
+		uint32_t mask = packet_slab(packet, node, t, entry.mask);
+		if (!mask)
+			continue;
+
+		if (node.is_leaf()) {
+			for (uint32_t m = mask; m; m &= m - 1) {
+				int l = __builtin_ctz(m);
+				intersect_leaf(packet.rays[l], triangles,
+					&bvh.primitives[node.first()], node.count(), hits[l]);
+				t[l] = hits[l].t;
+			}
+
+			continue;
+		}
+
+		int leader = __builtin_ctz(mask);
+		push_children(bvh, node, packet.rays[leader], t[leader], mask, stack);
+	}
+}
+
+template <int N>
+static void any_hit(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const Packet <N> &packet, uint8_t *occluded, float tmax)
+{
+	float t[N];
+	for (int l = 0; l < N; l++) {
+		occluded[l] = 0;
+		t[l] = tmax;
+	}
+
+	// Lanes still looking for an occluder
+	uint32_t active = packet.lanes;
+
+	PacketStack stack;
+	stack.push({ 0, packet.lanes });
+
+	while (!stack.empty() && active) {
+		PacketEntry entry = stack.pop();
+
+		const BVH::Node &node = bvh.nodes[entry.index];
+		if (packet.coherent && packet_misses(packet, node, tmax))
+			continue;
+
+		uint32_t mask = packet_slab(packet, node, t, entry.mask & active);
+		if (!mask)
+			continue;
+
+		if (node.is_leaf()) {
+			for (uint32_t m = mask; m; m &= m - 1) {
+				int l = __builtin_ctz(m);
+				if (occluded_leaf(packet.rays[l], triangles,
+						&bvh.primitives[node.first()], node.count(), tmax)) {
+					occluded[l] = 1;
+					active &= ~(1u << l);
+				}
+			}
+
+			continue;
+		}
+
+		int leader = __builtin_ctz(mask);
+		push_children(bvh, node, packet.rays[leader], t[leader], mask, stack);
+	}
+}
+
+// Indices of the rays of a stream, grouped by octant and sorted by the
+// Morton code of their origins within each group (stably, so that rays from
+// a common origin keep their order); returns the start of each group
+static std::array <uint32_t, 9> group_rays(const std::vector <Ray> &rays,
+		std::vector <uint32_t> &order)
+{
+	auto octant = [](const Ray &ray) {
+		return int(std::signbit(ray.direction.x))
+			| int(std::signbit(ray.direction.y)) << 1
+			| int(std::signbit(ray.direction.z)) << 2;
+	};
+
+	std::array <uint32_t, 9> offsets {};
+	for (const Ray &ray : rays)
+		offsets[octant(ray) + 1]++;
+
+	for (int i = 0; i < 8; i++)
+		offsets[i + 1] += offsets[i];
+
+	std::array <uint32_t, 9> cursor = offsets;
+
+	order.resize(rays.size());
+	for (uint32_t i = 0; i < rays.size(); i++)
+		order[cursor[octant(rays[i])]++] = i;
+
+	Bounds origins;
+	for (const Ray &ray : rays)
+		origins.extend(ray.origin);
+
+	glm::vec3 extent = origins.max - origins.min;
+	glm::vec3 scale = glm::vec3(1.0f)/glm::max(extent, glm::vec3(1e-20f));
+
+	std::vector <uint32_t> codes(rays.size());
+	for (uint32_t i = 0; i < rays.size(); i++)
+		codes[i] = morton((rays[i].origin - origins.min) * scale);
+
+	for (int i = 0; i < 8; i++) {
+		std::stable_sort(order.begin() + offsets[i], order.begin() + offsets[i + 1],
+			[&](uint32_t a, uint32_t b) {
+				return codes[a] < codes[b];
+			});
+	}
+
+	return offsets;
+}
+
+// Trace a stream in packets of 16; the function receives the packet, the
+// indices of its rays and their count
+template <class F>
+static void trace_stream(const std::vector <Ray> &rays, const F &trace)
+{
+	constexpr int eWidth = 16;
+
+	std::vector <uint32_t> order;
+	std::array <uint32_t, 9> offsets = group_rays(rays, order);
+
+	// Packets never straddle octants
+	std::vector <uint32_t> starts;
+	for (int i = 0; i < 8; i++) {
+		for (uint32_t s = offsets[i]; s < offsets[i + 1]; s += eWidth)
+			starts.push_back(s);
+	}
+
+	parallel_chunks(starts.size(), [&](uint32_t, uint32_t begin, uint32_t end) {
+		for (uint32_t p = begin; p < end; p++) {
+			uint32_t start = starts[p];
+			uint32_t limit = *std::upper_bound(offsets.begin(), offsets.end(), start);
+			int count = std::min <uint32_t> (eWidth, limit - start);
+
+			Ray local[eWidth];
+			for (int l = 0; l < count; l++)
+				local[l] = rays[order[start + l]];
+
+			Packet <eWidth> packet(local, count);
+			trace(packet, &order[start], count);
+		}
+	});
+}
+
+}
+
+template <int N>
+void closest_hit_packet(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const Ray *rays, int count, Hit *hits, float tmax)
+{
+	KOBRA_ASSERT(count >= 0 && count <= N, "Packet of " + std::to_string(count)
+		+ " rays exceeds its width of " + std::to_string(N));
+
+	if (count == 0)
+		return;
+
+	if (bvh.empty()) {
+		for (int l = 0; l < count; l++)
+			hits[l] = Hit {};
+
+		return;
+	}
+
+	detail::Packet <N> packet(rays, count);
+
+	Hit result[N];
+	detail::closest_hit(bvh, triangles, packet, result, tmax);
+	std::copy(result, result + count, hits);
+}
+
+template <int N>
+void any_hit_packet(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const Ray *rays, int count, uint8_t *occluded, float tmax)
+{
+	KOBRA_ASSERT(count >= 0 && count <= N, "Packet of " + std::to_string(count)
+		+ " rays exceeds its width of " + std::to_string(N));
+
+	if (count == 0)
+		return;
+
+	if (bvh.empty()) {
+		std::fill(occluded, occluded + count, 0);
+		return;
+	}
+
+	detail::Packet <N> packet(rays, count);
+
+	uint8_t result[N];
+	detail::any_hit(bvh, triangles, packet, result, tmax);
+	std::copy(result, result + count, occluded);
+}
+
+void closest_hit_stream(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const std::vector <Ray> &rays, std::vector <Hit> &hits, float tmax)
+{
+	hits.assign(rays.size(), Hit {});
+	if (bvh.empty())
+		return;
+
+	detail::trace_stream(rays, [&](const detail::Packet <16> &packet,
+			const uint32_t *indices, int count) {
+		Hit result[16];
+		detail::closest_hit(bvh, triangles, packet, result, tmax);
+		for (int l = 0; l < count; l++)
+			hits[indices[l]] = result[l];
+	});
+}
+
+void any_hit_stream(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const std::vector <Ray> &rays, std::vector <uint8_t> &occluded, float tmax)
+{
+	occluded.assign(rays.size(), 0);
+	if (bvh.empty())
+		return;
+
+	detail::trace_stream(rays, [&](const detail::Packet <16> &packet,
+			const uint32_t *indices, int count) {
+		uint8_t result[16];
+		detail::any_hit(bvh, triangles, packet, result, tmax);
+		for (int l = 0; l < count; l++)
+			occluded[indices[l]] = result[l];
+	});
+}
+
+// Explicit instantiations
+template void closest_hit_packet <8> (const BVH &, const std::vector <glm::vec3> &,
+	const Ray *, int, Hit *, float);
+template void closest_hit_packet <16> (const BVH &, const std::vector <glm::vec3> &,
+	const Ray *, int, Hit *, float);
+
+template void any_hit_packet <8> (const BVH &, const std::vector <glm::vec3> &,
+	const Ray *, int, uint8_t *, float);
+template void any_hit_packet <16> (const BVH &, const std::vector <glm::vec3> &,
+	const Ray *, int, uint8_t *, float);
+
+}
@@ -0,0 +1,422 @@
+// Engine headers
+#include "common.hpp"
+
+// SAH construction with spatial splits (Stich et al. 2009)
+namespace kobra {
+
+namespace detail {
+
+// Construction parameters
+static constexpr int eObjectBins = 16;
+static constexpr int eSpatialBins = 32;
+static constexpr uint32_t eMaxLeafSize = 4;
+static constexpr int eMaxDepth = 64;
+static constexpr float eTraversalCost = 1.0f;
+
+// Spatial splits are only tried when the children of the best object split
+// overlap by more than this fraction of the root area
+static constexpr float eAlpha = 1e-5f;
+
+// Reference to a (possibly clipped) triangle
+struct Reference {
+	Bounds bounds;
+	uint32_t primitive;
+};
+
+struct SBVHBuilder {
+	const std::vector <glm::vec3> &triangles;
+	BVH &bvh;
+
+	float root_area;
+
+	// Remaining references that spatial splits may add
+	size_t budget;
+};
+
+// Best split found for a node
+struct Split {
+	float cost = std::numeric_limits <float> ::max();
+	int axis = -1;
+	bool spatial = false;
+
+	// Object splits: bin boundary over the centroids; spatial splits: plane
+	int bin = 0;
+	float position = 0.0f;
+	Bounds centroids;
+
+	// Overlap of the children (object splits only)
+	float overlap = 0.0f;
+};
+
+static inline Bounds intersect(const Bounds &a, const Bounds &b)
+{
+	Bounds c;
+	c.min = glm::max(a.min, b.min);
+	c.max = glm::min(a.max, b.max);
+	return c;
+}
+
+static inline glm::vec3 centroid(const Reference &ref)
+{
+	return (ref.bounds.min + ref.bounds.max) / 2.0f;
+}
+
+// Split a reference by an axis aligned plane, clipping its triangle
+static void split_reference(const SBVHBuilder &builder, const Reference &ref,
+		int axis, float position, Reference &left, Reference &right)
+{
+	left = Reference { Bounds {}, ref.primitive };
+	right = Reference { Bounds {}, ref.primitive };
+
+	const glm::vec3 *v = &builder.triangles[3 * ref.primitive];
+	for (int i = 0; i < 3; i++) {
+		const glm::vec3 &a = v[i];
+		const glm::vec3 &b = v[(i + 1) % 3];
+
+		if (a[axis] <= position)
+			left.bounds.extend(a);
+
+		if (a[axis] >= position)
+			right.bounds.extend(a);
+
+		// Edge crossing the plane
+		if ((a[axis] < position && position < b[axis])
+				|| (b[axis] < position && position < a[axis])) {
+			float t = (position - a[axis]) / (b[axis] - a[axis]);
+
+			glm::vec3 p = a + t * (b - a);
+			p[axis] = position;
+
+			left.bounds.extend(p);
+			right.bounds.extend(p);
+		}
+	}
+
+	left.bounds.max[axis] = position;
+	right.bounds.min[axis] = position;
+
+	left.bounds = intersect(left.bounds, ref.bounds);
+	right.bounds = intersect(right.bounds, ref.bounds);
+}
+
+// Binned SAH over the reference centroids, on all axes
+static Split object_split(const std::vector <Reference> &refs, const Bounds &bounds)
+{
+	Bounds centroids;
+	for (const Reference &ref : refs)
+		centroids.extend(centroid(ref));
+
+	Split best;
+	best.centroids = centroids;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = centroids.max[axis] - centroids.min[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		float scale = eObjectBins / extent;
+
+		Bounds bins[eObjectBins];
+		uint32_t counts[eObjectBins] = {};
+
+		for (const Reference &ref : refs) {
+			int b = std::min(eObjectBins - 1, int((centroid(ref)[axis] - centroids.min[axis]) * scale));
+			bins[b].extend(ref.bounds);
+			counts[b]++;
+		}
+
+		// Right to left sweep
+		float right_costs[eObjectBins];
+		Bounds rights[eObjectBins];
+
+		Bounds right;
+		uint32_t right_count = 0;
+		for (int i = eObjectBins - 1; i > 0; i--) {
+			right.extend(bins[i]);
+			right_count += counts[i];
+			right_costs[i] = right_count ? right.area() * right_count : 0.0f;
+			rights[i] = right;
+		}
+
+		Bounds left;
+		uint32_t left_count = 0;
+		for (int i = 0; i < eObjectBins - 1; i++) {
+			left.extend(bins[i]);
+			left_count += counts[i];
+
+			if (left_count == 0 || left_count == refs.size())
+				continue;
+
+			float cost = left.area() * left_count + right_costs[i + 1];
+			if (cost < best.cost) {
+				best.cost = cost;
+				best.axis = axis;
+				best.bin = i + 1;
+				best.overlap = intersect(left, rights[i + 1]).area();
+			}
+		}
+	}
+
+	best.cost += eTraversalCost * bounds.area();
+	return best;
+}
+
+// Spatial split over bins of the node bounds, clipping references that
+// straddle bin boundaries
+static Split spatial_split(const SBVHBuilder &builder,
+		const std::vector <Reference> &refs, const Bounds &bounds)
+{
+	Split best;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float lo = bounds.min[axis];
+		float extent = bounds.max[axis] - lo;
+		if (extent <= 0.0f)
+			continue;
+
+		float width = extent / eSpatialBins;
+		auto bin_of = [&](float x) {
+			return std::clamp(int((x - lo) / width), 0, eSpatialBins - 1);
+		};
+
+		Bounds bins[eSpatialBins];
+		uint32_t entries[eSpatialBins] = {};
+		uint32_t exits[eSpatialBins] = {};
+
+		for (const Reference &ref : refs) {
+			int first = bin_of(ref.bounds.min[axis]);
+			int last = bin_of(ref.bounds.max[axis]);
+
+			Reference current = ref;
+			for (int b = first; b < last; b++) {
+				Reference left, right;
+				split_reference(builder, current, axis, lo + (b + 1) * width, left, right);
+				bins[b].extend(left.bounds);
+				current = right;
+			}
+
+			bins[last].extend(current.bounds);
+			entries[first]++;
+			exits[last]++;
+		}
+
+		// Right to left sweep
+		float right_costs[eSpatialBins];
+		uint32_t right_counts[eSpatialBins];
+
+		Bounds right;
+		uint32_t right_count = 0;
+		for (int i = eSpatialBins - 1; i > 0; i--) {
+			right.extend(bins[i]);
+			right_count += exits[i];
+			right_costs[i] = right_count ? right.area() * right_count : 0.0f;
+			right_counts[i] = right_count;
+		}
+
+		Bounds left;
+		uint32_t left_count = 0;
+		for (int i = 0; i < eSpatialBins - 1; i++) {
+			left.extend(bins[i]);
+			left_count += entries[i];
+
+			if (left_count == 0 || right_counts[i + 1] == 0)
+				continue;
+
+			float cost = left.area() * left_count + right_costs[i + 1];
+			if (cost < best.cost) {
+				best.cost = cost;
+				best.axis = axis;
+				best.spatial = true;
+				best.position = lo + (i + 1) * width;
+			}
+		}
+	}
+
+	best.cost += eTraversalCost * bounds.area();
+	return best;
+}
+
+static void partition_object(const std::vector <Reference> &refs, const Split &split,
+		std::vector <Reference> &left, std::vector <Reference> &right)
+{
+	int axis = split.axis;
+	float extent = split.centroids.max[axis] - split.centroids.min[axis];
+	float scale = eObjectBins / extent;
+
+	for (const Reference &ref : refs) {
+		int b = std::min(eObjectBins - 1, int((centroid(ref)[axis] - split.centroids.min[axis]) * scale));
+		(b < split.bin ? left : right).push_back(ref);
+	}
+}
+
+// Returns the number of duplicated references
+static size_t partition_spatial(const SBVHBuilder &builder,
+		const std::vector <Reference> &refs, const Split &split,
+		std::vector <Reference> &left, std::vector <Reference> &right)
+{
+	int axis = split.axis;
+
+	size_t duplicated = 0;
+	for (const Reference &ref : refs) {
+		if (ref.bounds.max[axis] <= split.position) {
+			left.push_back(ref);
+		} else if (ref.bounds.min[axis] >= split.position) {
+			right.push_back(ref);
+		} else {
+			Reference l, r;
+			split_reference(builder, ref, axis, split.position, l, r);
+			left.push_back(l);
+			right.push_back(r);
+			duplicated++;
+		}
+	}
+
+	return duplicated;
+}
+
+// Number of references straddling a plane
+static size_t straddling(const std::vector <Reference> &refs, int axis, float position)
+{
+	size_t count = 0;
+	for (const Reference &ref : refs) {
+		if (ref.bounds.min[axis] < position && position < ref.bounds.max[axis])
+			count++;
+	}
+
+	return count;
+}
+
+static uint32_t build(SBVHBuilder &builder, std::vector <Reference> &refs, int depth)
+{
+	BVH &bvh = builder.bvh;
+
+	uint32_t index = bvh.nodes.size();
+	bvh.nodes.emplace_back();
+
+	Bounds bounds;
+	for (const Reference &ref : refs)
+		bounds.extend(ref.bounds);
+
+	uint32_t count = refs.size();
+
+	auto leaf = [&]() {
+		make_leaf(bvh.nodes[index], bounds, bvh.primitives.size(), count);
+		for (const Reference &ref : refs)
+			bvh.primitives.push_back(ref.primitive);
+
+		return index;
+	};
+
+	if (count <= 1)
+		return leaf();
+
+	std::vector <Reference> left;
+	std::vector <Reference> right;
+
+	if (depth >= eMaxDepth) {
+		if (count <= eMaxLeafSize)
+			return leaf();
+
+		// Past the depth limit, halve at the median centroid along the
+		// widest axis instead of making one large leaf, so that leaves
+		// stay small (compressed nodes hold at most 255 primitives)
+		Bounds centroids;
+		for (const Reference &ref : refs)
+			centroids.extend(centroid(ref));
+
+		glm::vec3 extent = centroids.max - centroids.min;
+
+		int axis = 0;
+		if (extent.y > extent[axis])
+			axis = 1;
+		if (extent.z > extent[axis])
+			axis = 2;
+
+		std::nth_element(refs.begin(), refs.begin() + count/2, refs.end(),
+			[axis](const Reference &a, const Reference &b) {
+				return centroid(a)[axis] < centroid(b)[axis];
+			}
+		);
+
+		left.assign(refs.begin(), refs.begin() + count/2);
+		right.assign(refs.begin() + count/2, refs.end());
+	} else {
+		// Object split first, then spatial splits if its children overlap
+		Split split = object_split(refs, bounds);
+
+		if (builder.budget > 0 && split.overlap > eAlpha * builder.root_area) {
+			Split spatial = spatial_split(builder, refs, bounds);
+			if (spatial.cost < split.cost
+					&& straddling(refs, spatial.axis, spatial.position) <= builder.budget)
+				split = spatial;
+		}
+
+		float leaf_cost = bounds.area() * count;
+		if (count <= eMaxLeafSize && (split.axis < 0 || leaf_cost <= split.cost))
+			return leaf();
+
+		if (split.spatial) {
+			builder.budget -= partition_spatial(builder, refs, split, left, right);
+		} else if (split.axis >= 0) {
+			partition_object(refs, split, left, right);
+		}
+
+		// No usable split (e.g. coincident centroids), halve the references
+		if (left.empty() || right.empty()) {
+			left.assign(refs.begin(), refs.begin() + count/2);
+			right.assign(refs.begin() + count/2, refs.end());
+		}
+	}
+
+	// The parent references are no longer needed
+	std::vector <Reference> ().swap(refs);
+
+	uint32_t l = build(builder, left, depth + 1);
+	uint32_t r = build(builder, right, depth + 1);
+
+	BVH::Node &node = bvh.nodes[index];
+	node.min = bounds.min;
+	node.max = bounds.max;
+	node.left = l;
+	node.right = r;
+
+	return index;
+}
+
+// Construct an SBVH over a list of triangles
+BVH sbvh(const std::vector <glm::vec3> &triangles, float duplication_budget)
+{
+	BVH bvh;
+
+	uint32_t n = triangles.size()/3;
+	if (n == 0)
+		return bvh;
+
+	std::vector <Reference> refs(n);
+
+	Bounds root;
+	for (uint32_t i = 0; i < n; i++) {
+		refs[i].primitive = i;
+		for (int j = 0; j < 3; j++)
+			refs[i].bounds.extend(triangles[3 * i + j]);
+
+		root.extend(refs[i].bounds);
+	}
+
+	SBVHBuilder builder {
+		triangles, bvh, root.area(),
+		size_t(std::max(0.0f, duplication_budget) * n)
+	};
+
+	bvh.nodes.reserve(2 * n);
+	bvh.primitives.reserve(n);
+
+	build(builder, refs, 0);
+
+	bvh.nodes.shrink_to_fit();
+	return bvh;
+}
+
+}
+
+}
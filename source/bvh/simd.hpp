@@ -0,0 +1,187 @@
+#pragma once
+
+// SIMD headers
+#include <immintrin.h>
+
+// Engine headers
+#include "common.hpp"
+#include "include/bvh/wide.hpp"
+
+// SIMD kernels shared by the wide BVH traversals; 8-wide nodes use AVX when
+// compiled with it enabled, SSE otherwise
+namespace kobra {
+
+namespace detail {
+
+// Test a ray against all children of a node; returns the mask of children
+// hit, and writes their entry distances
+template <int N>
+inline uint32_t intersect_children(const typename WideBVH <N> ::Node &node,
+		const RayData &ray, float tmax, float *tnear)
+{
+	const float *near_x = ray.negative[0] ? node.max_x : node.min_x;
+	const float *near_y = ray.negative[1] ? node.max_y : node.min_y;
+	const float *near_z = ray.negative[2] ? node.max_z : node.min_z;
+
+	const float *far_x = ray.negative[0] ? node.min_x : node.max_x;
+	const float *far_y = ray.negative[1] ? node.min_y : node.max_y;
+	const float *far_z = ray.negative[2] ? node.min_z : node.max_z;
+
+	uint32_t mask = 0;
+
+#if defined(__AVX__)
+	if constexpr (N == 8) {
+		__m256 ox = _mm256_set1_ps(ray.origin.x);
+		__m256 oy = _mm256_set1_ps(ray.origin.y);
+		__m256 oz = _mm256_set1_ps(ray.origin.z);
+
+		__m256 ix = _mm256_set1_ps(ray.inv.x);
+		__m256 iy = _mm256_set1_ps(ray.inv.y);
+		__m256 iz = _mm256_set1_ps(ray.inv.z);
+
+		__m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_x), ox), ix);
+		__m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_y), oy), iy);
+		__m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_z), oz), iz);
+
+		__m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_x), ox), ix);
+		__m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_y), oy), iy);
+		__m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_z), oz), iz);
+
+		__m256 tn = _mm256_max_ps(_mm256_max_ps(t0x, t0y), _mm256_max_ps(t0z, _mm256_setzero_ps()));
+		__m256 tf = _mm256_min_ps(_mm256_min_ps(t1x, t1y), _mm256_min_ps(t1z, _mm256_set1_ps(tmax)));
+
+		_mm256_storeu_ps(tnear, tn);
+		return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+	}
+#endif
+
+	__m128 ox = _mm_set1_ps(ray.origin.x);
+	__m128 oy = _mm_set1_ps(ray.origin.y);
+	__m128 oz = _mm_set1_ps(ray.origin.z);
+
+	__m128 ix = _mm_set1_ps(ray.inv.x);
+	__m128 iy = _mm_set1_ps(ray.inv.y);
+	__m128 iz = _mm_set1_ps(ray.inv.z);
+
+	for (int k = 0; k < N; k += 4) {
+		__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_x + k), ox), ix);
+		__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_y + k), oy), iy);
+		__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_z + k), oz), iz);
+
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_x + k), ox), ix);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_y + k), oy), iy);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_z + k), oz), iz);
+
+		__m128 tn = _mm_max_ps(_mm_max_ps(t0x, t0y), _mm_max_ps(t0z, _mm_setzero_ps()));
+		__m128 tf = _mm_min_ps(_mm_min_ps(t1x, t1y), _mm_min_ps(t1z, _mm_set1_ps(tmax)));
+
+		_mm_storeu_ps(tnear + k, tn);
+		mask |= _mm_movemask_ps(_mm_cmple_ps(tn, tf)) << k;
+	}
+
+	return mask;
+}
+
+// Deep enough for any BVH produced by the builders; deeper ones spill
+constexpr int eStackDepth = 64;
+
+// Closest hit traversal over wide nodes, which are retrieved by index through
+// the given function (so that compressed trees can decode them on the fly)
+template <int N, class F>
+bool closest_hit_wide(const F &fetch, const std::vector <uint32_t> &primitives,
+		const std::vector <glm::vec3> &triangles,
+		const Ray &ray_, Hit &hit, float tmax)
+{
+	RayData ray(ray_);
+
+	hit = Hit {};
+	hit.t = tmax;
+
+	// Entries are either nodes (count = 0) or leaves
+	struct Entry {
+		uint32_t child;
+		uint32_t count;
+		float t;
+	};
+
+	TraversalStack <Entry, eStackDepth * N> stack;
+	stack.push({ 0, 0, 0.0f });
+
+	bool found = false;
+	while (!stack.empty()) {
+		Entry entry = stack.pop();
+		if (entry.t > hit.t)
+			continue;
+
+		if (entry.count > 0) {
+			found |= intersect_leaf(ray, triangles,
+				&primitives[entry.child], entry.count, hit);
+			continue;
+		}
+
+		const auto &node = fetch(entry.child);
+
+		alignas(32) float tnear[N];
+		uint32_t mask = intersect_children <N> (node, ray, hit.t, tnear);
+
+		// Push the hit children furthest first, so that the nearest is
+		// visited next
+		int base = stack.size;
+		while (mask) {
+			int i = __builtin_ctz(mask);
+			mask &= mask - 1;
+
+			Entry child { node.child[i], node.count[i], tnear[i] };
+			stack.push(child);
+
+			int j = stack.size - 1;
+			while (j > base && stack[j - 1].t < child.t) {
+				stack[j] = stack[j - 1];
+				j--;
+			}
+
+			stack[j] = child;
+		}
+	}
+
+	return found;
+}
+
+// Any hit traversal over wide nodes
+template <int N, class F>
+bool any_hit_wide(const F &fetch, const std::vector <uint32_t> &primitives,
+		const std::vector <glm::vec3> &triangles,
+		const Ray &ray_, float tmax)
+{
+	RayData ray(ray_);
+
+	TraversalStack <uint32_t, eStackDepth * N> stack;
+	stack.push(0);
+
+	while (!stack.empty()) {
+		const auto &node = fetch(stack.pop());
+
+		alignas(32) float tnear[N];
+		uint32_t mask = intersect_children <N> (node, ray, tmax, tnear);
+
+		while (mask) {
+			int i = __builtin_ctz(mask);
+			mask &= mask - 1;
+
+			if (node.count[i] == 0) {
+				stack.push(node.child[i]);
+				continue;
+			}
+
+			if (occluded_leaf(ray, triangles,
+					&primitives[node.child[i]], node.count[i], tmax))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+}
+
+}
@@ -0,0 +1,105 @@
+// Engine headers
+#include "common.hpp"
+
+// Scalar traversal of the binary BVH; the reference for the wide and packet
+// kernels
+namespace kobra {
+
+using detail::RayData;
+
+// Deep enough for any BVH produced by the builders; deeper ones spill
+static constexpr int eStackSize = 128;
+
+bool closest_hit(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const Ray &ray_, Hit &hit, float tmax)
+{
+	if (bvh.empty())
+		return false;
+
+	RayData ray(ray_);
+
+	hit = Hit {};
+	hit.t = tmax;
+
+	float tnear;
+	if (!detail::slab(ray, bvh.nodes[0].min, bvh.nodes[0].max, hit.t, tnear))
+		return false;
+
+	struct Entry {
+		uint32_t index;
+		float t;
+	};
+
+	detail::TraversalStack <Entry, eStackSize> stack;
+	stack.push({ 0, tnear });
+
+	bool found = false;
+	while (!stack.empty()) {
+		Entry entry = stack.pop();
+		if (entry.t > hit.t)
+			continue;
+
+		const BVH::Node &node = bvh.nodes[entry.index];
+		if (node.is_leaf()) {
+			found |= detail::intersect_leaf(ray, triangles,
+				&bvh.primitives[node.first()], node.count(), hit);
+			continue;
+		}
+
+		float tl, tr;
+		bool hl = detail::slab(ray, bvh.nodes[node.left].min, bvh.nodes[node.left].max, hit.t, tl);
+		bool hr = detail::slab(ray, bvh.nodes[node.right].min, bvh.nodes[node.right].max, hit.t, tr);
+
+		// Nearest child on top
+		if (hl && hr) {
+			if (tl <= tr) {
+				stack.push({ node.right, tr });
+				stack.push({ node.left, tl });
+			} else {
+				stack.push({ node.left, tl });
+				stack.push({ node.right, tr });
+			}
+		} else if (hl) {
+			stack.push({ node.left, tl });
+		} else if (hr) {
+			stack.push({ node.right, tr });
+		}
+	}
+
+	return found;
+}
+
+bool any_hit(const BVH &bvh, const std::vector <glm::vec3> &triangles,
+		const Ray &ray_, float tmax)
+{
+	if (bvh.empty())
+		return false;
+
+	RayData ray(ray_);
+
+	detail::TraversalStack <uint32_t, eStackSize> stack;
+	stack.push(0);
+
+	while (!stack.empty()) {
+		const BVH::Node &node = bvh.nodes[stack.pop()];
+
+		float tnear;
+		if (!detail::slab(ray, node.min, node.max, tmax, tnear))
+			continue;
+
+		if (node.is_leaf()) {
+			if (detail::occluded_leaf(ray, triangles,
+					&bvh.primitives[node.first()], node.count(), tmax))
+				return true;
+
+			continue;
+		}
+
+		stack.push(node.right);
+		stack.push(node.left);
+	}
+
+	return false;
+}
+
+}
@@ -0,0 +1,142 @@
+// Engine headers
+#include "common.hpp"
+#include "simd.hpp"
+
+// Wide BVH collapse and SIMD traversal
+namespace kobra {
+
+template <int N>
+WideBVH <N> collapse(const BVH &bvh)
+{
+	using Node = typename WideBVH <N> ::Node;
+
+	WideBVH <N> wide;
+	wide.primitives = bvh.primitives;
+
+	if (bvh.empty())
+		return wide;
+
+	// Binary node to expand into a wide node
+	struct Task {
+		uint32_t binary;
+		uint32_t wide;
+	};
+
+	std::vector <Task> stack { { 0, 0 } };
+	wide.nodes.emplace_back();
+
+	while (!stack.empty()) {
+		Task task = stack.back();
+		stack.pop_back();
+
+		// Gather up to N children, opening the largest internal ones
+		uint32_t slots[N];
+		int count = 0;
+
+		const BVH::Node &root = bvh.nodes[task.binary];
+		if (root.is_leaf()) {
+			slots[count++] = task.binary;
+		} else {
+			slots[count++] = root.left;
+			slots[count++] = root.right;
+		}
+
+		while (count < N) {
+			int largest = -1;
+			float largest_area = -1.0f;
+
+			for (int i = 0; i < count; i++) {
+				const BVH::Node &node = bvh.nodes[slots[i]];
+				if (!node.is_leaf() && detail::area(node) > largest_area) {
+					largest = i;
+					largest_area = detail::area(node);
+				}
+			}
+
+			if (largest < 0)
+				break;
+
+			const BVH::Node &node = bvh.nodes[slots[largest]];
+			slots[largest] = node.left;
+			slots[count++] = node.right;
+		}
+
+		// Fill the node; references into the arena are not stable while
+		// children are being allocated
+		Node node;
+		for (int i = 0; i < N; i++) {
+			if (i >= count) {
+				node.min_x[i] = node.min_y[i] = node.min_z[i] = std::numeric_limits <float> ::infinity();
+				node.max_x[i] = node.max_y[i] = node.max_z[i] = -std::numeric_limits <float> ::infinity();
+				node.child[i] = 0;
+				node.count[i] = 0;
+				continue;
+			}
+
+			const BVH::Node &child = bvh.nodes[slots[i]];
+			node.min_x[i] = child.min.x;
+			node.min_y[i] = child.min.y;
+			node.min_z[i] = child.min.z;
+			node.max_x[i] = child.max.x;
+			node.max_y[i] = child.max.y;
+			node.max_z[i] = child.max.z;
+
+			if (child.is_leaf()) {
+				node.child[i] = child.first();
+				node.count[i] = child.count();
+			} else {
+				node.child[i] = wide.nodes.size();
+				node.count[i] = 0;
+
+				stack.push_back({ slots[i], node.child[i] });
+				wide.nodes.emplace_back();
+			}
+		}
+
+		wide.nodes[task.wide] = node;
+	}
+
+	return wide;
+}
+
+template <int N>
+bool closest_hit(const WideBVH <N> &wide, const std::vector <glm::vec3> &triangles,
+		const Ray &ray, Hit &hit, float tmax)
+{
+	if (wide.empty())
+		return false;
+
+	return detail::closest_hit_wide <N> (
+		[&](uint32_t index) -> const typename WideBVH <N> ::Node & {
+			return wide.nodes[index];
+		},
+		wide.primitives, triangles, ray, hit, tmax
+	);
+}
+
+template <int N>
+bool any_hit(const WideBVH <N> &wide, const std::vector <glm::vec3> &triangles,
+		const Ray &ray, float tmax)
+{
+	if (wide.empty())
+		return false;
+
+	return detail::any_hit_wide <N> (
+		[&](uint32_t index) -> const typename WideBVH <N> ::Node & {
+			return wide.nodes[index];
+		},
+		wide.primitives, triangles, ray, tmax
+	);
+}
+
+// Instantiations
+template BVH4 collapse <4> (const BVH &);
+template BVH8 collapse <8> (const BVH &);
+
+template bool closest_hit <4> (const BVH4 &, const std::vector <glm::vec3> &, const Ray &, Hit &, float);
+template bool closest_hit <8> (const BVH8 &, const std::vector <glm::vec3> &, const Ray &, Hit &, float);
+
+template bool any_hit <4> (const BVH4 &, const std::vector <glm::vec3> &, const Ray &, float);
+template bool any_hit <8> (const BVH8 &, const std::vector <glm::vec3> &, const Ray &, float);
+
+}
@@ -0,0 +1,441 @@
+// Standard headers
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// Engine headers
+#include "include/bvh/cache.hpp"
+#include "include/daemons/bvh.hpp"
+#include "include/profiler.hpp"
+
+namespace kobra {
+
+BVHDaemon *make_bvh_daemon(System *system, const BVHOptions &options,
+                const std::filesystem::path &cache)
+{
+        BVHDaemon *daemon = new BVHDaemon;
+        daemon->system = system;
+        daemon->options = options;
+        daemon->cache = cache;
+        return daemon;
+}
+
+// World space box of an object space box
+static BoundingBox transform_box(const BoundingBox &box, const glm::mat4 &model)
+{
+        BoundingBox result {
+                glm::vec3(std::numeric_limits <float> ::max()),
+                glm::vec3(-std::numeric_limits <float> ::max())
+        };
+
+        for (int i = 0; i < 8; i++) {
+                glm::vec3 corner {
+                        (i & 1) ? box.max.x : box.min.x,
+                        (i & 2) ? box.max.y : box.min.y,
+                        (i & 4) ? box.max.z : box.min.z
+                };
+
+                glm::vec3 p = model * glm::vec4(corner, 1.0f);
+                result.min = glm::min(result.min, p);
+                result.max = glm::max(result.max, p);
+        }
+
+        return result;
+}
+
+// Retrieve the BLAS of a submesh, building it if no identical submesh has
+// been seen before; the BVH only depends on the triangle positions, which
+// are compared in full since hashes can collide
+static int32_t request_blas(BVHDaemon *daemon, const Submesh &submesh)
+{
+        uint64_t hash = submesh.hash();
+
+        std::vector <glm::vec3> triangles;
+        triangles.reserve(submesh.indices.size());
+        submesh.triangle_positions(triangles, Transform {});
+
+        std::vector <int32_t> &candidates = daemon->blas_lookup[hash];
+        for (int32_t index : candidates) {
+                const std::vector <glm::vec3> &other = daemon->blases[index].triangles;
+                if (other.size() == triangles.size()
+                                && std::memcmp(other.data(), triangles.data(),
+                                        triangles.size() * sizeof(glm::vec3)) == 0)
+                        return index;
+        }
+
+        BVHDaemon::BLAS blas;
+        blas.bbox = submesh.bbox();
+        blas.hash = hash;
+        blas.triangles = std::move(triangles);
+
+        // Try the on-disk cache before building
+        std::optional <BVH> cached;
+
+        uint64_t key = bvh_cache_key(hash, submesh, daemon->options);
+        if (!daemon->cache.empty())
+                cached = bvh_cache_load(bvh_cache_path(daemon->cache, key), key, hash, submesh);
+
+        if (cached) {
+                blas.bvh = std::move(*cached);
+                daemon->stats.blas_loaded++;
+        } else {
+                blas.bvh = submesh.bvh(Transform {}, daemon->options);
+                daemon->stats.blas_built++;
+
+                if (!daemon->cache.empty())
+                        bvh_cache_save(bvh_cache_path(daemon->cache, key), blas.bvh, key, hash, submesh);
+        }
+
+        int32_t index = daemon->blases.size();
+        daemon->blases.push_back(std::move(blas));
+        candidates.push_back(index);
+
+        return index;
+}
+
+static void update_instance(BVHDaemon *daemon, BVHDaemon::Instance &instance)
+{
+        const Transform &transform = daemon->system->get <Transform> (instance.entity);
+
+        instance.model = transform.matrix();
+        instance.inverse = glm::inverse(instance.model);
+        instance.bbox = transform_box(daemon->blases[instance.blas].bbox, instance.model);
+}
+
+// Rebuild the TLAS over the current instance boxes
+static void build_tlas(BVHDaemon *daemon)
+{
+        std::vector <BoundingBox> boxes;
+        boxes.reserve(daemon->instances.size());
+        for (const auto &instance : daemon->instances)
+                boxes.push_back(instance.bbox);
+
+        daemon->tlas = partition(boxes, daemon->options);
+        daemon->stats.tlas_rebuilt = true;
+
+        // Parents and depths, for refitting
+        const BVH &tlas = daemon->tlas;
+
+        daemon->parents.assign(tlas.nodes.size(), 0);
+        daemon->depths.assign(tlas.nodes.size(), 0);
+        daemon->leaves.assign(daemon->instances.size(), 0);
+        daemon->marked.assign(tlas.nodes.size(), 0);
+
+        if (tlas.empty())
+                return;
+
+        std::vector <uint32_t> stack { 0 };
+        while (!stack.empty()) {
+                uint32_t index = stack.back();
+                stack.pop_back();
+
+                const BVH::Node &node = tlas.nodes[index];
+                if (node.is_leaf()) {
+                        for (uint32_t i = 0; i < node.count(); i++)
+                                daemon->leaves[tlas.primitives[node.first() + i]] = index;
+
+                        continue;
+                }
+
+                for (uint32_t child : { node.left, node.right }) {
+                        daemon->parents[child] = index;
+                        daemon->depths[child] = daemon->depths[index] + 1;
+                        stack.push_back(child);
+                }
+        }
+}
+
+// Refit the TLAS along the paths from the given instances to the root
+static void refit_tlas(BVHDaemon *daemon, const std::vector <int32_t> &changed)
+{
+        BVH &tlas = daemon->tlas;
+
+        // Collect the affected nodes, each once
+        std::vector <uint32_t> nodes;
+        for (int32_t i : changed) {
+                uint32_t index = daemon->leaves[i];
+                while (!daemon->marked[index]) {
+                        daemon->marked[index] = 1;
+                        nodes.push_back(index);
+
+                        if (index == 0)
+                                break;
+
+                        index = daemon->parents[index];
+                }
+        }
+
+        // Deepest nodes first, so that children are always refit before
+        // their parents
+        std::sort(nodes.begin(), nodes.end(),
+                [&](uint32_t a, uint32_t b) {
+                        return daemon->depths[a] > daemon->depths[b];
+                }
+        );
+
+        for (uint32_t index : nodes) {
+                BVH::Node &node = tlas.nodes[index];
+
+                if (node.is_leaf()) {
+                        node.min = glm::vec3(std::numeric_limits <float> ::max());
+                        node.max = glm::vec3(-std::numeric_limits <float> ::max());
+
+                        for (uint32_t i = 0; i < node.count(); i++) {
+                                const BoundingBox &box = daemon->instances[tlas.primitives[node.first() + i]].bbox;
+                                node.min = glm::min(node.min, box.min);
+                                node.max = glm::max(node.max, box.max);
+                        }
+                } else {
+                        const BVH::Node &left = tlas.nodes[node.left];
+                        const BVH::Node &right = tlas.nodes[node.right];
+                        node.min = glm::min(left.min, right.min);
+                        node.max = glm::max(left.max, right.max);
+                }
+
+                daemon->marked[index] = 0;
+        }
+}
+
+// Drop the BLASes no instance refers to anymore, e.g. of deleted entities or
+// replaced meshes; the on-disk cache still holds them
+static void release_blases(BVHDaemon *daemon)
+{
+        std::vector <int32_t> remap(daemon->blases.size(), -1);
+        for (const auto &instance : daemon->instances)
+                remap[instance.blas] = 0;
+
+        int32_t count = 0;
+        for (int32_t i = 0; i < daemon->blases.size(); i++) {
+                if (remap[i] < 0)
+                        continue;
+
+                remap[i] = count;
+                if (i != count)
+                        daemon->blases[count] = std::move(daemon->blases[i]);
+
+                count++;
+        }
+
+        daemon->stats.blas_released = daemon->blases.size() - count;
+        if (daemon->stats.blas_released == 0)
+                return;
+
+        daemon->blases.resize(count);
+        for (auto &instance : daemon->instances)
+                instance.blas = remap[instance.blas];
+
+        daemon->blas_lookup.clear();
+        for (int32_t i = 0; i < count; i++)
+                daemon->blas_lookup[daemon->blases[i].hash].push_back(i);
+}
+
+void rebuild(BVHDaemon *daemon)
+{
+        KOBRA_PROFILE_TASK("BVHDaemon rebuild");
+
+        const System *system = daemon->system;
+
+        // Entities sharing a mesh only hash its submeshes once
+        std::map <const Submesh *, int32_t> shared;
+
+        daemon->instances.clear();
+        daemon->first_instance.assign(system->size() + 1, 0);
+
+        for (int i = 0; i < system->size(); i++) {
+                daemon->first_instance[i] = daemon->instances.size();
+                if (!system->exists <Mesh, Transform> (i))
+                        continue;
+
+                const Mesh &mesh = system->get <Mesh> (i);
+                for (int j = 0; j < mesh.submeshes.size(); j++) {
+                        BVHDaemon::Instance instance;
+                        instance.entity = i;
+                        instance.submesh = j;
+
+                        const Submesh *source = &mesh.submeshes[j];
+
+                        auto it = shared.find(source);
+                        if (it == shared.end())
+                                it = shared.emplace(source, request_blas(daemon, *source)).first;
+
+                        instance.blas = it->second;
+
+                        update_instance(daemon, instance);
+                        daemon->instances.push_back(instance);
+                }
+        }
+
+        daemon->first_instance[system->size()] = daemon->instances.size();
+
+        daemon->dirty = false;
+        daemon->dirty_entities.clear();
+
+        release_blases(daemon);
+        build_tlas(daemon);
+}
+
+void invalidate(BVHDaemon *daemon, int32_t entity)
+{
+        daemon->dirty_entities.insert(entity);
+}
+
+void invalidate(BVHDaemon *daemon)
+{
+        daemon->dirty = true;
+}
+
+// Find the BLASes of an entity whose geometry changed again; false if its
+// submeshes no longer map onto its instances
+static bool refresh_entity(BVHDaemon *daemon, int32_t entity, std::vector <int32_t> &changed)
+{
+        const System *system = daemon->system;
+
+        int32_t first = daemon->first_instance[entity];
+        int32_t count = daemon->first_instance[entity + 1] - first;
+
+        int32_t submeshes = 0;
+        if (system->exists <Mesh, Transform> (entity))
+                submeshes = system->get <Mesh> (entity).submeshes.size();
+
+        if (submeshes != count)
+                return false;
+
+        const Mesh *mesh = count ? &system->get <Mesh> (entity) : nullptr;
+        for (int32_t j = 0; j < count; j++) {
+                BVHDaemon::Instance &instance = daemon->instances[first + j];
+                instance.blas = request_blas(daemon, mesh->submeshes[j]);
+
+                update_instance(daemon, instance);
+                changed.push_back(first + j);
+        }
+
+        return true;
+}
+
+void update(BVHDaemon *daemon, const TransformDaemon *transform_daemon)
+{
+        KOBRA_PROFILE_TASK("BVHDaemon update");
+
+        daemon->stats.blas_built = 0;
+        daemon->stats.blas_loaded = 0;
+        daemon->stats.blas_released = 0;
+        daemon->stats.instances_refit = 0;
+        daemon->stats.tlas_rebuilt = false;
+
+        // Entities were added, or their submeshes changed in number; BLASes
+        // of unchanged geometry are found again through their content hash
+        int32_t entities = daemon->system->size();
+        if (daemon->dirty || daemon->first_instance.size() != entities + 1) {
+                rebuild(daemon);
+                return;
+        }
+
+        std::vector <int32_t> changed;
+
+        if (!daemon->dirty_entities.empty()) {
+                for (int32_t entity : daemon->dirty_entities) {
+                        if (!refresh_entity(daemon, entity, changed)) {
+                                rebuild(daemon);
+                                return;
+                        }
+                }
+
+                daemon->dirty_entities.clear();
+                release_blases(daemon);
+        }
+
+        // Only the entities that moved
+        for (int32_t entity : transform_daemon->changed_entities) {
+                if (entity >= entities)
+                        continue;
+
+                int32_t end = daemon->first_instance[entity + 1];
+                for (int32_t i = daemon->first_instance[entity]; i < end; i++) {
+                        update_instance(daemon, daemon->instances[i]);
+                        changed.push_back(i);
+                }
+        }
+
+        if (changed.empty())
+                return;
+
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+        // Refitting many instances degrades the TLAS, so rebuild it instead
+        // past a fraction of the scene
+        if (changed.size() > daemon->rebuild_threshold * daemon->instances.size()) {
+                build_tlas(daemon);
+                return;
+        }
+
+        refit_tlas(daemon, changed);
+        daemon->stats.instances_refit = changed.size();
+}
+
+// Whether a ray hits a box before the given distance
+static bool hits_box(const glm::vec3 &min, const glm::vec3 &max,
+                const Ray &ray, const glm::vec3 &inverse, float tmax)
+{
+        glm::vec3 t0 = (min - ray.origin) * inverse;
+        glm::vec3 t1 = (max - ray.origin) * inverse;
+
+        glm::vec3 near = glm::min(t0, t1);
+        glm::vec3 far = glm::max(t0, t1);
+
+        float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        float exit = std::min(std::min(far.x, far.y), std::min(far.z, tmax));
+
+        return enter <= exit;
+}
+
+bool closest_hit(const BVHDaemon *daemon, const Ray &ray, Hit &hit, int32_t &instance)
+{
+        const BVH &tlas = daemon->tlas;
+        if (tlas.empty())
+                return false;
+
+        glm::vec3 inverse = glm::vec3(1.0f)/ray.direction;
+
+        bool found = false;
+
+        std::vector <uint32_t> stack { 0 };
+        while (!stack.empty()) {
+                uint32_t index = stack.back();
+                stack.pop_back();
+
+                const BVH::Node &node = tlas.nodes[index];
+                if (!hits_box(node.min, node.max, ray, inverse, hit.t))
+                        continue;
+
+                if (!node.is_leaf()) {
+                        stack.push_back(node.left);
+                        stack.push_back(node.right);
+                        continue;
+                }
+
+                // Instances are traced in object space; the direction is
+                // not renormalized, so that distances carry over
+                for (uint32_t k = 0; k < node.count(); k++) {
+                        uint32_t i = tlas.primitives[node.first() + k];
+                        const BVHDaemon::Instance &candidate = daemon->instances[i];
+                        const BVHDaemon::BLAS &blas = daemon->blases[candidate.blas];
+
+                        Ray local {
+                                glm::vec3(candidate.inverse * glm::vec4(ray.origin, 1.0f)),
+                                glm::vec3(candidate.inverse * glm::vec4(ray.direction, 0.0f))
+                        };
+
+                        Hit local_hit;
+                        if (closest_hit(blas.bvh, blas.triangles, local, local_hit, hit.t)) {
+                                hit = local_hit;
+                                instance = i;
+                                found = true;
+                        }
+                }
+        }
+
+        return found;
+}
+
+}
@@ -15,6 +15,7 @@ void subscribe(MaterialDaemon *daemon, MaterialDaemon::Forward forward)
 void signal_update(MaterialDaemon *daemon, int32_t id)
 {
         daemon->status[id] = 1;
+        daemon->dirty[id] = 1;
 }
 
 void update(MaterialDaemon *daemon)
@@ -33,7 +34,7 @@ void update(MaterialDaemon *daemon)
         }
 }
 
-static Material load_material(std::ifstream &file)
+static Material load_material(std::istream &file)
 {
         Material material;
 
@@ -105,6 +106,12 @@ int32_t load(MaterialDaemon *daemon, const std::filesystem::path &path)
                 return -1;
         }
 
+        return load(daemon, file);
+}
+
+// Materials read from files start clean; others have never been saved
+int32_t load(MaterialDaemon *daemon, std::istream &file)
+{
         Material material = load_material(file);
         if (daemon->lookup.find(material.name) != daemon->lookup.end()) {
                 std::cout << "Material already loaded: " << material.name << std::endl;
@@ -115,6 +122,7 @@ int32_t load(MaterialDaemon *daemon, const std::filesystem::path &path)
         daemon->materials.push_back(material);
         daemon->lookup[material.name] = id;
         daemon->status.push_back(0);
+        daemon->dirty.push_back(0);
 
         return id;
 }
@@ -130,6 +138,7 @@ int32_t load(MaterialDaemon *daemon, const Material &material)
         daemon->materials.push_back(material);
         daemon->lookup[material.name] = id;
         daemon->status.push_back(0);
+        daemon->dirty.push_back(1);
 
         return id;
 }
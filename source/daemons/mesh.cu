@@ -22,12 +22,14 @@ void MeshDaemon::fill_cachelet(Cachelet &cachelet, const Submesh &submesh)
 }
 
 // Generate cache information for a renderable for CUDA
-void MeshDaemon::cache_cuda(const Entity &entity)
+bool MeshDaemon::cache_cuda(const Entity &entity)
 {
+        auto &renderable = entity.get <Renderable> ();
+
 	// Check if we need to cache
-	// TODO: check if the renderable has changed
-	if (m_cache.find(entity.id) != m_cache.end()) {
-		Cache cache = m_cache[entity.id];
+	auto it = m_cache.find(entity.id);
+	if (it != m_cache.end()) {
+		Cache &cache = it->second;
 		
 		int count = 0;
 		for (auto &cachelet : cache.m_cachelets) {
@@ -40,11 +42,21 @@ void MeshDaemon::cache_cuda(const Entity &entity)
 			count++;
 		}
 
-		if (count == cache.m_cachelets.size())
-			return;
+		if (count == cache.m_cachelets.size()
+				&& cache.m_generation == renderable.generation)
+			return false;
+
+		// Stale (e.g. paged in or out); the callers replace every
+		// reference to the old buffers before using them again
+		for (auto &cachelet : cache.m_cachelets) {
+			if (cachelet.m_cuda_triangles)
+				cuda::free(cachelet.m_cuda_triangles);
+
+			if (cachelet.m_cuda_vertices)
+				cuda::free(cachelet.m_cuda_vertices);
+		}
 	}
 
-        auto &renderable = entity.get <Renderable> ();
 	int submeshes = renderable.size();
 
 	std::vector <Cachelet> cachelets(submeshes);
@@ -55,9 +67,8 @@ void MeshDaemon::cache_cuda(const Entity &entity)
 	}
 
 	// Insert into cache
-	Cache cache { cachelets };
-
-	m_cache.insert({ entity.id, cache });
+	m_cache[entity.id] = Cache { cachelets, renderable.generation };
+	return true;
 }
 
 }
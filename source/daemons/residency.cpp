@@ -0,0 +1,331 @@
+// Standard headers
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+// Engine headers
+#include "include/daemons/residency.hpp"
+#include "include/instancing.hpp"
+#include "include/profiler.hpp"
+
+namespace kobra {
+
+ResidencyDaemon *make_residency_daemon(System *system, const ResidencyDaemon::Loader &loader, size_t budget)
+{
+        ResidencyDaemon *daemon = new ResidencyDaemon;
+        daemon->system = system;
+        daemon->loader = loader;
+        daemon->budget = budget;
+        return daemon;
+}
+
+Mesh proxy_mesh(const std::vector <ResidencyDaemon::Source> &sources)
+{
+        std::vector <Submesh> submeshes;
+        for (const auto &source : sources) {
+                glm::vec3 center = (source.bounds.min + source.bounds.max)/2.0f;
+                glm::vec3 extent = (source.bounds.max - source.bounds.min)/2.0f;
+
+                Submesh box = Mesh::box(center, extent).submeshes[0];
+                box.material_index = source.material;
+                submeshes.push_back(box);
+        }
+
+        return Mesh(submeshes);
+}
+
+void track(ResidencyDaemon *daemon, int32_t entity, const std::vector <ResidencyDaemon::Source> &sources)
+{
+        daemon->sources[entity] = sources;
+}
+
+bool is_resident(const ResidencyDaemon *daemon, int32_t entity)
+{
+        return daemon->sources.count(entity) == 0
+                || daemon->resident.count(entity) > 0;
+}
+
+const std::vector <ResidencyDaemon::Source> *proxied(const ResidencyDaemon *daemon, int32_t entity)
+{
+        auto it = daemon->sources.find(entity);
+        if (it == daemon->sources.end() || daemon->resident.count(entity))
+                return nullptr;
+
+        return &it->second;
+}
+
+//////////////////////
+// Paging in or out //
+//////////////////////
+
+// Bytes of vertex and index data of an entity
+static size_t entity_bytes(const ResidencyDaemon *daemon, int32_t entity)
+{
+        size_t bytes = 0;
+        for (const auto &source : daemon->sources.at(entity))
+                bytes += source.vertices * sizeof(Vertex) + source.indices * sizeof(uint32_t);
+
+        return bytes;
+}
+
+// Read the submeshes of an entity; safe to call in parallel for distinct
+// entities. The counts of the sources are corrected from the files, so that
+// accounting matches what is in memory
+static std::optional <std::vector <Submesh>> decode(const ResidencyDaemon::Loader &loader,
+                std::vector <ResidencyDaemon::Source> &sources)
+{
+        std::vector <Submesh> submeshes;
+        for (auto &source : sources) {
+                std::optional <Submesh> submesh = loader(source.file);
+                if (!submesh)
+                        return std::nullopt;
+
+                source.vertices = submesh->vertices.size();
+                source.indices = submesh->indices.size();
+
+                if (source.transform != glm::mat4 { 1.0f })
+                        submesh = instantiate(*submesh, source.transform);
+
+                submesh->material_index = source.material;
+                submeshes.push_back(std::move(*submesh));
+        }
+
+        return submeshes;
+}
+
+// Recreate the renderable of an entity after its mesh changed; frames in
+// flight may still use the old buffers, so they are released from the sync
+// queue, once the graphics queue is idle. The new renderable has a new
+// generation, which is how caches keyed by the entity (CUDA buffers, GASes,
+// descriptor sets) notice that they are stale
+static void refresh_renderable(System *system, const Context &context, int32_t entity)
+{
+        if (!system->exists <Renderable> (entity))
+                return;
+
+        RenderablePtr old = system->rasterizers[entity];
+        system->add <Renderable> (entity, context, &system->get <Mesh> (entity));
+
+        if (context.sync_queue)
+                context.sync_queue->push({ "Release paged out buffers", [old]() {} });
+}
+
+// The mesh is modified in place, since renderables point to it; the sources
+// are those the submeshes were read with
+static void install(ResidencyDaemon *daemon, const Context &context, int32_t entity,
+                std::vector <ResidencyDaemon::Source> &&sources, std::vector <Submesh> &&submeshes)
+{
+        daemon->sources.at(entity) = std::move(sources);
+        daemon->system->get <Mesh> (entity).submeshes = std::move(submeshes);
+        refresh_renderable(daemon->system, context, entity);
+        daemon->swapped.push_back(entity);
+
+        daemon->lru.push_back(entity);
+        daemon->resident[entity] = std::prev(daemon->lru.end());
+        daemon->resident_bytes += entity_bytes(daemon, entity);
+
+        daemon->stats.paged_in++;
+        daemon->stats.peak_bytes = std::max(daemon->stats.peak_bytes, daemon->resident_bytes);
+}
+
+static void evict(ResidencyDaemon *daemon, const Context &context, int32_t entity)
+{
+        auto it = daemon->resident.find(entity);
+        daemon->lru.erase(it->second);
+        daemon->resident.erase(it);
+        daemon->resident_bytes -= entity_bytes(daemon, entity);
+
+        const auto &sources = daemon->sources.at(entity);
+        daemon->system->get <Mesh> (entity).submeshes = proxy_mesh(sources).submeshes;
+        refresh_renderable(daemon->system, context, entity);
+        daemon->swapped.push_back(entity);
+
+        daemon->stats.evicted++;
+}
+
+// Mark as most recently used
+static void touch(ResidencyDaemon *daemon, int32_t entity)
+{
+        daemon->lru.splice(daemon->lru.end(), daemon->lru, daemon->resident.at(entity));
+}
+
+// Start reading an entity on the executor
+static void start(ResidencyDaemon *daemon, int32_t entity)
+{
+        auto pending = std::make_shared <ResidencyDaemon::Pending> ();
+        pending->sources = daemon->sources.at(entity);
+
+        ResidencyDaemon::Pending *ptr = pending.get();
+        pending->taskflow.emplace([ptr, loader = daemon->loader]() {
+                ptr->submeshes = decode(loader, ptr->sources);
+        });
+
+        pending->ready = daemon->executor.run(pending->taskflow);
+
+        daemon->pending[entity] = pending;
+        daemon->pending_bytes += entity_bytes(daemon, entity);
+}
+
+// Stop tracking a finished read; its geometry, if any, is moved out
+static std::shared_ptr <ResidencyDaemon::Pending> finish(ResidencyDaemon *daemon, int32_t entity)
+{
+        auto it = daemon->pending.find(entity);
+        std::shared_ptr <ResidencyDaemon::Pending> pending = it->second;
+        daemon->pending.erase(it);
+        daemon->pending_bytes -= entity_bytes(daemon, entity);
+
+        if (!pending->submeshes) {
+                KOBRA_LOG_FUNC(Log::WARN) << "Could not page in entity "
+                        << daemon->system->get_entity(entity).name << std::endl;
+                daemon->failed.insert(entity);
+        }
+
+        return pending;
+}
+
+bool request(ResidencyDaemon *daemon, const Context &context, int32_t entity)
+{
+        auto it = daemon->sources.find(entity);
+        if (it == daemon->sources.end())
+                return true;
+
+        if (daemon->resident.count(entity)) {
+                touch(daemon, entity);
+                return true;
+        }
+
+        // Entities already being read are waited for
+        if (!daemon->pending.count(entity))
+                start(daemon, entity);
+
+        daemon->pending.at(entity)->ready.wait();
+
+        std::shared_ptr <ResidencyDaemon::Pending> pending = finish(daemon, entity);
+        if (!pending->submeshes)
+                return false;
+
+        // Requested entities are paged in even if they alone exceed the
+        // budget; everything else is evicted for them then
+        size_t bytes = 0;
+        for (const auto &source : pending->sources)
+                bytes += source.vertices * sizeof(Vertex) + source.indices * sizeof(uint32_t);
+
+        while (!daemon->lru.empty() && daemon->resident_bytes + bytes > daemon->budget)
+                evict(daemon, context, daemon->lru.front());
+
+        install(daemon, context, entity, std::move(pending->sources), std::move(*pending->submeshes));
+        daemon->failed.erase(entity);
+        return true;
+}
+
+void update(ResidencyDaemon *daemon, const Context &context, const glm::vec3 &camera, int max_in_flight)
+{
+        if (daemon->sources.empty())
+                return;
+
+        KOBRA_PROFILE_TASK("ResidencyDaemon update");
+
+        System *system = daemon->system;
+
+        // Distance from the camera to the (bounding sphere of the) world
+        // space bounds of each tracked entity
+        std::map <int32_t, float> distances;
+        std::vector <std::pair <float, int32_t>> order;
+
+        for (const auto &pr : daemon->sources) {
+                BoundingBox box {
+                        glm::vec3(std::numeric_limits <float> ::max()),
+                        glm::vec3(-std::numeric_limits <float> ::max())
+                };
+
+                for (const auto &source : pr.second) {
+                        box.min = glm::min(box.min, source.bounds.min);
+                        box.max = glm::max(box.max, source.bounds.max);
+                }
+
+                const Transform &transform = system->get <Transform> (pr.first);
+                glm::vec3 scale = glm::abs(transform.scale);
+
+                glm::vec3 center = transform.matrix() * glm::vec4((box.min + box.max)/2.0f, 1.0f);
+                float radius = glm::length(box.max - box.min)/2.0f
+                        * std::max(scale.x, std::max(scale.y, scale.z));
+
+                float distance = std::max(glm::length(camera - center) - radius, 0.0f);
+
+                distances[pr.first] = distance;
+                order.push_back({ distance, pr.first });
+        }
+
+        std::sort(order.begin(), order.end());
+
+        // Resident entities are used from far to near, so that the farthest
+        // are evicted first
+        for (auto it = order.rbegin(); it != order.rend(); it++) {
+                if (daemon->resident.count(it->second))
+                        touch(daemon, it->second);
+        }
+
+        // Swap in what has been read since the last update, farthest first,
+        // so that the nearest are the most recently used; renderables own
+        // GPU resources, so this stays on the calling thread
+        for (auto it = order.rbegin(); it != order.rend(); it++) {
+                auto pending = daemon->pending.find(it->second);
+                if (pending == daemon->pending.end()
+                                || pending->second->ready.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                        continue;
+
+                std::shared_ptr <ResidencyDaemon::Pending> finished = finish(daemon, it->second);
+                if (finished->submeshes)
+                        install(daemon, context, it->second, std::move(finished->sources), std::move(*finished->submeshes));
+        }
+
+        // Recorded counts may have been stale
+        while (!daemon->lru.empty() && daemon->resident_bytes > daemon->budget)
+                evict(daemon, context, daemon->lru.front());
+
+        // The nearest missing entities, while they fit in the budget or
+        // farther entities can make room for them; decided on the recorded
+        // counts, before anything is read. Geometry being read takes memory
+        // as soon as it is decoded, so room is made right away
+        size_t projected = daemon->resident_bytes + daemon->pending_bytes;
+        auto victim = daemon->lru.begin();
+
+        std::vector <int32_t> victims;
+        for (const auto &pr : order) {
+                if ((int) daemon->pending.size() >= max_in_flight)
+                        break;
+
+                int32_t entity = pr.second;
+                if (daemon->resident.count(entity)
+                                || daemon->pending.count(entity)
+                                || daemon->failed.count(entity))
+                        continue;
+
+                size_t bytes = entity_bytes(daemon, entity);
+                while (projected + bytes > daemon->budget
+                                && victim != daemon->lru.end()
+                                && distances[*victim] > pr.first) {
+                        projected -= entity_bytes(daemon, *victim);
+                        victims.push_back(*victim++);
+                }
+
+                // Farther entities would not fit either
+                if (projected + bytes > daemon->budget)
+                        break;
+
+                projected += bytes;
+                start(daemon, entity);
+        }
+
+        for (int32_t entity : victims)
+                evict(daemon, context, entity);
+}
+
+void set_budget(ResidencyDaemon *daemon, const Context &context, size_t budget)
+{
+        daemon->budget = budget;
+        while (!daemon->lru.empty() && daemon->resident_bytes > budget)
+                evict(daemon, context, daemon->lru.front());
+}
+
+}
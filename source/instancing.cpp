@@ -0,0 +1,255 @@
+// Standard headers
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// Engine headers
+#include "../include/core/flat_map.hpp"
+#include "../include/instancing.hpp"
+
+namespace kobra {
+
+// Exact copies; same bytes
+static bool identical(const Submesh &a, const Submesh &b)
+{
+	return a.vertices.size() == b.vertices.size()
+		&& a.indices == b.indices
+		&& std::memcmp(a.vertices.data(), b.vertices.data(),
+			a.vertices.size() * sizeof(Vertex)) == 0;
+}
+
+// Hash of everything a similarity transform leaves unchanged
+static uint64_t topology_hash(const Submesh &submesh)
+{
+	uint64_t hash = core::hash_words(submesh.indices.data(),
+		submesh.indices.size() * sizeof(uint32_t));
+
+	for (const Vertex &vertex : submesh.vertices)
+		hash = core::hash_words(&vertex.tex_coords, sizeof(glm::vec2), hash);
+
+	return hash ^ submesh.vertices.size();
+}
+
+static bool same_topology(const Submesh &a, const Submesh &b)
+{
+	if (a.vertices.size() != b.vertices.size() || a.indices != b.indices)
+		return false;
+
+	for (size_t i = 0; i < a.vertices.size(); i++) {
+		if (a.vertices[i].tex_coords != b.vertices[i].tex_coords)
+			return false;
+	}
+
+	return true;
+}
+
+// Frame of a submesh, from its centroid and two vertices chosen on the
+// source; the same vertices are used on the candidate
+struct SimilarityFrame {
+	glm::vec3	centroid { 0.0f };
+	float		radius = 0.0f;		// RMS distance to the centroid
+	glm::mat3	axes { 1.0f };		// Orthonormal, right handed
+	bool		valid = false;
+};
+
+static glm::vec3 centroid(const VertexList &vertices)
+{
+	glm::dvec3 sum { 0.0 };
+	for (const Vertex &vertex : vertices)
+		sum += glm::dvec3(vertex.position);
+
+	return glm::vec3(sum/double(vertices.size()));
+}
+
+static SimilarityFrame frame(const VertexList &vertices, size_t a, size_t b)
+{
+	SimilarityFrame frame;
+	frame.centroid = centroid(vertices);
+
+	double sum = 0.0;
+	for (const Vertex &vertex : vertices) {
+		glm::vec3 d = vertex.position - frame.centroid;
+		sum += glm::dot(d, d);
+	}
+
+	frame.radius = std::sqrt(sum/vertices.size());
+
+	glm::vec3 u = vertices[a].position - frame.centroid;
+	glm::vec3 w = glm::cross(u, vertices[b].position - frame.centroid);
+
+	if (glm::length(u) <= 0.0f || glm::length(w) <= 0.0f)
+		return frame;
+
+	u = glm::normalize(u);
+	w = glm::normalize(w);
+
+	frame.axes = glm::mat3(u, glm::cross(w, u), w);
+	frame.valid = true;
+
+	return frame;
+}
+
+// Vertices spanning the source well: the farthest from the centroid, then
+// the one farthest from the line through it
+static bool extreme_vertices(const VertexList &vertices, size_t &a, size_t &b)
+{
+	glm::vec3 c = centroid(vertices);
+
+	float best = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		glm::vec3 d = vertices[i].position - c;
+		if (glm::dot(d, d) > best) {
+			best = glm::dot(d, d);
+			a = i;
+		}
+	}
+
+	glm::vec3 u = vertices[a].position - c;
+
+	best = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		glm::vec3 w = glm::cross(u, vertices[i].position - c);
+		if (glm::dot(w, w) > best) {
+			best = glm::dot(w, w);
+			b = i;
+		}
+	}
+
+	return best > 0.0f;
+}
+
+// Similarity mapping the source onto the candidate, if every vertex agrees
+static std::optional <glm::mat4> fit(const Submesh &source, const Submesh &candidate, float tolerance)
+{
+	size_t a = 0;
+	size_t b = 0;
+	if (!extreme_vertices(source.vertices, a, b))
+		return std::nullopt;
+
+	SimilarityFrame from = frame(source.vertices, a, b);
+	SimilarityFrame to = frame(candidate.vertices, a, b);
+
+	if (!from.valid || !to.valid || from.radius <= 0.0f)
+		return std::nullopt;
+
+	float scale = to.radius/from.radius;
+	glm::mat3 rotation = to.axes * glm::transpose(from.axes);
+
+	glm::mat4 transform { scale * rotation };
+	transform[3] = glm::vec4(to.centroid - scale * rotation * from.centroid, 1.0f);
+
+	// Check every vertex
+	BoundingBox bbox = candidate.bbox();
+	float limit = tolerance * glm::length(bbox.max - bbox.min);
+
+	// About 0.1 degrees, for unit vectors
+	static constexpr float eDirectionTolerance = 2e-3f;
+
+	auto same_direction = [&](const glm::vec3 &x, const glm::vec3 &y) {
+		return glm::length(rotation * x - y) <= eDirectionTolerance;
+	};
+
+	for (size_t i = 0; i < source.vertices.size(); i++) {
+		const Vertex &s = source.vertices[i];
+		const Vertex &c = candidate.vertices[i];
+
+		glm::vec3 p = glm::vec3(transform * glm::vec4(s.position, 1.0f));
+		if (glm::length(p - c.position) > limit)
+			return std::nullopt;
+
+		bool directions = same_direction(s.normal, c.normal)
+			&& same_direction(s.tangent, c.tangent)
+			&& same_direction(s.bitangent, c.bitangent);
+
+		if (!directions)
+			return std::nullopt;
+	}
+
+	return transform;
+}
+
+std::vector <SubmeshInstance> find_instances(const std::vector <const Submesh *> &submeshes,
+		const InstancingOptions &options)
+{
+	std::vector <SubmeshInstance> instances(submeshes.size());
+
+	// Sources seen so far, by content and by topology
+	std::unordered_map <uint64_t, std::vector <size_t>> by_content;
+	std::unordered_map <uint64_t, std::vector <size_t>> by_topology;
+
+	for (size_t i = 0; i < submeshes.size(); i++) {
+		const Submesh &submesh = *submeshes[i];
+		uint64_t hash = submesh.hash();
+
+		instances[i] = { i, glm::mat4 { 1.0f }, true, hash };
+
+		std::vector <size_t> &same_content = by_content[hash];
+
+		bool found = false;
+		for (size_t source : same_content) {
+			if (identical(*submeshes[source], submesh)) {
+				instances[i].source = source;
+				found = true;
+				break;
+			}
+		}
+
+		if (found)
+			continue;
+
+		if (options.similarity && !submesh.vertices.empty()) {
+			std::vector <size_t> &same_topology_ = by_topology[topology_hash(submesh)];
+
+			for (size_t source : same_topology_) {
+				if (!same_topology(*submeshes[source], submesh))
+					continue;
+
+				if (auto transform = fit(*submeshes[source], submesh, options.tolerance)) {
+					instances[i] = { source, *transform, false, hash };
+					found = true;
+					break;
+				}
+			}
+
+			if (!found)
+				same_topology_.push_back(i);
+		}
+
+		if (!found)
+			same_content.push_back(i);
+	}
+
+	return instances;
+}
+
+Submesh instantiate(const Submesh &source, const glm::mat4 &transform)
+{
+	Submesh submesh = source;
+
+	// Uniform scale, so directions only need renormalizing
+	glm::mat3 linear { transform };
+
+	auto direction = [&](const glm::vec3 &v) {
+		glm::vec3 d = linear * v;
+		float length = glm::length(d);
+		return length > 0.0f ? d/length : d;
+	};
+
+	for (Vertex &vertex : submesh.vertices) {
+		vertex.position = glm::vec3(transform * glm::vec4(vertex.position, 1.0f));
+		vertex.normal = direction(vertex.normal);
+		vertex.tangent = direction(vertex.tangent);
+		vertex.bitangent = direction(vertex.bitangent);
+	}
+
+	if (!submesh.meshlets.empty())
+		meshlet_bounds(submesh.meshlets, submesh.vertices);
+
+	float scale = glm::length(linear[0]);
+	for (SubmeshLOD &lod : submesh.lods)
+		lod.error *= scale;
+
+	return submesh;
+}
+
+}
@@ -0,0 +1,594 @@
+// Standard headers
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <thread>
+
+// Unix headers
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Engine headers
+#include "obj.hpp"
+#include "../../include/core/thread_pool.hpp"
+
+namespace kobra {
+
+namespace io {
+
+// Chunks are at least this large, so that small files are parsed in one go
+static constexpr size_t eMinChunkSize = 1 << 20;
+
+// ...and at most this large when progress is reported, so that it advances
+// in small steps
+static constexpr size_t eProgressChunkSize = 16 << 20;
+
+// Read-only mapping of a whole file
+struct MappedFile {
+	const char *data = nullptr;
+	size_t size = 0;
+
+	~MappedFile() {
+		if (data)
+			munmap((void *) data, size);
+	}
+
+	bool open(const std::string &path) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			return false;
+		}
+
+		size = st.st_size;
+		if (size == 0) {
+			close(fd);
+			return true;
+		}
+
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+
+		if (mapped == MAP_FAILED)
+			return false;
+
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		data = (const char *) mapped;
+		return true;
+	}
+};
+
+// Shape (o/g) or material (usemtl) change, before a triangle of a chunk
+struct Marker {
+	uint32_t triangle;
+	std::string name;
+};
+
+// Tokenised chunk of lines; indices are 0-based, and relative (negative)
+// ones are resolved against the chunk-local attribute counts, with fixups
+// recorded so that the offsets of the chunk can be added once known
+struct Chunk {
+	const char *begin;
+	const char *end;
+
+	std::vector <float> positions;
+	std::vector <float> normals;
+	std::vector <float> texcoords;
+
+	// Three per triangle
+	std::vector <tinyobj::index_t> indices;
+	std::vector <int> materials;
+
+	// Entries of indices with relative vertex, normal and texcoord indices
+	std::vector <uint32_t> fixups[3];
+
+	std::vector <Marker> shapes;
+	std::vector <Marker> usemtl;
+	std::vector <std::string> libraries;
+
+	std::string error;
+
+	uint32_t triangles() const {
+		return indices.size()/3;
+	}
+};
+
+// Tokenising helpers
+static inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char *skip_space(const char *p, const char *end)
+{
+	while (p < end && is_space(*p))
+		p++;
+
+	return p;
+}
+
+static inline const char *skip_token(const char *p, const char *end)
+{
+	while (p < end && !is_space(*p))
+		p++;
+
+	return p;
+}
+
+static inline bool parse_float(const char *&p, const char *end, float &value)
+{
+	p = skip_space(p, end);
+	if (p < end && *p == '+')
+		p++;
+
+	auto [next, ec] = std::from_chars(p, end, value);
+	if (ec != std::errc())
+		return false;
+
+	p = next;
+	return true;
+}
+
+static inline bool parse_int(const char *&p, const char *end, int &value)
+{
+	if (p < end && *p == '+')
+		p++;
+
+	auto [next, ec] = std::from_chars(p, end, value);
+	if (ec != std::errc())
+		return false;
+
+	p = next;
+	return true;
+}
+
+// Rest of the line, without surrounding whitespace
+static inline std::string rest(const char *p, const char *end)
+{
+	p = skip_space(p, end);
+	while (end > p && is_space(end[-1]))
+		end--;
+
+	return std::string(p, end);
+}
+
+// Vertex of a face, before triangulation
+struct FaceVertex {
+	tinyobj::index_t index;
+	uint8_t relative;
+};
+
+// Resolve one component of a face vertex; counts are chunk-local
+static inline bool resolve(int raw, size_t count, int &index, uint8_t &relative, uint8_t bit)
+{
+	if (raw > 0) {
+		index = raw - 1;
+	} else if (raw < 0) {
+		index = int(count) + raw;
+		relative |= bit;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+static bool parse_face(Chunk &chunk, const char *p, const char *end,
+		std::vector <FaceVertex> &polygon)
+{
+	polygon.clear();
+
+	while (true) {
+		p = skip_space(p, end);
+		if (p >= end)
+			break;
+
+		FaceVertex fv { { -1, -1, -1 }, 0 };
+
+		int raw;
+		if (!parse_int(p, end, raw)
+				|| !resolve(raw, chunk.positions.size()/3, fv.index.vertex_index, fv.relative, 1))
+			return false;
+
+		if (p < end && *p == '/') {
+			p++;
+
+			if (p < end && *p != '/') {
+				if (!parse_int(p, end, raw)
+						|| !resolve(raw, chunk.texcoords.size()/2, fv.index.texcoord_index, fv.relative, 4))
+					return false;
+			}
+
+			if (p < end && *p == '/') {
+				p++;
+				if (!parse_int(p, end, raw)
+						|| !resolve(raw, chunk.normals.size()/3, fv.index.normal_index, fv.relative, 2))
+					return false;
+			}
+		}
+
+		if (p < end && !is_space(*p))
+			return false;
+
+		polygon.push_back(fv);
+	}
+
+	// Fan triangulation; points and lines are dropped
+	for (size_t i = 1; i + 1 < polygon.size(); i++) {
+		for (size_t k : { size_t(0), i, i + 1 }) {
+			const FaceVertex &fv = polygon[k];
+			for (int c = 0; c < 3; c++) {
+				if (fv.relative & (1 << c))
+					chunk.fixups[c].push_back(chunk.indices.size());
+			}
+
+			chunk.indices.push_back(fv.index);
+		}
+	}
+
+	return true;
+}
+
+// First pass, over the lines of a chunk
+static void tokenise(Chunk &chunk)
+{
+	std::vector <FaceVertex> polygon;
+
+	const char *line = chunk.begin;
+	while (line < chunk.end) {
+		const char *eol = (const char *) std::memchr(line, '\n', chunk.end - line);
+		if (!eol)
+			eol = chunk.end;
+
+		const char *p = skip_space(line, eol);
+		const char *q = skip_token(p, eol);
+		size_t length = q - p;
+
+		line = eol + 1;
+
+		if (length == 0 || *p == '#')
+			continue;
+
+		if (length == 1 && *p == 'v') {
+			float x = 0.0f, y = 0.0f, z = 0.0f;
+			if (!parse_float(q, eol, x) || !parse_float(q, eol, y) || !parse_float(q, eol, z)) {
+				chunk.error = "Malformed vertex: " + std::string(p, eol);
+				return;
+			}
+
+			chunk.positions.insert(chunk.positions.end(), { x, y, z });
+		} else if (length == 2 && p[0] == 'v' && p[1] == 'n') {
+			float x = 0.0f, y = 0.0f, z = 0.0f;
+			if (!parse_float(q, eol, x) || !parse_float(q, eol, y) || !parse_float(q, eol, z)) {
+				chunk.error = "Malformed normal: " + std::string(p, eol);
+				return;
+			}
+
+			chunk.normals.insert(chunk.normals.end(), { x, y, z });
+		} else if (length == 2 && p[0] == 'v' && p[1] == 't') {
+			float u = 0.0f, v = 0.0f;
+			if (!parse_float(q, eol, u)) {
+				chunk.error = "Malformed texture coordinate: " + std::string(p, eol);
+				return;
+			}
+
+			parse_float(q, eol, v);
+			chunk.texcoords.insert(chunk.texcoords.end(), { u, v });
+		} else if (length == 1 && *p == 'f') {
+			if (!parse_face(chunk, q, eol, polygon)) {
+				chunk.error = "Malformed face: " + std::string(p, eol);
+				return;
+			}
+		} else if (length == 1 && (*p == 'o' || *p == 'g')) {
+			chunk.shapes.push_back({ chunk.triangles(), rest(q, eol) });
+		} else if (length == 6 && std::memcmp(p, "usemtl", 6) == 0) {
+			chunk.usemtl.push_back({ chunk.triangles(), rest(q, eol) });
+		} else if (length == 6 && std::memcmp(p, "mtllib", 6) == 0) {
+			while (true) {
+				q = skip_space(q, eol);
+				if (q >= eol)
+					break;
+
+				const char *name = q;
+				q = skip_token(q, eol);
+				chunk.libraries.emplace_back(name, q);
+			}
+		}
+	}
+}
+
+// Offsets of a chunk into the global attribute arrays
+struct Offsets {
+	size_t positions = 0;
+	size_t normals = 0;
+	size_t texcoords = 0;
+};
+
+// Second pass; applies the offsets, validates the indices and assigns
+// materials to triangles
+static void resolve(Chunk &chunk, const Offsets &offsets, const Offsets &totals,
+		int material, const std::map <std::string, int> &material_map)
+{
+	for (uint32_t i : chunk.fixups[0])
+		chunk.indices[i].vertex_index += offsets.positions;
+
+	for (uint32_t i : chunk.fixups[1])
+		chunk.indices[i].normal_index += offsets.normals;
+
+	for (uint32_t i : chunk.fixups[2])
+		chunk.indices[i].texcoord_index += offsets.texcoords;
+
+	for (const tinyobj::index_t &index : chunk.indices) {
+		bool valid = index.vertex_index >= 0 && size_t(index.vertex_index) < totals.positions
+			&& index.normal_index >= -1 && index.normal_index < int64_t(totals.normals)
+			&& index.texcoord_index >= -1 && index.texcoord_index < int64_t(totals.texcoords);
+
+		if (!valid) {
+			chunk.error = "Face references a missing vertex";
+			return;
+		}
+	}
+
+	chunk.materials.resize(chunk.triangles());
+
+	uint32_t start = 0;
+	for (const Marker &marker : chunk.usemtl) {
+		std::fill(chunk.materials.begin() + start, chunk.materials.begin() + marker.triangle, material);
+
+		auto it = material_map.find(marker.name);
+		material = (it == material_map.end()) ? -1 : it->second;
+		start = marker.triangle;
+	}
+
+	std::fill(chunk.materials.begin() + start, chunk.materials.end(), material);
+}
+
+// Contiguous triangles of a chunk, belonging to a shape
+struct Range {
+	uint32_t chunk;
+	uint32_t begin;
+	uint32_t end;
+};
+
+struct PendingShape {
+	std::string name;
+	std::vector <Range> ranges;
+	size_t triangles = 0;
+};
+
+// Group triangles into shapes; a shape starts at every o or g statement,
+// and shapes without faces are dropped (as tinyobj does)
+static std::vector <PendingShape> assemble(const std::vector <Chunk> &chunks)
+{
+	std::vector <PendingShape> shapes;
+
+	PendingShape current;
+	for (uint32_t c = 0; c < chunks.size(); c++) {
+		const Chunk &chunk = chunks[c];
+
+		uint32_t cursor = 0;
+		auto flush = [&](uint32_t end) {
+			if (end > cursor) {
+				current.ranges.push_back({ c, cursor, end });
+				current.triangles += end - cursor;
+			}
+
+			cursor = end;
+		};
+
+		for (const Marker &marker : chunk.shapes) {
+			flush(marker.triangle);
+
+			if (current.triangles > 0)
+				shapes.push_back(std::move(current));
+
+			current = PendingShape {};
+			current.name = marker.name;
+		}
+
+		flush(chunk.triangles());
+	}
+
+	if (current.triangles > 0)
+		shapes.push_back(std::move(current));
+
+	return shapes;
+}
+
+bool parse_obj(const std::string &path, const std::string &directory, OBJData &data,
+		std::atomic <size_t> *parsed, const std::atomic <bool> *cancel)
+{
+	MappedFile file;
+	if (!file.open(path)) {
+		data.error = "Could not open file " + path;
+		return false;
+	}
+
+	int threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// Line aligned chunks
+	size_t count = std::max <size_t> (1, std::min <size_t> (4 * threads, file.size/eMinChunkSize));
+	if (parsed)
+		count = std::max(count, file.size/eProgressChunkSize);
+
+	std::vector <Chunk> chunks;
+
+	const char *end = file.data + file.size;
+	const char *begin = file.data;
+	for (size_t i = 0; i < count && begin < end; i++) {
+		const char *split = (i + 1 == count) ? end : file.data + (i + 1) * file.size/count;
+		if (split < begin)
+			split = begin;
+
+		const char *eol = (const char *) std::memchr(split, '\n', end - split);
+		split = eol ? eol + 1 : end;
+
+		chunks.emplace_back();
+		chunks.back().begin = begin;
+		chunks.back().end = split;
+		begin = split;
+	}
+
+	auto cancelled = [&]() {
+		return cancel && cancel->load();
+	};
+
+	// First pass: tokenise all chunks
+	core::TaskQueue tasks;
+	for (Chunk &chunk : chunks) {
+		tasks.push([&chunk, &cancelled, parsed]() {
+			if (cancelled())
+				return;
+
+			tokenise(chunk);
+			if (parsed)
+				*parsed += chunk.end - chunk.begin;
+		});
+	}
+
+	core::run_tasks(tasks, threads);
+
+	if (cancelled()) {
+		data.error = "Cancelled";
+		return false;
+	}
+
+	for (const Chunk &chunk : chunks) {
+		if (!chunk.error.empty()) {
+			data.error = chunk.error;
+			return false;
+		}
+	}
+
+	// Materials, from all referenced libraries
+	std::map <std::string, int> material_map;
+	std::vector <std::string> loaded;
+
+	for (const Chunk &chunk : chunks) {
+		for (const std::string &library : chunk.libraries) {
+			if (std::find(loaded.begin(), loaded.end(), library) != loaded.end())
+				continue;
+
+			loaded.push_back(library);
+			data.libraries.push_back((std::filesystem::path(directory) / library).string());
+
+			std::ifstream stream(data.libraries.back());
+			if (!stream.is_open()) {
+				data.warning += "Material file " + library + " not found\n";
+				continue;
+			}
+
+			std::string error;
+			tinyobj::LoadMtl(&material_map, &data.materials, &stream, &data.warning, &error);
+			if (!error.empty())
+				data.warning += error;
+		}
+	}
+
+	// Chunk offsets and the material in effect at the start of each chunk
+	std::vector <Offsets> offsets(chunks.size());
+	std::vector <int> materials(chunks.size(), -1);
+
+	Offsets totals;
+
+	int material = -1;
+	for (size_t c = 0; c < chunks.size(); c++) {
+		offsets[c] = totals;
+		materials[c] = material;
+
+		totals.positions += chunks[c].positions.size()/3;
+		totals.normals += chunks[c].normals.size()/3;
+		totals.texcoords += chunks[c].texcoords.size()/2;
+
+		if (!chunks[c].usemtl.empty()) {
+			auto it = material_map.find(chunks[c].usemtl.back().name);
+			material = (it == material_map.end()) ? -1 : it->second;
+		}
+	}
+
+	for (const Chunk &chunk : chunks) {
+		for (const Marker &marker : chunk.usemtl) {
+			if (!marker.name.empty() && material_map.count(marker.name) == 0) {
+				data.warning += "Material " + marker.name + " not found\n";
+				material_map[marker.name] = -1;
+			}
+		}
+	}
+
+	// Second pass: resolve indices and gather attributes
+	tinyobj::attrib_t &attrib = data.attrib;
+	attrib.vertices.resize(3 * totals.positions);
+	attrib.normals.resize(3 * totals.normals);
+	attrib.texcoords.resize(2 * totals.texcoords);
+
+	for (size_t c = 0; c < chunks.size(); c++) {
+		tasks.push([&, c]() {
+			Chunk &chunk = chunks[c];
+			resolve(chunk, offsets[c], totals, materials[c], material_map);
+
+			std::copy(chunk.positions.begin(), chunk.positions.end(),
+				attrib.vertices.begin() + 3 * offsets[c].positions);
+			std::copy(chunk.normals.begin(), chunk.normals.end(),
+				attrib.normals.begin() + 3 * offsets[c].normals);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+				attrib.texcoords.begin() + 2 * offsets[c].texcoords);
+
+			std::vector <float> ().swap(chunk.positions);
+			std::vector <float> ().swap(chunk.normals);
+			std::vector <float> ().swap(chunk.texcoords);
+		});
+	}
+
+	core::run_tasks(tasks, threads);
+
+	for (const Chunk &chunk : chunks) {
+		if (!chunk.error.empty()) {
+			data.error = chunk.error;
+			return false;
+		}
+	}
+
+	// Shapes, in file order
+	std::vector <PendingShape> pending = assemble(chunks);
+	data.shapes.resize(pending.size());
+
+	for (size_t s = 0; s < pending.size(); s++) {
+		tasks.push([&, s]() {
+			const PendingShape &source = pending[s];
+			tinyobj::shape_t &shape = data.shapes[s];
+
+			shape.name = source.name;
+			shape.mesh.indices.reserve(3 * source.triangles);
+			shape.mesh.material_ids.reserve(source.triangles);
+
+			for (const Range &range : source.ranges) {
+				const Chunk &chunk = chunks[range.chunk];
+				shape.mesh.indices.insert(shape.mesh.indices.end(),
+					chunk.indices.begin() + 3 * range.begin,
+					chunk.indices.begin() + 3 * range.end);
+				shape.mesh.material_ids.insert(shape.mesh.material_ids.end(),
+					chunk.materials.begin() + range.begin,
+					chunk.materials.begin() + range.end);
+			}
+
+			shape.mesh.num_face_vertices.assign(source.triangles, 3);
+			shape.mesh.smoothing_group_ids.assign(source.triangles, 0);
+		});
+	}
+
+	core::run_tasks(tasks, threads);
+
+	return true;
+}
+
+}
+
+}
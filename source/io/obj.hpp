@@ -0,0 +1,43 @@
+#pragma once
+
+// Standard headers
+#include <atomic>
+#include <string>
+#include <vector>
+
+// TinyObjLoader headers
+#include <tinyobjloader/tiny_obj_loader.h>
+
+// Parallel OBJ parser; a drop-in replacement for tinyobj::ObjReader, filling
+// in the same structures (with triangulated faces) so that the conversion in
+// mesh.cpp is shared. The file is memory mapped and split into line aligned
+// chunks, which are tokenised in parallel and stitched together in file
+// order, so the output is the same for any number of threads.
+namespace kobra {
+
+namespace io {
+
+struct OBJData {
+	tinyobj::attrib_t			attrib;
+	std::vector <tinyobj::shape_t>		shapes;
+	std::vector <tinyobj::material_t>	materials;
+
+	// Material libraries referenced by the file, under the directory,
+	// whether or not they could be read
+	std::vector <std::string>		libraries;
+
+	std::string				warning;
+	std::string				error;
+};
+
+// Materials are looked up in the given directory; returns false (with an
+// error message) if the file cannot be read or references missing vertices.
+// Optionally, the number of bytes tokenised so far is published through the
+// first pointer, and the parse is abandoned once the flag is set.
+bool parse_obj(const std::string &, const std::string &, OBJData &,
+		std::atomic <size_t> * = nullptr,
+		const std::atomic <bool> * = nullptr);
+
+}
+
+}
@@ -1,3 +1,7 @@
+// Standard headers
+#include <map>
+#include <memory>
+
 // Engine headers
 #include "include/layers/forward_renderer.hpp"
 #include "include/renderable.hpp"
@@ -62,6 +66,7 @@ ForwardRenderer::ForwardRenderer(const Context &context)
 	device = context.device;
 	phdev = context.phdev;
 	descriptor_pool = context.descriptor_pool;
+	sync_queue = context.sync_queue;
 
 	loader = context.texture_loader;
 
@@ -229,21 +234,63 @@ void ForwardRenderer::render
 		vk::SubpassContents::eInline
 	);
 
-	// TODO: on dset changes, use sync queue
+	// Descriptor sets are made for renderables drawn for the first time,
+	// and remade for a renderable replaced at the same address (its
+	// generation differs). Renderables only leave the System when they are
+	// replaced, so sets of those that are gone (and not drawn) are looked
+	// for only then. Frames in flight may still use released sets, hence
+	// the sync queue
 	PipelinePackage &pipeline_package = pipeline_packages[parameters.pipeline_package];
+	auto &dsets = pipeline_package.dsets;
+
+	auto released = std::make_shared <std::vector <RenderableDset>> ();
+
+	bool added = false;
 	for (const auto &[renderable, _] : parameters.renderables) {
-		auto &dsets = pipeline_package.dsets;
-		if (dsets.find(renderable) == dsets.end()) {
-			dsets[renderable] = make_renderable_dset(
-				pipeline_package,
-				renderable->material_indices.size()
-			);
+		auto it = dsets.find(renderable);
+		if (it != dsets.end() && it->second.first == renderable->generation)
+			continue;
+
+		if (it != dsets.end())
+			released->push_back(std::move(it->second.second));
+
+		auto &[generation, dset] = dsets[renderable];
+		generation = renderable->generation;
+		dset = make_renderable_dset(
+			pipeline_package,
+			renderable->material_indices.size()
+		);
 
-			// Configure the dset
-			configure_renderable_dset(parameters.system, pipeline_package, dsets[renderable], renderable);
+		// Configure the dset
+		configure_renderable_dset(parameters.system, pipeline_package, dset, renderable);
+		added = true;
+	}
+
+	if (added && parameters.system) {
+		std::map <const Renderable *, uint64_t> live;
+		for (const auto &renderable : parameters.system->rasterizers) {
+			if (renderable)
+				live.emplace(renderable.get(), renderable->generation);
+		}
+
+		for (const auto &[renderable, _] : parameters.renderables)
+			live.emplace(renderable, renderable->generation);
+
+		for (auto it = dsets.begin(); it != dsets.end(); ) {
+			auto current = live.find(it->first);
+			if (current != live.end() && current->second == it->second.first) {
+				it++;
+				continue;
+			}
+
+			released->push_back(std::move(it->second.second));
+			it = dsets.erase(it);
 		}
 	}
 
+	if (!released->empty() && sync_queue)
+		sync_queue->push({ "Release forward renderer descriptor sets", [released]() {} });
+
 	// Update the data
 	// TODO: update only when needed, and update lights...
 
@@ -257,12 +304,19 @@ void ForwardRenderer::render
 	pc.perspective = camera.perspective_matrix();
 	pc.view_position = camera_transform.position;
 
+	// Pixels per unit of object space error at unit distance
+	float projection = extent.height/(2.0f * std::tan(glm::radians(camera.fov)/2.0f));
+
 	int count = parameters.renderables.size();
 	for (int i = 0; i < count; i++) {
-		pc.model = std::get <1> (parameters.renderables[i])->matrix();
+		const Transform *transform = std::get <1> (parameters.renderables[i]);
+		pc.model = transform->matrix();
+
+		glm::vec3 scale = glm::abs(transform->scale);
+		float max_scale = std::max({ scale.x, scale.y, scale.z });
 
 		const Renderable *renderable = std::get <0> (parameters.renderables[i]);
-		ForwardRenderer::RenderableDset &dset = pipeline_package.dsets[renderable];
+		ForwardRenderer::RenderableDset &dset = dsets[renderable].second;
 
 		int submesh_count = renderable->size();
 		for (int j = 0; j < submesh_count; j++) {
@@ -284,8 +338,30 @@ void ForwardRenderer::render
 				*pipeline_package.ppl, 0, *dset[j], {}
 			);
 
+			// Pick the LOD from the distance to the submesh bounds
+			uint32_t first = 0;
+			uint32_t indices = renderable->index_count[j];
+
+			const auto &ranges = renderable->lod_ranges[j];
+			if (parameters.lod_threshold > 0.0f && !ranges.empty()) {
+				glm::vec4 sphere = renderable->bounding_spheres[j];
+				glm::vec3 center = transform->apply(glm::vec3(sphere));
+
+				float distance = glm::length(center - camera_transform.position)
+					- sphere.w * max_scale;
+
+				size_t level = select_lod(
+					renderable->lod_errors[j],
+					max_scale, distance, projection,
+					parameters.lod_threshold
+				);
+
+				if (level > 0)
+					std::tie(first, indices) = ranges[level - 1];
+			}
+
 			// Draw
-			cmd.drawIndexed(renderable->index_count[j], 1, 0, 0, 0);
+			cmd.drawIndexed(indices, 1, first, 0, 0);
 		}
 	}
 
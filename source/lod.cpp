@@ -0,0 +1,544 @@
+// Standard headers
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Engine headers
+#include "../include/core/flat_map.hpp"
+#include "../include/lod.hpp"
+#include "../include/mesh_optimizer.hpp"
+
+namespace kobra {
+
+// Symmetric 4x4 error quadric, with the total weight of its planes so that
+// errors are area weighted mean squared distances
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double w = 0;
+
+	// Plane n.p + d = 0, with unit n
+	static Quadric plane(const glm::vec3 &n, float d, float weight) {
+		Quadric q;
+		q.a00 = weight * n.x * n.x;
+		q.a01 = weight * n.x * n.y;
+		q.a02 = weight * n.x * n.z;
+		q.a11 = weight * n.y * n.y;
+		q.a12 = weight * n.y * n.z;
+		q.a22 = weight * n.z * n.z;
+		q.b0 = weight * n.x * d;
+		q.b1 = weight * n.y * d;
+		q.b2 = weight * n.z * d;
+		q.c = weight * double(d) * d;
+		q.w = weight;
+		return q;
+	}
+
+	Quadric &operator+=(const Quadric &q) {
+		a00 += q.a00; a01 += q.a01; a02 += q.a02;
+		a11 += q.a11; a12 += q.a12; a22 += q.a22;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		w += q.w;
+		return *this;
+	}
+
+	double error(const glm::vec3 &p) const {
+		double x = p.x, y = p.y, z = p.z;
+
+		double r = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2 * (b0 * x + b1 * y + b2 * z)
+			+ c;
+
+		return w > 0 ? std::max(r, 0.0)/w : 0.0;
+	}
+};
+
+// Vertices on borders get a plane through the border edge, perpendicular
+// to the triangle, with this much more weight than the triangle planes
+static constexpr float eBorderWeight = 10.0f;
+
+// Simplification state, kept across the levels of a chain so that errors
+// are always measured against the original surface.
+//
+// Vertices are grouped by position; the quadrics, the topology and the
+// collapses are those of the groups, so that split vertices move together.
+// Edges whose triangles disagree on the vertices at its ends (seams of UVs,
+// normals or tangents) are treated like open borders: their vertices only
+// move along them, each copy onto the copy of the target on its side, and
+// junctions of more than two are kept. Copies with identical attributes
+// (e.g. from unindexed sources) are no seam at all.
+class Simplifier {
+	enum Kind : uint8_t {
+		eManifold,
+		eBorder,	// Or on a seam
+		eLocked
+	};
+
+	// Between position groups
+	struct Collapse {
+		uint32_t	from;
+		uint32_t	to;
+		float		cost;
+	};
+
+	// Edge between position groups; the triangles on it, and whether they
+	// use different vertices (by attributes) at both of its ends; a split
+	// at one end only, e.g. at a pole, is up to that vertex
+	struct Edge {
+		uint32_t	count;
+		bool		seam;
+		uint32_t	ends[2];
+	};
+
+	const VertexList &_vertices;
+
+	// Position group of each vertex (first vertex with the same
+	// position), first vertex with identical attributes, and the members
+	// of each group, as ranges of _members
+	std::vector <uint32_t> _weld;
+	std::vector <uint32_t> _canon;
+	std::vector <uint32_t> _first_member;
+	std::vector <uint32_t> _members;
+
+	// Per position group
+	std::vector <Quadric> _quadrics;
+
+	using EdgeTable = core::FlatMap <uint64_t, Edge,
+		core::BytesHash <uint64_t>,
+		core::BytesEqual <uint64_t>>;
+
+	EdgeTable _edges;
+
+	static uint64_t _pair(uint32_t a, uint32_t b) {
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	}
+
+	// Triangles on each (welded) edge
+	void _count_edges(const std::vector <uint32_t> &indices) {
+		_edges.clear();
+		_edges.reserve(indices.size());
+
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = indices[i + k];
+				uint32_t b = indices[i + (k + 1) % 3];
+				if (_weld[a] > _weld[b])
+					std::swap(a, b);
+
+				Edge &edge = _edges.insert(_pair(_weld[a], _weld[b]),
+					{ 0, false, { _canon[a], _canon[b] } }).first;
+
+				edge.count++;
+				edge.seam |= edge.ends[0] != _canon[a] && edge.ends[1] != _canon[b];
+			}
+		}
+	}
+
+	const Edge &_edge(uint32_t a, uint32_t b) {
+		return *_edges.find(_pair(_weld[a], _weld[b]));
+	}
+
+	// Open border or seam
+	bool _boundary(uint32_t a, uint32_t b) {
+		const Edge &edge = _edge(a, b);
+		return edge.count == 1 || edge.seam;
+	}
+
+	glm::vec3 _position(uint32_t v) const {
+		return _vertices[v].position;
+	}
+public:
+	float error = 0.0f;
+
+	Simplifier(const VertexList &vertices, const std::vector <uint32_t> &indices)
+			: _vertices(vertices),
+			_weld(vertices.size()),
+			_canon(vertices.size()),
+			_first_member(vertices.size() + 1, 0),
+			_members(vertices.size()),
+			_quadrics(vertices.size()) {
+		// Weld by exact position, and by all attributes
+		using PositionTable = core::FlatMap <glm::vec3, uint32_t,
+			core::BytesHash <glm::vec3>,
+			core::BytesEqual <glm::vec3>>;
+
+		using VertexTable = core::FlatMap <Vertex, uint32_t,
+			core::BytesHash <Vertex>,
+			core::BytesEqual <Vertex>>;
+
+		PositionTable positions;
+		positions.reserve(vertices.size());
+
+		VertexTable identical;
+		identical.reserve(vertices.size());
+
+		for (size_t v = 0; v < vertices.size(); v++) {
+			_weld[v] = positions.insert(vertices[v].position, v).first;
+			_canon[v] = identical.insert(vertices[v], v).first;
+			_first_member[_weld[v] + 1]++;
+		}
+
+		std::partial_sum(_first_member.begin(), _first_member.end(), _first_member.begin());
+		{
+			std::vector <uint32_t> fill(_first_member.begin(), _first_member.end() - 1);
+			for (size_t v = 0; v < vertices.size(); v++)
+				_members[fill[_weld[v]]++] = v;
+		}
+
+		// Triangle planes, weighted by area
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			glm::vec3 a = _position(indices[i]);
+			glm::vec3 b = _position(indices[i + 1]);
+			glm::vec3 c = _position(indices[i + 2]);
+
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float length = glm::length(n);
+			if (length <= 0.0f)
+				continue;
+
+			n /= length;
+
+			Quadric q = Quadric::plane(n, -glm::dot(n, a), length/2.0f);
+			for (int k = 0; k < 3; k++)
+				_quadrics[_weld[indices[i + k]]] += q;
+		}
+
+		// Border planes, to keep open boundaries and seams in place
+		_count_edges(indices);
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			glm::vec3 p[3] = {
+				_position(indices[i]),
+				_position(indices[i + 1]),
+				_position(indices[i + 2])
+			};
+
+			glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+			if (glm::dot(n, n) <= 0.0f)
+				continue;
+
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = indices[i + k];
+				uint32_t b = indices[i + (k + 1) % 3];
+				if (!_boundary(a, b))
+					continue;
+
+				glm::vec3 edge = p[(k + 1) % 3] - p[k];
+				glm::vec3 m = glm::cross(edge, n);
+
+				float length = glm::length(m);
+				if (length <= 0.0f)
+					continue;
+
+				m /= length;
+
+				Quadric q = Quadric::plane(m, -glm::dot(m, p[k]),
+					eBorderWeight * glm::dot(edge, edge));
+
+				_quadrics[_weld[a]] += q;
+				_quadrics[_weld[b]] += q;
+			}
+		}
+	}
+
+	// Collapse edges until the target index count is reached, or until
+	// no collapse is within the error limit (squared, absolute)
+	void reduce(std::vector <uint32_t> &indices, size_t target, float limit) {
+		// Per position group
+		std::vector <uint8_t> kind(_vertices.size());
+		std::vector <uint32_t> boundary(_vertices.size());
+		std::vector <bool> touched(_vertices.size());
+
+		// Per vertex
+		std::vector <uint32_t> remap(_vertices.size());
+		std::vector <uint32_t> offsets(_vertices.size() + 1);
+		std::vector <uint32_t> adjacency;
+
+		std::vector <Collapse> collapses;
+		std::vector <std::pair <uint32_t, uint32_t>> moves;
+
+		while (indices.size() > target) {
+			size_t triangles = indices.size()/3;
+
+			// Classify position groups against the current topology;
+			// border edges are seen from one triangle and seams from
+			// two, so boundary counts two per edge either way
+			_count_edges(indices);
+
+			std::fill(kind.begin(), kind.end(), eManifold);
+			std::fill(boundary.begin(), boundary.end(), 0);
+
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				for (int k = 0; k < 3; k++) {
+					uint32_t a = _weld[indices[i + k]];
+					uint32_t b = _weld[indices[i + (k + 1) % 3]];
+
+					const Edge &edge = _edge(a, b);
+					if (edge.count > 2) {
+						kind[a] = kind[b] = eLocked;
+					} else if (edge.count == 1 || edge.seam) {
+						kind[a] = std::max <uint8_t> (kind[a], eBorder);
+						kind[b] = std::max <uint8_t> (kind[b], eBorder);
+
+						uint32_t weight = edge.count == 1 ? 2 : 1;
+						boundary[a] += weight;
+						boundary[b] += weight;
+					}
+				}
+			}
+
+			// Corners, where more than two boundary edges meet
+			for (size_t v = 0; v < _vertices.size(); v++) {
+				if (boundary[v] > 4)
+					kind[v] = eLocked;
+			}
+
+			// Candidate collapses; border vertices only move along
+			// border edges
+			collapses.clear();
+
+			auto consider = [&](uint32_t from, uint32_t to) {
+				if (kind[from] == eLocked)
+					return;
+
+				if (kind[from] == eBorder && (kind[to] == eManifold || !_boundary(from, to)))
+					return;
+
+				Quadric q = _quadrics[from];
+				q += _quadrics[to];
+
+				collapses.push_back({ from, to, float(q.error(_position(to))) });
+			};
+
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				for (int k = 0; k < 3; k++) {
+					uint32_t a = _weld[indices[i + k]];
+					uint32_t b = _weld[indices[i + (k + 1) % 3]];
+
+					consider(a, b);
+					consider(b, a);
+				}
+			}
+
+			std::sort(collapses.begin(), collapses.end(),
+				[](const Collapse &a, const Collapse &b) {
+					return a.cost < b.cost;
+				}
+			);
+
+			// Triangles around each vertex, for the flip test
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (uint32_t index : indices)
+				offsets[index + 1]++;
+
+			std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+			adjacency.resize(indices.size());
+			{
+				std::vector <uint32_t> fill(offsets.begin(), offsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); i++)
+					adjacency[fill[indices[i]]++] = i/3;
+			}
+
+			std::iota(remap.begin(), remap.end(), 0);
+			std::fill(touched.begin(), touched.end(), false);
+
+			// Vertex of the target group that a vertex moves onto: the
+			// one its triangles reach, if there is exactly one (up to
+			// identical copies)
+			auto reached = [&](uint32_t v, uint32_t to) {
+				uint32_t onto = ~0u;
+				for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++) {
+					const uint32_t *t = &indices[3 * adjacency[j]];
+					for (int k = 0; k < 3; k++) {
+						if (_weld[t[k]] != to)
+							continue;
+
+						if (onto != ~0u && _canon[onto] != _canon[t[k]])
+							return ~0u;
+
+						onto = t[k];
+					}
+				}
+
+				return onto;
+			};
+
+			// Collapse greedily; a group takes part in at most one
+			// collapse per pass, and neither do its neighbours, so
+			// that the flip test sees the final positions
+			size_t removable = triangles - target/3;
+			size_t removed = 0;
+
+			for (const Collapse &collapse : collapses) {
+				if (collapse.cost > limit || removed >= removable)
+					break;
+
+				uint32_t from = collapse.from;
+				uint32_t to = collapse.to;
+
+				if (touched[from] || touched[to])
+					continue;
+
+				// Each used vertex of the group moves onto the target
+				// vertex on its side, or that of an identical copy;
+				// without one, its attributes would be lost
+				moves.clear();
+
+				bool valid = true;
+				for (uint32_t i = _first_member[from]; i < _first_member[from + 1]; i++) {
+					uint32_t v = _members[i];
+					if (offsets[v] != offsets[v + 1])
+						moves.push_back({ v, reached(v, to) });
+				}
+
+				for (auto &[v, onto] : moves) {
+					for (size_t i = 0; i < moves.size() && onto == ~0u; i++) {
+						if (_canon[moves[i].first] == _canon[v])
+							onto = reached(moves[i].first, to);
+					}
+
+					valid &= onto != ~0u;
+				}
+
+				if (!valid)
+					continue;
+
+				bool flips = false;
+				size_t lost = 0;
+
+				for (const auto &[v, onto] : moves) {
+					for (uint32_t j = offsets[v]; j < offsets[v + 1] && !flips; j++) {
+						const uint32_t *t = &indices[3 * adjacency[j]];
+						if (_weld[t[0]] == to || _weld[t[1]] == to || _weld[t[2]] == to) {
+							lost++;
+							continue;
+						}
+
+						glm::vec3 p[3];
+						glm::vec3 q[3];
+						for (int k = 0; k < 3; k++) {
+							p[k] = _position(t[k]);
+							q[k] = _position(_weld[t[k]] == from ? to : t[k]);
+						}
+
+						glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+						glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+						// Turned by more than 60 degrees, or flipped
+						if (glm::dot(before, after) <= 0.5f * glm::length(before) * glm::length(after))
+							flips = true;
+					}
+				}
+
+				if (flips)
+					continue;
+
+				for (const auto &[v, onto] : moves) {
+					remap[v] = onto;
+
+					for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++) {
+						const uint32_t *t = &indices[3 * adjacency[j]];
+						for (int k = 0; k < 3; k++)
+							touched[_weld[t[k]]] = true;
+					}
+				}
+
+				_quadrics[to] += _quadrics[from];
+
+				error = std::max(error, collapse.cost);
+				removed += lost;
+			}
+
+			if (removed == 0)
+				break;
+
+			// Apply the collapses, dropping degenerate triangles (also
+			// those left between two copies of a position)
+			size_t kept = 0;
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				uint32_t a = remap[indices[i]];
+				uint32_t b = remap[indices[i + 1]];
+				uint32_t c = remap[indices[i + 2]];
+
+				if (_weld[a] == _weld[b] || _weld[b] == _weld[c] || _weld[c] == _weld[a])
+					continue;
+
+				indices[kept++] = a;
+				indices[kept++] = b;
+				indices[kept++] = c;
+			}
+
+			indices.resize(kept);
+		}
+	}
+};
+
+// Diagonal of the bounds of the referenced vertices
+static float extent(const VertexList &vertices, const std::vector <uint32_t> &indices)
+{
+	if (indices.empty())
+		return 0.0f;
+
+	glm::vec3 min = vertices[indices[0]].position;
+	glm::vec3 max = min;
+
+	for (uint32_t index : indices) {
+		min = glm::min(min, vertices[index].position);
+		max = glm::max(max, vertices[index].position);
+	}
+
+	return glm::length(max - min);
+}
+
+std::vector <uint32_t> simplify(const VertexList &vertices, const std::vector <uint32_t> &indices,
+		size_t target, float target_error, float *result_error)
+{
+	std::vector <uint32_t> result(indices.begin(), indices.begin() + indices.size()/3 * 3);
+
+	float limit = target_error * extent(vertices, indices);
+
+	Simplifier simplifier(vertices, result);
+	simplifier.reduce(result, target, limit * limit);
+
+	if (result_error)
+		*result_error = std::sqrt(simplifier.error);
+
+	return result;
+}
+
+std::vector <SubmeshLOD> build_lods(const VertexList &vertices, const std::vector <uint32_t> &indices,
+		const LODOptions &options)
+{
+	std::vector <SubmeshLOD> lods;
+
+	std::vector <uint32_t> current(indices.begin(), indices.begin() + indices.size()/3 * 3);
+	if (current.size()/3 <= options.min_triangles)
+		return lods;
+
+	float limit = options.target_error * extent(vertices, indices);
+
+	Simplifier simplifier(vertices, current);
+	for (uint32_t level = 0; level < options.levels; level++) {
+		size_t triangles = current.size()/3;
+		size_t target = std::max <size_t> (options.min_triangles, triangles * options.ratio);
+		if (target >= triangles)
+			break;
+
+		simplifier.reduce(current, 3 * target, limit * limit);
+
+		// Not worth a level of its own
+		if (current.size()/3 > triangles * (1.0f + options.ratio)/2.0f)
+			break;
+
+		current = optimize_vertex_cache(current, vertices.size());
+		lods.push_back({ current, std::sqrt(simplifier.error) });
+	}
+
+	return lods;
+}
+
+}
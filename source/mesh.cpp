@@ -1,4 +1,8 @@
 // Standard headers
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <thread>
 
 // GLM headers
@@ -6,6 +10,7 @@
 
 // Assimp headers
 #include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
@@ -16,9 +21,13 @@
 
 // Engine headers
 #include "../include/common.hpp"
+#include "../include/core/flat_map.hpp"
 #include "../include/core/thread_pool.hpp"
 #include "../include/mesh.hpp"
+#include "../include/mesh_import.hpp"
+#include "../include/mesh_optimizer.hpp"
 #include "../include/profiler.hpp"
+#include "io/obj.hpp"
 
 // Global operators
 namespace tinyobj {
@@ -37,51 +46,6 @@ inline bool operator==(const tinyobj::index_t &a, const tinyobj::index_t &b)
 
 }
 
-namespace std {
-
-template <>
-struct hash <tinyobj::index_t>
-{
-	size_t operator()(const tinyobj::index_t &k) const
-	{
-		return ((hash<int>()(k.vertex_index)
-			^ (hash<int>()(k.normal_index) << 1)) >> 1)
-			^ (hash<int>()(k.texcoord_index) << 1);
-	}
-};
-
-// TODO: please make a common vector type
-template <>
-struct hash <glm::vec3> {
-	size_t operator()(const glm::vec3 &v) const
-	{
-		return ((hash <float>()(v.x)
-			^ (hash <float>()(v.y) << 1)) >> 1)
-			^ (hash <float>()(v.z) << 1);
-	}
-};
-
-template <>
-struct hash <glm::vec2> {
-	size_t operator()(const glm::vec2 &v) const
-	{
-		return ((hash <float>()(v.x)
-			^ (hash <float>()(v.y) << 1)) >> 1);
-	}
-};
-
-template <>
-struct hash <kobra::Vertex> {
-	size_t operator()(kobra::Vertex const &vertex) const
-	{
-		return ((hash <glm::vec3>()(vertex.position)
-			^ (hash <glm::vec3>()(vertex.normal) << 1)) >> 1)
-			^ (hash <glm::vec2>()(vertex.tex_coords) << 1);
-	}
-};
-
-}
-
 namespace kobra {
 
 inline bool operator==(const kobra::Vertex &a, const kobra::Vertex &b)
@@ -109,68 +73,16 @@ BoundingBox Submesh::bbox() const
 	return box;
 }
 
-// Process submesh vertex data, generate tangents and bitangents
-void Submesh::_process_vertex_data()
+// Hash of the vertices and indices of the submesh
+uint64_t Submesh::hash() const
 {
-	// TODO: run a compute shader for this...
-	auto task = [&](const int &i) {
-		// Get the vertex
-		Vertex &v = vertices[i];
-
-		// Calculate tangent and bitangent
-		v.tangent = glm::vec3(0.0f);
-		v.bitangent = glm::vec3(0.0f);
-
-		// Iterate over all faces
-		for (int j = 0; j < indices.size(); j += 3) {
-			// Get the face
-			int face0 = indices[j];
-			int face1 = indices[j + 1];
-			int face2 = indices[j + 2];
-
-			// Check if the vertex is part of the face
-			if (face0 == i || face1 == i || face2 == i) {
-				// Get the face vertices
-				const auto &v1 = vertices[face0];
-				const auto &v2 = vertices[face1];
-				const auto &v3 = vertices[face2];
-
-				glm::vec3 e1 = v2.position - v1.position;
-				glm::vec3 e2 = v3.position - v1.position;
-
-				glm::vec2 uv1 = v2.tex_coords - v1.tex_coords;
-				glm::vec2 uv2 = v3.tex_coords- v1.tex_coords;
-
-				float r = 1.0f / (uv1.x * uv2.y - uv1.y * uv2.x);
-				glm::vec3 tangent = (e1 * uv2.y - e2 * uv1.y) * r;
-				glm::vec3 bitangent = (e2 * uv1.x - e1 * uv2.x) * r;
-
-				// Add the tangent and bitangent to the vertex
-				v.tangent += tangent;
-				v.bitangent += bitangent;
-			}
-		}
+	size_t sizes[2] = { vertices.size(), indices.size() };
 
-		// Normalize the tangent and bitangent
-		v.tangent = glm::normalize(v.tangent);
-		v.bitangent = glm::normalize(v.bitangent);
-	};
-
-	struct _generator {
-		int counter = 0;
-		int max = 0;
-
-		_generator(int max) : max(max) {}
+	uint64_t hash = core::hash_words(sizes, sizeof(sizes));
+	hash = core::hash_words(vertices.data(), vertices.size() * sizeof(Vertex), hash);
+	hash = core::hash_words(indices.data(), indices.size() * sizeof(uint32_t), hash);
 
-		std::optional <int> operator()() {
-			if (counter < max)
-				return counter++;
-
-			return std::nullopt;
-		}
-	};
-
-	core::run_tasks <int> (task, _generator(vertices.size()));
+	return hash;
 }
 
 // Submesh modifiers
@@ -183,6 +95,16 @@ void Submesh::transform(Submesh &submesh, const Transform &transform)
 		vertex.tangent = transform.apply_vector(vertex.tangent);
 		vertex.bitangent = transform.apply_vector(vertex.bitangent);
 	}
+
+	// Meshlet bounds follow the vertices
+	if (!submesh.meshlets.empty())
+		meshlet_bounds(submesh.meshlets, submesh.vertices);
+
+	// Errors are distances, so they scale with the vertices (conservatively,
+	// by the largest factor)
+	glm::vec3 scale = glm::abs(transform.scale);
+	for (SubmeshLOD &lod : submesh.lods)
+		lod.error *= std::max({ scale.x, scale.y, scale.z });
 }
 
 // Submesh factories
@@ -768,16 +690,41 @@ Submesh Submesh::cone(int resolution)
 	return Submesh {vertices, indices};
 }
 
+// Reorder indices and vertices for the GPU and build meshlets and the LOD
+// chain (over the final order), so that cached meshes are stored optimized
+static void finalize(Submesh &submesh)
+{
+	optimize(submesh);
+	submesh.meshlets = build_meshlets(submesh.vertices, submesh.indices);
+	submesh.lods = build_lods(submesh.vertices, submesh.indices);
+}
+
+// Hand a final submesh (with its index in the final mesh) to the import, if
+// any; called by the converters as soon as each submesh is done, so that
+// imports see them before the rest of the file is converted
+static void publish(detail::ImportHooks *hooks, size_t index, const Submesh &submesh, const Material &material)
+{
+	if (!hooks)
+		return;
+
+	hooks->finished(index, submesh, material);
+	hooks->submeshes_done++;
+}
+
 namespace assimp {
 
 static std::tuple <Submesh, Material> process_mesh(aiMesh *mesh, const aiScene *scene, const std::string &dir)
 {
-	KOBRA_PROFILE_TASK("Assimp process mesh");
+	// NOTE: runs on worker threads, whose profiler events are not kept
+	// (see Profiler::one); see process_node for the breakdown
 
 	// Mesh data
 	VertexList vertices;
         std::vector <uint32_t> indices;
 
+	vertices.reserve(mesh->mNumVertices);
+	indices.reserve(3 * mesh->mNumFaces);
+
 	// Process all the mesh's vertices
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
 		// Create a new vertex
@@ -807,6 +754,21 @@ static std::tuple <Submesh, Material> process_mesh(aiMesh *mesh, const aiScene *
 			};
 		}
 
+		// Vertex tangent frame, if the source has one; otherwise it
+		// is generated with the submesh
+		if (mesh->HasTangentsAndBitangents()) {
+			v.tangent = {
+				mesh->mTangents[i].x,
+				mesh->mTangents[i].y,
+				mesh->mTangents[i].z
+			};
+
+			v.bitangent = {
+				mesh->mBitangents[i].x,
+				mesh->mBitangents[i].y,
+				mesh->mBitangents[i].z
+			};
+		}
 
 		// TODO: material?
 
@@ -866,120 +828,264 @@ static std::tuple <Submesh, Material> process_mesh(aiMesh *mesh, const aiScene *
 	return { Submesh { vertices, indices, -1 }, mat };
 }
 
-static std::tuple <Mesh, std::vector <Material>> process_node(aiNode *node, const aiScene *scene, const std::string &dir)
+// Meshes referenced by the node hierarchy, in depth first order (a node's
+// own meshes before its children's), which is the submesh order
+static void collect_meshes(aiNode *node, std::vector <unsigned int> &meshes)
 {
-	// Process all the node's meshes (if any)
-	std::vector <Submesh> submeshes;
-        std::vector <Material> materials;
+	for (size_t i = 0; i < node->mNumMeshes; i++)
+		meshes.push_back(node->mMeshes[i]);
 
-	for (size_t i = 0; i < node->mNumMeshes; i++) {
-		aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
+	for (size_t i = 0; i < node->mNumChildren; i++)
+		collect_meshes(node->mChildren[i], meshes);
+}
 
-                auto [submesh, material] = process_mesh(mesh, scene, dir);
-		submeshes.push_back(submesh);
-                materials.push_back(material);
+// Serial hierarchy pass, then each distinct aiMesh is converted (and
+// finalized) once on the thread pool into its own slot, and published right
+// away at every place it is referenced; results are assembled in hierarchy
+// order, so the output does not depend on the scheduling
+static std::optional <std::tuple <Mesh, std::vector <Material>>> process_node
+		(aiNode *node, const aiScene *scene, const std::string &dir,
+		detail::ImportHooks *hooks)
+{
+	std::vector <unsigned int> references;
+	{
+		KOBRA_PROFILE_TASK("Assimp load mesh: hierarchy");
+		collect_meshes(node, references);
 	}
 
-	// Recusively process all the node's children
-	// TODO: multithreaded task system (using a threadpool, etc) in core/
-	// std::vector <Mesh> children;
+	if (hooks)
+		hooks->submeshes_total = references.size();
 
-	for (size_t i = 0; i < node->mNumChildren; i++) {
-		auto [m, mats] = process_node(node->mChildren[i], scene, dir);
+	// Where each mesh ends up in the final mesh
+	std::vector <std::vector <size_t>> places(scene->mNumMeshes);
+	for (size_t i = 0; i < references.size(); i++)
+		places[references[i]].push_back(i);
 
-		for (size_t j = 0; j < m.submeshes.size(); j++)
-			submeshes.push_back(m.submeshes[j]);
+	// Distinct meshes, largest first so that big meshes do not end up
+	// last in the queue
+	std::vector <unsigned int> unique = references;
+	std::sort(unique.begin(), unique.end());
+	unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
 
-                materials.insert(materials.end(), mats.begin(), mats.end());
+	std::stable_sort(unique.begin(), unique.end(),
+		[&](unsigned int a, unsigned int b) {
+			return scene->mMeshes[a]->mNumFaces > scene->mMeshes[b]->mNumFaces;
+		}
+	);
+
+	std::vector <std::optional <std::tuple <Submesh, Material>>> converted(scene->mNumMeshes);
+	{
+		KOBRA_PROFILE_TASK("Assimp load mesh: converting meshes");
+
+		core::TaskQueue tasks;
+		for (unsigned int index : unique) {
+			tasks.push([&, index]() {
+				if (hooks && hooks->cancel)
+					return;
+
+				auto &[submesh, material] = converted[index].emplace(
+					process_mesh(scene->mMeshes[index], scene, dir)
+				);
+
+				finalize(submesh);
+				for (size_t place : places[index])
+					publish(hooks, place, submesh, material);
+			});
+		}
+
+		core::run_tasks(tasks);
 	}
 
-	return { Mesh { submeshes }, materials };
+	if (hooks && hooks->cancel)
+		return std::nullopt;
+
+	// Meshes referenced by several nodes are copied, as before
+	std::vector <Submesh> submeshes;
+        std::vector <Material> materials;
+
+	{
+		KOBRA_PROFILE_TASK("Assimp load mesh: assembling");
+
+		submeshes.reserve(references.size());
+		materials.reserve(references.size());
+
+		for (unsigned int index : references) {
+			const auto &[submesh, material] = converted[index].value();
+			submeshes.push_back(submesh);
+			materials.push_back(material);
+		}
+	}
+
+	return {{ Mesh { submeshes }, materials }};
 }
 
-std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::string &path)
+// Forwards the reading progress (a fraction) of Assimp to an import, and
+// aborts the read once the import is cancelled
+class ImportProgressHandler : public Assimp::ProgressHandler {
+	detail::ImportHooks *_hooks;
+public:
+	ImportProgressHandler(detail::ImportHooks *hooks) : _hooks(hooks) {}
+
+	bool Update(float percentage) override {
+		if (percentage >= 0.0f)
+			_hooks->bytes_parsed = size_t(std::min(percentage, 1.0f) * _hooks->bytes_total);
+
+		return !_hooks->cancel;
+	}
+};
+
+std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::string &path, detail::ImportHooks *hooks)
 {
 	KOBRA_PROFILE_TASK("Assimp load mesh");
 
-	// Create the Assimp importer
+	// Create the Assimp importer; it owns the progress handler
 	Assimp::Importer importer;
+	if (hooks)
+		importer.SetProgressHandler(new ImportProgressHandler(hooks));
 
 	// Read scene
-	const aiScene *scene = importer.ReadFile(
-		path, aiProcess_Triangulate
-			| aiProcess_GenNormals
-			| aiProcess_FlipUVs
-	);
+	const aiScene *scene = nullptr;
+	{
+		KOBRA_PROFILE_TASK("Assimp load mesh: reading file");
+		scene = importer.ReadFile(
+			path, aiProcess_Triangulate
+				| aiProcess_GenNormals
+				| aiProcess_FlipUVs
+		);
+	}
+
+	if (hooks && hooks->cancel)
+		return std::nullopt;
 
 	// Check if the scene was loaded
-	if (!scene | scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE
+	if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)
 			|| !scene->mRootNode) {
 		KOBRA_LOG_FUNC(Log::ERROR) << "Assimp error: "
 			<< importer.GetErrorString() << std::endl;
 		return std::nullopt;
 	}
 
+	if (hooks)
+		hooks->bytes_parsed = size_t(hooks->bytes_total);
+
 	// Process the scene (root node)
-	return process_node(scene->mRootNode, scene, common::get_directory(path));
+	return process_node(scene->mRootNode, scene, common::get_directory(path), hooks);
 }
 
 }
 
 namespace tinyobjloader {
 
+// Vertices are deduplicated by their position, normal and texture
+// coordinates (compared bitwise), face vertices by their OBJ indices
+struct VertexKey {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 tex_coords;
+};
+
+using VertexTable = core::FlatMap <VertexKey, uint32_t,
+	core::BytesHash <VertexKey>,
+	core::BytesEqual <VertexKey>>;
+
+using IndexTable = core::FlatMap <tinyobj::index_t, uint32_t,
+	core::BytesHash <tinyobj::index_t>,
+	core::BytesEqual <tinyobj::index_t>>;
+
 // TODO: alias for std::optional <std::tuple <Mesh, std::vector <Material>>>
-std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::string &path)
+// The material libraries of the file are listed in libraries, if given
+std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::string &path, detail::ImportHooks *hooks,
+		std::vector <std::string> *libraries = nullptr)
 {
 	KOBRA_PROFILE_TASK("Loading mesh");
 
-	// Loader configuration
-	tinyobj::ObjReaderConfig reader_config;
-	reader_config.mtl_search_path = common::get_directory(path);
+	std::string directory = common::get_directory(path);
 
-	// Loader
-	tinyobj::ObjReader reader;
+	// Parse the file, in parallel
+	io::OBJData data;
 
 	{
 		KOBRA_PROFILE_TASK("Loading mesh: reading file");
 
-		// Load the mesh
-		if (!reader.ParseFromFile(path, reader_config)) {
-			KOBRA_LOG_FUNC(Log::ERROR) << "TinyObjLoader error: "
-				<< reader.Error() << std::endl;
+		bool parsed = io::parse_obj(path, directory, data,
+			hooks ? &hooks->bytes_parsed : nullptr,
+			hooks ? &hooks->cancel : nullptr
+		);
+
+		if (hooks && hooks->cancel)
+			return {};
+
+		if (!parsed) {
+			KOBRA_LOG_FUNC(Log::ERROR) << "OBJ parser error: "
+				<< data.error << std::endl;
 			return {};
 		}
 
-		// Warnings
-		// TODO: cusotm logger headers (like optix)
-		if (!reader.Warning().empty())
-			KOBRA_LOG_FUNC(Log::WARN) << reader.Warning() << std::endl;
+		if (!data.warning.empty())
+			KOBRA_LOG_FUNC(Log::WARN) << data.warning << std::endl;
 
+		if (libraries)
+			*libraries = data.libraries;
 	}
 
 	// Get the mesh properties
-	auto &attrib = reader.GetAttrib();
-	auto &shapes = reader.GetShapes();
-	auto &materials = reader.GetMaterials();
+	auto &attrib = data.attrib;
+	auto &shapes = data.shapes;
+	auto &materials = data.materials;
+
+	// Load submeshes; each shape writes to its own slot, and the slots are
+	// concatenated in file order
+	std::vector <std::vector <Submesh>> shape_submeshes(shapes.size());
+	std::vector <std::vector <Material>> shape_materials(shapes.size());
+
+	// Index of the first submesh of each shape in the final mesh (a shape
+	// is split wherever its material changes), so that submeshes can be
+	// published as soon as they are done
+	std::vector <size_t> shape_offsets(shapes.size() + 1, 0);
+	for (size_t i = 0; i < shapes.size(); i++) {
+		const auto &ids = shapes[i].mesh.material_ids;
+
+		size_t count = 0;
+		for (size_t f = 0; f < shapes[i].mesh.num_face_vertices.size(); f++) {
+			if (f + 1 == shapes[i].mesh.num_face_vertices.size() || ids[f] != ids[f + 1])
+				count++;
+		}
 
-	// Load submeshes
-	std::vector <Submesh> submeshes;
-        std::vector <Material> mats;
+		shape_offsets[i + 1] = shape_offsets[i] + count;
+	}
+
+	if (hooks)
+		hooks->submeshes_total = shape_offsets.back();
 
 	{
 		KOBRA_PROFILE_TASK("Loading mesh: Loading submeshes");
 
-		std::mutex submeshes_mutex;
-
 		core::TaskQueue tasks;
 		for (int i = 0; i < shapes.size(); i++) {
 			core::Task task = [&, i]() {
+				if (hooks && hooks->cancel)
+					return;
+
 				// Get the mesh
 				auto &mesh = shapes[i].mesh;
 
+				std::vector <Submesh> &submeshes = shape_submeshes[i];
+				std::vector <Material> &mats = shape_materials[i];
+
 				std::vector <Vertex> vertices;
 				std::vector <uint32_t> indices;
 
-				std::unordered_map <Vertex, uint32_t> unique_vertices;
-				std::unordered_map <tinyobj::index_t, uint32_t> index_map;
+				// Deduplication tables, reused by every shape
+				// converted on this thread; sized for roughly
+				// one vertex per two faces, as in closed meshes
+				thread_local VertexTable unique_vertices;
+				thread_local IndexTable index_map;
+
+				unique_vertices.clear();
+				index_map.clear();
+
+				unique_vertices.reserve(mesh.num_face_vertices.size()/2 + 1);
+				index_map.reserve(mesh.num_face_vertices.size()/2 + 1);
 
 				int offset = 0;
 				for (int f = 0; f < mesh.num_face_vertices.size(); f++) {
@@ -991,8 +1097,11 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 						// Get the vertex index
 						tinyobj::index_t index = mesh.indices[offset + v];
 
-						if (index_map.count(index) > 0) {
-							indices.push_back(index_map[index]);
+						// One probe; the slot is filled in
+						// below for new indices
+						auto [slot, added] = index_map.insert(index, 0);
+						if (!added) {
+							indices.push_back(slot);
 							continue;
 						}
 
@@ -1053,16 +1162,13 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 						// indices.push_back(vertices.size() - 1);
 
 						// Add the vertex
-						uint32_t id;
-						if (unique_vertices.count(vertex) > 0) {
-							id = unique_vertices[vertex];
-						} else {
-							id = vertices.size();
-							unique_vertices[vertex] = id;
+						VertexKey key { vertex.position, vertex.normal, vertex.tex_coords };
+
+						auto [id, inserted] = unique_vertices.insert(key, vertices.size());
+						if (inserted)
 							vertices.push_back(vertex);
-						}
 
-						index_map[index] = id;
+						slot = id;
 						indices.push_back(id);
 					}
 
@@ -1112,7 +1218,7 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 							if (!m.diffuse_texname.empty()) {
 								mat.diffuse_texture = m.diffuse_texname;
 								mat.diffuse_texture = common::resolve_path(
-									m.diffuse_texname, {reader_config.mtl_search_path}
+									m.diffuse_texname, {directory}
 								);
 							}
 
@@ -1120,7 +1226,7 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 							if (!m.normal_texname.empty()) {
 								mat.normal_texture = m.normal_texname;
 								mat.normal_texture = common::resolve_path(
-									m.normal_texname, {reader_config.mtl_search_path}
+									m.normal_texname, {directory}
 								);
 							}
 
@@ -1128,7 +1234,7 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 							if (!m.specular_texname.empty()) {
 								mat.specular_texture = m.specular_texname;
 								mat.specular_texture = common::resolve_path(
-									m.specular_texname, {reader_config.mtl_search_path}
+									m.specular_texname, {directory}
 								);
 							}
 
@@ -1136,7 +1242,7 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 							if (!m.emissive_texname.empty()) {
 								mat.emission_texture = m.emissive_texname;
 								mat.emission_texture = common::resolve_path(
-									m.emissive_texname, {reader_config.mtl_search_path}
+									m.emissive_texname, {directory}
 								);
 
 								mat.type = eEmissive;
@@ -1149,9 +1255,11 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
                                                 mats.push_back(mat);
 
 						// Add submesh
-						submeshes_mutex.lock();
 						submeshes.push_back(Submesh { vertices, indices, -1 });
-						submeshes_mutex.unlock();
+
+						finalize(submeshes.back());
+						publish(hooks, shape_offsets[i] + submeshes.size() - 1,
+							submeshes.back(), mats.back());
 
 						// Clear the vertices and indices
 						unique_vertices.clear();
@@ -1166,8 +1274,18 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 			tasks.push(task);
 		}
 
-		core::run_tasks(tasks, 1);
+		core::run_tasks(tasks);
+	}
+
+	if (hooks && hooks->cancel)
+		return {};
+
+	std::vector <Submesh> submeshes;
+	std::vector <Material> mats;
 
+	for (size_t i = 0; i < shapes.size(); i++) {
+		std::move(shape_submeshes[i].begin(), shape_submeshes[i].end(), std::back_inserter(submeshes));
+		std::move(shape_materials[i].begin(), shape_materials[i].end(), std::back_inserter(mats));
 	}
 
 	return {{ Mesh { submeshes }, mats }};
@@ -1175,8 +1293,8 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> load_mesh(const std::s
 
 }
 
-// Load mesh from file
-std::optional <std::tuple <Mesh, std::vector <Material>>> Mesh::load(const std::string &path)
+// Load mesh from file, reporting to the hooks (if any) of a background import
+std::optional <std::tuple <Mesh, std::vector <Material>>> detail::load_mesh(const std::string &path, ImportHooks *hooks)
 {
 	// Special cases
 	// if (path == "box")
@@ -1189,268 +1307,67 @@ std::optional <std::tuple <Mesh, std::vector <Material>>> Mesh::load(const std::
 		return {};
 	}
 
-	/* Check if cached
+	std::error_code error;
+	size_t size = std::filesystem::file_size(path, error);
+
+	if (hooks)
+		hooks->bytes_total = error ? 0 : size;
+
+	// Check if cached; the entry is only used if the source is unchanged,
+	// and its submeshes are published as they are decoded
 	// TODO: central filesystem manager for caching, etc
-	std::string filename = ".kobra/cached/" + common::get_filename(path) + ".cache";
-	// TODO: create this directory if it doesn't exist
-	if (common::file_exists(filename))
-		return Mesh::cache_load(filename); */
+	std::string filename = Mesh::cache_path(path);
+
+	Mesh::CacheCallback decoded;
+	if (hooks) {
+		decoded = [hooks](size_t total, size_t index, const Submesh &submesh, const Material &material) {
+			hooks->bytes_parsed = size_t(hooks->bytes_total);
+			hooks->submeshes_total = total;
+			publish(hooks, index, submesh, material);
+		};
+	}
+
+	if (auto cached = Mesh::cache_load(filename, path, decoded))
+		return cached;
 
 	// Load the mesh
 	// TODO: use filesystem C++
 	std::string ext = common::file_extension(path);
 	std::cout << "Loading mesh: " << path << " - " << ext << std::endl;
 
+	// Files the source depends on, stamped in the cache along with it
+	std::vector <std::string> dependencies;
+
 	// TODO: sphere primitives...
 	std::optional <std::tuple <Mesh, std::vector <Material>>> opt;
 	if (ext == "obj") // TODO: fix this for smooth normals (option...)
-		opt = tinyobjloader::load_mesh(path);
+		opt = tinyobjloader::load_mesh(path, hooks, &dependencies);
 	else
-		opt = assimp::load_mesh(path);
+		opt = assimp::load_mesh(path, hooks);
+
+	// Cancelled imports are incomplete; they are not cached
+	if (hooks && hooks->cancel)
+		return {};
 
 	if (!opt.has_value()) {
 		KOBRA_LOG_FUNC(Log::ERROR) << "Could not load mesh: " << path << std::endl;
 		return {};
 	}
 
-	// Mesh m = std::get <0> (opt.value());
-	// m._source = path; // TODO: deprecate this field
-
-	// KOBRA_LOG_FUNC(Log::INFO) << "Loaded mesh with " << m.submeshes.size()
-	// 	<< " submeshes (#verts = " << m.vertices() << ", #triangles = "
-	// 	<< m.triangles() << "), from " << path << std::endl;
+	// The converters have already optimized (and published) every
+	// submesh, and built its meshlets and LODs
+	const auto &[mesh, materials] = opt.value();
 
 	// Cache the mesh
-	// Mesh::cache_save(m, filename);
+	if (!Mesh::cache_save(filename, path, dependencies, mesh, materials))
+		KOBRA_LOG_FUNC(Log::WARN) << "Could not cache mesh: " << path << std::endl;
 
 	return opt;
 }
 
-/* Cache mesh data to file
-// TODO: cache load entire files, store materials in a separate file
-// TODO: cache dir per scene
-void Mesh::cache_save(const Mesh &mesh, const std::string &path)
+std::optional <std::tuple <Mesh, std::vector <Material>>> Mesh::load(const std::string &path)
 {
-	// TODO: ensure that the directory is created
-	std::ofstream file(path, std::ios::binary);
-
-	// Write the number of submeshes
-	uint32_t num_submeshes = mesh.submeshes.size();
-	file.write((char *) &num_submeshes, sizeof(uint32_t));
-
-	// Write data offsets
-	uint32_t offset = file.tellp();
-	offset += sizeof(uint32_t) * num_submeshes;
-
-	for (const Submesh &submesh : mesh.submeshes) {
-		file.write((char *) &offset, sizeof(uint32_t));
-
-		offset += sizeof(uint32_t) + submesh.vertices.size() * sizeof(Vertex);
-		offset += sizeof(uint32_t) + submesh.indices.size() * sizeof(uint32_t);
-
-		offset += sizeof(glm::vec3) * 4;
-		offset += sizeof(float) * 3;
-		offset += sizeof(int) + submesh.material.diffuse_texture.size();
-		offset += sizeof(int) + submesh.material.normal_texture.size();
-		offset += sizeof(int) + submesh.material.specular_texture.size();
-		offset += sizeof(int) + submesh.material.emission_texture.size();
-		offset += sizeof(int) + submesh.material.roughness_texture.size();
-
-		offset += sizeof(Shading);
-	}
-
-	for (const Submesh &s : mesh.submeshes) {
-		// TODO: static kernel function...
-		// Write the number of vertices
-		uint32_t num_vertices = s.vertices.size();
-		file.write((char *) &num_vertices, sizeof(uint32_t));
-
-		// Write the vertices
-		file.write((char *) s.vertices.data(), sizeof(Vertex) * num_vertices);
-
-		// Write the number of indices
-		uint32_t num_indices = s.indices.size();
-		file.write((char *) &num_indices, sizeof(uint32_t));
-
-		// Write the indices
-		file.write((char *) s.indices.data(), sizeof(uint32_t) * num_indices);
-
-		// Write the material
-		file.write((char *) &s.material.diffuse, sizeof(glm::vec3));
-		file.write((char *) &s.material.specular, sizeof(glm::vec3));
-		file.write((char *) &s.material.emission, sizeof(glm::vec3));
-		file.write((char *) &s.material.ambient, sizeof(glm::vec3));
-
-		file.write((char *) &s.material.shininess, sizeof(float));
-		file.write((char *) &s.material.roughness, sizeof(float));
-		file.write((char *) &s.material.refraction, sizeof(float));
-
-		// TODO: organize so that errors are not as prone
-		int tex_albedo_length = s.material.diffuse_texture.length();
-		file.write((char *) &tex_albedo_length, sizeof(int));
-		file.write(s.material.diffuse_texture.c_str(), tex_albedo_length);
-
-		int tex_normal_length = s.material.normal_texture.length();
-		file.write((char *) &tex_normal_length, sizeof(int));
-		file.write(s.material.normal_texture.c_str(), tex_normal_length);
-
-		int tex_specular_length = s.material.specular_texture.length();
-		file.write((char *) &tex_specular_length, sizeof(int));
-		file.write(s.material.specular_texture.c_str(), tex_specular_length);
-
-		int tex_emission_length = s.material.emission_texture.length();
-		file.write((char *) &tex_emission_length, sizeof(int));
-		file.write(s.material.emission_texture.c_str(), tex_emission_length);
-
-		int tex_roughness_length = s.material.roughness_texture.length();
-		file.write((char *) &tex_roughness_length, sizeof(int));
-		file.write(s.material.roughness_texture.c_str(), tex_roughness_length);
-
-		file.write((char *) &s.material.type, sizeof(Shading));
-	}
-
-	file.close();
+	return detail::load_mesh(path, nullptr);
 }
 
-// Load mesh from cache file
-std::optional <Mesh> Mesh::cache_load(const std::string &path)
-{
-	KOBRA_PROFILE_FUNCTION();
-
-	std::vector <char> data;
-
-	{
-		KOBRA_PROFILE_TASK(Reading file binary data);
-
-		std::ifstream file(path, std::ios::binary);
-		if (!file.is_open()) {
-			KOBRA_LOG_FUNC(Log::ERROR) << "Could not open cache file: "
-				<< path << std::endl;
-			return {};
-		}
-
-		// Read all the data at once
-		data = std::vector <char> (
-			(std::istreambuf_iterator <char> (file)),
-			std::istreambuf_iterator <char> ()
-		);
-
-		file.close();
-	}
-
-	// Read the number of submeshes
-	uint32_t num_submeshes = *(uint32_t *) data.data();
-	std::cout << "Reading " << num_submeshes << " submeshes from cache file @" << path << std::endl;
-
-	// Read offsets
-	std::vector <uint32_t> offsets(num_submeshes);
-	std::memcpy(offsets.data(), data.data() + sizeof(uint32_t), sizeof(uint32_t) * num_submeshes);
-
-	std::vector <Submesh> submeshes;
-	submeshes.reserve(num_submeshes);
-
-	// Extracting tasks
-	core::TaskQueue tasks;
-
-	std::mutex submeshes_mutex;
-	for (int i = 0; i < num_submeshes; i++) {
-		// TODO: static method kernel...
-		core::Task task = [i, &offsets, &data, &submeshes, &submeshes_mutex]() {
-			// Read the number of vertices
-			uint32_t offset = offsets[i];
-			uint32_t num_vertices = *(uint32_t *) &data[offset];
-			offset += sizeof(uint32_t);
-
-			// Read the vertices
-			std::vector <Vertex> vertices;
-			vertices.resize(num_vertices);
-			std::memcpy(vertices.data(), &data[offset], sizeof(Vertex) * num_vertices);
-			offset += sizeof(Vertex) * num_vertices;
-
-			// Read the number of indices
-			uint32_t num_indices = *(uint32_t *) &data[offset];
-			offset += sizeof(uint32_t);
-
-			// Read the indices
-			std::vector <uint32_t> indices;
-			indices.resize(num_indices);
-			std::memcpy(indices.data(), &data[offset], sizeof(uint32_t) * num_indices);
-			offset += sizeof(uint32_t) * num_indices;
-
-			// Read the material
-			Material material;
-
-			material.diffuse = *(glm::vec3 *) &data[offset];
-			offset += sizeof(glm::vec3);
-
-			material.specular = *(glm::vec3 *) &data[offset];
-			offset += sizeof(glm::vec3);
-
-			material.emission = *(glm::vec3 *) &data[offset];
-			offset += sizeof(glm::vec3);
-
-			material.ambient = *(glm::vec3 *) &data[offset];
-			offset += sizeof(glm::vec3);
-
-			material.shininess = *(float *) &data[offset];
-			offset += sizeof(float);
-
-			material.roughness = *(float *) &data[offset];
-			offset += sizeof(float);
-
-			material.refraction = *(float *) &data[offset];
-			offset += sizeof(float);
-
-			int tex_albedo_length = *(int *) &data[offset];
-			offset += sizeof(int);
-			material.diffuse_texture = std::string(&data[offset], tex_albedo_length);
-			offset += tex_albedo_length;
-
-			int tex_normal_length = *(int *) &data[offset];
-			offset += sizeof(int);
-			material.normal_texture = std::string(&data[offset], tex_normal_length);
-			offset += tex_normal_length;
-
-			int tex_specular_length = *(int *) &data[offset];
-			offset += sizeof(int);
-			material.specular_texture = std::string(&data[offset], tex_specular_length);
-			offset += tex_specular_length;
-
-			int tex_emission_length = *(int *) &data[offset];
-			offset += sizeof(int);
-			material.emission_texture = std::string(&data[offset], tex_emission_length);
-			offset += tex_emission_length;
-
-			int tex_roughness_length = *(int *) &data[offset];
-			offset += sizeof(int);
-			material.roughness_texture = std::string(&data[offset], tex_roughness_length);
-			offset += tex_roughness_length;
-
-			material.type = *(Shading *) &data[offset];
-			offset += sizeof(Shading);
-
-			// Create the submesh
-			submeshes_mutex.lock();
-
-			submeshes.push_back(
-				Submesh {
-					vertices, indices,
-					material, false
-				}
-			);
-
-			submeshes_mutex.unlock();
-		};
-
-		tasks.push(task);
-	}
-
-	{
-		KOBRA_PROFILE_TASK(Extracting submesh data);
-		core::run_tasks(tasks);
-	}
-
-	return Mesh {submeshes};
-} */
-
 }
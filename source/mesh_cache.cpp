@@ -0,0 +1,601 @@
+// Standard headers
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// Unix headers
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Engine headers
+#include "../include/core/flat_map.hpp"
+#include "../include/logger.hpp"
+#include "../include/mesh.hpp"
+#include "../include/profiler.hpp"
+
+// Binary mesh cache; the layout is
+//
+//	header (64 bytes)
+//	submesh table (one entry per submesh)
+//	material table (one record per material)
+//	dependency table (one record per file the source depends on)
+//	string pool (names and texture paths of the materials, and paths of
+//		the dependencies)
+//	blobs (vertices, indices, meshlets and LODs), each aligned to 64 bytes
+//
+// and a file is only used while its source file has the size, modification
+// time and sampled content hash recorded in the header, and each dependency
+// (e.g. a .mtl file) the size and modification time in its record
+namespace kobra {
+
+struct MeshCacheHeader {
+	static constexpr uint32_t eMagic = 0x48534D4B;	// "KMSH"
+	static constexpr uint32_t eVersion = 6;	// 6: dependencies
+
+	uint32_t	magic;
+	uint32_t	version;
+
+	// Source file stamp
+	uint64_t	source_size;
+	int64_t		source_mtime;	// Nanoseconds
+	uint64_t	source_hash;
+
+	uint32_t	submeshes;
+	uint32_t	materials;
+	uint64_t	strings;	// Size of the string pool
+	uint32_t	vertex_size;	// sizeof(Vertex) when written
+	uint32_t	dependencies;
+	uint32_t	reserved[2];
+};
+
+static_assert(sizeof(MeshCacheHeader) == 64, "MeshCacheHeader must be 64 bytes");
+
+// Region of the file, in bytes
+struct MeshCacheBlob {
+	uint64_t	offset;
+	uint64_t	size;
+};
+
+struct MeshCacheSubmesh {
+	MeshCacheBlob	vertices;
+	MeshCacheBlob	indices;
+
+	// See meshlet.hpp
+	MeshCacheBlob	meshlets;
+	MeshCacheBlob	meshlet_vertices;
+	MeshCacheBlob	meshlet_triangles;
+
+	// LOD records, and the index lists of all levels back to back
+	MeshCacheBlob	lods;
+	MeshCacheBlob	lod_indices;
+
+	int32_t		material_index;
+	uint32_t	reserved;
+};
+
+// Level of the LOD chain; see lod.hpp
+struct MeshCacheLOD {
+	uint32_t	indices;	// Count, in lod_indices
+	float		error;
+};
+
+// Strings are (offset, length) pairs into the pool
+struct MeshCacheString {
+	uint32_t	offset;
+	uint32_t	length;
+};
+
+struct MeshCacheMaterial {
+	float		diffuse[3];
+	float		specular[3];
+	float		emission[3];
+	float		roughness;
+	float		refraction;
+	int32_t		type;
+
+	MeshCacheString	name;
+	MeshCacheString	diffuse_texture;
+	MeshCacheString	normal_texture;
+	MeshCacheString	specular_texture;
+	MeshCacheString	emission_texture;
+	MeshCacheString	roughness_texture;
+};
+
+// Missing files are recorded with a size of eMissing, so that the entry goes
+// stale once they appear
+struct MeshCacheDependency {
+	static constexpr uint64_t eMissing = ~0ull;
+
+	MeshCacheString	path;
+	uint64_t	size;
+	int64_t		mtime;	// Nanoseconds
+};
+
+static constexpr size_t eBlobAlignment = 64;
+
+static inline size_t align_blob(size_t offset)
+{
+	return (offset + eBlobAlignment - 1) & ~(eBlobAlignment - 1);
+}
+
+// Bytes sampled from each end of the source for its hash, so that stamping
+// a multi-gigabyte file stays cheap
+static constexpr size_t eSampleSize = 1 << 20;
+
+// Size, modification time and sampled content hash of a source file
+static bool stamp(const std::string &source, MeshCacheHeader &header)
+{
+	int fd = open(source.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	header.source_size = st.st_size;
+	header.source_mtime = int64_t(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec;
+
+	size_t head = std::min <size_t> (eSampleSize, st.st_size);
+	size_t tail = std::min <size_t> (eSampleSize, st.st_size - head);
+
+	std::vector <uint8_t> sample(head + tail);
+
+	bool ok = pread(fd, sample.data(), head, 0) == ssize_t(head)
+		&& pread(fd, sample.data() + head, tail, st.st_size - tail) == ssize_t(tail);
+
+	close(fd);
+
+	header.source_hash = core::hash_words(sample.data(), sample.size());
+	return ok;
+}
+
+// Size and modification time of a dependency
+static void stamp(const std::string &dependency, MeshCacheDependency &record)
+{
+	struct stat st;
+	if (stat(dependency.c_str(), &st) != 0) {
+		record.size = MeshCacheDependency::eMissing;
+		record.mtime = 0;
+		return;
+	}
+
+	record.size = st.st_size;
+	record.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec;
+}
+
+std::filesystem::path Mesh::cache_directory;
+
+std::string Mesh::cache_path(const std::string &source)
+{
+	std::error_code error;
+	std::filesystem::path absolute = std::filesystem::absolute(source, error);
+	std::string key = error ? source : absolute.string();
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "-%016llx.kmesh",
+		(unsigned long long) core::hash_words(key.data(), key.size()));
+
+	// Not relative to the working directory, which depends on where the
+	// program was started; without a home either, entries go next to the
+	// source
+	std::filesystem::path directory = cache_directory;
+	if (directory.empty()) {
+		if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+			directory = std::filesystem::path(xdg) / "kobra" / "meshes";
+		else if (const char *home = std::getenv("HOME"); home && *home)
+			directory = std::filesystem::path(home) / ".cache" / "kobra" / "meshes";
+		else
+			directory = std::filesystem::path(key).parent_path() / ".kobra" / "cached";
+	}
+
+	return (directory / (std::filesystem::path(source).stem().string() + name)).string();
+}
+
+bool Mesh::cache_save(const std::string &path, const std::string &source,
+		const std::vector <std::string> &dependencies,
+		const Mesh &mesh, const std::vector <Material> &materials)
+{
+	KOBRA_PROFILE_TASK("Saving mesh cache");
+
+	MeshCacheHeader header {};
+	header.magic = MeshCacheHeader::eMagic;
+	header.version = MeshCacheHeader::eVersion;
+	header.submeshes = mesh.submeshes.size();
+	header.materials = materials.size();
+	header.vertex_size = sizeof(Vertex);
+	header.dependencies = dependencies.size();
+
+	if (!stamp(source, header))
+		return false;
+
+	// Material records and string pool
+	std::string strings;
+	auto intern = [&](const std::string &str) {
+		MeshCacheString ref { uint32_t(strings.size()), uint32_t(str.size()) };
+		strings += str;
+		return ref;
+	};
+
+	std::vector <MeshCacheMaterial> records(materials.size());
+	for (size_t i = 0; i < materials.size(); i++) {
+		const Material &material = materials[i];
+		MeshCacheMaterial &record = records[i];
+
+		for (int k = 0; k < 3; k++) {
+			record.diffuse[k] = material.diffuse[k];
+			record.specular[k] = material.specular[k];
+			record.emission[k] = material.emission[k];
+		}
+
+		record.roughness = material.roughness;
+		record.refraction = material.refraction;
+		record.type = material.type;
+
+		record.name = intern(material.name);
+		record.diffuse_texture = intern(material.diffuse_texture);
+		record.normal_texture = intern(material.normal_texture);
+		record.specular_texture = intern(material.specular_texture);
+		record.emission_texture = intern(material.emission_texture);
+		record.roughness_texture = intern(material.roughness_texture);
+	}
+
+	std::vector <MeshCacheDependency> stamps(dependencies.size());
+	for (size_t i = 0; i < dependencies.size(); i++) {
+		stamps[i].path = intern(dependencies[i]);
+		stamp(dependencies[i], stamps[i]);
+	}
+
+	header.strings = strings.size();
+
+	// Blob offsets
+	size_t offset = sizeof(MeshCacheHeader)
+		+ mesh.submeshes.size() * sizeof(MeshCacheSubmesh)
+		+ records.size() * sizeof(MeshCacheMaterial)
+		+ stamps.size() * sizeof(MeshCacheDependency)
+		+ strings.size();
+
+	std::vector <std::pair <const MeshCacheBlob *, const void *>> blobs;
+
+	auto blob = [&](MeshCacheBlob &blob, const auto &data) {
+		offset = align_blob(offset);
+		blob = { offset, data.size() * sizeof(data[0]) };
+		offset += blob.size;
+
+		blobs.push_back({ &blob, data.data() });
+	};
+
+	std::vector <MeshCacheSubmesh> entries(mesh.submeshes.size());
+	std::vector <std::vector <MeshCacheLOD>> lods(mesh.submeshes.size());
+	std::vector <std::vector <uint32_t>> lod_indices(mesh.submeshes.size());
+
+	for (size_t i = 0; i < mesh.submeshes.size(); i++) {
+		const Submesh &submesh = mesh.submeshes[i];
+		MeshCacheSubmesh &entry = entries[i];
+
+		entry = MeshCacheSubmesh {};
+		entry.material_index = submesh.material_index;
+
+		blob(entry.vertices, submesh.vertices);
+		blob(entry.indices, submesh.indices);
+		blob(entry.meshlets, submesh.meshlets.meshlets);
+		blob(entry.meshlet_vertices, submesh.meshlets.vertices);
+		blob(entry.meshlet_triangles, submesh.meshlets.triangles);
+
+		for (const SubmeshLOD &lod : submesh.lods) {
+			lods[i].push_back({ uint32_t(lod.indices.size()), lod.error });
+			lod_indices[i].insert(lod_indices[i].end(), lod.indices.begin(), lod.indices.end());
+		}
+
+		blob(entry.lods, lods[i]);
+		blob(entry.lod_indices, lod_indices[i]);
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+	std::string tmp = path + ".tmp";
+
+	std::ofstream file(tmp, std::ios::binary);
+	if (!file.is_open()) {
+		KOBRA_LOG_FUNC(Log::WARN) << "Could not write mesh cache file " << tmp << "\n";
+		return false;
+	}
+
+	file.write((const char *) &header, sizeof(header));
+	file.write((const char *) entries.data(), entries.size() * sizeof(MeshCacheSubmesh));
+	file.write((const char *) records.data(), records.size() * sizeof(MeshCacheMaterial));
+	file.write((const char *) stamps.data(), stamps.size() * sizeof(MeshCacheDependency));
+	file.write(strings.data(), strings.size());
+
+	auto pad = [&](size_t offset) {
+		static const char zeros[eBlobAlignment] = {};
+		size_t position = file.tellp();
+		file.write(zeros, offset - position);
+	};
+
+	for (const auto &[blob, data] : blobs) {
+		pad(blob->offset);
+		file.write((const char *) data, blob->size);
+	}
+
+	file.close();
+
+	if (!file) {
+		std::filesystem::remove(tmp, error);
+		return false;
+	}
+
+	std::filesystem::rename(tmp, path, error);
+	return !error;
+}
+
+// Structural checks, so that a truncated or corrupt file is never read out
+// of bounds
+static bool validate(const uint8_t *bytes, size_t size, const MeshCacheHeader &header)
+{
+	size_t tables = sizeof(MeshCacheHeader)
+		+ size_t(header.submeshes) * sizeof(MeshCacheSubmesh)
+		+ size_t(header.materials) * sizeof(MeshCacheMaterial)
+		+ size_t(header.dependencies) * sizeof(MeshCacheDependency);
+
+	if (header.strings > size || tables + header.strings > size)
+		return false;
+
+	const MeshCacheSubmesh *entries = (const MeshCacheSubmesh *) (bytes + sizeof(MeshCacheHeader));
+	const MeshCacheMaterial *records = (const MeshCacheMaterial *) (entries + header.submeshes);
+	const MeshCacheDependency *stamps = (const MeshCacheDependency *) (records + header.materials);
+
+	auto valid_blob = [&](const MeshCacheBlob &blob, size_t element) {
+		return blob.offset % eBlobAlignment == 0
+			&& blob.offset >= tables && blob.offset <= size
+			&& blob.size <= size - blob.offset
+			&& blob.size % element == 0;
+	};
+
+	for (uint32_t i = 0; i < header.submeshes; i++) {
+		const MeshCacheSubmesh &entry = entries[i];
+
+		bool valid = valid_blob(entry.vertices, sizeof(Vertex))
+			&& valid_blob(entry.indices, sizeof(uint32_t))
+			&& valid_blob(entry.meshlets, sizeof(Meshlet))
+			&& valid_blob(entry.meshlet_vertices, sizeof(uint32_t))
+			&& valid_blob(entry.meshlet_triangles, sizeof(uint8_t))
+			&& valid_blob(entry.lods, sizeof(MeshCacheLOD))
+			&& valid_blob(entry.lod_indices, sizeof(uint32_t));
+
+		if (!valid)
+			return false;
+
+		// Indices must stay within the submesh, and meshlets within
+		// their tables
+		size_t vertices = entry.vertices.size/sizeof(Vertex);
+
+		auto within = [&](const MeshCacheBlob &blob, size_t count) {
+			const uint32_t *index = (const uint32_t *) (bytes + blob.offset);
+			for (size_t k = 0; k < blob.size/sizeof(uint32_t); k++) {
+				if (index[k] >= count)
+					return false;
+			}
+
+			return true;
+		};
+
+		if (!within(entry.indices, vertices)
+				|| !within(entry.meshlet_vertices, vertices)
+				|| !within(entry.lod_indices, vertices))
+			return false;
+
+		// LOD index counts must add up to the shared table, in whole
+		// triangles
+		const MeshCacheLOD *lods = (const MeshCacheLOD *) (bytes + entry.lods.offset);
+
+		size_t lod_indices = 0;
+		for (size_t k = 0; k < entry.lods.size/sizeof(MeshCacheLOD); k++) {
+			if (lods[k].indices % 3 != 0)
+				return false;
+
+			lod_indices += lods[k].indices;
+		}
+
+		if (lod_indices != entry.lod_indices.size/sizeof(uint32_t))
+			return false;
+
+		const Meshlet *meshlets = (const Meshlet *) (bytes + entry.meshlets.offset);
+		const uint8_t *triangles = bytes + entry.meshlet_triangles.offset;
+
+		for (size_t k = 0; k < entry.meshlets.size/sizeof(Meshlet); k++) {
+			const Meshlet &meshlet = meshlets[k];
+
+			bool valid = size_t(meshlet.vertex_offset) + meshlet.vertex_count
+					<= entry.meshlet_vertices.size/sizeof(uint32_t)
+				&& size_t(meshlet.triangle_offset) + 3 * size_t(meshlet.triangle_count)
+					<= entry.meshlet_triangles.size;
+
+			if (!valid)
+				return false;
+
+			for (size_t t = 0; t < 3 * size_t(meshlet.triangle_count); t++) {
+				if (triangles[meshlet.triangle_offset + t] >= meshlet.vertex_count)
+					return false;
+			}
+		}
+	}
+
+	auto valid_string = [&](const MeshCacheString &str) {
+		return size_t(str.offset) + str.length <= header.strings;
+	};
+
+	for (uint32_t i = 0; i < header.materials; i++) {
+		const MeshCacheMaterial &record = records[i];
+
+		// Shading types are combinations of the known flags
+		int32_t flags = eReflection | eTransmission | eDiffuse
+			| eGlossy | eSpecular | eEmissive;
+
+		bool valid = (record.type & ~flags) == 0
+			&& valid_string(record.name)
+			&& valid_string(record.diffuse_texture)
+			&& valid_string(record.normal_texture)
+			&& valid_string(record.specular_texture)
+			&& valid_string(record.emission_texture)
+			&& valid_string(record.roughness_texture);
+
+		if (!valid)
+			return false;
+	}
+
+	for (uint32_t i = 0; i < header.dependencies; i++) {
+		if (!valid_string(stamps[i].path))
+			return false;
+	}
+
+	return true;
+}
+
+std::optional <std::tuple <Mesh, std::vector <Material>>>
+Mesh::cache_load(const std::string &path, const std::string &source, const CacheCallback &callback)
+{
+	KOBRA_PROFILE_TASK("Loading mesh cache");
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return std::nullopt;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MeshCacheHeader)) {
+		close(fd);
+		return std::nullopt;
+	}
+
+	size_t size = st.st_size;
+	void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return std::nullopt;
+
+	const uint8_t *bytes = (const uint8_t *) data;
+
+	MeshCacheHeader header;
+	std::memcpy(&header, bytes, sizeof(header));
+
+	// Stale entries are expected (the source was edited), and silently
+	// replaced; corrupt ones are reported
+	MeshCacheHeader current {};
+	bool fresh = header.magic == MeshCacheHeader::eMagic
+		&& header.version == MeshCacheHeader::eVersion
+		&& header.vertex_size == sizeof(Vertex)
+		&& stamp(source, current)
+		&& header.source_size == current.source_size
+		&& header.source_mtime == current.source_mtime
+		&& header.source_hash == current.source_hash;
+
+	if (!fresh) {
+		munmap(data, size);
+		return std::nullopt;
+	}
+
+	if (!validate(bytes, size, header)) {
+		munmap(data, size);
+		KOBRA_LOG_FUNC(Log::WARN) << "Discarding invalid mesh cache file " << path << "\n";
+		return std::nullopt;
+	}
+
+	const MeshCacheSubmesh *entries = (const MeshCacheSubmesh *) (bytes + sizeof(MeshCacheHeader));
+	const MeshCacheMaterial *records = (const MeshCacheMaterial *) (entries + header.submeshes);
+	const MeshCacheDependency *stamps = (const MeshCacheDependency *) (records + header.materials);
+	const char *strings = (const char *) (stamps + header.dependencies);
+
+	// Dependencies are checked once the tables are known to be in bounds
+	for (uint32_t i = 0; i < header.dependencies; i++) {
+		MeshCacheDependency current {};
+		stamp(std::string(strings + stamps[i].path.offset, stamps[i].path.length), current);
+
+		if (current.size != stamps[i].size || current.mtime != stamps[i].mtime) {
+			munmap(data, size);
+			return std::nullopt;
+		}
+	}
+
+	// Blobs are copied out whole; there is no per element decoding
+	auto copy = [&](auto &vector, const MeshCacheBlob &blob) {
+		using T = std::decay_t <decltype(vector[0])>;
+
+		const T *data = (const T *) (bytes + blob.offset);
+		vector.assign(data, data + blob.size/sizeof(T));
+	};
+
+	// Materials first, so that each submesh goes to the callback (if any)
+	// with its material as soon as it is decoded
+	auto string = [&](const MeshCacheString &str) {
+		return std::string(strings + str.offset, str.length);
+	};
+
+	std::vector <Material> materials(header.materials);
+	for (uint32_t i = 0; i < header.materials; i++) {
+		const MeshCacheMaterial &record = records[i];
+		Material &material = materials[i];
+
+		material.diffuse = { record.diffuse[0], record.diffuse[1], record.diffuse[2] };
+		material.specular = { record.specular[0], record.specular[1], record.specular[2] };
+		material.emission = { record.emission[0], record.emission[1], record.emission[2] };
+		material.roughness = record.roughness;
+		material.refraction = record.refraction;
+		material.type = Shading(record.type);
+
+		material.name = string(record.name);
+		material.diffuse_texture = string(record.diffuse_texture);
+		material.normal_texture = string(record.normal_texture);
+		material.specular_texture = string(record.specular_texture);
+		material.emission_texture = string(record.emission_texture);
+		material.roughness_texture = string(record.roughness_texture);
+	}
+
+	std::vector <Submesh> submeshes;
+	submeshes.reserve(header.submeshes);
+
+	for (uint32_t i = 0; i < header.submeshes; i++) {
+		const MeshCacheSubmesh &entry = entries[i];
+
+		VertexList vertices;
+		std::vector <uint32_t> indices;
+
+		copy(vertices, entry.vertices);
+		copy(indices, entry.indices);
+
+		Submesh &submesh = submeshes.emplace_back(vertices, indices, entry.material_index, false);
+
+		copy(submesh.meshlets.meshlets, entry.meshlets);
+		copy(submesh.meshlets.vertices, entry.meshlet_vertices);
+		copy(submesh.meshlets.triangles, entry.meshlet_triangles);
+
+		const MeshCacheLOD *lods = (const MeshCacheLOD *) (bytes + entry.lods.offset);
+		const uint32_t *lod_indices = (const uint32_t *) (bytes + entry.lod_indices.offset);
+
+		for (size_t k = 0; k < entry.lods.size/sizeof(MeshCacheLOD); k++) {
+			submesh.lods.push_back({
+				std::vector <uint32_t> (lod_indices, lod_indices + lods[k].indices),
+				lods[k].error
+			});
+
+			lod_indices += lods[k].indices;
+		}
+
+		if (callback) {
+			callback(header.submeshes, i, submesh,
+				i < materials.size() ? materials[i] : Material {});
+		}
+	}
+
+	munmap(data, size);
+
+	return {{ Mesh { submeshes }, materials }};
+}
+
+}
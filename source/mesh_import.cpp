@@ -0,0 +1,94 @@
+// Engine headers
+#include "../include/mesh_import.hpp"
+
+namespace kobra {
+
+std::shared_ptr <MeshImport> MeshImport::start(const std::string &path, const Callback &callback)
+{
+	std::shared_ptr <MeshImport> import(new MeshImport());
+
+	// The handle outlives the thread (the destructor joins it)
+	MeshImport *self = import.get();
+
+	// Submeshes go either to the callback or to the queue for take(); only
+	// the latter keeps a copy
+	if (callback) {
+		self->_hooks.finished = callback;
+	} else {
+		self->_hooks.finished = [self](size_t index, const Submesh &submesh, const Material &material) {
+			std::tuple <size_t, Submesh, Material> entry { index, submesh, material };
+
+			std::lock_guard <std::mutex> lock(self->_mutex);
+			self->_ready.push_back(std::move(entry));
+		};
+	}
+
+	self->_thread = std::thread([self, path]() {
+		Result result = detail::load_mesh(path, &self->_hooks);
+
+		Status status = Status::eFinished;
+		if (self->_hooks.cancel)
+			status = Status::eCancelled;
+		else if (!result)
+			status = Status::eFailed;
+
+		{
+			std::lock_guard <std::mutex> lock(self->_mutex);
+			if (status == Status::eFinished)
+				self->_result = std::move(result);
+		}
+
+		self->_status = status;
+	});
+
+	return import;
+}
+
+MeshImport::~MeshImport()
+{
+	cancel();
+	if (_thread.joinable())
+		_thread.join();
+}
+
+MeshImport::Progress MeshImport::progress() const
+{
+	return Progress {
+		_hooks.bytes_parsed,
+		_hooks.bytes_total,
+		_hooks.submeshes_done,
+		_hooks.submeshes_total
+	};
+}
+
+void MeshImport::cancel()
+{
+	// Too late once finished; the result stands
+	if (_status == Status::eRunning)
+		_hooks.cancel = true;
+}
+
+std::vector <std::tuple <size_t, Submesh, Material>> MeshImport::take()
+{
+	std::vector <std::tuple <size_t, Submesh, Material>> ready;
+
+	std::lock_guard <std::mutex> lock(_mutex);
+	ready.swap(_ready);
+
+	return ready;
+}
+
+MeshImport::Result MeshImport::get()
+{
+	if (_thread.joinable())
+		_thread.join();
+
+	std::lock_guard <std::mutex> lock(_mutex);
+
+	Result result = std::move(_result);
+	_result.reset();
+
+	return result;
+}
+
+}
@@ -0,0 +1,429 @@
+// Standard headers
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Engine headers
+#include "../include/mesh_optimizer.hpp"
+
+namespace kobra {
+
+/////////////////////////
+// Vertex cache (FIFO) //
+/////////////////////////
+
+// Simulated FIFO cache; a vertex is resident if fewer than size misses
+// happened since it was last loaded
+struct FIFOCache {
+	std::vector <uint32_t> loaded;	// Miss count after the load, zero if never
+	size_t size;
+	uint32_t misses = 0;
+
+	FIFOCache(size_t vertices, size_t size_) : loaded(vertices, 0), size(size_) {}
+
+	// Returns true on a miss
+	bool access(uint32_t v) {
+		if (loaded[v] && misses - loaded[v] < size)
+			return false;
+
+		loaded[v] = ++misses;
+		return true;
+	}
+
+	void reset() {
+		// Everything loaded so far is now too old
+		misses += size;
+	}
+};
+
+VertexCacheStats vertex_cache_stats(const std::vector <uint32_t> &indices, size_t vertices, size_t cache_size)
+{
+	VertexCacheStats stats;
+	stats.triangles = indices.size()/3;
+
+	FIFOCache cache(vertices, cache_size);
+	std::vector <bool> referenced(vertices, false);
+
+	for (size_t i = 0; i < 3 * stats.triangles; i++) {
+		uint32_t v = indices[i];
+		stats.transformed += cache.access(v);
+
+		if (!referenced[v]) {
+			referenced[v] = true;
+			stats.vertices++;
+		}
+	}
+
+	return stats;
+}
+
+std::ostream &operator<<(std::ostream &os, const VertexCacheStats &stats)
+{
+	return os << "ACMR: " << stats.acmr()
+		<< ", ATVR: " << stats.atvr()
+		<< " (" << stats.transformed << " transformed, "
+		<< stats.vertices << " vertices, "
+		<< stats.triangles << " triangles)";
+}
+
+///////////////////////////////////
+// Forsyth vertex cache ordering //
+///////////////////////////////////
+
+// Scoring parameters from Forsyth's "Linear-Speed Vertex Cache
+// Optimisation"; the modelled cache is LRU and somewhat larger than the
+// hardware FIFO, which works well in practice for either
+static constexpr int eForsythCacheSize = 32;
+static constexpr int eForsythMaxValence = 32;
+
+struct ForsythTables {
+	float position[eForsythCacheSize];
+	float valence[eForsythMaxValence + 1];
+
+	ForsythTables() {
+		for (int i = 0; i < eForsythCacheSize; i++) {
+			// The last triangle's vertices get a fixed score, so
+			// that the next one does not simply reuse an edge
+			if (i < 3) {
+				position[i] = 0.75f;
+			} else {
+				float x = 1.0f - float(i - 3)/(eForsythCacheSize - 3);
+				position[i] = std::pow(x, 1.5f);
+			}
+		}
+
+		// Favour vertices with few remaining triangles, to finish off
+		// lone triangles instead of leaving them behind
+		valence[0] = 0.0f;
+		for (int i = 1; i <= eForsythMaxValence; i++)
+			valence[i] = 2.0f/std::sqrt(float(i));
+	}
+};
+
+static float forsyth_score(int position, uint32_t live)
+{
+	static const ForsythTables tables;
+
+	if (live == 0)
+		return -1.0f;
+
+	float score = position < 0 ? 0.0f : tables.position[position];
+	return score + tables.valence[std::min <uint32_t> (live, eForsythMaxValence)];
+}
+
+std::vector <uint32_t> optimize_vertex_cache(const std::vector <uint32_t> &indices, size_t vertices)
+{
+	size_t triangles = indices.size()/3;
+	if (triangles == 0)
+		return indices;
+
+	// Triangles adjacent to each vertex; the first live[v] entries of a
+	// vertex's range are those that are not emitted yet
+	std::vector <uint32_t> live(vertices, 0);
+	for (size_t i = 0; i < 3 * triangles; i++)
+		live[indices[i]]++;
+
+	std::vector <uint32_t> offsets(vertices + 1, 0);
+	for (size_t v = 0; v < vertices; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+
+	std::vector <uint32_t> adjacency(3 * triangles);
+	{
+		std::vector <uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < 3 * triangles; i++)
+			adjacency[fill[indices[i]]++] = i/3;
+	}
+
+	std::vector <int> position(vertices, -1);
+	std::vector <float> vertex_score(vertices);
+	for (size_t v = 0; v < vertices; v++)
+		vertex_score[v] = forsyth_score(-1, live[v]);
+
+	std::vector <float> triangle_score(triangles);
+	for (size_t t = 0; t < triangles; t++) {
+		triangle_score[t] = vertex_score[indices[3 * t]]
+			+ vertex_score[indices[3 * t + 1]]
+			+ vertex_score[indices[3 * t + 2]];
+	}
+
+	std::vector <bool> emitted(triangles, false);
+
+	// Cache contents, most recent first, with room for the three vertices
+	// pushed by a triangle before the oldest ones fall out
+	uint32_t cache[eForsythCacheSize + 3];
+	uint32_t next_cache[eForsythCacheSize + 3];
+	int cache_count = 0;
+
+	int64_t best = std::max_element(triangle_score.begin(), triangle_score.end())
+		- triangle_score.begin();
+
+	size_t cursor = 0;
+
+	std::vector <uint32_t> result;
+	result.reserve(indices.size());
+
+	for (size_t emitted_count = 0; emitted_count < triangles; emitted_count++) {
+		// Nothing useful in the cache; continue with the next triangle
+		// in the input order
+		if (best < 0) {
+			while (emitted[cursor])
+				cursor++;
+
+			best = cursor;
+		}
+
+		const uint32_t *triangle = &indices[3 * best];
+		result.insert(result.end(), triangle, triangle + 3);
+		emitted[best] = true;
+
+		// Remove the triangle from its vertices' live lists
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = triangle[k];
+			uint32_t *list = &adjacency[offsets[v]];
+
+			uint32_t *it = std::find(list, list + live[v], uint32_t(best));
+			std::swap(*it, list[live[v] - 1]);
+			live[v]--;
+		}
+
+		// Move the triangle's vertices to the front of the cache
+		int next_count = 0;
+		for (int k = 0; k < 3; k++)
+			next_cache[next_count++] = triangle[k];
+
+		for (int i = 0; i < cache_count; i++) {
+			uint32_t v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				next_cache[next_count++] = v;
+		}
+
+		// Update vertex scores, including those that fell out
+		for (int i = 0; i < next_count; i++) {
+			uint32_t v = next_cache[i];
+			position[v] = i < eForsythCacheSize ? i : -1;
+			vertex_score[v] = forsyth_score(position[v], live[v]);
+		}
+
+		// Rescore the live triangles around the cache, and pick the
+		// best one among those with a vertex still in it
+		best = -1;
+
+		float best_score = -1.0f;
+		for (int i = 0; i < next_count; i++) {
+			uint32_t v = next_cache[i];
+			const uint32_t *list = &adjacency[offsets[v]];
+
+			for (uint32_t j = 0; j < live[v]; j++) {
+				uint32_t t = list[j];
+
+				float score = vertex_score[indices[3 * t]]
+					+ vertex_score[indices[3 * t + 1]]
+					+ vertex_score[indices[3 * t + 2]];
+
+				triangle_score[t] = score;
+				if (i < eForsythCacheSize && score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+
+		cache_count = std::min(next_count, eForsythCacheSize);
+		std::copy(next_cache, next_cache + cache_count, cache);
+	}
+
+	// Trailing indices that do not form a triangle are kept as they are
+	result.insert(result.end(), indices.begin() + 3 * triangles, indices.end());
+	return result;
+}
+
+//////////////////////////////
+// Overdraw cluster sorting //
+//////////////////////////////
+
+// Clusters below this many triangles are not split further
+static constexpr size_t eMinClusterSize = 16;
+
+// Cache size assumed when choosing cluster boundaries
+static constexpr size_t eClusterCacheSize = 16;
+
+std::vector <uint32_t> optimize_overdraw(const std::vector <uint32_t> &indices, const VertexList &vertices, float threshold)
+{
+	size_t triangles = indices.size()/3;
+	if (triangles == 0)
+		return indices;
+
+	// Hard boundaries: triangles that miss on all of their vertices, which
+	// is where the cache order already restarts
+	std::vector <size_t> hard { 0 };
+	{
+		FIFOCache cache(vertices.size(), eClusterCacheSize);
+		for (size_t t = 0; t < triangles; t++) {
+			int misses = cache.access(indices[3 * t])
+				+ cache.access(indices[3 * t + 1])
+				+ cache.access(indices[3 * t + 2]);
+
+			if (misses == 3 && t > 0)
+				hard.push_back(t);
+		}
+
+		hard.push_back(triangles);
+	}
+
+	// Soft boundaries: split hard clusters further as long as each piece
+	// (starting from a cold cache) stays within the threshold of the
+	// cluster's own miss ratio
+	std::vector <size_t> clusters;
+
+	FIFOCache cache(vertices.size(), eClusterCacheSize);
+	for (size_t c = 0; c + 1 < hard.size(); c++) {
+		size_t begin = hard[c];
+		size_t end = hard[c + 1];
+
+		cache.reset();
+
+		size_t cluster_misses = 0;
+		for (size_t t = begin; t < end; t++) {
+			cluster_misses += cache.access(indices[3 * t])
+				+ cache.access(indices[3 * t + 1])
+				+ cache.access(indices[3 * t + 2]);
+		}
+
+		float target = threshold * float(cluster_misses)/(end - begin);
+
+		cache.reset();
+		clusters.push_back(begin);
+
+		size_t start = begin;
+		size_t misses = 0;
+
+		for (size_t t = begin; t < end; t++) {
+			misses += cache.access(indices[3 * t])
+				+ cache.access(indices[3 * t + 1])
+				+ cache.access(indices[3 * t + 2]);
+
+			size_t count = t - start + 1;
+			if (t + 1 < end && count >= eMinClusterSize
+					&& float(misses)/count <= target) {
+				clusters.push_back(t + 1);
+				cache.reset();
+
+				start = t + 1;
+				misses = 0;
+			}
+		}
+	}
+
+	clusters.push_back(triangles);
+
+	// Area weighted centroid and normal of each cluster; clusters that face
+	// away from the mesh center are drawn first, as they are more likely to
+	// occlude the rest
+	size_t count = clusters.size() - 1;
+
+	std::vector <glm::vec3> centroids(count);
+	std::vector <glm::vec3> normals(count);
+	std::vector <float> areas(count);
+
+	glm::vec3 center {0.0f};
+	float total_area = 0.0f;
+
+	for (size_t c = 0; c < count; c++) {
+		glm::vec3 centroid {0.0f};
+		glm::vec3 normal {0.0f};
+		float area = 0.0f;
+
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			const glm::vec3 &a = vertices[indices[3 * t]].position;
+			const glm::vec3 &b = vertices[indices[3 * t + 1]].position;
+			const glm::vec3 &p = vertices[indices[3 * t + 2]].position;
+
+			glm::vec3 n = glm::cross(b - a, p - a);
+			float w = glm::length(n);
+
+			centroid += (a + b + p) * (w/3.0f);
+			normal += n;
+			area += w;
+		}
+
+		center += centroid;
+		total_area += area;
+
+		centroids[c] = area > 0.0f ? centroid/area : glm::vec3 {0.0f};
+		normals[c] = normal;
+		areas[c] = area;
+	}
+
+	if (total_area > 0.0f)
+		center /= total_area;
+
+	std::vector <float> keys(count, 0.0f);
+	for (size_t c = 0; c < count; c++) {
+		float length = glm::length(normals[c]);
+		if (length > 0.0f)
+			keys[c] = glm::dot(centroids[c] - center, normals[c]/length);
+	}
+
+	std::vector <size_t> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(),
+		[&](size_t a, size_t b) {
+			return keys[a] > keys[b];
+		}
+	);
+
+	std::vector <uint32_t> result;
+	result.reserve(indices.size());
+
+	for (size_t c : order) {
+		result.insert(result.end(),
+			indices.begin() + 3 * clusters[c],
+			indices.begin() + 3 * clusters[c + 1]);
+	}
+
+	result.insert(result.end(), indices.begin() + 3 * triangles, indices.end());
+	return result;
+}
+
+///////////////////////////
+// Vertex fetch ordering //
+///////////////////////////
+
+void optimize_vertex_fetch(Submesh &submesh)
+{
+	const uint32_t eUnused = ~0u;
+
+	std::vector <uint32_t> remap(submesh.vertices.size(), eUnused);
+
+	uint32_t next = 0;
+	for (uint32_t &index : submesh.indices) {
+		if (remap[index] == eUnused)
+			remap[index] = next++;
+
+		index = remap[index];
+	}
+
+	// Unreferenced vertices are kept, after all the others
+	for (uint32_t &r : remap) {
+		if (r == eUnused)
+			r = next++;
+	}
+
+	VertexList vertices(submesh.vertices.size());
+	for (size_t v = 0; v < submesh.vertices.size(); v++)
+		vertices[remap[v]] = submesh.vertices[v];
+
+	submesh.vertices = std::move(vertices);
+}
+
+void optimize(Submesh &submesh)
+{
+	if (submesh.indices.size() < 3)
+		return;
+
+	submesh.indices = optimize_vertex_cache(submesh.indices, submesh.vertices.size());
+	submesh.indices = optimize_overdraw(submesh.indices, submesh.vertices);
+	optimize_vertex_fetch(submesh);
+}
+
+}
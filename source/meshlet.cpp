@@ -0,0 +1,334 @@
+// Standard headers
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Engine headers
+#include "../include/meshlet.hpp"
+
+namespace kobra {
+
+////////////////
+// Clustering //
+////////////////
+
+// Triangle normal, unit length or zero for degenerate triangles
+static glm::vec3 triangle_normal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+	glm::vec3 n = glm::cross(b - a, c - a);
+	float length = glm::length(n);
+	return length > 0.0f ? n/length : glm::vec3 {0.0f};
+}
+
+Meshlets build_meshlets(const VertexList &vertices, const std::vector <uint32_t> &indices,
+		const MeshletOptions &options)
+{
+	uint32_t max_vertices = std::clamp <uint32_t> (options.max_vertices, 3, 256);
+	uint32_t max_triangles = std::clamp <uint32_t> (options.max_triangles, 1, 512);
+
+	Meshlets result;
+
+	size_t triangles = indices.size()/3;
+	if (triangles == 0)
+		return result;
+
+	// Triangles adjacent to each vertex
+	std::vector <uint32_t> offsets(vertices.size() + 1, 0);
+	for (size_t i = 0; i < 3 * triangles; i++)
+		offsets[indices[i] + 1]++;
+
+	for (size_t v = 0; v < vertices.size(); v++)
+		offsets[v + 1] += offsets[v];
+
+	std::vector <uint32_t> adjacency(3 * triangles);
+	{
+		std::vector <uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < 3 * triangles; i++)
+			adjacency[fill[indices[i]]++] = i/3;
+	}
+
+	std::vector <glm::vec3> normals(triangles);
+	std::vector <glm::vec3> centroids(triangles);
+	for (size_t t = 0; t < triangles; t++) {
+		const glm::vec3 &a = vertices[indices[3 * t]].position;
+		const glm::vec3 &b = vertices[indices[3 * t + 1]].position;
+		const glm::vec3 &c = vertices[indices[3 * t + 2]].position;
+
+		normals[t] = triangle_normal(a, b, c);
+		centroids[t] = (a + b + c)/3.0f;
+	}
+
+	// Scale for the distance term, about the inverse radius of a full
+	// meshlet, so that both terms are comparable regardless of units
+	float area = 0.0f;
+	for (size_t t = 0; t < triangles; t++) {
+		const glm::vec3 &a = vertices[indices[3 * t]].position;
+		const glm::vec3 &b = vertices[indices[3 * t + 1]].position;
+		const glm::vec3 &c = vertices[indices[3 * t + 2]].position;
+
+		area += glm::length(glm::cross(b - a, c - a))/2.0f;
+	}
+
+	float scale = area > 0.0f ? 1.0f/std::sqrt(max_triangles * area/triangles) : 0.0f;
+
+	std::vector <bool> used(triangles, false);
+
+	// Local index of each vertex in the current meshlet, or -1; candidate
+	// triangles are tagged with the meshlet they were queued for
+	std::vector <int> local(vertices.size(), -1);
+	std::vector <uint32_t> queued(triangles, ~0u);
+	std::vector <uint32_t> candidates;
+
+	float cone_weight = std::clamp(options.cone_weight, 0.0f, 1.0f);
+
+	size_t cursor = 0;
+	size_t remaining = triangles;
+
+	while (remaining > 0) {
+		Meshlet meshlet {};
+		meshlet.vertex_offset = result.vertices.size();
+		meshlet.triangle_offset = result.triangles.size();
+
+		uint32_t id = result.meshlets.size();
+
+		glm::vec3 normal_sum {0.0f};
+		glm::vec3 centroid_sum {0.0f};
+
+		candidates.clear();
+
+		// Seed with the first unused triangle in index order
+		while (used[cursor])
+			cursor++;
+
+		int64_t next = cursor;
+		while (next >= 0) {
+			uint32_t t = next;
+			used[t] = true;
+			remaining--;
+
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = indices[3 * t + k];
+				if (local[v] < 0) {
+					local[v] = meshlet.vertex_count++;
+					result.vertices.push_back(v);
+
+					// Queue the vertex's other triangles
+					for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++) {
+						uint32_t n = adjacency[j];
+						if (!used[n] && queued[n] != id) {
+							queued[n] = id;
+							candidates.push_back(n);
+						}
+					}
+				}
+
+				result.triangles.push_back(local[v]);
+			}
+
+			meshlet.triangle_count++;
+			normal_sum += normals[t];
+			centroid_sum += centroids[t];
+
+			if (meshlet.triangle_count >= max_triangles)
+				break;
+
+			glm::vec3 axis = normal_sum;
+			float length = glm::length(axis);
+			if (length > 0.0f)
+				axis /= length;
+
+			glm::vec3 center = centroid_sum/float(meshlet.triangle_count);
+
+			// Pick the best candidate that still fits, dropping used
+			// ones from the list as we go
+			next = -1;
+
+			int best_new = 4;
+			float best_score = std::numeric_limits <float> ::max();
+
+			size_t kept = 0;
+			for (size_t i = 0; i < candidates.size(); i++) {
+				uint32_t c = candidates[i];
+				if (used[c])
+					continue;
+
+				candidates[kept++] = c;
+
+				int added = (local[indices[3 * c]] < 0)
+					+ (local[indices[3 * c + 1]] < 0)
+					+ (local[indices[3 * c + 2]] < 0);
+
+				if (meshlet.vertex_count + added > max_vertices || added > best_new)
+					continue;
+
+				float spread = 1.0f - glm::dot(normals[c], axis);
+				float distance = glm::length(centroids[c] - center) * scale;
+				float score = cone_weight * spread + (1.0f - cone_weight) * distance;
+
+				if (added < best_new || score < best_score) {
+					best_new = added;
+					best_score = score;
+					next = c;
+				}
+			}
+
+			candidates.resize(kept);
+
+			// Nothing adjacent is left (a disconnected piece was
+			// finished); continue in index order, where the next
+			// piece is likely to be nearby
+			if (candidates.empty() && meshlet.vertex_count + 3 <= max_vertices) {
+				while (cursor < triangles && used[cursor])
+					cursor++;
+
+				if (cursor < triangles)
+					next = cursor;
+			}
+		}
+
+		// Reset the local map for the next meshlet
+		for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+			local[result.vertices[meshlet.vertex_offset + i]] = -1;
+
+		result.meshlets.push_back(meshlet);
+	}
+
+	meshlet_bounds(result, vertices);
+	return result;
+}
+
+////////////
+// Bounds //
+////////////
+
+// Ritter's bounding sphere; not minimal, but within a few percent and
+// linear in the number of points
+static void bounding_sphere(const std::vector <glm::vec3> &points, glm::vec3 &center, float &radius)
+{
+	// Most distant point from an arbitrary one, then from that one
+	auto farthest = [&](const glm::vec3 &from) {
+		size_t best = 0;
+		float distance = -1.0f;
+		for (size_t i = 0; i < points.size(); i++) {
+			glm::vec3 d = points[i] - from;
+			if (glm::dot(d, d) > distance) {
+				distance = glm::dot(d, d);
+				best = i;
+			}
+		}
+
+		return points[best];
+	};
+
+	glm::vec3 a = farthest(points[0]);
+	glm::vec3 b = farthest(a);
+
+	center = (a + b)/2.0f;
+	radius = glm::length(b - a)/2.0f;
+
+	// Grow to include any points outside
+	for (const glm::vec3 &p : points) {
+		float distance = glm::length(p - center);
+		if (distance > radius) {
+			float grown = (radius + distance)/2.0f;
+			center += (p - center) * ((grown - radius)/distance);
+			radius = grown;
+		}
+	}
+}
+
+void meshlet_bounds(Meshlets &meshlets, const VertexList &vertices)
+{
+	std::vector <glm::vec3> points;
+
+	for (Meshlet &meshlet : meshlets.meshlets) {
+		points.clear();
+		for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+			points.push_back(vertices[meshlets.vertices[meshlet.vertex_offset + i]].position);
+
+		bounding_sphere(points, meshlet.center, meshlet.radius);
+
+		// Normal cone around the average triangle normal
+		const uint8_t *triangles = &meshlets.triangles[meshlet.triangle_offset];
+
+		auto normal = [&](uint32_t t) {
+			return triangle_normal(
+				points[triangles[3 * t]],
+				points[triangles[3 * t + 1]],
+				points[triangles[3 * t + 2]]
+			);
+		};
+
+		glm::vec3 axis {0.0f};
+		for (uint32_t t = 0; t < meshlet.triangle_count; t++)
+			axis += normal(t);
+
+		float length = glm::length(axis);
+		if (length <= 0.0f) {
+			meshlet.cone_axis = glm::vec3 {0.0f, 0.0f, 1.0f};
+			meshlet.cone_cutoff = -1.0f;
+			continue;
+		}
+
+		axis /= length;
+
+		float cutoff = 1.0f;
+		for (uint32_t t = 0; t < meshlet.triangle_count; t++) {
+			glm::vec3 n = normal(t);
+
+			// Degenerate triangles are never visible
+			if (glm::dot(n, n) > 0.0f)
+				cutoff = std::min(cutoff, glm::dot(n, axis));
+		}
+
+		meshlet.cone_axis = axis;
+		meshlet.cone_cutoff = cutoff;
+	}
+}
+
+////////////////////
+// Quality report //
+////////////////////
+
+MeshletStats statistics(const Meshlets &meshlets, const MeshletOptions &options)
+{
+	MeshletStats stats;
+	stats.meshlets = meshlets.meshlets.size();
+	if (stats.meshlets == 0)
+		return stats;
+
+	for (const Meshlet &meshlet : meshlets.meshlets) {
+		stats.vertex_fill += float(meshlet.vertex_count)/options.max_vertices;
+		stats.triangle_fill += float(meshlet.triangle_count)/options.max_triangles;
+
+		float cutoff = std::clamp(meshlet.cone_cutoff, -1.0f, 1.0f);
+		stats.cone_angle += glm::degrees(std::acos(cutoff));
+		stats.cullable += meshlet.cone_cutoff > 0.0f;
+	}
+
+	stats.vertex_fill /= stats.meshlets;
+	stats.triangle_fill /= stats.meshlets;
+	stats.cone_angle /= stats.meshlets;
+	stats.cullable /= stats.meshlets;
+
+	std::vector <uint32_t> unique = meshlets.vertices;
+	std::sort(unique.begin(), unique.end());
+	unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+	if (!unique.empty())
+		stats.vertex_ratio = float(meshlets.vertices.size())/unique.size();
+
+	return stats;
+}
+
+std::ostream &operator<<(std::ostream &os, const MeshletStats &stats)
+{
+	return os << stats.meshlets << " meshlets"
+		<< ", vertex fill: " << 100.0f * stats.vertex_fill << "%"
+		<< ", triangle fill: " << 100.0f * stats.triangle_fill << "%"
+		<< ", cone angle: " << stats.cone_angle << " deg"
+		<< ", cullable: " << 100.0f * stats.cullable << "%"
+		<< ", vertex ratio: " << stats.vertex_ratio;
+}
+
+}
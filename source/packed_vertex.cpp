@@ -0,0 +1,295 @@
+// GLM headers
+#include <glm/gtc/packing.hpp>
+
+// Engine headers
+#include "../include/packed_vertex.hpp"
+
+namespace kobra {
+
+////////////////////
+// Static methods //
+////////////////////
+
+// Vertex binding
+vk::VertexInputBindingDescription PackedVertex::vertex_binding()
+{
+	return {
+		0, sizeof(PackedVertex),
+		vk::VertexInputRate::eVertex
+	};
+}
+
+// Get vertex attribute descriptions
+std::vector <vk::VertexInputAttributeDescription> PackedVertex::vertex_attributes()
+{
+	return {
+		// Position in xyz, tangent sign in w
+		vk::VertexInputAttributeDescription {
+			0, 0,
+			vk::Format::eR16G16B16A16Unorm,
+			offsetof(PackedVertex, position)
+		},
+
+		vk::VertexInputAttributeDescription {
+			1, 0,
+			vk::Format::eR16G16Snorm,
+			offsetof(PackedVertex, normal)
+		},
+
+		vk::VertexInputAttributeDescription {
+			2, 0,
+			vk::Format::eR16G16Sfloat,
+			offsetof(PackedVertex, tex_coords)
+		},
+
+		vk::VertexInputAttributeDescription {
+			3, 0,
+			vk::Format::eR16G16Snorm,
+			offsetof(PackedVertex, tangent)
+		}
+	};
+}
+
+/////////////////////////////
+// Scalar encoding helpers //
+/////////////////////////////
+
+static inline float from_snorm16(int16_t x)
+{
+	return std::max(x/32767.0f, -1.0f);
+}
+
+static inline uint16_t to_unorm16(float x)
+{
+	return (uint16_t) std::round(glm::clamp(x, 0.0f, 1.0f) * 65535.0f);
+}
+
+static inline float from_unorm16(uint16_t x)
+{
+	return x/65535.0f;
+}
+
+////////////////////////
+// Octahedral mapping //
+////////////////////////
+
+glm::vec2 octahedral_encode(const glm::vec3 &n)
+{
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (l1 <= 0.0f)
+		return glm::vec2 {0.0f};
+
+	glm::vec2 p = glm::vec2 {n.x, n.y}/l1;
+	if (n.z < 0.0f) {
+		p = glm::vec2 {
+			(1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f)
+		};
+	}
+
+	return p;
+}
+
+glm::vec3 octahedral_decode(const glm::vec2 &p)
+{
+	glm::vec3 n {p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y)};
+	if (n.z < 0.0f) {
+		n.x = (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	return glm::normalize(n);
+}
+
+// Quantized octahedral encoding; of the four neighbouring grid points, the
+// one that decodes closest to the input is kept, which roughly halves the
+// error of plain rounding
+static void encode_direction(const glm::vec3 &v, int16_t out[2])
+{
+	glm::vec2 p = octahedral_encode(v);
+
+	float best = -2.0f;
+	for (int i = 0; i < 4; i++) {
+		float x = (i & 1) ? std::ceil(p.x * 32767.0f) : std::floor(p.x * 32767.0f);
+		float y = (i & 2) ? std::ceil(p.y * 32767.0f) : std::floor(p.y * 32767.0f);
+
+		int16_t q[2] = {
+			(int16_t) glm::clamp(x, -32767.0f, 32767.0f),
+			(int16_t) glm::clamp(y, -32767.0f, 32767.0f)
+		};
+
+		glm::vec3 d = octahedral_decode({ from_snorm16(q[0]), from_snorm16(q[1]) });
+
+		float cosine = glm::dot(d, v);
+		if (cosine > best) {
+			best = cosine;
+			out[0] = q[0];
+			out[1] = q[1];
+		}
+	}
+}
+
+static glm::vec3 decode_direction(const int16_t in[2])
+{
+	return octahedral_decode({ from_snorm16(in[0]), from_snorm16(in[1]) });
+}
+
+///////////////////////////
+// Encoding and decoding //
+///////////////////////////
+
+PackedSubmesh pack(const Submesh &submesh)
+{
+	PackedSubmesh packed;
+	packed.material_index = submesh.material_index;
+
+	BoundingBox box = submesh.bbox();
+	if (submesh.vertices.empty())
+		box = BoundingBox { glm::vec3 {0.0f}, glm::vec3 {0.0f} };
+
+	packed.origin = box.min;
+	packed.extent = box.max - box.min;
+
+	glm::vec3 scale {0.0f};
+	for (int k = 0; k < 3; k++) {
+		if (packed.extent[k] > 0.0f)
+			scale[k] = 1.0f/packed.extent[k];
+	}
+
+	for (const Vertex &vertex : submesh.vertices) {
+		if (glm::dot(vertex.tangent, vertex.tangent) > 0.0f) {
+			packed.tangents = true;
+			break;
+		}
+	}
+
+	packed.vertices.resize(submesh.vertices.size());
+	for (size_t i = 0; i < submesh.vertices.size(); i++) {
+		const Vertex &vertex = submesh.vertices[i];
+		PackedVertex &out = packed.vertices[i];
+
+		glm::vec3 position = (vertex.position - packed.origin) * scale;
+		for (int k = 0; k < 3; k++)
+			out.position[k] = to_unorm16(position[k]);
+
+		encode_direction(vertex.normal, out.normal);
+
+		out.tex_coords[0] = glm::packHalf1x16(vertex.tex_coords.x);
+		out.tex_coords[1] = glm::packHalf1x16(vertex.tex_coords.y);
+
+		out.tangent[0] = out.tangent[1] = 0;
+		out.sign = 0xFFFF;
+
+		if (packed.tangents) {
+			encode_direction(vertex.tangent, out.tangent);
+
+			glm::vec3 bitangent = glm::cross(vertex.normal, vertex.tangent);
+			if (glm::dot(bitangent, vertex.bitangent) < 0.0f)
+				out.sign = 0;
+		}
+	}
+
+	if (submesh.vertices.size() < (1 << 16))
+		packed.indices16.assign(submesh.indices.begin(), submesh.indices.end());
+	else
+		packed.indices32 = submesh.indices;
+
+	return packed;
+}
+
+Submesh unpack(const PackedSubmesh &packed)
+{
+	VertexList vertices(packed.vertices.size());
+	for (size_t i = 0; i < packed.vertices.size(); i++) {
+		const PackedVertex &in = packed.vertices[i];
+		Vertex &vertex = vertices[i];
+
+		glm::vec3 position {
+			from_unorm16(in.position[0]),
+			from_unorm16(in.position[1]),
+			from_unorm16(in.position[2])
+		};
+
+		vertex.position = packed.origin + packed.extent * position;
+		vertex.normal = decode_direction(in.normal);
+		vertex.tex_coords = {
+			glm::unpackHalf1x16(in.tex_coords[0]),
+			glm::unpackHalf1x16(in.tex_coords[1])
+		};
+
+		vertex.tangent = glm::vec3 {0.0f};
+		vertex.bitangent = glm::vec3 {0.0f};
+
+		if (packed.tangents) {
+			float sign = 2.0f * from_unorm16(in.sign) - 1.0f;
+			vertex.tangent = decode_direction(in.tangent);
+			vertex.bitangent = sign * glm::cross(vertex.normal, vertex.tangent);
+		}
+	}
+
+	std::vector <uint32_t> indices = packed.indices32;
+	if (!packed.indices16.empty())
+		indices.assign(packed.indices16.begin(), packed.indices16.end());
+
+	return Submesh { vertices, indices, packed.material_index, false };
+}
+
+////////////////////
+// Error analysis //
+////////////////////
+
+// Angle between two directions in degrees, or zero if either is degenerate
+// (nothing was there to preserve); atan2 keeps small angles accurate, where
+// acos of a float cosine bottoms out at about 0.02 degrees
+static float angle(const glm::vec3 &reference, const glm::vec3 &v)
+{
+	if (glm::dot(reference, reference) <= 0.0f || glm::dot(v, v) <= 0.0f)
+		return 0.0f;
+
+	float sine = glm::length(glm::cross(reference, v));
+	return glm::degrees(std::atan2(sine, glm::dot(reference, v)));
+}
+
+PackingError packing_error(const Submesh &submesh, const PackedSubmesh &packed)
+{
+	PackingError error;
+	error.bytes = submesh.vertices.size() * sizeof(Vertex)
+		+ submesh.indices.size() * sizeof(uint32_t);
+	error.packed_bytes = packed.bytes();
+
+	Submesh decoded = unpack(packed);
+
+	size_t count = std::min(submesh.vertices.size(), decoded.vertices.size());
+	for (size_t i = 0; i < count; i++) {
+		const Vertex &a = submesh.vertices[i];
+		const Vertex &b = decoded.vertices[i];
+
+		glm::vec2 duv = glm::abs(a.tex_coords - b.tex_coords);
+
+		error.position = std::max(error.position, glm::distance(a.position, b.position));
+		error.normal = std::max(error.normal, angle(a.normal, b.normal));
+		error.tex_coords = std::max({ error.tex_coords, duv.x, duv.y });
+
+		// The bitangent is compared against the reference frame of the
+		// source; a non-orthogonal source frame is reported as error
+		error.tangent = std::max(error.tangent, angle(a.tangent, b.tangent));
+		error.bitangent = std::max(error.bitangent, angle(a.bitangent, b.bitangent));
+	}
+
+	return error;
+}
+
+std::ostream &operator<<(std::ostream &os, const PackingError &error)
+{
+	float ratio = error.bytes ? float(error.packed_bytes)/error.bytes : 0.0f;
+
+	return os << "position: " << error.position
+		<< ", normal: " << error.normal << " deg"
+		<< ", tangent: " << error.tangent << " deg"
+		<< ", bitangent: " << error.bitangent << " deg"
+		<< ", tex_coords: " << error.tex_coords
+		<< ", size: " << error.bytes << " -> " << error.packed_bytes
+		<< " bytes (" << 100.0f * ratio << "%)";
+}
+
+}
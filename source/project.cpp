@@ -1,11 +1,44 @@
 // Standard headers
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <limits>
 #include <sstream>
 
 // Engine headers
+#include "include/bvh/cache.hpp"
+#include "include/instancing.hpp"
+#include "include/profiler.hpp"
 #include "include/project.hpp"
+#include "include/scene_description.hpp"
 
 namespace kobra {
 
+// Submesh files (.submesh) hold, back to back
+//
+//	vertex and index counts (ints), vertices, indices
+//	meshlet, meshlet vertex and meshlet triangle byte counts (ints)
+//	meshlets, meshlet vertices, meshlet triangles (see meshlet.hpp)
+//	LOD level and LOD index counts (ints)
+//	index count and error of each level, then all LOD indices (see lod.hpp)
+//
+// Files written before the meshlets or the LODs were stored end after the
+// indices or the meshlets, and are loaded without them
+
+// Size of the file of a submesh
+static size_t submesh_file_size(const Submesh &submesh)
+{
+        size_t lods = 0;
+        for (const SubmeshLOD &lod : submesh.lods)
+                lods += sizeof(int) + sizeof(float) + sizeof(int) * lod.indices.size();
+
+        return 7 * sizeof(int)
+                + sizeof(Vertex) * submesh.vertices.size()
+                + sizeof(int) * submesh.indices.size()
+                + submesh.meshlets.bytes() + lods;
+}
+
 // Saving projects
 static std::string transcribe_submesh(const Submesh &submesh) {
         // TODO: generate the tangent and bitangent vectors
@@ -22,6 +55,33 @@ static std::string transcribe_submesh(const Submesh &submesh) {
         stream.write((char *) submesh.vertices.data(), sizeof(Vertex) * vertices);
         stream.write((char *) submesh.indices.data(), sizeof(int) * indices);
 
+        const Meshlets &meshlets = submesh.meshlets;
+
+        int counts[3] = {
+                int(meshlets.meshlets.size()),
+                int(meshlets.vertices.size()),
+                int(meshlets.triangles.size())
+        };
+
+        stream.write((char *) counts, sizeof(counts));
+        stream.write((char *) meshlets.meshlets.data(), sizeof(Meshlet) * counts[0]);
+        stream.write((char *) meshlets.vertices.data(), sizeof(uint32_t) * counts[1]);
+        stream.write((char *) meshlets.triangles.data(), counts[2]);
+
+        int lods[2] = { int(submesh.lods.size()), 0 };
+        for (const SubmeshLOD &lod : submesh.lods)
+                lods[1] += lod.indices.size();
+
+        stream.write((char *) lods, sizeof(lods));
+        for (const SubmeshLOD &lod : submesh.lods) {
+                int count = lod.indices.size();
+                stream.write((char *) &count, sizeof(int));
+                stream.write((char *) &lod.error, sizeof(float));
+        }
+
+        for (const SubmeshLOD &lod : submesh.lods)
+                stream.write((char *) lod.indices.data(), sizeof(int) * lod.indices.size());
+
         return stream.str();
 }
 
@@ -55,13 +115,113 @@ static std::string transcribe_material(const Material &material) {
         return buffer;
 }
 
-// Save project
+// Unique submesh file, and how an entity's submesh is placed from it
+struct SubmeshReference {
+        std::string name;
+        glm::mat4 transform;
+        bool exact;
+};
+
+// Whether a submesh file already holds a submesh; files are named after the
+// content hash, so only the size needs checking (against partial writes, and
+// files of an older layout)
+static bool submesh_file_current(const std::filesystem::path &filename, const Submesh &submesh)
+{
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(filename, error);
+
+        return !error && size == submesh_file_size(submesh);
+}
+
+// Describe a scene for its .kobra file
+static SceneDescription s_describe_scene(Scene &scene, const std::vector <Material> &materials,
+                const std::map <const Submesh *, SubmeshReference> &submesh_id_map)
+{
+        SceneDescription description;
+
+        for (auto &entity : *scene.system) {
+                const Transform &transform = entity.get <Transform> ();
+                description.add_entity(entity.name, transform.position, transform.rotation, transform.scale);
+
+                uint32_t &flags = description.flags.back();
+                if (entity.exists <Mesh> ()) {
+                        flags |= SceneDescription::eMesh;
+                        auto &submeshes = entity.get <Mesh> ().submeshes;
+
+                        // Proxies are described by where their geometry
+                        // would be read from
+                        const std::vector <ResidencyDaemon::Source> *sources = nullptr;
+                        if (scene.residency)
+                                sources = proxied(scene.residency.get(), entity.id);
+
+                        for (size_t k = 0; k < submeshes.size(); k++) {
+                                const Submesh &submesh = submeshes[k];
+
+                                // TODO: find the path instead...
+                                // std::string material = Material::all[submesh.material_index].name;
+                                std::string material = materials[submesh.material_index].name;
+
+                                SceneDescription::SubmeshEntry entry;
+                                entry.material = description.add_string(material + ".mat");
+
+                                if (sources) {
+                                        const ResidencyDaemon::Source &source = (*sources)[k];
+                                        entry.file = description.add_string(source.file);
+                                        entry.set_matrix(source.transform);
+                                        entry.set_bounds(source.bounds, source.vertices, source.indices);
+                                } else {
+                                        const SubmeshReference &reference = submesh_id_map.at(&submesh);
+                                        entry.file = description.add_string(reference.name + ".submesh");
+                                        entry.set_matrix(reference.transform);
+                                        entry.set_bounds(submesh.bbox(), submesh.vertices.size(), submesh.indices.size());
+                                }
+
+                                description.add_submesh(entry);
+                        }
+
+                        // TODO: material indices...
+                }
+
+                if (entity.exists <Renderable> ()) {
+                        flags |= SceneDescription::eRenderable;
+                        // TODO: material ids
+                }
+
+                if (entity.exists <Camera> ()) {
+                        const Camera &camera = entity.get <Camera> ();
+                        description.add_camera(camera.fov, camera.aspect);
+                }
+        }
+
+        return description;
+}
+
+// Last finished profiler event of this thread; a root frame, or the last
+// child of the frame that was open at the time
+static const Profiler::Frame &last_event()
+{
+        const Profiler &profiler = Profiler::one();
+        return profiler.stack.empty()
+                ? profiler.frames.back()
+                : profiler.stack.top().children.back();
+}
+
+// Save project; only submeshes and materials that changed since they were
+// last written are saved again (the scene descriptions are always written)
 void Project::save()
 {
-        // TODO: detect parts that have changed...
         printf("Saving to %s\n", directory.c_str());
         std::filesystem::path path = directory;
 
+        // Timed as a whole, and logged once done
+        std::optional <ScopedEvent <EventType::eCPU>> save_event;
+        save_event.emplace("Project::save");
+
+        // Packed projects are saved to the directory next to the archive,
+        // which is then repacked
+        if (archive)
+                path.replace_extension();
+
         // Create the necessary directories
         std::filesystem::create_directory(path);			// Root directory
         std::filesystem::create_directory(path / ".cache");	// Cache directory
@@ -70,43 +230,117 @@ void Project::save()
         std::filesystem::path cache_path = path / ".cache";
         std::filesystem::path assets_path = path / "assets";
 
-        // Collect all SUBMESHES to populate the cache
-        // TODO: need to find similar enough meshes (e.g. translated or
-        // scaled)
-        std::set <const Submesh *> submesh_cache;
-        for (auto &scene : scenes)
-                scene.populate_mesh_cache(submesh_cache);
-
-        // ID each submesh in the cache
+        // Unique submeshes to write, by file name, and where each submesh
+        // of the scenes comes from
         std::vector <std::pair <const Submesh *, std::string>> submesh_ids;
-        std::map <const Submesh *, size_t> submesh_id_map;
-
-        // TODO: use the name of the entity for the mesh...
-        size_t id = 0;
-        for (auto &submesh : submesh_cache) {
-                submesh_ids.push_back({submesh, "submesh-" + std::to_string(id)});
-                submesh_id_map[submesh] = id;
-                id++;
-        }
+        std::map <const Submesh *, SubmeshReference> submesh_id_map;
 
-        tf::Taskflow taskflow;
-        tf::Executor executor;
+        // Content hashes of the submeshes in memory, whose cached BVHs
+        // (bvh/cache.hpp) are kept
+        std::set <uint64_t> content_hashes;
 
-        taskflow.for_each(submesh_ids.begin(), submesh_ids.end(),
-                [&](const auto &pr) {
-                        // TODO: ID each submesh in the cache...
-                        std::filesystem::path filename = cache_path/(pr.second + ".submesh");
-                        std::ofstream file(filename, std::ios::binary);
+        {
+                KOBRA_PROFILE_TASK("Deduplicate submeshes");
 
-                        // Write the submesh to the file
-                        std::string data = transcribe_submesh(*pr.first);
-                        file.write(data.data(), data.size());
+                // Collect all SUBMESHES to populate the cache
+                std::set <const Submesh *> submesh_cache;
+                for (auto &scene : scenes) {
+                        scene.populate_mesh_cache(submesh_cache);
 
-                        file.close();
+                        // Proxies only stand in for geometry that is not in
+                        // memory, and keep their files
+                        if (!scene.residency)
+                                continue;
+
+                        for (const auto &pr : scene.residency->sources) {
+                                if (!proxied(scene.residency.get(), pr.first))
+                                        continue;
+
+                                for (const auto &submesh : scene.system->get <Mesh> (pr.first).submeshes)
+                                        submesh_cache.erase(&submesh);
+                        }
                 }
-        );
 
-        executor.run(taskflow).wait();
+                // Deduplicate the geometry; copies (exact, or, if enabled,
+                // moved, rotated or uniformly scaled) refer to the file of
+                // their source, with the transform from one to the other
+                InstancingOptions instancing;
+                instancing.similarity = instance_similar;
+
+                std::vector <const Submesh *> submesh_list(submesh_cache.begin(), submesh_cache.end());
+                std::vector <SubmeshInstance> instances = find_instances(submesh_list, instancing);
+
+                // Files are named after the content, so that unchanged
+                // submeshes keep their file between saves; distinct submeshes
+                // with the same hash (unlikely) get a suffix
+                std::map <uint64_t, size_t> hash_uses;
+                std::vector <std::string> names(submesh_list.size());
+
+                size_t exact_copies = 0;
+                size_t transformed_copies = 0;
+
+                for (size_t i = 0; i < submesh_list.size(); i++) {
+                        const SubmeshInstance &instance = instances[i];
+                        content_hashes.insert(instance.hash);
+
+                        if (instance.source == i) {
+                                char hash[17];
+                                std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) instance.hash);
+
+                                names[i] = "submesh-" + std::string(hash);
+
+                                size_t uses = hash_uses[instance.hash]++;
+                                if (uses > 0)
+                                        names[i] += "-" + std::to_string(uses);
+
+                                submesh_ids.push_back({submesh_list[i], names[i]});
+                        } else if (instance.exact) {
+                                exact_copies++;
+                        } else {
+                                transformed_copies++;
+                        }
+
+                        submesh_id_map[submesh_list[i]] = {
+                                names[instance.source],
+                                instance.transform,
+                                instance.exact
+                        };
+                }
+
+                printf("Saving %lu unique submeshes (%lu exact and %lu transformed copies)\n",
+                        submesh_ids.size(), exact_copies, transformed_copies);
+        }
+
+        // Skip the submeshes whose file is current; suffixed names may be
+        // stale, and are always written
+        std::vector <std::pair <const Submesh *, std::string>> dirty_submeshes;
+        for (const auto &pr : submesh_ids) {
+                std::filesystem::path filename = cache_path/(pr.second + ".submesh");
+                bool suffixed = pr.second.size() > std::string("submesh-").size() + 16;
+                if (suffixed || !submesh_file_current(filename, *pr.first))
+                        dirty_submeshes.push_back(pr);
+        }
+
+        // Files of the entities that are not paged in are kept as they are;
+        // packed projects may only have them in the archive
+        std::set <std::string> proxy_files;
+        for (auto &scene : scenes) {
+                if (!scene.residency)
+                        continue;
+
+                for (const auto &pr : scene.residency->sources) {
+                        if (auto sources = proxied(scene.residency.get(), pr.first)) {
+                                for (const auto &source : *sources)
+                                        proxy_files.insert(source.file);
+                        }
+                }
+        }
+
+        std::vector <std::string> missing_proxy_files;
+        for (const auto &name : proxy_files) {
+                if (archive && !std::filesystem::exists(cache_path/name))
+                        missing_proxy_files.push_back(name);
+        }
 
         // Collect all materials
         // TODO: save in the same location as creation (in the assets
@@ -132,397 +366,572 @@ void Project::save()
         //         }
         // );
        
+        // Materials changed since they were last written (see
+        // signal_update), or missing from the assets
         const auto &materials = material_daemon->materials;
-        taskflow.for_each(materials.begin(), materials.end(),
-                [&](const Material &mat) {
-                        // TODO: ID each submesh in the cache...
-                        std::filesystem::path filename = assets_path/(mat.name + ".mat");
-                        std::ofstream file(filename, std::ios::binary);
-
-                        // Write the submesh to the file
-                        std::string data = transcribe_material(mat);
-                        file.write(data.data(), data.size());
+        auto &material_dirty = material_daemon->dirty;
 
-                        file.close();
-                }
-        );
-        
-        executor.run(taskflow).wait();
+        std::vector <size_t> dirty_materials;
+        for (size_t i = 0; i < materials.size(); i++) {
+                std::filesystem::path filename = assets_path/(materials[i].name + ".mat");
+                if (i >= material_dirty.size() || material_dirty[i] || !std::filesystem::exists(filename))
+                        dirty_materials.push_back(i);
+        }
 
-        // Scene description file (.kobra)
-        for (auto &scene : scenes) {
-                std::filesystem::path filename = path / (scene.name + ".kobra");
-                std::ofstream file(filename);
+        {
+                KOBRA_PROFILE_TASK("Write submeshes and materials");
 
-                // Write the scene description
-                for (auto &entity : *scene.system) {
-                        file << "\n@entity " << entity.name << "\n";
+                tf::Taskflow taskflow;
+                tf::Executor executor;
 
-                        const Transform &transform = entity.get <Transform> ();
-                        file << ".transform "
-                                << transform.position.x << " " << transform.position.y << " " << transform.position.z << " "
-                                << transform.rotation.x << " " << transform.rotation.y << " " << transform.rotation.z << " "
-                                << transform.scale.x << " " << transform.scale.y << " " << transform.scale.z << "\n";
+                taskflow.for_each(dirty_submeshes.begin(), dirty_submeshes.end(),
+                        [&](const auto &pr) {
+                                std::filesystem::path filename = cache_path/(pr.second + ".submesh");
+                                std::ofstream file(filename, std::ios::binary);
 
-                        if (entity.exists <Mesh> ()) {
-                                file << ".mesh " << entity.get <Mesh> ().submeshes.size() << "\n";
-                                auto &submeshes = entity.get <Mesh> ().submeshes;
-                                for (auto &submesh : submeshes) {
-                                        size_t id = submesh_id_map[&submesh];
-                                        // TODO: find the path instead...
-                                        // std::string material = Material::all[submesh.material_index].name;
-                                        std::string material = materials[submesh.material_index].name;
-                                        file << "\tsubmesh-" << id << ".submesh, " << material << ".mat\n";
-                                }
+                                // Write the submesh to the file
+                                std::string data = transcribe_submesh(*pr.first);
+                                file.write(data.data(), data.size());
 
-                                // TODO: material indices...
+                                file.close();
                         }
+                );
 
-                        if (entity.exists <Renderable> ()) {
-                                file << ".renderable\n";
-                                // TODO: material ids
+                taskflow.for_each(dirty_materials.begin(), dirty_materials.end(),
+                        [&](size_t index) {
+                                const Material &mat = materials[index];
+                                std::filesystem::path filename = assets_path/(mat.name + ".mat");
+                                std::ofstream file(filename, std::ios::binary);
+
+                                // Write the material to the file
+                                std::string data = transcribe_material(mat);
+                                file.write(data.data(), data.size());
+
+                                file.close();
                         }
+                );
 
-                        if (entity.exists <Camera> ()) {
-                                const Camera &camera = entity.get <Camera> ();
-                                file << ".camera "
-                                        << camera.fov << " "
-                                        << camera.aspect << "\n";
+                taskflow.for_each(missing_proxy_files.begin(), missing_proxy_files.end(),
+                        [&](const std::string &name) {
+                                auto contents = archive->find(".cache/" + name);
+                                if (!contents)
+                                        return;
+
+                                std::ofstream file(cache_path/name, std::ios::binary);
+                                file.write(contents->data(), contents->size());
+                                file.close();
                         }
+                );
+
+                executor.run(taskflow).wait();
+        }
+
+        material_dirty.assign(materials.size(), 0);
+
+        printf("Wrote %lu of %lu submeshes and %lu of %lu materials\n",
+                dirty_submeshes.size(), submesh_ids.size(),
+                dirty_materials.size(), materials.size());
+
+        {
+                KOBRA_PROFILE_TASK("Write scenes");
+
+                // Scene description file (.kobra)
+                for (auto &scene : scenes) {
+                        SceneDescription description = s_describe_scene(scene, materials, submesh_id_map);
+                        std::string data = binary_scenes
+                                ? encode_scene(description)
+                                : write_scene_text(description);
+
+                        std::ofstream file(path / (scene.name + ".kobra"), std::ios::binary);
+                        file.write(data.data(), data.size());
+                        file.close();
                 }
 
+                // Top level project file, describing all the scenes (.den)
+                std::filesystem::path filename = path / "project.den";
+                std::ofstream file(filename);
+
+                // Write all the scenes
+                file << "@scenes " << scenes.size() << "\n";
+                for (auto &scene : scenes)
+                        file << scene.name << ".kobra\n";
+
+                // TODO: use fmt library
+
+                // TODO: other project information
+
                 file.close();
         }
 
-        // Top level project file, describing all the scenes (.den)
-        std::filesystem::path filename = path / "project.den";
-        std::ofstream file(filename);
+        // Submesh files no longer referenced by any scene, and material
+        // files of materials that no longer exist (e.g. renamed), which
+        // would otherwise be read again on load; cached BVHs of geometry
+        // that is gone are never read again, and would pile up
+        {
+                KOBRA_PROFILE_TASK("Remove stale files");
+
+                auto sweep = [](const std::filesystem::path &directory, const std::string &extension,
+                                const std::set <std::string> &current) {
+                        std::vector <std::filesystem::path> stale;
+
+                        std::error_code error;
+                        for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+                                std::string name = entry.path().filename().string();
+                                if (entry.path().extension() == extension && !current.count(name))
+                                        stale.push_back(entry.path());
+                        }
 
-        // Write all the scenes
-        file << "@scenes " << scenes.size() << "\n";
-        for (auto &scene : scenes)
-                file << scene.name << ".kobra\n";
+                        for (const auto &file : stale)
+                                std::filesystem::remove(file, error);
+                };
 
-        // TODO: use fmt library
+                std::set <std::string> current_submeshes;
+                for (const auto &pr : submesh_ids)
+                        current_submeshes.insert(pr.second + ".submesh");
 
-        // TODO: other project information
+                current_submeshes.insert(proxy_files.begin(), proxy_files.end());
 
-        file.close();
+                std::set <std::string> current_materials;
+                for (const auto &material : materials)
+                        current_materials.insert(material.name + ".mat");
+
+                sweep(cache_path, ".submesh", current_submeshes);
+                sweep(assets_path, ".mat", current_materials);
+
+                // Cached BVHs of geometry that is gone; those of proxies are
+                // found through the content hash in their file name
+                for (const std::string &file : proxy_files) {
+                        const std::string prefix = "submesh-";
+                        if (file.compare(0, prefix.size(), prefix) == 0 && file.size() >= prefix.size() + 16)
+                                content_hashes.insert(std::strtoull(file.substr(prefix.size(), 16).c_str(), nullptr, 16));
+                }
+
+                std::vector <std::filesystem::path> stale_bvhs;
+
+                std::error_code error;
+                for (const auto &entry : std::filesystem::directory_iterator(cache_path, error)) {
+                        if (entry.path().extension() != ".bvh")
+                                continue;
+
+                        std::optional <uint64_t> content = bvh_cache_content(entry.path());
+                        if (!content || !content_hashes.count(*content))
+                                stale_bvhs.push_back(entry.path());
+                }
+
+                for (const auto &file : stale_bvhs)
+                        std::filesystem::remove(file, error);
+        }
+
+        if (archive) {
+                KOBRA_PROFILE_TASK("Repack archive");
+
+                if (!pack_project(path, directory))
+                        KOBRA_LOG_FILE(Log::ERROR) << "Could not repack project archive: " << directory << std::endl;
+
+                if (auto repacked = ProjectArchive::open(directory))
+                        archive = repacked;
+        }
+
+        // Breakdown of the save
+        save_event.reset();
+        KOBRA_LOG_FILE(Log::INFO) << "Saved project:\n" << Profiler::pretty(last_event());
 }
 
 // Loading projects
-static std::string trim_whitespace(const std::string &str)
+// Contents of a project file, by its path relative to the project; a view
+// into the archive of packed projects, otherwise read into the buffer
+static std::optional <std::string_view> read_project_file(const std::filesystem::path &directory,
+                const ProjectArchive *archive, const std::filesystem::path &name, std::string &buffer)
+{
+        if (archive)
+                return archive->find(name.generic_string());
+
+        std::ifstream file(directory / name, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+                return std::nullopt;
+
+        buffer.resize(file.tellg());
+        file.seekg(0);
+        file.read(buffer.data(), buffer.size());
+
+        return std::string_view(buffer);
+}
+
+// Whether the meshlets of a submesh file stay within their arrays and the
+// vertices of the submesh
+static bool valid_meshlets(const Meshlets &meshlets, size_t vertices)
 {
-        std::string result = str;
-        result.erase(0, result.find_first_not_of(' '));
-        result.erase(result.find_last_not_of(' ') + 1);
-        return result;
+        for (const Meshlet &meshlet : meshlets.meshlets) {
+                if (size_t(meshlet.vertex_offset) + meshlet.vertex_count > meshlets.vertices.size()
+                                || size_t(meshlet.triangle_offset) + 3 * size_t(meshlet.triangle_count) > meshlets.triangles.size())
+                        return false;
+
+                for (uint32_t i = 0; i < 3 * meshlet.triangle_count; i++) {
+                        if (meshlets.triangles[meshlet.triangle_offset + i] >= meshlet.vertex_count)
+                                return false;
+                }
+        }
+
+        for (uint32_t vertex : meshlets.vertices) {
+                if (vertex >= vertices)
+                        return false;
+        }
+
+        return true;
 }
 
-static Submesh load_mesh(std::ifstream &file)
+static std::optional <Submesh> load_mesh(std::string_view data)
 {
-        int num_vertices;
-        file.read((char *) &num_vertices, sizeof(int));
+        const char *ptr = data.data();
+        const char *end = data.data() + data.size();
+
+        // Copy the next bytes out, if there are enough left
+        auto read = [&](void *dst, size_t size) {
+                if (size_t(end - ptr) < size)
+                        return false;
+
+                std::memcpy(dst, ptr, size);
+                ptr += size;
+                return true;
+        };
 
+        int num_vertices;
         int num_indices;
-        file.read((char *) &num_indices, sizeof(int));
 
-        std::vector <Vertex> vertices;
-        vertices.resize(num_vertices);
-        file.read((char *) vertices.data(), sizeof(Vertex) * num_vertices);
+        if (!read(&num_vertices, sizeof(int)) || !read(&num_indices, sizeof(int))
+                        || num_vertices < 0 || num_indices < 0)
+                return std::nullopt;
 
+        std::vector <Vertex> vertices;
         std::vector <uint32_t> indices;
+
+        size_t geometry = sizeof(Vertex) * size_t(num_vertices) + sizeof(int) * size_t(num_indices);
+        if (size_t(end - ptr) < geometry)
+                return std::nullopt;
+
+        vertices.resize(num_vertices);
         indices.resize(num_indices);
-        file.read((char *) indices.data(), sizeof(int) * num_indices);
 
-        return Submesh { vertices, indices, 0};
-}
+        read(vertices.data(), sizeof(Vertex) * num_vertices);
+        read(indices.data(), sizeof(int) * num_indices);
 
-static void s_load_scene(const std::filesystem::path &path, const Context &context, Scene &scene, MaterialDaemon *material_daemon, std::ifstream &file)
-{
-        std::vector <std::string> lines;
+        // Whole triangles, within the vertices (tangents are generated from
+        // them right away)
+        if (num_indices % 3 != 0)
+                return std::nullopt;
 
-        std::string line;
-        while (std::getline(file, line)) {
-                // printf("Line: %s\n", line.c_str());
-                lines.push_back(line);
+        for (uint32_t index : indices) {
+                if (index >= uint32_t(num_vertices))
+                        return std::nullopt;
         }
 
-        struct Element {
-                using FieldValue = std::variant <
-                        int,
-                        float,
-                        Transform,
-                        std::string,
-                        std::vector <int>,
-                        std::vector <std::string>
-                >;
-
-                std::map <std::string, FieldValue> fields;
-        };
+        Submesh submesh { vertices, indices, 0 };
 
-        std::vector <Element> elements;
-        Element *current_element = nullptr;
+        // Older files have no meshlets or LODs; they are loaded without,
+        // rather than simplified on every load or page in (the renderer
+        // draws full detail without LODs)
+        if (ptr == end)
+                return submesh;
 
-        int i = 0;
-        while (i < lines.size()) {
-                const std::string &line = lines[i++];
+        int counts[3];
+        if (!read(counts, sizeof(counts)) || counts[0] < 0 || counts[1] < 0 || counts[2] < 0)
+                return std::nullopt;
 
-                // Skip empty lines
-                if (line.empty())
-                        continue;
+        size_t clusters = sizeof(Meshlet) * size_t(counts[0])
+                + sizeof(uint32_t) * size_t(counts[1]) + size_t(counts[2]);
 
-                // Skip comments
-                if (line[0] == '#')
-                        continue;
+        if (size_t(end - ptr) < clusters)
+                return std::nullopt;
 
-                // Check if it's a new element
-                if (line[0] == '@') {
-                        // printf("New element: %s\n", line.c_str());
-                        std::istringstream iss(line.substr(1));
-
-                        std::string type;
-                        iss >> type;
-
-                        if (type == "entity") {
-                                // elements.push_back(Element { Element::ENTITY });
-                                elements.push_back(Element {});
-                                // printf("Entity\n");
-
-                                std::string name = line.substr(7);
-                                elements.back().fields["name"] = trim_whitespace(name);
-                        } else if (type == "materials") {
-                                // elements.push_back(Element { Element::MATERIALS });
-                                elements.push_back(Element {});
-                                // printf("Materials\n");
-                        } else {
-                                KOBRA_LOG_FILE(Log::WARN) << "Unknown element type: " << type << std::endl;
-                                continue;
-                        }
-                        
-                        current_element = &elements.back();
+        Meshlets &meshlets = submesh.meshlets;
+        meshlets.meshlets.resize(counts[0]);
+        meshlets.vertices.resize(counts[1]);
+        meshlets.triangles.resize(counts[2]);
+
+        read(meshlets.meshlets.data(), sizeof(Meshlet) * counts[0]);
+        read(meshlets.vertices.data(), sizeof(uint32_t) * counts[1]);
+        read(meshlets.triangles.data(), counts[2]);
+
+        if (!valid_meshlets(meshlets, submesh.vertices.size()))
+                return std::nullopt;
+
+        if (ptr == end)
+                return submesh;
+
+        int lods[2];
+        if (!read(lods, sizeof(lods)) || lods[0] < 0 || lods[1] < 0)
+                return std::nullopt;
+
+        size_t chain = (sizeof(int) + sizeof(float)) * size_t(lods[0]) + sizeof(int) * size_t(lods[1]);
+        if (size_t(end - ptr) != chain)
+                return std::nullopt;
+
+        submesh.lods.resize(lods[0]);
+
+        size_t total = 0;
+        for (SubmeshLOD &lod : submesh.lods) {
+                int count;
+                read(&count, sizeof(int));
+                read(&lod.error, sizeof(float));
+
+                if (count < 0 || count % 3 != 0)
+                        return std::nullopt;
+
+                total += count;
+                if (total > size_t(lods[1]))
+                        return std::nullopt;
+
+                lod.indices.resize(count);
+        }
+
+        if (total != size_t(lods[1]))
+                return std::nullopt;
+
+        for (SubmeshLOD &lod : submesh.lods) {
+                read(lod.indices.data(), sizeof(int) * lod.indices.size());
+
+                for (uint32_t index : lod.indices) {
+                        if (index >= submesh.vertices.size())
+                                return std::nullopt;
                 }
+        }
 
-                // Check if it's a field
-                if (line[0] == '.') {
-                        if (current_element == nullptr) {
-                                KOBRA_LOG_FILE(Log::WARN) << "Field without element: " << line << std::endl;
-                                continue;
-                        }
+        return submesh;
+}
 
-                        std::string field = line.substr(1);
-                        // printf("Field: %s\n", field.c_str());
+// Load a scene in phases: read the description (a bulk copy if binary,
+// parsed if text), read and decode the files it uses in parallel, then
+// create the entities serially (they own GPU resources); each phase is a
+// profiler event. With a residency budget, entities whose bounds and counts
+// are recorded start as proxies, and their files are only read when paged in
+// (through the loader)
+static void s_load_scene(const std::filesystem::path &path, const ProjectArchive *archive, const Context &context, Scene &scene, MaterialDaemon *material_daemon, std::string_view contents,
+                size_t residency_budget, const ResidencyDaemon::Loader &loader)
+{
+        std::optional <ScopedEvent <EventType::eCPU>> phase;
+        phase.emplace("Parse");
 
-                        if (field.rfind("transform", 0) == 0) {
-                                // printf("\tTransform\n");
+        std::optional <SceneDescription> parsed = read_scene(contents);
+        if (!parsed)
+                throw std::runtime_error("Invalid scene description");
 
-                                float vec[9];
-                                std::istringstream iss(field.substr(10));
-                                for (int i = 0; i < 9; i++)
-                                        iss >> vec[i];
+        const SceneDescription &description = *parsed;
+        size_t entities = description.size();
 
-                                // printf("\t\t%f %f %f\n", vec[0], vec[1], vec[2]);
-                                // printf("\t\t%f %f %f\n", vec[3], vec[4], vec[5]);
-                                // printf("\t\t%f %f %f\n", vec[6], vec[7], vec[8]);
+        // Unique submesh and material files, in order of first use; many
+        // entities share them
+        phase.emplace("Gather files");
 
-                                Transform transform {
-                                        { vec[0], vec[1], vec[2] },
-                                        { vec[3], vec[4], vec[5] },
-                                        { vec[6], vec[7], vec[8] }
-                                };
+        std::vector <std::filesystem::path> submesh_names;
+        std::vector <std::filesystem::path> material_names;
 
-                                current_element->fields["transform"] = transform;
-                        } else if (field.rfind("mesh", 0) == 0) {
-                                // printf("\tMesh\n");
+        std::map <std::filesystem::path, size_t> submesh_indices;
+        std::map <std::filesystem::path, size_t> material_indices;
 
-                                int mesh_count = std::stoi(field.substr(5));
+        auto unique = [](std::vector <std::filesystem::path> &names,
+                        std::map <std::filesystem::path, size_t> &indices,
+                        const std::filesystem::path &name) {
+                auto it = indices.find(name);
+                if (it == indices.end()) {
+                        it = indices.emplace(name, names.size()).first;
+                        names.push_back(name);
+                }
 
-                                std::vector <std::string> meshes;
-                                std::vector <std::string> materials_paths;
+                return it->second;
+        };
 
-                                for (int j = 0; j < mesh_count; j++) {
-                                        std::istringstream iss(lines[i++]);
+        // Submesh and material file of each submesh of each entity, and its
+        // transform from the file
+        struct SubmeshSource {
+                size_t submesh;
+                size_t material;
+                glm::mat4 transform;
+        };
 
-                                        std::string mesh;
-                                        std::string material_path;
+        // Entities that start as proxies, if all their submeshes have
+        // recorded extents; their submesh files are not read here
+        static constexpr size_t eProxy = std::numeric_limits <size_t> ::max();
 
-                                        // Skip whitespace
-                                        iss >> std::ws;
-                                        
-                                        // Cut the trailing comma
-                                        std::getline(iss, mesh, ',');
-                                        iss >> material_path;
+        std::vector <std::vector <SubmeshSource>> sources(entities);
+        std::vector <char> lazy(entities, 0);
 
-                                        // printf("\t\t%s, %s\n", mesh.c_str(), material_path.c_str());
-                                        meshes.push_back(mesh);
-                                        materials_paths.push_back(material_path);
-                                }
+        for (size_t i = 0; i < entities; i++) {
+                if (!(description.flags[i] & SceneDescription::eMesh))
+                        continue;
 
-                                current_element->fields["mesh"] = meshes;
-                                current_element->fields["material"] = materials_paths;
-                        } else if (field.rfind("renderable", 0) == 0) {
-                                // printf("\tRenderable\n");
-                                current_element->fields["renderable"] = true;
-                        } else if (field.rfind("list", 0) == 0) {
-                                if (field.length() <= 5) {
-                                        KOBRA_LOG_FILE(Log::WARN) << "List field without count: " << line << std::endl;
-                                        continue;
-                                }
+                auto first = description.submeshes.begin() + description.submesh_offsets[i];
+                auto last = description.submeshes.begin() + description.submesh_offsets[i + 1];
 
-                                std::string count = field.substr(5);
-                                elements.back().fields["count"] = std::stoi(count);
+                lazy[i] = residency_budget > 0 && first != last
+                        && std::all_of(first, last, [](const auto &entry) {
+                                return entry.flags & SceneDescription::SubmeshEntry::eExtent;
+                        });
 
-                                // printf("\tList of materials, count: %s\n", count.c_str());
+                for (auto it = first; it != last; it++) {
+                        std::filesystem::path mesh_name = std::filesystem::path(".cache") / description.string(it->file);
+                        std::filesystem::path material_name = std::filesystem::path("assets") / description.string(it->material);
 
-                                std::vector <std::string> materials;
-                                for (int j = 0; j < std::stoi(count); j++) {
-                                        std::istringstream iss(lines[i++]);
+                        sources[i].push_back({
+                                lazy[i] ? eProxy : unique(submesh_names, submesh_indices, mesh_name),
+                                unique(material_names, material_indices, material_name),
+                                it->matrix()
+                        });
+                }
+        }
+
+        // Read and decode in parallel: every submesh file once, every
+        // material file once, then the submeshes of each entity (copies of
+        // the decoded files, placed by their transform)
+        phase.emplace("Read and decode");
+
+        std::vector <std::optional <Submesh>> submesh_files(submesh_names.size());
+        std::vector <std::optional <std::string>> material_files(material_names.size());
+        std::vector <std::vector <Submesh>> mesh_lists(entities);
+
+        {
+                tf::Taskflow taskflow;
+                tf::Executor executor;
+
+                tf::Task decode = taskflow.for_each_index(size_t(0), submesh_names.size(), size_t(1),
+                        [&](size_t i) {
+                                std::string buffer;
+                                auto contents = read_project_file(path, archive, submesh_names[i], buffer);
+                                if (contents)
+                                        submesh_files[i] = load_mesh(*contents);
+                        }
+                );
+
+                taskflow.for_each_index(size_t(0), material_names.size(), size_t(1),
+                        [&](size_t i) {
+                                std::string buffer;
+                                auto contents = read_project_file(path, archive, material_names[i], buffer);
+                                if (contents)
+                                        material_files[i] = std::string(*contents);
+                        }
+                );
 
-                                        std::string material;
-                                        iss >> material;
+                tf::Task assemble = taskflow.for_each_index(size_t(0), entities, size_t(1),
+                        [&](size_t i) {
+                                if (lazy[i])
+                                        return;
 
-                                        printf("\t\t%s\n", material.c_str());
-                                        materials.push_back(material);
+                                for (const SubmeshSource &source : sources[i]) {
+                                        const std::optional <Submesh> &submesh = submesh_files[source.submesh];
+                                        if (!submesh)
+                                                continue;
+
+                                        if (source.transform == glm::mat4 { 1.0f })
+                                                mesh_lists[i].push_back(*submesh);
+                                        else
+                                                mesh_lists[i].push_back(instantiate(*submesh, source.transform));
                                 }
+                        }
+                );
 
-                                current_element->fields["list"] = materials;
-                        } else if (field.rfind("camera", 0) == 0) {
-                                float fov;
-                                float aspect;
+                decode.precede(assemble);
+                executor.run(taskflow).wait();
+        }
 
-                                std::istringstream iss(field.substr(7));
-                                iss >> fov >> aspect;
+        // Serial from here on: materials are registered in order of first
+        // use, then the entities and their GPU resources are created
+        phase.emplace("Create entities");
 
-                                // printf("\tCamera, fov: %f, aspect: %f\n", fov, aspect);
+        for (size_t i = 0; i < submesh_names.size(); i++) {
+                if (!submesh_files[i])
+                        KOBRA_LOG_FILE(Log::WARN) << "Missing or invalid mesh file: " << submesh_names[i] << std::endl;
+        }
 
-                                current_element->fields["fov"] = fov;
-                                current_element->fields["aspect"] = aspect;
-                        } else {
-                                KOBRA_LOG_FILE(Log::WARN) << "Unknown field: " << field << std::endl;
-                                continue;
-                        }
+        std::vector <int32_t> material_ids(material_names.size(), -1);
+        for (size_t i = 0; i < material_names.size(); i++) {
+                if (!material_files[i]) {
+                        KOBRA_LOG_FILE(Log::WARN) << "Material file does not exist: " << material_names[i] << std::endl;
+                        continue;
                 }
-        }
 
-        // Print the elements
-        // printf("-----------------------------------------\n");
-        // printf("Elements: %lu\n", elements.size());
-        // for (Element &element : elements) {
-        //         if (element.type == Element::ENTITY) {
-        //                 printf("Entity:\n");
-        //         } else if (element.type == Element::MATERIALS) {
-        //                 printf("Materials:\n");
-        //         }
-        //
-        //         for (auto &field : element.fields) {
-        //                 printf("\t%s: ", field.first.c_str());
-        //
-        //                 if (std::holds_alternative <int> (field.second)) {
-        //                         printf("%d\n", std::get <int> (field.second));
-        //                 } else if (std::holds_alternative <float> (field.second)) {
-        //                         printf("%f\n", std::get <float> (field.second));
-        //                 } else if (std::holds_alternative <Transform> (field.second)) {
-        //                         Transform &transform = std::get <Transform> (field.second);
-        //
-        //                         glm::vec3 position = transform.position;
-        //                         printf("Transform: %f %f %f\n", position.x, position.y, position.z);
-        //                 } else if (std::holds_alternative <std::string> (field.second)) {
-        //                         printf("%s\n", std::get <std::string> (field.second).c_str());
-        //                 } else if (std::holds_alternative <std::vector <std::string>> (field.second)) {
-        //                         printf("\n");
-        //                         for (const std::string &str : std::get <std::vector <std::string>> (field.second))
-        //                                 printf("\t\t%s\n", str.c_str());
-        //                 } else {
-        //                         printf("Unknown type\n");
-        //                 }
-        //         }
-        // }
+                std::istringstream material_file { *material_files[i] };
+                material_ids[i] = load(material_daemon, material_file);
+        }
 
         // Initilize the system
         scene.system = std::make_shared <System> (material_daemon);
 
+        scene.residency = nullptr;
+        if (std::find(lazy.begin(), lazy.end(), 1) != lazy.end()) {
+                scene.residency = std::shared_ptr <ResidencyDaemon> (
+                        make_residency_daemon(scene.system.get(), loader, residency_budget)
+                );
+        }
+
         // Add the entities
-        for (Element &element : elements) {
+        auto camera = description.cameras.begin();
+        for (size_t e = 0; e < entities; e++) {
+                uint32_t flags = description.flags[e];
+
                 // Create the entity
-                std::string name = std::get <std::string> (element.fields["name"]);
+                std::string name { description.string(description.names[e]) };
                 Entity entity = scene.system->make_entity(name);
 
                 // Add the components
-                for (auto &field : element.fields) {
-                        if (field.first == "transform") {
-                                Transform &transform = std::get <Transform> (field.second);
-                                entity.get <Transform> () = transform;
-                        } else if (field.first == "mesh") {
-                                std::vector <std::string> &meshes = std::get
-                                        <std::vector <std::string>> (field.second);
-                                
-                                std::vector <std::string> &material_paths = std::get
-                                        <std::vector <std::string>> (element.fields["material"]);
-
-                                std::vector <Submesh> mesh_list;
-                                for (int i = 0; i < meshes.size(); i++) {
-                                        std::string &mesh = meshes[i];
-                                        std::string &material_path = material_paths[i];
-
-                                        std::filesystem::path material_path_full = path / "assets" / material_path;
-                                        // if (!std::filesystem::exists(material_path_full)) {
-                                        //         KOBRA_LOG_FILE(Log::WARN) << "Material file does not exist: " << material_path_full << std::endl;
-                                        //         continue;
-                                        // }
-                                        //
-                                        // std::ifstream material_file(material_path_full);
-                                        // Material material = load_material(material_file);
-                                        // int32_t index = Material::all.size();
-                                        // Material::all.push_back(material);
-                                        int32_t index = load(material_daemon, material_path_full);
-
-                                        // printf("Mesh: %s, material: %s\n", mesh.c_str(), material_path_full.c_str());
-
-                                        // Check the assets path
-                                        std::filesystem::path mesh_path = path / ".cache" / mesh;
-                                        if (!std::filesystem::exists(mesh_path)) {
-                                                KOBRA_LOG_FILE(Log::WARN) << "Mesh file does not exist: " << mesh_path << std::endl;
-                                                continue;
-                                        }
-
-                                        std::ifstream mesh_file(mesh_path);
+                entity.get <Transform> () = Transform {
+                        description.positions[e],
+                        description.rotations[e],
+                        description.scales[e]
+                };
+
+                if ((flags & SceneDescription::eMesh) && lazy[e]) {
+                        // Proxy boxes, until paged in
+                        uint32_t first = description.submesh_offsets[e];
+
+                        std::vector <ResidencyDaemon::Source> proxy_sources;
+                        for (size_t k = 0; k < sources[e].size(); k++) {
+                                const SubmeshSource &source = sources[e][k];
+                                const auto &entry = description.submeshes[first + k];
+
+                                proxy_sources.push_back({
+                                        std::string(description.string(entry.file)),
+                                        source.transform,
+                                        material_ids[source.material],
+                                        entry.bounds(),
+                                        entry.vertices,
+                                        entry.indices
+                                });
+                        }
 
-                                        Submesh mesh_object = load_mesh(mesh_file);
-                                        mesh_object.material_index = index;
-                                        mesh_list.push_back(mesh_object);                                        
+                        entity.add <Mesh> (proxy_mesh(proxy_sources));
+                        track(scene.residency.get(), entity.id, proxy_sources);
+                } else if (flags & SceneDescription::eMesh) {
+                        // Decoded above; only the materials are left
+                        std::vector <Submesh> &mesh_list = mesh_lists[e];
 
-                                        // Material::all = material_daemon->materials;
-                                }
-
-                                if (mesh_list.empty()) {
-                                        KOBRA_LOG_FILE(Log::WARN) << "No meshes loaded for entity: " << name << std::endl;
-                                        continue;
-                                }
+                        size_t k = 0;
+                        for (const SubmeshSource &source : sources[e]) {
+                                if (submesh_files[source.submesh])
+                                        mesh_list[k++].material_index = material_ids[source.material];
+                        }
 
-                                entity.add <Mesh> (mesh_list);
-                        } else if (field.first == "renderable") {
-                                // TODO: no need for mesh component, only renderable should be enough
-                                // cache still contains all necessary meshes...
-                                // scene.ecs->add_component <Renderable> (entity);
+                        if (mesh_list.empty())
+                                KOBRA_LOG_FILE(Log::WARN) << "No meshes loaded for entity: " << name << std::endl;
+                        else
+                                entity.add <Mesh> (std::move(mesh_list));
+                }
 
-                                // Make sure the entity has a mesh by now
-                                if (!entity.exists <Mesh> ()) {
-                                        KOBRA_LOG_FILE(Log::WARN) << "Entity does not have a mesh: " << name << std::endl;
-                                        continue;
-                                }
+                if (flags & SceneDescription::eRenderable) {
+                        // TODO: no need for mesh component, only renderable should be enough
+                        // cache still contains all necessary meshes...
 
+                        // Make sure the entity has a mesh by now
+                        if (entity.exists <Mesh> ()) {
                                 Mesh *mesh = &entity.get <Mesh> ();
                                 entity.add <Renderable> (context, mesh);
-                        } else if (field.first == "fov") {
-                                // Also get aspect
-                                float fov = std::get <float> (field.second);
-                                float aspect = std::get <float> (element.fields["aspect"]);
-
-                                // printf("Camera: fov = %f, aspect = %f\n", fov, aspect);
-
-                                entity.add <Camera> (fov, aspect);
+                        } else {
+                                KOBRA_LOG_FILE(Log::WARN) << "Entity does not have a mesh: " << name << std::endl;
                         }
                 }
+
+                if (flags & SceneDescription::eCamera) {
+                        entity.add <Camera> (camera->fov, camera->aspect);
+                        camera++;
+                }
         }
 }
 
@@ -557,8 +966,52 @@ Scene &Project::load_scene(const Context &context, int index)
         printf("Loading scene from path: %s, stem = %s\n", path.c_str(), path.stem().c_str());
 
         // scenes[index].load(context, path.string());
-        std::ifstream file(path);
-        s_load_scene(directory, context, scenes[index], material_daemon, file);
+        std::string buffer;
+        auto contents = read_project_file(directory, archive.get(), scene_file, buffer);
+        if (!contents)
+                throw std::runtime_error("Scene file does not exist");
+
+        {
+                KOBRA_PROFILE_TASK("Project::load_scene");
+
+                // Submeshes paged in later are read from the same place; the
+                // loader keeps the archive mapped
+                std::filesystem::path root = directory;
+                std::shared_ptr <ProjectArchive> source = archive;
+
+                ResidencyDaemon::Loader loader = [root, source](const std::string &name) -> std::optional <Submesh> {
+                        std::string buffer;
+                        auto contents = read_project_file(root, source.get(), std::filesystem::path(".cache") / name, buffer);
+                        if (!contents)
+                                return std::nullopt;
+
+                        return load_mesh(*contents);
+                };
+
+                s_load_scene(directory, archive.get(), context, scenes[index], material_daemon, *contents,
+                        residency_budget, loader);
+
+                if (scene_bvh) {
+                        KOBRA_PROFILE_TASK("Scene BVH");
+
+                        std::filesystem::path cache;
+                        if (!archive)
+                                cache = std::filesystem::path(directory) / ".cache";
+
+                        Scene &scene = scenes[index];
+                        scene.bvh = std::shared_ptr <BVHDaemon> (
+                                make_bvh_daemon(scene.system.get(), {}, cache)
+                        );
+
+                        rebuild(scene.bvh.get());
+
+                        KOBRA_LOG_FILE(Log::INFO) << "Scene BVH: " << scene.bvh->stats.blas_built
+                                << " BLASes built, " << scene.bvh->stats.blas_loaded << " loaded from the cache\n";
+                }
+        }
+
+        KOBRA_LOG_FILE(Log::INFO) << "Loaded scene:\n" << Profiler::pretty(last_event());
+
         scenes[index].name = path.stem();
 
         return scenes[index];
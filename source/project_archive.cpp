@@ -0,0 +1,285 @@
+// Standard headers
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Unix headers
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Engine headers
+#include "include/common.hpp"
+#include "include/project_archive.hpp"
+
+namespace kobra {
+
+/////////////
+// Reading //
+/////////////
+
+ProjectArchive::~ProjectArchive()
+{
+	if (_data)
+		munmap((void *) _data, _size);
+}
+
+// Structural checks, so that no view can leave the mapping
+static bool validate(const uint8_t *data, size_t size)
+{
+	ProjectArchiveHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	bool valid = header.magic == ProjectArchiveHeader::eMagic
+		&& header.version == ProjectArchiveHeader::eVersion
+		&& header.toc >= sizeof(ProjectArchiveHeader)
+		&& header.toc % alignof(ProjectArchiveEntry) == 0
+		&& header.toc <= size
+		&& header.entries <= (size - header.toc)/sizeof(ProjectArchiveEntry)
+		&& header.names == header.toc + header.entries * sizeof(ProjectArchiveEntry)
+		&& header.names_size == size - header.names;
+
+	if (!valid)
+		return false;
+
+	const ProjectArchiveEntry *entries = (const ProjectArchiveEntry *) (data + header.toc);
+	const char *names = (const char *) (data + header.names);
+
+	std::string_view previous;
+	for (size_t i = 0; i < header.entries; i++) {
+		const ProjectArchiveEntry &entry = entries[i];
+
+		// Contents before the table of contents, names within the pool
+		if (entry.offset < sizeof(ProjectArchiveHeader)
+				|| entry.offset % ProjectArchiveHeader::eAlignment != 0
+				|| entry.offset > header.toc
+				|| entry.size > header.toc - entry.offset)
+			return false;
+
+		if (size_t(entry.name) + entry.name_size > header.names_size)
+			return false;
+
+		// Strictly sorted, for lookups
+		std::string_view name(names + entry.name, entry.name_size);
+		if (i > 0 && !(previous < name))
+			return false;
+
+		previous = name;
+	}
+
+	return true;
+}
+
+std::shared_ptr <ProjectArchive> ProjectArchive::open(const std::filesystem::path &path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ProjectArchiveHeader)) {
+		close(fd);
+		return nullptr;
+	}
+
+	size_t size = st.st_size;
+	void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return nullptr;
+
+	if (!validate((const uint8_t *) data, size)) {
+		munmap(data, size);
+		KOBRA_LOG_FUNC(Log::WARN) << "Invalid project archive " << path << "\n";
+		return nullptr;
+	}
+
+	std::shared_ptr <ProjectArchive> archive(new ProjectArchive());
+	archive->_data = (const uint8_t *) data;
+	archive->_size = size;
+
+	ProjectArchiveHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	archive->_entries = (const ProjectArchiveEntry *) (archive->_data + header.toc);
+	archive->_count = header.entries;
+	archive->_names = (const char *) (archive->_data + header.names);
+
+	return archive;
+}
+
+std::string_view ProjectArchive::name(size_t index) const
+{
+	const ProjectArchiveEntry &entry = _entries[index];
+	return { _names + entry.name, entry.name_size };
+}
+
+std::string_view ProjectArchive::contents(size_t index) const
+{
+	const ProjectArchiveEntry &entry = _entries[index];
+	return { (const char *) _data + entry.offset, entry.size };
+}
+
+std::optional <std::string_view> ProjectArchive::find(std::string_view key) const
+{
+	size_t lo = 0;
+	size_t hi = _count;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi)/2;
+
+		std::string_view current = name(mid);
+		if (current == key)
+			return contents(mid);
+
+		if (current < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return std::nullopt;
+}
+
+/////////////
+// Packing //
+/////////////
+
+std::filesystem::path project_archive_path(const std::filesystem::path &directory)
+{
+	// Trailing separators would name the archive inside the directory
+	std::filesystem::path path = directory.lexically_normal();
+	if (!path.has_filename())
+		path = path.parent_path();
+
+	path += ".kpak";
+	return path;
+}
+
+bool is_project_archive(const std::filesystem::path &path)
+{
+	return path.extension() == ".kpak" && std::filesystem::is_regular_file(path);
+}
+
+// Files of a project directory, by archive name
+static std::vector <std::string> project_files(const std::filesystem::path &directory)
+{
+	std::vector <std::string> files;
+
+	auto collect = [&](const std::filesystem::path &subdirectory, const std::string &extension) {
+		std::error_code error;
+		std::filesystem::directory_iterator it(directory / subdirectory, error);
+		if (error)
+			return;
+
+		for (const auto &entry : it) {
+			if (entry.is_regular_file() && entry.path().extension() == extension) {
+				std::filesystem::path name = subdirectory / entry.path().filename();
+				files.push_back(name.relative_path().generic_string());
+			}
+		}
+	};
+
+	files.push_back("project.den");
+	collect("", ".kobra");
+	collect(".cache", ".submesh");
+	collect("assets", ".mat");
+
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+bool pack_project(const std::filesystem::path &directory, const std::filesystem::path &path)
+{
+	if (!std::filesystem::exists(directory / "project.den")) {
+		KOBRA_LOG_FUNC(Log::ERROR) << "Not a project directory: " << directory << "\n";
+		return false;
+	}
+
+	std::vector <std::string> files = project_files(directory);
+
+	std::filesystem::path tmp = path;
+	tmp += ".tmp";
+
+	std::ofstream file(tmp, std::ios::binary);
+	if (!file.is_open()) {
+		KOBRA_LOG_FUNC(Log::WARN) << "Could not write project archive " << tmp << "\n";
+		return false;
+	}
+
+	// Contents, streamed one file at a time
+	ProjectArchiveHeader header {};
+	file.write((const char *) &header, sizeof(header));
+
+	std::vector <ProjectArchiveEntry> entries(files.size());
+	std::string names;
+
+	uint64_t offset = sizeof(ProjectArchiveHeader);
+	for (size_t i = 0; i < files.size(); i++) {
+		std::ifstream input(directory / files[i], std::ios::binary | std::ios::ate);
+
+		std::string data;
+		if (input.is_open()) {
+			data.resize(input.tellg());
+			input.seekg(0);
+			input.read(data.data(), data.size());
+		}
+
+		if (!input) {
+			KOBRA_LOG_FUNC(Log::ERROR) << "Could not read " << files[i] << "\n";
+			file.close();
+			std::filesystem::remove(tmp);
+			return false;
+		}
+
+		uint64_t aligned = (offset + ProjectArchiveHeader::eAlignment - 1)
+			& ~(ProjectArchiveHeader::eAlignment - 1);
+
+		static const char padding[ProjectArchiveHeader::eAlignment] {};
+		file.write(padding, aligned - offset);
+		file.write(data.data(), data.size());
+
+		entries[i].offset = aligned;
+		entries[i].size = data.size();
+		entries[i].name = names.size();
+		entries[i].name_size = files[i].size();
+
+		names += files[i];
+		offset = aligned + data.size();
+	}
+
+	// Table of contents and names
+	uint64_t toc = (offset + alignof(ProjectArchiveEntry) - 1)
+		& ~uint64_t(alignof(ProjectArchiveEntry) - 1);
+
+	static const char padding[alignof(ProjectArchiveEntry)] {};
+	file.write(padding, toc - offset);
+	file.write((const char *) entries.data(), entries.size() * sizeof(ProjectArchiveEntry));
+	file.write(names.data(), names.size());
+
+	header.magic = ProjectArchiveHeader::eMagic;
+	header.version = ProjectArchiveHeader::eVersion;
+	header.entries = entries.size();
+	header.toc = toc;
+	header.names = toc + entries.size() * sizeof(ProjectArchiveEntry);
+	header.names_size = names.size();
+
+	file.seekp(0);
+	file.write((const char *) &header, sizeof(header));
+	file.close();
+
+	if (!file) {
+		std::filesystem::remove(tmp);
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tmp, path, error);
+	return !error;
+}
+
+}
@@ -1,3 +1,6 @@
+// Standard headers
+#include <atomic>
+
 // Engine headers
 #include "../include/renderable.hpp"
 #include "../shaders/raster/bindings.h"
@@ -9,11 +12,27 @@ namespace kobra {
 Renderable::Renderable(const Context &context, Mesh *mesh_)
 		: mesh(mesh_)
 {
+	static std::atomic <uint64_t> generations { 0 };
+	generation = ++generations;
+
 	const Device &dev = context.dev();
 	for (size_t i = 0; i < mesh->submeshes.size(); i++) {
 		// Allocate memory for the vertex, index, and uniform buffers
+		// LOD indices follow the full detail ones, in the same buffer
+		const Submesh &submesh = (*mesh)[i];
+
+		std::vector <uint32_t> indices = submesh.indices;
+		std::vector <std::pair <uint32_t, uint32_t>> ranges;
+		std::vector <float> errors;
+
+		for (const SubmeshLOD &lod : submesh.lods) {
+			ranges.push_back({ indices.size(), lod.indices.size() });
+			errors.push_back(lod.error);
+			indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+		}
+
 		vk::DeviceSize vbuf_size = (*mesh)[i].vertices.size() * sizeof(Vertex);
-		vk::DeviceSize ibuf_size = (*mesh)[i].indices.size() * sizeof(uint32_t);
+		vk::DeviceSize ibuf_size = indices.size() * sizeof(uint32_t);
 
 		vertex_buffer.emplace_back(*dev.phdev, *dev.device,
 			vbuf_size,
@@ -31,7 +50,7 @@ Renderable::Renderable(const Context &context, Mesh *mesh_)
 
 		// Upload data to buffers
 		vertex_buffer[i].upload((*mesh)[i].vertices);
-		index_buffer[i].upload((*mesh)[i].indices);
+		index_buffer[i].upload(indices);
 
 		// UBO
 		// kobra::Material mat = (*mesh)[i].material;
@@ -46,6 +65,14 @@ Renderable::Renderable(const Context &context, Mesh *mesh_)
 		// Other data
 		index_count.push_back((*mesh)[i].indices.size());
 		material_indices.push_back((*mesh)[i].material_index);
+		lod_ranges.push_back(ranges);
+		lod_errors.push_back(errors);
+
+		BoundingBox bbox = submesh.bbox();
+		bounding_spheres.push_back({
+			(bbox.min + bbox.max)/2.0f,
+			glm::length(bbox.max - bbox.min)/2.0f
+		});
 	}
 }
 
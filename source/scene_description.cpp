@@ -0,0 +1,631 @@
+// Standard headers
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <type_traits>
+
+// Engine headers
+#include "include/common.hpp"
+#include "include/scene_description.hpp"
+
+namespace kobra {
+
+//////////////
+// Building //
+//////////////
+
+glm::mat4 SceneDescription::SubmeshEntry::matrix() const
+{
+	glm::mat4 matrix { 1.0f };
+	if (!(flags & eInstance))
+		return matrix;
+
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++)
+			matrix[c][r] = rows[r * 4 + c];
+	}
+
+	return matrix;
+}
+
+// Identity transforms are not stored, so that both encodings agree
+void SceneDescription::SubmeshEntry::set_matrix(const glm::mat4 &matrix)
+{
+	std::memset(rows, 0, sizeof(rows));
+	flags &= ~eInstance;
+
+	if (matrix == glm::mat4 { 1.0f })
+		return;
+
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++)
+			rows[r * 4 + c] = matrix[c][r];
+	}
+
+	flags |= eInstance;
+}
+
+BoundingBox SceneDescription::SubmeshEntry::bounds() const
+{
+	return BoundingBox {
+		{ extent[0], extent[1], extent[2] },
+		{ extent[3], extent[4], extent[5] }
+	};
+}
+
+void SceneDescription::SubmeshEntry::set_bounds(const BoundingBox &box, size_t vertices_, size_t indices_)
+{
+	extent[0] = box.min.x;
+	extent[1] = box.min.y;
+	extent[2] = box.min.z;
+	extent[3] = box.max.x;
+	extent[4] = box.max.y;
+	extent[5] = box.max.z;
+
+	vertices = vertices_;
+	indices = indices_;
+	flags |= eExtent;
+}
+
+uint32_t SceneDescription::add_string(std::string_view str)
+{
+	auto it = _lookup.find(std::string(str));
+	if (it != _lookup.end())
+		return it->second;
+
+	uint32_t index = string_offsets.size() - 1;
+	string_data += str;
+	string_offsets.push_back(string_data.size());
+
+	_lookup.emplace(str, index);
+	return index;
+}
+
+uint32_t SceneDescription::add_entity(std::string_view name, const glm::vec3 &position,
+		const glm::vec3 &rotation, const glm::vec3 &scale)
+{
+	names.push_back(add_string(name));
+	flags.push_back(0);
+
+	positions.push_back(position);
+	rotations.push_back(rotation);
+	scales.push_back(scale);
+
+	submesh_offsets.push_back(submeshes.size());
+	return names.size() - 1;
+}
+
+void SceneDescription::add_submesh(const SubmeshEntry &entry)
+{
+	submeshes.push_back(entry);
+	submesh_offsets.back() = submeshes.size();
+}
+
+void SceneDescription::add_camera(float fov, float aspect)
+{
+	cameras.push_back({ uint32_t(names.size() - 1), fov, aspect });
+	flags.back() |= eCamera;
+}
+
+////////////
+// Binary //
+////////////
+
+// Offsets of the tables, which only depend on the counts
+struct SceneLayout {
+	uint64_t names;
+	uint64_t flags;
+	uint64_t positions;
+	uint64_t rotations;
+	uint64_t scales;
+	uint64_t submesh_offsets;
+	uint64_t submeshes;
+	uint64_t cameras;
+	uint64_t string_offsets;
+	uint64_t string_data;
+	uint64_t size;
+};
+
+static SceneLayout scene_layout(const SceneDescriptionHeader &header)
+{
+	uint64_t offset = sizeof(SceneDescriptionHeader);
+
+	auto table = [&](uint64_t bytes) {
+		uint64_t start = (offset + SceneDescriptionHeader::eAlignment - 1)
+			& ~(SceneDescriptionHeader::eAlignment - 1);
+
+		offset = start + bytes;
+		return start;
+	};
+
+	uint64_t entities = header.entities;
+
+	SceneLayout layout;
+	layout.names = table(entities * sizeof(uint32_t));
+	layout.flags = table(entities * sizeof(uint32_t));
+	layout.positions = table(entities * sizeof(glm::vec3));
+	layout.rotations = table(entities * sizeof(glm::vec3));
+	layout.scales = table(entities * sizeof(glm::vec3));
+	layout.submesh_offsets = table((entities + 1) * sizeof(uint32_t));
+	layout.submeshes = table(uint64_t(header.submeshes) * sizeof(SceneDescription::SubmeshEntry));
+	layout.cameras = table(uint64_t(header.cameras) * sizeof(SceneDescription::CameraEntry));
+	layout.string_offsets = table((uint64_t(header.strings) + 1) * sizeof(uint32_t));
+	layout.string_data = table(header.string_bytes);
+	layout.size = offset;
+
+	return layout;
+}
+
+bool is_binary_scene(std::string_view data)
+{
+	uint32_t magic = 0;
+	if (data.size() >= sizeof(magic))
+		std::memcpy(&magic, data.data(), sizeof(magic));
+
+	return magic == SceneDescriptionHeader::eMagic;
+}
+
+std::string encode_scene(const SceneDescription &description)
+{
+	SceneDescriptionHeader header {};
+	header.magic = SceneDescriptionHeader::eMagic;
+	header.version = SceneDescriptionHeader::eVersion;
+	header.entities = description.size();
+	header.submeshes = description.submeshes.size();
+	header.cameras = description.cameras.size();
+	header.strings = description.string_offsets.size() - 1;
+	header.string_bytes = description.string_data.size();
+
+	SceneLayout layout = scene_layout(header);
+
+	// Padding stays zero
+	std::string data(layout.size, '\0');
+
+	auto copy = [&](uint64_t offset, const auto &table) {
+		using T = typename std::decay_t <decltype(table)> ::value_type;
+		std::memcpy(data.data() + offset, table.data(), table.size() * sizeof(T));
+	};
+
+	std::memcpy(data.data(), &header, sizeof(header));
+	copy(layout.names, description.names);
+	copy(layout.flags, description.flags);
+	copy(layout.positions, description.positions);
+	copy(layout.rotations, description.rotations);
+	copy(layout.scales, description.scales);
+	copy(layout.submesh_offsets, description.submesh_offsets);
+	copy(layout.submeshes, description.submeshes);
+	copy(layout.cameras, description.cameras);
+	copy(layout.string_offsets, description.string_offsets);
+	copy(layout.string_data, description.string_data);
+
+	return data;
+}
+
+// Indices and ranges, so that no lookup can leave the tables
+static bool validate(const SceneDescription &description)
+{
+	size_t strings = description.string_offsets.size() - 1;
+
+	auto ascending = [](const std::vector <uint32_t> &offsets, size_t last) {
+		if (offsets.front() != 0 || offsets.back() != last)
+			return false;
+
+		for (size_t i = 1; i < offsets.size(); i++) {
+			if (offsets[i] < offsets[i - 1])
+				return false;
+		}
+
+		return true;
+	};
+
+	if (!ascending(description.string_offsets, description.string_data.size())
+			|| !ascending(description.submesh_offsets, description.submeshes.size()))
+		return false;
+
+	for (uint32_t name : description.names) {
+		if (name >= strings)
+			return false;
+	}
+
+	for (const auto &entry : description.submeshes) {
+		if (entry.file >= strings || entry.material >= strings)
+			return false;
+	}
+
+	// One camera per entity with the flag, in order
+	size_t cameras = 0;
+	for (uint32_t flags : description.flags)
+		cameras += (flags & SceneDescription::eCamera) ? 1 : 0;
+
+	if (cameras != description.cameras.size())
+		return false;
+
+	for (size_t i = 0; i < description.cameras.size(); i++) {
+		uint32_t entity = description.cameras[i].entity;
+		if (entity >= description.size()
+				|| !(description.flags[entity] & SceneDescription::eCamera)
+				|| (i > 0 && entity <= description.cameras[i - 1].entity))
+			return false;
+	}
+
+	return true;
+}
+
+std::optional <SceneDescription> decode_scene(std::string_view data)
+{
+	SceneDescriptionHeader header;
+	if (data.size() < sizeof(header))
+		return std::nullopt;
+
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (header.magic != SceneDescriptionHeader::eMagic
+			|| header.version != SceneDescriptionHeader::eVersion
+			|| header.string_bytes > data.size())
+		return std::nullopt;
+
+	SceneLayout layout = scene_layout(header);
+	if (layout.size != data.size())
+		return std::nullopt;
+
+	SceneDescription description;
+
+	auto copy = [&](uint64_t offset, size_t count, auto &table) {
+		using T = typename std::decay_t <decltype(table)> ::value_type;
+		table.resize(count);
+		std::memcpy(table.data(), data.data() + offset, count * sizeof(T));
+	};
+
+	copy(layout.names, header.entities, description.names);
+	copy(layout.flags, header.entities, description.flags);
+	copy(layout.positions, header.entities, description.positions);
+	copy(layout.rotations, header.entities, description.rotations);
+	copy(layout.scales, header.entities, description.scales);
+	copy(layout.submesh_offsets, size_t(header.entities) + 1, description.submesh_offsets);
+	copy(layout.submeshes, header.submeshes, description.submeshes);
+	copy(layout.cameras, header.cameras, description.cameras);
+	copy(layout.string_offsets, size_t(header.strings) + 1, description.string_offsets);
+	copy(layout.string_data, header.string_bytes, description.string_data);
+
+	if (!validate(description))
+		return std::nullopt;
+
+	return description;
+}
+
+//////////
+// Text //
+//////////
+
+// Strings are quoted, with quotes, backslashes and line breaks escaped, so
+// that names and files with spaces or commas read back the same
+static void write_quoted(std::ostream &stream, std::string_view str)
+{
+	stream << '"';
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			stream << '\\' << c;
+		else if (c == '\n')
+			stream << "\\n";
+		else if (c == '\r')
+			stream << "\\r";
+		else
+			stream << c;
+	}
+
+	stream << '"';
+}
+
+// Floats are written with 9 significant digits, enough for conversions
+// between the encodings to be lossless
+std::string write_scene_text(const SceneDescription &description)
+{
+	std::ostringstream stream;
+	stream << std::setprecision(9);
+
+	auto vec3 = [&](const glm::vec3 &v) {
+		stream << v.x << " " << v.y << " " << v.z;
+	};
+
+	auto camera = description.cameras.begin();
+	for (size_t i = 0; i < description.size(); i++) {
+		uint32_t flags = description.flags[i];
+
+		stream << "\n@entity ";
+		write_quoted(stream, description.string(description.names[i]));
+		stream << "\n";
+
+		stream << ".transform ";
+		vec3(description.positions[i]);
+		stream << " ";
+		vec3(description.rotations[i]);
+		stream << " ";
+		vec3(description.scales[i]);
+		stream << "\n";
+
+		if (flags & SceneDescription::eMesh) {
+			uint32_t first = description.submesh_offsets[i];
+			uint32_t last = description.submesh_offsets[i + 1];
+
+			stream << ".mesh " << (last - first) << "\n";
+			for (uint32_t j = first; j < last; j++) {
+				const auto &entry = description.submeshes[j];
+				stream << "\t";
+				write_quoted(stream, description.string(entry.file));
+				stream << ", ";
+				write_quoted(stream, description.string(entry.material));
+
+				// Rows of the affine transform from the source
+				if (entry.flags & SceneDescription::SubmeshEntry::eInstance) {
+					stream << " instance";
+					for (float x : entry.rows)
+						stream << " " << x;
+				}
+
+				if (entry.flags & SceneDescription::SubmeshEntry::eExtent) {
+					stream << " bounds";
+					for (float x : entry.extent)
+						stream << " " << x;
+
+					stream << " counts " << entry.vertices << " " << entry.indices;
+				}
+
+				stream << "\n";
+			}
+		}
+
+		if (flags & SceneDescription::eRenderable)
+			stream << ".renderable\n";
+
+		if (flags & SceneDescription::eCamera) {
+			stream << ".camera " << camera->fov << " " << camera->aspect << "\n";
+			camera++;
+		}
+	}
+
+	return stream.str();
+}
+
+// Words and numbers of a line; strtof and strtoull need terminated strings,
+// so the line is copied
+struct LineReader {
+	std::string line;
+	const char *ptr;
+	bool ok = true;
+
+	LineReader(std::string_view line_) : line(line_), ptr(line.c_str()) {}
+
+	float number() {
+		char *end;
+		float value = std::strtof(ptr, &end);
+		ok &= (end != ptr);
+		ptr = end;
+		return value;
+	}
+
+	uint64_t integer() {
+		char *end;
+		uint64_t value = std::strtoull(ptr, &end, 10);
+		ok &= (end != ptr);
+		ptr = end;
+		return value;
+	}
+
+	// Up to a delimiter (excluded), or the next whitespace
+	std::string_view word(char delimiter = '\0') {
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+		const char *start = ptr;
+		while (*ptr && *ptr != delimiter && !std::isspace((unsigned char) *ptr))
+			ptr++;
+
+		std::string_view result(start, ptr - start);
+		if (delimiter && *ptr == delimiter)
+			ptr++;
+
+		return result;
+	}
+
+	// A quoted string (see write_quoted), followed by an optional
+	// delimiter; unquoted strings, from older files, are read as words
+	std::string string(char delimiter = '\0') {
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+		if (*ptr != '"')
+			return std::string(word(delimiter));
+
+		std::string result;
+		for (ptr++; *ptr && *ptr != '"'; ptr++) {
+			if (*ptr == '\\' && ptr[1]) {
+				ptr++;
+				result += (*ptr == 'n') ? '\n' : (*ptr == 'r') ? '\r' : *ptr;
+			} else {
+				result += *ptr;
+			}
+		}
+
+		// Unterminated strings are invalid
+		ok &= (*ptr == '"');
+		if (*ptr)
+			ptr++;
+
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+
+		if (delimiter && *ptr == delimiter)
+			ptr++;
+
+		return result;
+	}
+};
+
+std::optional <SceneDescription> read_scene_text(std::string_view data)
+{
+	SceneDescription description;
+
+	// Lines, without line endings
+	std::vector <std::string_view> lines;
+	while (!data.empty()) {
+		size_t end = data.find('\n');
+		std::string_view line = data.substr(0, end);
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+
+		lines.push_back(line);
+		data.remove_prefix(end == std::string_view::npos ? data.size() : end + 1);
+	}
+
+	bool entity = false;
+	for (size_t i = 0; i < lines.size(); ) {
+		std::string_view line = lines[i++];
+
+		// Skip empty lines and comments
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		if (line[0] == '@') {
+			LineReader reader(line.substr(1));
+			std::string_view type = reader.word();
+
+			entity = (type == "entity");
+			if (!entity) {
+				KOBRA_LOG_FILE(Log::WARN) << "Ignoring element: " << type << std::endl;
+				continue;
+			}
+
+			// Quoted; older files have the rest of the line, without
+			// surrounding spaces
+			std::string_view rest = line.substr(std::min <size_t> (7, line.size()));
+			rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+			rest = rest.substr(0, rest.find_last_not_of(' ') + 1);
+
+			std::string name(rest);
+			if (!rest.empty() && rest[0] == '"') {
+				name = reader.string();
+				if (!reader.ok || *reader.ptr) {
+					KOBRA_LOG_FILE(Log::WARN) << "Invalid entity: " << line << std::endl;
+					return std::nullopt;
+				}
+			}
+
+			description.add_entity(name, glm::vec3 { 0.0f }, glm::vec3 { 0.0f }, glm::vec3 { 1.0f });
+			continue;
+		}
+
+		if (line[0] != '.') {
+			KOBRA_LOG_FILE(Log::WARN) << "Unexpected line: " << line << std::endl;
+			continue;
+		}
+
+		LineReader reader(line.substr(1));
+		std::string_view field = reader.word();
+
+		// Lists of legacy material elements
+		if (field == "list") {
+			i += reader.integer();
+			continue;
+		}
+
+		if (!entity) {
+			KOBRA_LOG_FILE(Log::WARN) << "Field without entity: " << line << std::endl;
+			continue;
+		}
+
+		uint32_t &flags = description.flags.back();
+		if (field == "transform") {
+			glm::vec3 *vectors[3] = {
+				&description.positions.back(),
+				&description.rotations.back(),
+				&description.scales.back()
+			};
+
+			for (glm::vec3 *v : vectors) {
+				v->x = reader.number();
+				v->y = reader.number();
+				v->z = reader.number();
+			}
+		} else if (field == "mesh") {
+			flags |= SceneDescription::eMesh;
+
+			uint64_t count = reader.integer();
+			for (uint64_t j = 0; j < count && i < lines.size(); j++) {
+				LineReader submesh(lines[i++]);
+
+				SceneDescription::SubmeshEntry entry;
+				entry.file = description.add_string(submesh.string(','));
+				entry.material = description.add_string(submesh.string());
+
+				// Copies of another submesh carry the rows of their
+				// transform; proxies need bounds and counts
+				BoundingBox box;
+				bool has_bounds = false;
+				bool has_counts = false;
+
+				for (std::string_view keyword = submesh.word(); !keyword.empty(); keyword = submesh.word()) {
+					if (keyword == "instance") {
+						for (float &x : entry.rows)
+							x = submesh.number();
+
+						entry.flags |= SceneDescription::SubmeshEntry::eInstance;
+					} else if (keyword == "bounds") {
+						box.min = { submesh.number(), submesh.number(), submesh.number() };
+						box.max = { submesh.number(), submesh.number(), submesh.number() };
+						has_bounds = true;
+					} else if (keyword == "counts") {
+						entry.vertices = submesh.integer();
+						entry.indices = submesh.integer();
+						has_counts = true;
+					} else {
+						KOBRA_LOG_FILE(Log::WARN) << "Unknown submesh keyword: " << keyword << std::endl;
+						break;
+					}
+				}
+
+				if (!submesh.ok) {
+					KOBRA_LOG_FILE(Log::WARN) << "Invalid submesh: " << submesh.line << std::endl;
+					return std::nullopt;
+				}
+
+				// Identity transforms are not stored
+				entry.set_matrix(entry.matrix());
+				if (has_bounds && has_counts)
+					entry.set_bounds(box, entry.vertices, entry.indices);
+				else
+					entry.vertices = entry.indices = 0;
+
+				description.add_submesh(entry);
+			}
+		} else if (field == "renderable") {
+			flags |= SceneDescription::eRenderable;
+		} else if (field == "camera") {
+			float fov = reader.number();
+			float aspect = reader.number();
+			if (!(flags & SceneDescription::eCamera))
+				description.add_camera(fov, aspect);
+		} else {
+			KOBRA_LOG_FILE(Log::WARN) << "Unknown field: " << field << std::endl;
+			continue;
+		}
+
+		if (!reader.ok) {
+			KOBRA_LOG_FILE(Log::WARN) << "Invalid field: " << line << std::endl;
+			return std::nullopt;
+		}
+	}
+
+	return description;
+}
+
+std::optional <SceneDescription> read_scene(std::string_view data)
+{
+	if (is_binary_scene(data))
+		return decode_scene(data);
+
+	return read_scene_text(data);
+}
+
+}
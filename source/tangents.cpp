@@ -0,0 +1,314 @@
+// Standard headers
+#include <cmath>
+
+// SIMD headers
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Engine headers
+#include "../include/tangents.hpp"
+
+namespace kobra {
+
+bool has_tangents(const VertexList &vertices)
+{
+	for (const Vertex &vertex : vertices) {
+		if (vertex.tangent != glm::vec3 {0.0f})
+			return true;
+	}
+
+	return false;
+}
+
+//////////////////////
+// Triangle kernels //
+//////////////////////
+
+// Four triangles, as structure of arrays
+struct TriangleBatch {
+	alignas(16) float px[3][4];
+	alignas(16) float py[3][4];
+	alignas(16) float pz[3][4];
+	alignas(16) float u[3][4];
+	alignas(16) float v[3][4];
+};
+
+// Frames of four triangles; unit tangent and bitangent along the texture
+// axes, the area of the triangle, and its handedness (-1 for mirrored UVs,
+// and zero for triangles without a usable frame)
+struct TriangleFrames {
+	alignas(16) float tx[4], ty[4], tz[4];
+	alignas(16) float bx[4], by[4], bz[4];
+	alignas(16) float area[4];
+	alignas(16) float sign[4];
+};
+
+// UV triangles with less than this sine of their angle are degenerate
+static constexpr float eMinUVSine = 1e-6f;
+
+// One lane at a time, for targets without SSE; the same operations, in the
+// same order, as the SSE kernel
+static void triangle_frames_scalar(const TriangleBatch &batch, TriangleFrames &frames)
+{
+	for (int lane = 0; lane < 4; lane++) {
+		float p0x = batch.px[0][lane];
+		float p0y = batch.py[0][lane];
+		float p0z = batch.pz[0][lane];
+
+		float e1x = batch.px[1][lane] - p0x;
+		float e1y = batch.py[1][lane] - p0y;
+		float e1z = batch.pz[1][lane] - p0z;
+
+		float e2x = batch.px[2][lane] - p0x;
+		float e2y = batch.py[2][lane] - p0y;
+		float e2z = batch.pz[2][lane] - p0z;
+
+		float u0 = batch.u[0][lane];
+		float v0 = batch.v[0][lane];
+
+		float d1u = batch.u[1][lane] - u0;
+		float d1v = batch.v[1][lane] - v0;
+		float d2u = batch.u[2][lane] - u0;
+		float d2v = batch.v[2][lane] - v0;
+
+		float det = d1u * d2v - d1v * d2u;
+
+		float tx = e1x * d2v - e2x * d1v;
+		float ty = e1y * d2v - e2y * d1v;
+		float tz = e1z * d2v - e2z * d1v;
+
+		float bx = e2x * d1u - e1x * d2u;
+		float by = e2y * d1u - e1y * d2u;
+		float bz = e2z * d1u - e1z * d2u;
+
+		float nx = e1y * e2z - e1z * e2y;
+		float ny = e1z * e2x - e1x * e2z;
+		float nz = e1x * e2y - e1y * e2x;
+
+		auto length = [](float x, float y, float z) {
+			return std::sqrt((x * x + y * y) + z * z);
+		};
+
+		float t_length = length(tx, ty, tz);
+		float b_length = length(bx, by, bz);
+		float area = length(nx, ny, nz) * 0.5f;
+
+		float uv_scale = (d1u * d1u + d1v * d1v) + (d2u * d2u + d2v * d2v);
+
+		bool valid = std::fabs(det) > uv_scale * (eMinUVSine/2.0f)
+			&& t_length > 0.0f && b_length > 0.0f && area > 0.0f;
+
+		float sign = std::copysign(1.0f, det);
+
+		float t_scale = sign/(t_length > 1e-30f ? t_length : 1e-30f);
+		float b_scale = sign/(b_length > 1e-30f ? b_length : 1e-30f);
+
+		frames.tx[lane] = tx * t_scale;
+		frames.ty[lane] = ty * t_scale;
+		frames.tz[lane] = tz * t_scale;
+
+		frames.bx[lane] = bx * b_scale;
+		frames.by[lane] = by * b_scale;
+		frames.bz[lane] = bz * b_scale;
+
+		frames.area[lane] = area;
+		frames.sign[lane] = valid ? sign : 0.0f;
+	}
+}
+
+#if defined(__SSE2__) || defined(__x86_64__)
+
+static void triangle_frames_sse(const TriangleBatch &batch, TriangleFrames &frames)
+{
+	__m128 p0x = _mm_load_ps(batch.px[0]);
+	__m128 p0y = _mm_load_ps(batch.py[0]);
+	__m128 p0z = _mm_load_ps(batch.pz[0]);
+
+	__m128 e1x = _mm_sub_ps(_mm_load_ps(batch.px[1]), p0x);
+	__m128 e1y = _mm_sub_ps(_mm_load_ps(batch.py[1]), p0y);
+	__m128 e1z = _mm_sub_ps(_mm_load_ps(batch.pz[1]), p0z);
+
+	__m128 e2x = _mm_sub_ps(_mm_load_ps(batch.px[2]), p0x);
+	__m128 e2y = _mm_sub_ps(_mm_load_ps(batch.py[2]), p0y);
+	__m128 e2z = _mm_sub_ps(_mm_load_ps(batch.pz[2]), p0z);
+
+	__m128 u0 = _mm_load_ps(batch.u[0]);
+	__m128 v0 = _mm_load_ps(batch.v[0]);
+
+	__m128 d1u = _mm_sub_ps(_mm_load_ps(batch.u[1]), u0);
+	__m128 d1v = _mm_sub_ps(_mm_load_ps(batch.v[1]), v0);
+	__m128 d2u = _mm_sub_ps(_mm_load_ps(batch.u[2]), u0);
+	__m128 d2v = _mm_sub_ps(_mm_load_ps(batch.v[2]), v0);
+
+	// Tangent and bitangent, scaled by the UV determinant
+	__m128 det = _mm_sub_ps(_mm_mul_ps(d1u, d2v), _mm_mul_ps(d1v, d2u));
+
+	__m128 tx = _mm_sub_ps(_mm_mul_ps(e1x, d2v), _mm_mul_ps(e2x, d1v));
+	__m128 ty = _mm_sub_ps(_mm_mul_ps(e1y, d2v), _mm_mul_ps(e2y, d1v));
+	__m128 tz = _mm_sub_ps(_mm_mul_ps(e1z, d2v), _mm_mul_ps(e2z, d1v));
+
+	__m128 bx = _mm_sub_ps(_mm_mul_ps(e2x, d1u), _mm_mul_ps(e1x, d2u));
+	__m128 by = _mm_sub_ps(_mm_mul_ps(e2y, d1u), _mm_mul_ps(e1y, d2u));
+	__m128 bz = _mm_sub_ps(_mm_mul_ps(e2z, d1u), _mm_mul_ps(e1z, d2u));
+
+	// Geometric normal, for the area
+	__m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+	__m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+	__m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+	auto length = [](__m128 x, __m128 y, __m128 z) {
+		__m128 squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		return _mm_sqrt_ps(squared);
+	};
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	__m128 t_length = length(tx, ty, tz);
+	__m128 b_length = length(bx, by, bz);
+	__m128 area = _mm_mul_ps(length(nx, ny, nz), _mm_set1_ps(0.5f));
+
+	// |det| = |d1| |d2| sin, and |d1| |d2| <= (|d1|^2 + |d2|^2)/2
+	__m128 uv_scale = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(d1u, d1u), _mm_mul_ps(d1v, d1v)),
+		_mm_add_ps(_mm_mul_ps(d2u, d2u), _mm_mul_ps(d2v, d2v))
+	);
+
+	__m128 valid = _mm_cmpgt_ps(_mm_and_ps(det, abs), _mm_mul_ps(uv_scale, _mm_set1_ps(eMinUVSine/2.0f)));
+	valid = _mm_and_ps(valid, _mm_cmpgt_ps(t_length, zero));
+	valid = _mm_and_ps(valid, _mm_cmpgt_ps(b_length, zero));
+	valid = _mm_and_ps(valid, _mm_cmpgt_ps(area, zero));
+
+	// Signed so that the vectors point along increasing UVs
+	__m128 sign = _mm_or_ps(_mm_and_ps(det, _mm_castsi128_ps(_mm_set1_epi32(0x80000000))), one);
+
+	__m128 t_scale = _mm_div_ps(sign, _mm_max_ps(t_length, _mm_set1_ps(1e-30f)));
+	__m128 b_scale = _mm_div_ps(sign, _mm_max_ps(b_length, _mm_set1_ps(1e-30f)));
+
+	_mm_store_ps(frames.tx, _mm_mul_ps(tx, t_scale));
+	_mm_store_ps(frames.ty, _mm_mul_ps(ty, t_scale));
+	_mm_store_ps(frames.tz, _mm_mul_ps(tz, t_scale));
+
+	_mm_store_ps(frames.bx, _mm_mul_ps(bx, b_scale));
+	_mm_store_ps(frames.by, _mm_mul_ps(by, b_scale));
+	_mm_store_ps(frames.bz, _mm_mul_ps(bz, b_scale));
+
+	_mm_store_ps(frames.area, area);
+	_mm_store_ps(frames.sign, _mm_and_ps(sign, valid));
+}
+
+#endif
+
+///////////////////
+// Vertex frames //
+///////////////////
+
+// Sums over the triangles of a vertex with one handedness
+struct FrameSum {
+	glm::vec3	tangent {0.0f};
+	glm::vec3	bitangent {0.0f};
+	float		area = 0.0f;
+};
+
+// Any unit vector perpendicular to a unit vector (Duff et al.)
+static glm::vec3 perpendicular(const glm::vec3 &n)
+{
+	float sign = std::copysign(1.0f, n.z);
+	float a = -1.0f/(sign + n.z);
+	float b = n.x * n.y * a;
+
+	return { 1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x };
+}
+
+void generate_tangents(VertexList &vertices, const std::vector <uint32_t> &indices, bool simd)
+{
+#if defined(__SSE2__) || defined(__x86_64__)
+	auto triangle_frames = simd ? triangle_frames_sse : triangle_frames_scalar;
+#else
+	auto triangle_frames = triangle_frames_scalar;
+	(void) simd;
+#endif
+
+	// Sums for regular (even) and mirrored (odd) triangles
+	std::vector <FrameSum> sums(2 * vertices.size());
+
+	size_t triangles = indices.size()/3;
+	for (size_t base = 0; base < triangles; base += 4) {
+		// Gather, padding the last batch with degenerate triangles
+		TriangleBatch batch {};
+		for (size_t lane = 0; lane < 4 && base + lane < triangles; lane++) {
+			for (int k = 0; k < 3; k++) {
+				const Vertex &vertex = vertices[indices[3 * (base + lane) + k]];
+
+				batch.px[k][lane] = vertex.position.x;
+				batch.py[k][lane] = vertex.position.y;
+				batch.pz[k][lane] = vertex.position.z;
+				batch.u[k][lane] = vertex.tex_coords.x;
+				batch.v[k][lane] = vertex.tex_coords.y;
+			}
+		}
+
+		TriangleFrames frames;
+		triangle_frames(batch, frames);
+
+		// Scatter
+		for (size_t lane = 0; lane < 4 && base + lane < triangles; lane++) {
+			if (frames.sign[lane] == 0.0f)
+				continue;
+
+			glm::vec3 tangent { frames.tx[lane], frames.ty[lane], frames.tz[lane] };
+			glm::vec3 bitangent { frames.bx[lane], frames.by[lane], frames.bz[lane] };
+
+			float area = frames.area[lane];
+			size_t mirrored = frames.sign[lane] < 0.0f;
+
+			for (int k = 0; k < 3; k++) {
+				FrameSum &sum = sums[2 * indices[3 * (base + lane) + k] + mirrored];
+				sum.tangent += area * tangent;
+				sum.bitangent += area * bitangent;
+				sum.area += area;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < vertices.size(); i++) {
+		Vertex &vertex = vertices[i];
+
+		const FrameSum &regular = sums[2 * i];
+		const FrameSum &mirrored = sums[2 * i + 1];
+		const FrameSum &sum = (regular.area >= mirrored.area) ? regular : mirrored;
+
+		// Missing normals fall back to the texture frame
+		glm::vec3 normal = vertex.normal;
+		if (glm::dot(normal, normal) <= 0.0f) {
+			normal = glm::cross(sum.tangent, sum.bitangent);
+			if (&sum == &mirrored)
+				normal = -normal;
+		}
+
+		if (glm::dot(normal, normal) > 0.0f)
+			normal = glm::normalize(normal);
+		else
+			normal = glm::vec3 {0.0f, 0.0f, 1.0f};
+
+		// Gram-Schmidt against the normal
+		glm::vec3 tangent = sum.tangent - normal * glm::dot(normal, sum.tangent);
+
+		float length = glm::length(tangent);
+		if (sum.area > 0.0f && length > 1e-6f * sum.area)
+			tangent /= length;
+		else
+			tangent = perpendicular(normal);
+
+		glm::vec3 bitangent = glm::cross(normal, tangent);
+		if (glm::dot(bitangent, sum.bitangent) < 0.0f)
+			bitangent = -bitangent;
+
+		vertex.tangent = tangent;
+		vertex.bitangent = bitangent;
+	}
+}
+
+}